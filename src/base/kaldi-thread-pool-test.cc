@@ -0,0 +1,62 @@
+// base/kaldi-thread-pool-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include "base/kaldi-common.h"
+#include "base/kaldi-thread-pool.h"
+
+namespace kaldi {
+
+// Runs jobs with varying numbers of tasks on one pool, and checks that each
+// task is done exactly once per job.
+void UnitTestThreadPool() {
+  ThreadPool pool;
+  for (int32 job = 0; job < 100; job++) {
+    int32 num_tasks = RandInt(1, 8);
+    std::vector<int32> counts(num_tasks, 0);
+    pool.Run(num_tasks, [&](int32 task) { counts[task]++; });
+    for (int32 i = 0; i < num_tasks; i++)
+      KALDI_ASSERT(counts[i] == 1);
+  }
+}
+
+// Uses one pool from several threads at once; those that find it busy do
+// their tasks themselves.
+void UnitTestThreadPoolBusy() {
+  ThreadPool pool;
+  std::atomic<int64> total(0);
+  std::vector<std::thread> threads;
+  for (int32 t = 0; t < 4; t++) {
+    threads.push_back(std::thread([&]() {
+          for (int32 job = 0; job < 100; job++)
+            pool.Run(4, [&](int32 task) { total += task + 1; });
+        }));
+  }
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+  KALDI_ASSERT(total == 4 * 100 * (1 + 2 + 3 + 4));
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestThreadPool();
+  UnitTestThreadPoolBusy();
+  std::cout << "Test OK.\n";
+  return 0;
+}
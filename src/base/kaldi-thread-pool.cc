@@ -0,0 +1,76 @@
+// base/kaldi-thread-pool.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-thread-pool.h"
+
+namespace kaldi {
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
+  }
+  start_.notify_all();
+  for (size_t i = 0; i < workers_.size(); i++)
+    workers_[i].join();
+}
+
+void ThreadPool::Run(int32 num_tasks,
+                     const std::function<void(int32)> &task) {
+  std::unique_lock<std::mutex> busy(busy_mutex_, std::try_to_lock);
+  if (num_tasks == 1 || !busy.owns_lock()) {
+    for (int32 i = 0; i < num_tasks; i++)
+      task(i);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (static_cast<int32>(workers_.size()) < num_tasks - 1) {
+    int32 index = workers_.size() + 1;
+    workers_.push_back(std::thread(&ThreadPool::Work, this, index,
+                                   generation_));
+  }
+  task_ = &task;
+  num_tasks_ = num_tasks;
+  num_pending_ = num_tasks - 1;
+  generation_++;
+  lock.unlock();
+  start_.notify_all();
+  task(0);
+  lock.lock();
+  done_.wait(lock, [this]() { return num_pending_ == 0; });
+}
+
+void ThreadPool::Work(int32 index, int64 generation) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    start_.wait(lock, [&]() {
+        return generation_ != generation || exiting_; });
+    if (exiting_)
+      return;
+    generation = generation_;
+    if (index >= num_tasks_)
+      continue;
+    const std::function<void(int32)> *task = task_;
+    lock.unlock();
+    (*task)(index);
+    lock.lock();
+    if (--num_pending_ == 0)
+      done_.notify_one();
+  }
+}
+
+}  // namespace kaldi
@@ -0,0 +1,77 @@
+// base/kaldi-thread-pool.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_BASE_KALDI_THREAD_POOL_H_
+#define KALDI_BASE_KALDI_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "base/kaldi-types.h"
+#include "base/kaldi-utils.h"
+
+namespace kaldi {
+
+/// A set of worker threads that is kept for repeated parallel jobs, so that
+/// we don't pay for starting threads each time; it is for fine-grained
+/// parallelism such as in matrix multiplication (see kaldi-gemm.cc) or the
+/// decoders.  For parallelism at the level of whole utterances, see
+/// MultiThreader and TaskSequencer in util/kaldi-thread.h.
+///
+/// Only one thread can use the pool at a time.  A thread that finds it busy
+/// (e.g. because several threads are decoding in parallel) does all the tasks
+/// of its job itself, so we never have more threads running than were asked
+/// for.
+class ThreadPool {
+ public:
+  ThreadPool(): generation_(0), task_(NULL), num_tasks_(0), num_pending_(0),
+                exiting_(false) { }
+
+  /// Waits for the worker threads to exit; it must not be called while Run()
+  /// is running.
+  ~ThreadPool();
+
+  /// Calls task(0) ... task(num_tasks - 1), in parallel if possible, and
+  /// returns when they have all finished.  The calling thread does task(0),
+  /// and worker threads, which are started when first needed and then kept,
+  /// do the others.  If the pool is busy, the calling thread does all of the
+  /// tasks, in order.  The tasks must not throw exceptions; catch them in the
+  /// task and deal with them after Run() returns.
+  void Run(int32 num_tasks, const std::function<void(int32)> &task);
+
+ private:
+  // Worker "index" does task "index" of each job that has that many tasks.
+  void Work(int32 index, int64 generation);
+
+  std::mutex busy_mutex_;  // Held by the thread that is using the pool.
+  std::mutex mutex_;       // Protects the members below.
+  std::condition_variable start_, done_;
+  std::vector<std::thread> workers_;
+  int64 generation_;  // Incremented for each job.
+  const std::function<void(int32)> *task_;
+  int32 num_tasks_;
+  int32 num_pending_;  // Tasks of the current job not yet done by workers.
+  bool exiting_;  // Set by the destructor, to make the workers exit.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_BASE_KALDI_THREAD_POOL_H_
@@ -46,7 +46,7 @@ int main(int argc, char *argv[]) {
         " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
     ParseOptions po(usage);
     Timer timer;
-    bool allow_partial = false;
+    bool allow_partial = false, mmap_fst = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
     TaskSequencerConfig sequencer_config; // has --num-threads option
@@ -59,6 +59,11 @@ int main(int argc, char *argv[]) {
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("mmap-fst", &mmap_fst, "If true and the decoding graph is "
+                "a ConstFst in an ordinary file, memory-map it rather than "
+                "reading it, so that its memory is shared between processes.  "
+                "The graph must have been written with aligned data, e.g. by "
+                "fstconvert --fst_type=const --fst_align=true.");
 
     po.Read(argc, argv);
 
@@ -105,7 +110,7 @@ int main(int argc, char *argv[]) {
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
-      decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+      decode_fst = fst::ReadFstKaldiGeneric(fst_in_str, true, mmap_fst);
 
       {
         for (; !loglike_reader.Done(); loglike_reader.Next()) {
@@ -0,0 +1,143 @@
+// decoder/decoder-test-utils.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_TEST_UTILS_H_
+#define KALDI_DECODER_DECODER_TEST_UTILS_H_
+
+// This header contains things that are shared by the tests in this directory.
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+#include "base/kaldi-math.h"
+#include "matrix/kaldi-matrix.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/// Creates a graph that looks a bit like an HCLG: each state has a self-loop
+/// and a few arcs to nearby states, with pdf-ids plus one as input labels (as
+/// expected by DecodableMatrixScaled), and some states have epsilon arcs to
+/// later states (so there are no epsilon cycles).  The graph depends only on
+/// "seed".
+inline fst::VectorFst<fst::StdArc> *RandomDecodingGraph(int32 num_states,
+                                                        int32 num_pdfs,
+                                                        int32 seed) {
+  typedef fst::StdArc Arc;
+  RandomState state;
+  state.seed = seed;
+  fst::VectorFst<Arc> *fst = new fst::VectorFst<Arc>();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 pdf = RandInt(0, num_pdfs - 1, &state);
+    fst->AddArc(s, Arc(pdf + 1, 0, -Log(RandUniform(&state)), s));
+    int32 num_arcs = RandInt(1, 5, &state);
+    for (int32 i = 0; i < num_arcs; i++) {
+      int32 next = (s + RandInt(1, 200, &state)) % num_states,
+          olabel = (RandInt(0, 9, &state) == 0 ?
+                    RandInt(1, 1000, &state) : 0);
+      pdf = RandInt(0, num_pdfs - 1, &state);
+      fst->AddArc(s, Arc(pdf + 1, olabel, -Log(RandUniform(&state)), next));
+    }
+    if (RandInt(0, 9, &state) == 0 && s + 1 < num_states) {
+      int32 olabel = RandInt(1, 1000, &state),
+          next = RandInt(s + 1, num_states - 1, &state);
+      fst->AddArc(s, Arc(0, olabel, -Log(RandUniform(&state)), next));
+    }
+    fst->SetFinal(s, -Log(RandUniform(&state)));
+  }
+  return fst;
+}
+
+/// Sets "loglikes" to random log-likelihoods that depend only on "seed".
+inline void RandomLoglikes(int32 num_frames, int32 num_pdfs, int32 seed,
+                           Matrix<BaseFloat> *loglikes) {
+  RandomState state;
+  state.seed = seed;
+  loglikes->Resize(num_frames, num_pdfs, kUndefined);
+  for (int32 t = 0; t < num_frames; t++)
+    for (int32 p = 0; p < num_pdfs; p++)
+      (*loglikes)(t, p) = 3.0 * RandGauss(&state);
+}
+
+/// Used by LatticesAreIdentical(): returns the bit pattern of "f", so that we
+/// can compare floats exactly and use them in keys.
+inline int64 FloatBits(float f) {
+  int32 i;
+  std::memcpy(&i, &f, sizeof(i));
+  return i;
+}
+
+/// Used by LatticesAreIdentical(): returns an id for the start state of
+/// "lat", which must be acyclic, such that two states get the same id if and
+/// only if the parts of the lattice(s) reachable from them are the same, with
+/// exactly the same weights and final-probs.  "ids" maps the description of a
+/// state to its id; it should be shared between calls.  Returns -1 if the
+/// lattice is empty.
+inline int32 LatticeStartStateId(const Lattice &lat_in,
+                                 std::map<std::vector<int64>, int32> *ids) {
+  if (lat_in.Start() == fst::kNoStateId)
+    return -1;
+  Lattice lat(lat_in);
+  if (!fst::TopSort(&lat))
+    KALDI_ERR << "Lattice has cycles.";
+  int32 num_states = lat.NumStates();
+  std::vector<int32> state_ids(num_states);
+  // After TopSort(), arcs go from lower to higher-numbered states, so we can
+  // work backwards.
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    std::vector<std::vector<int64> > arcs;
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done();
+         aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      std::vector<int64> desc(5);
+      desc[0] = arc.ilabel;
+      desc[1] = arc.olabel;
+      desc[2] = FloatBits(arc.weight.Value1());
+      desc[3] = FloatBits(arc.weight.Value2());
+      desc[4] = state_ids[arc.nextstate];
+      arcs.push_back(desc);
+    }
+    std::sort(arcs.begin(), arcs.end());
+    std::vector<int64> key;
+    key.push_back(FloatBits(lat.Final(s).Value1()));
+    key.push_back(FloatBits(lat.Final(s).Value2()));
+    for (size_t i = 0; i < arcs.size(); i++)
+      key.insert(key.end(), arcs[i].begin(), arcs[i].end());
+    int32 new_id = ids->size();
+    state_ids[s] = ids->insert(std::make_pair(key, new_id)).first->second;
+  }
+  return state_ids[lat.Start()];
+}
+
+/// Returns true if the acyclic lattices "lat1" and "lat2" are the same, up to
+/// the numbering of the states and the order of the arcs; the weights must be
+/// exactly the same.  We need this to compare the output of decoders that
+/// visit the tokens of a frame in different orders, as that changes the
+/// numbering of the states in the output of GetRawLattice().
+inline bool LatticesAreIdentical(const Lattice &lat1, const Lattice &lat2) {
+  std::map<std::vector<int64>, int32> ids;
+  return lat1.NumStates() == lat2.NumStates() &&
+      LatticeStartStateId(lat1, &ids) == LatticeStartStateId(lat2, &ids);
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_DECODER_TEST_UTILS_H_
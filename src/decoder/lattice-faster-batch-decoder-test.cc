@@ -0,0 +1,88 @@
+// decoder/lattice-faster-batch-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-batch-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+
+namespace kaldi {
+
+// Checks that decoding utterances of different lengths in lockstep with
+// LatticeFasterBatchDecoder, with several streams and threads, gives exactly
+// the same lattices as decoding them one at a time with LatticeFasterDecoder.
+// The batch decoder decodes two batches, so that the streams are reused.
+void UnitTestBatchDecoder(bool const_fst) {
+  int32 num_states = 20000, num_pdfs = 500;
+  fst::VectorFst<fst::StdArc> *vector_fst =
+      RandomDecodingGraph(num_states, num_pdfs, RandInt(0, 1000));
+  fst::Fst<fst::StdArc> *fst = vector_fst;
+  if (const_fst) {
+    fst = new fst::ConstFst<fst::StdArc>(*vector_fst);
+    delete vector_fst;
+  }
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 13.0;
+  config.max_active = 7000;
+  // The batch decoder always uses FlatHashList for the tokens, which visits
+  // them in a different order from HashList.
+  config.flat_hash = true;
+  int32 num_streams = RandInt(1, 5), num_threads = RandInt(1, 4);
+  LatticeFasterDecoder decoder(*fst, config);
+  LatticeFasterBatchDecoder batch_decoder(*fst, config, num_streams,
+                                          num_threads);
+
+  for (int32 batch = 0; batch < 2; batch++) {
+    std::vector<Matrix<BaseFloat> > loglikes(num_streams);
+    std::vector<DecodableMatrixScaled*> decodables(num_streams);
+    for (int32 s = 0; s < num_streams; s++) {
+      RandomLoglikes(RandInt(1, 100), num_pdfs, RandInt(0, 1000),
+                     &(loglikes[s]));
+      decodables[s] = new DecodableMatrixScaled(loglikes[s], 1.0);
+      batch_decoder.InitDecoding(s);
+    }
+    std::vector<DecodableInterface*> batch_decodables(decodables.begin(),
+                                                      decodables.end());
+    batch_decoder.AdvanceDecoding(batch_decodables);
+
+    for (int32 s = 0; s < num_streams; s++) {
+      LatticeFasterDecoder &stream_decoder = batch_decoder.Decoder(s);
+      stream_decoder.FinalizeDecoding();
+      KALDI_ASSERT(stream_decoder.NumFramesDecoded() ==
+                   loglikes[s].NumRows());
+      KALDI_ASSERT(decoder.Decode(decodables[s]));
+      Lattice lat, batch_lat;
+      KALDI_ASSERT(decoder.GetRawLattice(&lat) &&
+                   stream_decoder.GetRawLattice(&batch_lat));
+      KALDI_ASSERT(LatticesAreIdentical(lat, batch_lat));
+      delete decodables[s];
+    }
+  }
+  delete fst;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 4; i++) {
+    UnitTestBatchDecoder(false);
+    UnitTestBatchDecoder(true);
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
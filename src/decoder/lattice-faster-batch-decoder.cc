@@ -0,0 +1,267 @@
+// decoder/lattice-faster-batch-decoder.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include "decoder/lattice-faster-batch-decoder.h"
+
+namespace kaldi {
+
+template <typename FST>
+LatticeFasterBatchDecoderTpl<FST>::LatticeFasterBatchDecoderTpl(
+    const FST &fst, const LatticeFasterDecoderConfig &config,
+    int32 num_streams, int32 num_threads): fst_(fst),
+                                           num_threads_(num_threads) {
+  KALDI_ASSERT(num_streams > 0 && num_threads > 0);
+  LatticeFasterDecoderConfig stream_config(config);
+  // The batched search looks up the tokens of each stream in flat_toks_, and
+  // does its own expansion of the emitting arcs.
+  stream_config.flat_hash = true;
+  stream_config.num_emitting_threads = 1;
+  streams_.resize(num_streams);
+  for (int32 s = 0; s < num_streams; s++)
+    streams_[s] = new Stream(fst, stream_config);
+  frame_.resize(num_streams, 0);
+  cost_offset_.resize(num_streams, 0.0);
+  adaptive_beam_.resize(num_streams, 0.0);
+  next_cutoff_.resize(num_streams, 0.0);
+  arcs_.resize(num_streams);
+  tok_arcs_.resize(num_streams);
+}
+
+template <typename FST>
+LatticeFasterBatchDecoderTpl<FST>::~LatticeFasterBatchDecoderTpl() {
+  for (size_t s = 0; s < streams_.size(); s++)
+    delete streams_[s];
+}
+
+template <typename FST>
+void LatticeFasterBatchDecoderTpl<FST>::InitDecoding(int32 stream) {
+  KALDI_ASSERT(stream >= 0 && stream < NumStreams());
+  streams_[stream]->InitDecoding();
+}
+
+template <typename FST>
+void LatticeFasterBatchDecoderTpl<FST>::AdvanceDecoding(
+    const std::vector<DecodableInterface*> &decodables) {
+  if (std::is_same<FST, fst::Fst<fst::StdArc> >::value) {
+    // As in LatticeFasterDecoderTpl::AdvanceDecoding(), if the type is
+    // actually a ConstFst or VectorFst we cast to that type so that the arc
+    // iterators can be inlined.
+    if (fst_.Type() == "const") {
+      LatticeFasterBatchDecoderTpl<fst::ConstFst<fst::StdArc> > *this_cast =
+          reinterpret_cast<LatticeFasterBatchDecoderTpl<
+            fst::ConstFst<fst::StdArc> >* >(this);
+      this_cast->AdvanceDecoding(decodables);
+      return;
+    } else if (fst_.Type() == "vector") {
+      LatticeFasterBatchDecoderTpl<fst::VectorFst<fst::StdArc> > *this_cast =
+          reinterpret_cast<LatticeFasterBatchDecoderTpl<
+            fst::VectorFst<fst::StdArc> >* >(this);
+      this_cast->AdvanceDecoding(decodables);
+      return;
+    }
+  }
+
+  KALDI_ASSERT(decodables.size() == streams_.size());
+  int32 num_streams = streams_.size();
+  for (int32 s = 0; s < num_streams; s++) {
+    if (decodables[s] != NULL) {
+      KALDI_ASSERT(!streams_[s]->active_toks_.empty() &&
+                   !streams_[s]->decoding_finalized_ &&
+                   "You must call InitDecoding() before AdvanceDecoding");
+      KALDI_ASSERT(decodables[s]->NumFramesReady() >=
+                   streams_[s]->NumFramesDecoded());
+    }
+  }
+
+  // The threads read the FST concurrently, which is only safe for types that
+  // are not expanded on demand; see above for the case where FST is fst::Fst.
+  const bool fst_is_thread_safe =
+      std::is_same<FST, fst::ConstFst<fst::StdArc> >::value ||
+      std::is_same<FST, fst::VectorFst<fst::StdArc> >::value;
+  std::vector<int32> active;
+  while (true) {
+    // "active" is the list of streams that have a frame ready.
+    active.clear();
+    for (int32 s = 0; s < num_streams; s++)
+      if (decodables[s] != NULL &&
+          streams_[s]->NumFramesDecoded() < decodables[s]->NumFramesReady())
+        active.push_back(s);
+    if (active.empty())
+      break;
+    int32 num_tasks = (fst_is_thread_safe ?
+                       std::min<int32>(num_threads_, active.size()) : 1);
+    if (active_tokens_.size() < static_cast<size_t>(num_tasks))
+      active_tokens_.resize(num_tasks);
+    thread_pool_.Run(num_tasks, [&](int32 task) {
+        DecodeFrame(active, decodables, task, num_tasks);
+      });
+  }
+}
+
+template <typename FST>
+void LatticeFasterBatchDecoderTpl<FST>::DecodeFrame(
+    const std::vector<int32> &active,
+    const std::vector<DecodableInterface*> &decodables,
+    int32 task, int32 num_tasks) {
+  std::vector<ActiveToken> &active_tokens = active_tokens_[task];
+  active_tokens.clear();
+  for (size_t i = task; i < active.size(); i += num_tasks) {
+    int32 s = active[i];
+    Stream *stream = streams_[s];
+    if (stream->NumFramesDecoded() % stream->config_.prune_interval == 0)
+      stream->PruneActiveTokens(stream->config_.lattice_beam *
+                                stream->config_.prune_scale);
+    BeginFrame(s, decodables[s], &active_tokens);
+  }
+
+  // Sorting by state puts together the tokens from different streams that are
+  // in the same state, so we only iterate over its arcs once.
+  std::sort(active_tokens.begin(), active_tokens.end());
+  ExpandEmittingArcs(active_tokens, decodables);
+
+  for (size_t i = task; i < active.size(); i += num_tasks) {
+    int32 s = active[i];
+    AddEmittingArcs(s);
+    streams_[s]->ProcessNonemitting(next_cutoff_[s]);
+  }
+}
+
+template <typename FST>
+void LatticeFasterBatchDecoderTpl<FST>::BeginFrame(
+    int32 s, DecodableInterface *decodable,
+    std::vector<ActiveToken> *active_tokens) {
+  // This is the first part of LatticeFasterDecoderTpl::ProcessEmitting().
+  Stream *stream = streams_[s];
+  int32 frame = stream->active_toks_.size() - 1;
+  frame_[s] = frame;
+  stream->active_toks_.resize(frame + 2);
+  stream->flat_toks_.Clear(&(stream->prev_states_), &(stream->prev_toks_));
+  size_t tok_cnt;
+  int32 best_index;
+  BaseFloat cur_cutoff = stream->GetCutoffFlat(&tok_cnt, &(adaptive_beam_[s]),
+                                               &best_index);
+  stream->PossiblyResizeHash(tok_cnt);
+  StateId best_state = fst::kNoStateId;
+  Token *best_tok = NULL;
+  if (best_index >= 0) {
+    best_state = stream->prev_states_[best_index];
+    best_tok = stream->prev_toks_[best_index];
+  }
+  next_cutoff_[s] = stream->ProcessEmittingBestToken(
+      decodable, frame, best_state, best_tok, adaptive_beam_[s],
+      &(cost_offset_[s]));
+
+  const std::vector<StateId> &states = stream->prev_states_;
+  const std::vector<Token*> &toks = stream->prev_toks_;
+  arcs_[s].clear();
+  tok_arcs_[s].assign(toks.size(), std::pair<size_t, size_t>(0, 0));
+  for (size_t j = 0; j < toks.size(); j++) {
+    if (toks[j]->tot_cost <= cur_cutoff) {
+      ActiveToken a;
+      a.state = states[j];
+      a.stream = s;
+      a.index = j;
+      a.tok = toks[j];
+      active_tokens->push_back(a);
+    }
+  }
+}
+
+template <typename FST>
+void LatticeFasterBatchDecoderTpl<FST>::ExpandEmittingArcs(
+    const std::vector<ActiveToken> &active_tokens,
+    const std::vector<DecodableInterface*> &decodables) {
+  size_t num_active = active_tokens.size();
+  for (size_t begin = 0, end; begin < num_active; begin = end) {
+    StateId state = active_tokens[begin].state;
+    for (end = begin + 1;
+         end < num_active && active_tokens[end].state == state; end++);
+    // A stream has at most one token per state, so the arcs out of each token
+    // are contiguous in arcs_[s].
+    for (size_t i = begin; i < end; i++) {
+      const ActiveToken &a = active_tokens[i];
+      tok_arcs_[a.stream][a.index].first = arcs_[a.stream].size();
+    }
+    for (fst::ArcIterator<FST> aiter(fst_, state);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel == 0)
+        continue;
+      BaseFloat graph_cost = arc.weight.Value();
+      for (size_t i = begin; i < end; i++) {
+        int32 s = active_tokens[i].stream;
+        Token *tok = active_tokens[i].tok;
+        BaseFloat ac_cost = cost_offset_[s] -
+            decodables[s]->LogLikelihood(frame_[s], arc.ilabel),
+            tot_cost = tok->tot_cost + ac_cost + graph_cost;
+        if (tot_cost > next_cutoff_[s]) continue;
+        EmittingArc emitting_arc;
+        emitting_arc.tok = tok;
+        emitting_arc.nextstate = arc.nextstate;
+        emitting_arc.ilabel = arc.ilabel;
+        emitting_arc.olabel = arc.olabel;
+        emitting_arc.graph_cost = graph_cost;
+        emitting_arc.ac_cost = ac_cost;
+        emitting_arc.tot_cost = tot_cost;
+        arcs_[s].push_back(emitting_arc);
+      }
+    }
+    for (size_t i = begin; i < end; i++) {
+      const ActiveToken &a = active_tokens[i];
+      tok_arcs_[a.stream][a.index].second = arcs_[a.stream].size();
+    }
+  }
+}
+
+template <typename FST>
+void LatticeFasterBatchDecoderTpl<FST>::AddEmittingArcs(int32 s) {
+  Stream *stream = streams_[s];
+  const std::vector<EmittingArc> &arcs = arcs_[s];
+  const std::vector<std::pair<size_t, size_t> > &tok_arcs = tok_arcs_[s];
+  BaseFloat adaptive_beam = adaptive_beam_[s], next_cutoff = next_cutoff_[s];
+  int32 frame = frame_[s];
+  // We visit the tokens in the order of prev_toks_, as
+  // LatticeFasterDecoderTpl::ProcessEmitting() does.
+  for (size_t j = 0; j < tok_arcs.size(); j++) {
+    for (size_t k = tok_arcs[j].first; k < tok_arcs[j].second; k++) {
+      const EmittingArc &arc = arcs[k];
+      BaseFloat tot_cost = arc.tot_cost;
+      if (tot_cost > next_cutoff) continue;
+      else if (tot_cost + adaptive_beam < next_cutoff)
+        next_cutoff = tot_cost + adaptive_beam;
+      Token *tok = arc.tok,
+          *next_tok = stream->FindOrAddToken(arc.nextstate, frame + 1,
+                                             tot_cost, tok, NULL);
+      tok->links = stream->NewForwardLink(next_tok, arc.ilabel, arc.olabel,
+                                          arc.graph_cost, arc.ac_cost,
+                                          tok->links);
+    }
+  }
+  next_cutoff_[s] = next_cutoff;
+}
+
+// Instantiate the template for the FST types that we'll need.
+template class LatticeFasterBatchDecoderTpl<fst::Fst<fst::StdArc> >;
+template class LatticeFasterBatchDecoderTpl<fst::VectorFst<fst::StdArc> >;
+template class LatticeFasterBatchDecoderTpl<fst::ConstFst<fst::StdArc> >;
+
+
+} // end namespace kaldi.
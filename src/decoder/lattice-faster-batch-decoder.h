@@ -0,0 +1,177 @@
+// decoder/lattice-faster-batch-decoder.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LATTICE_FASTER_BATCH_DECODER_H_
+#define KALDI_DECODER_LATTICE_FASTER_BATCH_DECODER_H_
+
+#include <utility>
+#include <vector>
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+
+/** LatticeFasterBatchDecoderTpl decodes several utterances ("streams") at
+    once, in lockstep, with a single FST.  On each step it advances every
+    stream that has a frame ready by one frame.  The streams are divided
+    between the threads of a thread pool (up to "num_threads"), and each
+    thread processes the emitting arcs of its streams together: their active
+    tokens are sorted by FST state, and the arcs of each state are read once
+    and applied to all the streams that have a token in that state.  Since
+    different utterances tend to be in similar regions of the graph (e.g. the
+    silence and common-word parts), this gives better cache locality for the
+    FST than decoding the utterances one after the other, or with one decoder
+    per thread.  The per-stream cutoffs are kept in arrays indexed by stream.
+
+    Each stream is a LatticeFasterDecoderTpl (with config.flat_hash set to
+    true, whatever the config says), accessible via Decoder(), which you use to
+    get the lattices, call FinalizeDecoding() and so on.  The arcs expanded in
+    state order are buffered and then added to each stream in the order that
+    decoder would have visited them, with its "online" pruning, so the output
+    is exactly the same as that of LatticeFasterDecoderTpl with
+    config.flat_hash == true, whatever the number of streams and threads.
+ */
+template <typename FST>
+class LatticeFasterBatchDecoderTpl {
+ public:
+  using Arc = typename FST::Arc;
+  using Label = typename Arc::Label;
+  using StateId = typename Arc::StateId;
+  using Token = decoder::StdToken;
+  using ForwardLinkT = decoder::ForwardLink<Token>;
+
+  /// The decoder does not take ownership of 'fst'.  "num_streams" is the
+  /// maximum number of utterances that can be decoded at the same time, and
+  /// "num_threads" is the maximum number of threads used to decode them
+  /// (only FSTs of type ConstFst or VectorFst can be used with more than
+  /// one thread; with other types it is ignored).
+  LatticeFasterBatchDecoderTpl(const FST &fst,
+                               const LatticeFasterDecoderConfig &config,
+                               int32 num_streams, int32 num_threads = 1);
+
+  int32 NumStreams() const { return streams_.size(); }
+
+  /// Starts decoding a new utterance in stream "stream" (whatever that stream
+  /// was doing before is discarded).
+  void InitDecoding(int32 stream);
+
+  /// Decodes all the frames that are ready in the decodable objects, in
+  /// lockstep.  "decodables" must have size NumStreams(); it contains, for
+  /// each stream, the decodable object for the utterance that it is decoding,
+  /// or NULL if that stream is not in use.  Like
+  /// LatticeFasterDecoderTpl::AdvanceDecoding(), this can be called repeatedly
+  /// as more frames become ready, and the decodable objects may change
+  /// between calls as long as the frame indexes carry on from the previous
+  /// ones (e.g. DecodableMatrixMapped with a frame offset).  The decodable
+  /// objects of different streams may be used from different threads at the
+  /// same time.
+  void AdvanceDecoding(const std::vector<DecodableInterface*> &decodables);
+
+  /// Returns the decoder for stream "stream"; use it to get the output
+  /// (GetRawLattice(), ReachedFinal() and so on).  Don't call InitDecoding()
+  /// or AdvanceDecoding() on it directly.
+  LatticeFasterDecoderTpl<FST, Token> &Decoder(int32 stream) {
+    return *(streams_[stream]);
+  }
+  const LatticeFasterDecoderTpl<FST, Token> &Decoder(int32 stream) const {
+    return *(streams_[stream]);
+  }
+
+  ~LatticeFasterBatchDecoderTpl();
+
+ private:
+  // We derive from LatticeFasterDecoderTpl to get access to its internals.
+  class Stream: public LatticeFasterDecoderTpl<FST, Token> {
+   public:
+    Stream(const FST &fst, const LatticeFasterDecoderConfig &config):
+        LatticeFasterDecoderTpl<FST, Token>(fst, config) { }
+    friend class LatticeFasterBatchDecoderTpl<FST>;
+  };
+
+  using EmittingArc = typename Stream::EmittingArc;
+
+  // A token that is within the beam on the previous frame of stream "stream";
+  // "index" is its index in the stream's prev_toks_.
+  struct ActiveToken {
+    StateId state;
+    int32 stream;
+    int32 index;
+    Token *tok;
+    bool operator < (const ActiveToken &other) const {
+      return (state < other.state ||
+              (state == other.state && stream < other.stream));
+    }
+  };
+
+  // Decodes one frame of the streams active[task], active[task + num_tasks],
+  // and so on, where "active" is the list of streams that have a frame ready;
+  // this is the work done by one thread of thread_pool_.
+  void DecodeFrame(const std::vector<int32> &active,
+                   const std::vector<DecodableInterface*> &decodables,
+                   int32 task, int32 num_tasks);
+
+  // Works out the cutoffs for the current frame of stream "s", and appends
+  // its tokens that are within the beam to "active_tokens".
+  void BeginFrame(int32 s, DecodableInterface *decodable,
+                  std::vector<ActiveToken> *active_tokens);
+
+  // Expands the emitting arcs out of "active_tokens" (which must be sorted),
+  // into arcs_ and tok_arcs_.  It only discards the arcs that are outside
+  // the cutoff given by the best token of their stream, which is never
+  // tighter than the cutoff the stream would apply to them.
+  void ExpandEmittingArcs(const std::vector<ActiveToken> &active_tokens,
+                          const std::vector<DecodableInterface*> &decodables);
+
+  // Adds the arcs in arcs_[s] to stream "s" in the order that
+  // LatticeFasterDecoderTpl::ProcessEmitting() would have visited them, with
+  // its pruning.  Leaves the cutoff for ProcessNonemitting() in
+  // next_cutoff_[s].
+  void AddEmittingArcs(int32 s);
+
+  const FST &fst_;
+  std::vector<Stream*> streams_;
+  int32 num_threads_;
+
+  // The following are indexed by stream, and are only valid, on each step,
+  // for streams that have a frame ready.  frame_ is the (zero-based) frame we
+  // are processing; cost_offset_ is the offset applied to the acoustic costs
+  // on that frame; adaptive_beam_ is the beam used for pruning within the
+  // frame and next_cutoff_ is the (decreasing) cutoff for the next frame.
+  // arcs_ contains the emitting arcs expanded from the stream's tokens, and
+  // tok_arcs_ the range of arcs_ for each token, indexed as prev_toks_.
+  std::vector<int32> frame_;
+  std::vector<BaseFloat> cost_offset_;
+  std::vector<BaseFloat> adaptive_beam_;
+  std::vector<BaseFloat> next_cutoff_;
+  std::vector<std::vector<EmittingArc> > arcs_;
+  std::vector<std::vector<std::pair<size_t, size_t> > > tok_arcs_;
+
+  // The tokens within the beam on the previous frame, from the streams
+  // handled by each task of DecodeFrame(); indexed by task.
+  std::vector<std::vector<ActiveToken> > active_tokens_;
+
+  ThreadPool thread_pool_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterBatchDecoderTpl);
+};
+
+typedef LatticeFasterBatchDecoderTpl<fst::StdFst> LatticeFasterBatchDecoder;
+
+
+} // end namespace kaldi.
+
+#endif
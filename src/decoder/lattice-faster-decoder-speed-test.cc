@@ -0,0 +1,111 @@
+// decoder/lattice-faster-decoder-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "fstext/fstext-utils.h"
+#include "fstext/kaldi-fst-io.h"
+#include "hmm/transition-model.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+// Decodes "decodable" with HashList and with FlatHashList for the tokens
+// (--flat-hash=false and true), prints the real-time factor of each (assuming
+// 10ms frames), and checks that they give the same lattice.
+static void CompareTokenHashes(const fst::Fst<fst::StdArc> &fst,
+                               const LatticeFasterDecoderConfig &config_in,
+                               DecodableInterface *decodable,
+                               const std::string &description) {
+  Lattice lats[2];
+  for (int32 i = 0; i < 2; i++) {
+    LatticeFasterDecoderConfig config(config_in);
+    config.flat_hash = (i == 1);
+    LatticeFasterDecoder decoder(fst, config);
+
+    Timer timer;
+    KALDI_ASSERT(decoder.Decode(decodable));
+    double elapsed = timer.Elapsed();
+    int32 num_frames = decoder.NumFramesDecoded();
+    KALDI_ASSERT(decoder.GetRawLattice(&(lats[i])));
+
+    Lattice best_path;
+    decoder.GetBestPath(&best_path);
+    std::vector<int32> alignment, words;
+    LatticeWeight weight;
+    fst::GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+    KALDI_LOG << description << ", --flat-hash="
+              << (config.flat_hash ? "true" : "false") << ": RTF = "
+              << (elapsed / (num_frames * 0.01)) << ", best cost = "
+              << (weight.Value1() + weight.Value2()) << ", lattice has "
+              << lats[i].NumStates() << " states";
+  }
+  // The two versions do the same search, so they should give exactly the same
+  // lattice, although the states may be numbered differently.
+  KALDI_ASSERT(LatticesAreIdentical(lats[0], lats[1]));
+}
+
+// Compares the token hashes on a generated graph that looks a bit like an
+// HCLG, with random log-likelihoods.  Both are the same on every run.
+static void TestLatticeFasterDecoderSpeed(int32 num_states, int32 max_active) {
+  int32 num_pdfs = 2000, num_frames = 300;
+  fst::VectorFst<fst::StdArc> *fst = RandomDecodingGraph(num_states, num_pdfs,
+                                                         num_states);
+  Matrix<BaseFloat> loglikes;
+  RandomLoglikes(num_frames, num_pdfs, num_states, &loglikes);
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 13.0;
+  config.max_active = max_active;
+  std::ostringstream description;
+  description << "num-states = " << num_states << ", max-active = "
+              << max_active;
+  CompareTokenHashes(*fst, config, &decodable, description.str());
+  delete fst;
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  if (argc == 4) {
+    // Decodes a real utterance with a real graph, e.g.
+    // lattice-faster-decoder-speed-test final.mdl HCLG.fst loglikes.mat
+    // where loglikes.mat is the output of e.g. nnet3-compute for one
+    // utterance, in text or binary form.
+    TransitionModel trans_model;
+    ReadKaldiObject(argv[1], &trans_model);
+    fst::Fst<fst::StdArc> *fst = fst::ReadFstKaldiGeneric(argv[2]);
+    Matrix<BaseFloat> loglikes;
+    ReadKaldiObject(argv[3], &loglikes);
+    DecodableMatrixScaledMapped decodable(trans_model, loglikes, 0.1);
+    LatticeFasterDecoderConfig config;
+    CompareTokenHashes(*fst, config, &decodable, argv[2]);
+    delete fst;
+  } else if (argc == 1) {
+    TestLatticeFasterDecoderSpeed(20000, 7000);
+    TestLatticeFasterDecoderSpeed(200000, 7000);
+  } else {
+    std::cerr << "Usage: lattice-faster-decoder-speed-test "
+              << "[<model> <HCLG> <loglikes-matrix>]\n";
+    return 1;
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,87 @@
+// decoder/lattice-faster-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "fstext/fstext-utils.h"
+
+namespace kaldi {
+
+// Checks that decoding with several threads for the emitting arcs
+// (--num-emitting-threads) gives exactly the same lattice and best path as
+// with one thread.  The same decoders decode several utterances, so that the
+// threads are reused.
+void UnitTestEmittingThreads(bool flat_hash, bool const_fst) {
+  int32 num_states = 20000, num_pdfs = 500;
+  fst::VectorFst<fst::StdArc> *vector_fst =
+      RandomDecodingGraph(num_states, num_pdfs, RandInt(0, 1000));
+  fst::Fst<fst::StdArc> *fst = vector_fst;
+  if (const_fst) {
+    fst = new fst::ConstFst<fst::StdArc>(*vector_fst);
+    delete vector_fst;
+  }
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 13.0;
+  config.max_active = 7000;
+  config.flat_hash = flat_hash;
+  LatticeFasterDecoderConfig threaded_config(config);
+  threaded_config.num_emitting_threads = RandInt(2, 4);
+  LatticeFasterDecoder decoder(*fst, config),
+      threaded_decoder(*fst, threaded_config);
+
+  for (int32 utt = 0; utt < 3; utt++) {
+    Matrix<BaseFloat> loglikes;
+    RandomLoglikes(RandInt(1, 100), num_pdfs, RandInt(0, 1000), &loglikes);
+    DecodableMatrixScaled decodable(loglikes, 1.0);
+    KALDI_ASSERT(decoder.Decode(&decodable) &&
+                 threaded_decoder.Decode(&decodable));
+
+    Lattice lat, threaded_lat;
+    KALDI_ASSERT(decoder.GetRawLattice(&lat) &&
+                 threaded_decoder.GetRawLattice(&threaded_lat));
+    KALDI_ASSERT(LatticesAreIdentical(lat, threaded_lat));
+
+    Lattice best_path, threaded_best_path;
+    decoder.GetBestPath(&best_path);
+    threaded_decoder.GetBestPath(&threaded_best_path);
+    std::vector<int32> alignment, words, threaded_alignment, threaded_words;
+    LatticeWeight weight, threaded_weight;
+    fst::GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+    fst::GetLinearSymbolSequence(threaded_best_path, &threaded_alignment,
+                                 &threaded_words, &threaded_weight);
+    KALDI_ASSERT(alignment == threaded_alignment && words == threaded_words &&
+                 weight.Value1() == threaded_weight.Value1() &&
+                 weight.Value2() == threaded_weight.Value2());
+  }
+  delete fst;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 2; i++) {
+    UnitTestEmittingThreads(false, false);
+    UnitTestEmittingThreads(false, true);
+    UnitTestEmittingThreads(true, false);
+    UnitTestEmittingThreads(true, true);
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -32,7 +32,9 @@ LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
     const LatticeFasterDecoderConfig &config):
     fst_(&fst), delete_fst_(false), config_(config), num_toks_(0) {
   config.Check();
-  toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+  // just so on the first frame we do something reasonable.
+  if (config_.flat_hash) flat_toks_.SetSize(1000);
+  else toks_.SetSize(1000);
 }
 
 
@@ -41,13 +43,15 @@ LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
     const LatticeFasterDecoderConfig &config, FST *fst):
     fst_(fst), delete_fst_(true), config_(config), num_toks_(0) {
   config.Check();
-  toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+  // just so on the first frame we do something reasonable.
+  if (config_.flat_hash) flat_toks_.SetSize(1000);
+  else toks_.SetSize(1000);
 }
 
 
 template <typename FST, typename Token>
 LatticeFasterDecoderTpl<FST, Token>::~LatticeFasterDecoderTpl() {
-  DeleteElems(toks_.Clear());
+  ClearToks();
   ClearActiveTokens();
   if (delete_fst_) delete fst_;
 }
@@ -55,19 +59,30 @@ LatticeFasterDecoderTpl<FST, Token>::~LatticeFasterDecoderTpl() {
 template <typename FST, typename Token>
 void LatticeFasterDecoderTpl<FST, Token>::InitDecoding() {
   // clean up from last time:
-  DeleteElems(toks_.Clear());
+  ClearToks();
   cost_offsets_.clear();
   ClearActiveTokens();
   warned_ = false;
   num_toks_ = 0;
   decoding_finalized_ = false;
+  if (config_.num_emitting_threads > 1 && !EmittingThreadsSupported()) {
+    static bool warned_threads = false;
+    if (!warned_threads) {
+      warned_threads = true;
+      KALDI_WARN << "Ignoring --num-emitting-threads="
+                 << config_.num_emitting_threads << " for FST of type "
+                 << fst_->Type() << "; it is only supported for ConstFst "
+                 << "and VectorFst.";
+    }
+  }
   final_costs_.clear();
   StateId start_state = fst_->Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = NewToken(0.0, 0.0, NULL, NULL, NULL);
   active_toks_[0].toks = start_tok;
-  toks_.Insert(start_state, start_tok);
+  if (config_.flat_hash) flat_toks_.Insert(start_state, start_tok);
+  else toks_.Insert(start_state, start_tok);
   num_toks_++;
   ProcessNonemitting(config_.beam);
 }
@@ -77,6 +92,21 @@ void LatticeFasterDecoderTpl<FST, Token>::InitDecoding() {
 // an unusual search error.
 template <typename FST, typename Token>
 bool LatticeFasterDecoderTpl<FST, Token>::Decode(DecodableInterface *decodable) {
+  if (std::is_same<FST, fst::Fst<fst::StdArc> >::value) {
+    // As in AdvanceDecoding(): if fst_ is actually a ConstFst or VectorFst,
+    // call the version of this function for that type, which is faster and
+    // can use config_.num_emitting_threads.
+    if (fst_->Type() == "const") {
+      LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, Token> *this_cast =
+          reinterpret_cast<LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, Token>* >(this);
+      return this_cast->Decode(decodable);
+    } else if (fst_->Type() == "vector") {
+      LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, Token> *this_cast =
+          reinterpret_cast<LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, Token>* >(this);
+      return this_cast->Decode(decodable);
+    }
+  }
+
   InitDecoding();
 
   // We use 1-based indexing for frames in this decoder (if you view it in
@@ -226,11 +256,25 @@ template <typename FST, typename Token>
 void LatticeFasterDecoderTpl<FST, Token>::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
-  if (new_sz > toks_.Size()) {
+  if (config_.flat_hash) {
+    if (new_sz > flat_toks_.Size())
+      flat_toks_.SetSize(new_sz);
+  } else if (new_sz > toks_.Size()) {
     toks_.SetSize(new_sz);
   }
 }
 
+template <typename FST, typename Token>
+inline Token* LatticeFasterDecoderTpl<FST, Token>::FindToken(StateId state) {
+  if (config_.flat_hash) {
+    Token **tok = flat_toks_.Find(state);
+    return (tok == NULL ? NULL : *tok);
+  } else {
+    Elem *e = toks_.Find(state);
+    return (e == NULL ? NULL : e->val);
+  }
+}
+
 /*
   A note on the definition of extra_cost.
 
@@ -270,21 +314,22 @@ inline Token* LatticeFasterDecoderTpl<FST, Token>::FindOrAddToken(
   // if the token was newly created or the cost changed.
   KALDI_ASSERT(frame_plus_one < active_toks_.size());
   Token *&toks = active_toks_[frame_plus_one].toks;
-  Elem *e_found = toks_.Find(state);
-  if (e_found == NULL) {  // no such token presently.
+  Token *tok = FindToken(state);
+  if (tok == NULL) {  // no such token presently.
     const BaseFloat extra_cost = 0.0;
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = NewToken(tot_cost, extra_cost, NULL, toks, backpointer);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
-    toks_.Insert(state, new_tok);
+    if (config_.flat_hash) flat_toks_.Insert(state, new_tok);
+    else toks_.Insert(state, new_tok);
     if (changed) *changed = true;
     return new_tok;
   } else {
-    Token *tok = e_found->val;  // There is an existing Token for this state.
+    // There is an existing Token for this state.
     if (tok->tot_cost > tot_cost) {  // replace old token
       tok->tot_cost = tot_cost;
       // SetBackpointer() just does tok->backpointer = backpointer in
@@ -353,7 +398,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinks(
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          DeleteForwardLink(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -396,11 +441,11 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
   typedef typename unordered_map<Token*, BaseFloat>::const_iterator IterType;
   ComputeFinalCosts(&final_costs_, &final_relative_cost_, &final_best_cost_);
   decoding_finalized_ = true;
-  // We call DeleteElems() as a nicety, not because it's really necessary;
+  // We call ClearToks() as a nicety, not because it's really necessary;
   // otherwise there would be a time, after calling PruneTokensForFrame() on the
   // final frame, when toks_.GetList() or toks_.Clear() would contain pointers
   // to nonexistent tokens.
-  DeleteElems(toks_.Clear());
+  ClearToks();
 
   // Now go through tokens on this frame, pruning forward links...  may have to
   // iterate a few times until there is no more change, because the list is not
@@ -441,7 +486,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          DeleteForwardLink(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -502,7 +547,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneTokensForFrame(int32 frame_plus_o
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      DeleteToken(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -553,11 +598,26 @@ void LatticeFasterDecoderTpl<FST, Token>::ComputeFinalCosts(
   KALDI_ASSERT(!decoding_finalized_);
   if (final_costs != NULL)
     final_costs->clear();
-  const Elem *final_toks = toks_.GetList();
   BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
   BaseFloat best_cost = infinity,
       best_cost_with_final = infinity;
 
+  if (config_.flat_hash) {
+    const std::vector<StateId> &states = flat_toks_.Keys();
+    const std::vector<Token*> &toks = flat_toks_.Vals();
+    for (size_t i = 0; i < states.size(); i++) {
+      Token *tok = toks[i];
+      BaseFloat final_cost = fst_->Final(states[i]).Value();
+      BaseFloat cost = tok->tot_cost,
+          cost_with_final = cost + final_cost;
+      best_cost = std::min(cost, best_cost);
+      best_cost_with_final = std::min(cost_with_final, best_cost_with_final);
+      if (final_costs != NULL && final_cost != infinity)
+        (*final_costs)[tok] = final_cost;
+    }
+  }
+
+  const Elem *final_toks = toks_.GetList();
   while (final_toks != NULL) {
     StateId state = final_toks->key;
     Token *tok = final_toks->val;
@@ -682,45 +742,82 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
       }
     }
     if (tok_count != NULL) *tok_count = count;
+    return GetCutoffFromArray(best_weight, adaptive_beam);
+  }
+}
 
-    BaseFloat beam_cutoff = best_weight + config_.beam,
-        min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
-        max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
-
-    KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
-                  << " is " << tmp_array_.size();
-
-    if (tmp_array_.size() > static_cast<size_t>(config_.max_active)) {
-      std::nth_element(tmp_array_.begin(),
-                       tmp_array_.begin() + config_.max_active,
-                       tmp_array_.end());
-      max_active_cutoff = tmp_array_[config_.max_active];
-    }
-    if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
-      if (adaptive_beam)
-        *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
-      return max_active_cutoff;
+template <typename FST, typename Token>
+BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoffFlat(
+    size_t *tok_count, BaseFloat *adaptive_beam, int32 *best_index) {
+  BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
+  size_t count = prev_toks_.size();
+  *best_index = -1;
+  if (tok_count != NULL) *tok_count = count;
+  if (config_.max_active == std::numeric_limits<int32>::max() &&
+      config_.min_active == 0) {
+    for (size_t i = 0; i < count; i++) {
+      BaseFloat w = static_cast<BaseFloat>(prev_toks_[i]->tot_cost);
+      if (w < best_weight) {
+        best_weight = w;
+        *best_index = static_cast<int32>(i);
+      }
     }
-    if (tmp_array_.size() > static_cast<size_t>(config_.min_active)) {
-      if (config_.min_active == 0) min_active_cutoff = best_weight;
-      else {
-        std::nth_element(tmp_array_.begin(),
-                         tmp_array_.begin() + config_.min_active,
-                         tmp_array_.size() > static_cast<size_t>(config_.max_active) ?
-                         tmp_array_.begin() + config_.max_active :
-                         tmp_array_.end());
-        min_active_cutoff = tmp_array_[config_.min_active];
+    if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
+    return best_weight + config_.beam;
+  } else {
+    tmp_array_.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      BaseFloat w = prev_toks_[i]->tot_cost;
+      tmp_array_[i] = w;
+      if (w < best_weight) {
+        best_weight = w;
+        *best_index = static_cast<int32>(i);
       }
     }
-    if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam.
-      if (adaptive_beam)
-        *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
-      return min_active_cutoff;
-    } else {
-      *adaptive_beam = config_.beam;
-      return beam_cutoff;
+    return GetCutoffFromArray(best_weight, adaptive_beam);
+  }
+}
+
+template <typename FST, typename Token>
+BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoffFromArray(
+    BaseFloat best_weight, BaseFloat *adaptive_beam) {
+  BaseFloat beam_cutoff = best_weight + config_.beam,
+      min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
+      max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
+
+  KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
+                << " is " << tmp_array_.size();
+
+  if (tmp_array_.size() > static_cast<size_t>(config_.max_active)) {
+    std::nth_element(tmp_array_.begin(),
+                     tmp_array_.begin() + config_.max_active,
+                     tmp_array_.end());
+    max_active_cutoff = tmp_array_[config_.max_active];
+  }
+  if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
+    if (adaptive_beam)
+      *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
+    return max_active_cutoff;
+  }
+  if (tmp_array_.size() > static_cast<size_t>(config_.min_active)) {
+    if (config_.min_active == 0) min_active_cutoff = best_weight;
+    else {
+      std::nth_element(tmp_array_.begin(),
+                       tmp_array_.begin() + config_.min_active,
+                       tmp_array_.size() > static_cast<size_t>(config_.max_active) ?
+                       tmp_array_.begin() + config_.max_active :
+                       tmp_array_.end());
+      min_active_cutoff = tmp_array_[config_.min_active];
     }
   }
+  if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam.
+    if (adaptive_beam)
+      *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
+    return min_active_cutoff;
+  } else {
+    *adaptive_beam = config_.beam;
+    return beam_cutoff;
+  }
 }
 
 template <typename FST, typename Token>
@@ -732,31 +829,102 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
                                          // from the decodable object.
   active_toks_.resize(active_toks_.size() + 1);
 
-  Elem *final_toks = toks_.Clear(); // analogous to swapping prev_toks_ / cur_toks_
-                                   // in simple-decoder.h.   Removes the Elems from
-                                   // being indexed in the hash in toks_.
-  Elem *best_elem = NULL;
+  Elem *final_toks = NULL;
+  StateId best_state = fst::kNoStateId;
+  Token *best_tok = NULL;
   BaseFloat adaptive_beam;
   size_t tok_cnt;
-  BaseFloat cur_cutoff = GetCutoff(final_toks, &tok_cnt, &adaptive_beam, &best_elem);
+  BaseFloat cur_cutoff;
+  if (config_.flat_hash) {
+    // Moves the states and tokens into prev_states_ and prev_toks_, and
+    // clears the hash.
+    flat_toks_.Clear(&prev_states_, &prev_toks_);
+    int32 best_index;
+    cur_cutoff = GetCutoffFlat(&tok_cnt, &adaptive_beam, &best_index);
+    if (best_index >= 0) {
+      best_state = prev_states_[best_index];
+      best_tok = prev_toks_[best_index];
+    }
+  } else {
+    final_toks = toks_.Clear(); // analogous to swapping prev_toks_ / cur_toks_
+                                // in simple-decoder.h.   Removes the Elems from
+                                // being indexed in the hash in toks_.
+    Elem *best_elem = NULL;
+    cur_cutoff = GetCutoff(final_toks, &tok_cnt, &adaptive_beam, &best_elem);
+    if (best_elem) {
+      best_state = best_elem->key;
+      best_tok = best_elem->val;
+    }
+  }
   KALDI_VLOG(6) << "Adaptive beam on frame " << NumFramesDecoded() << " is "
                 << adaptive_beam;
 
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
 
-  BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
+  BaseFloat cost_offset; // Used to keep probabilities in a good
+                         // dynamic range.
   // pruning "online" before having seen all tokens
+  BaseFloat next_cutoff = ProcessEmittingBestToken(decodable, frame,
+                                                   best_state, best_tok,
+                                                   adaptive_beam, &cost_offset);
+
+  if (UseEmittingThreads(tok_cnt)) {
+    if (!config_.flat_hash) {
+      prev_states_.clear();
+      prev_toks_.clear();
+      for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
+        prev_states_.push_back(e->key);
+        prev_toks_.push_back(e->val);
+        e_tail = e->tail;
+        toks_.Delete(e);
+      }
+    }
+    ProcessEmittingParallel(decodable, frame, cur_cutoff, cost_offset,
+                            adaptive_beam, &next_cutoff);
+    return next_cutoff;
+  }
+
+  if (config_.flat_hash) {
+    // the previous frame's tokens are in prev_states_ and prev_toks_, which
+    // are contiguous in memory.
+    for (size_t i = 0; i < prev_toks_.size(); i++) {
+      Token *tok = prev_toks_[i];
+      if (tok->tot_cost <= cur_cutoff)
+        ProcessEmittingToken(decodable, frame, prev_states_[i], tok,
+                             cost_offset, adaptive_beam, &next_cutoff);
+    }
+    return next_cutoff;
+  }
 
-  BaseFloat cost_offset = 0.0; // Used to keep probabilities in a good
-                               // dynamic range.
+  // the tokens are now owned here, in final_toks, and the hash is empty.
+  // 'owned' is a complex thing here; the point is we need to call DeleteElem
+  // on each elem 'e' to let toks_ know we're done with them.
+  for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
+    // loop this way because we delete "e" as we go.
+    StateId state = e->key;
+    Token *tok = e->val;
+    if (tok->tot_cost <= cur_cutoff)
+      ProcessEmittingToken(decodable, frame, state, tok,
+                           cost_offset, adaptive_beam, &next_cutoff);
+    e_tail = e->tail;
+    toks_.Delete(e); // delete Elem
+  }
+  return next_cutoff;
+}
 
+template <typename FST, typename Token>
+BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmittingBestToken(
+    DecodableInterface *decodable, int32 frame, StateId best_state,
+    Token *best_tok, BaseFloat adaptive_beam, BaseFloat *cost_offset_out) {
+  BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
+  BaseFloat cost_offset = 0.0;
 
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.  The only
   // products of the next block are "next_cutoff" and "cost_offset".
-  if (best_elem) {
-    StateId state = best_elem->key;
-    Token *tok = best_elem->val;
+  if (best_tok) {
+    StateId state = best_state;
+    Token *tok = best_tok;
     cost_offset = - tok->tot_cost;
     for (fst::ArcIterator<FST> aiter(*fst_, state);
          !aiter.Done();
@@ -776,53 +944,156 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
   // do it this way as it's more robust to future code changes.
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
+  *cost_offset_out = cost_offset;
+  return next_cutoff;
+}
 
-  // the tokens are now owned here, in final_toks, and the hash is empty.
-  // 'owned' is a complex thing here; the point is we need to call DeleteElem
-  // on each elem 'e' to let toks_ know we're done with them.
-  for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
-    // loop this way because we delete "e" as we go.
-    StateId state = e->key;
-    Token *tok = e->val;
-    if (tok->tot_cost <= cur_cutoff) {
-      for (fst::ArcIterator<FST> aiter(*fst_, state);
-           !aiter.Done();
-           aiter.Next()) {
-        const Arc &arc = aiter.Value();
-        if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
-              graph_cost = arc.weight.Value(),
-              cur_cost = tok->tot_cost,
-              tot_cost = cur_cost + ac_cost + graph_cost;
-          if (tot_cost > next_cutoff) continue;
-          else if (tot_cost + adaptive_beam < next_cutoff)
-            next_cutoff = tot_cost + adaptive_beam; // prune by best current token
-          // Note: the frame indexes into active_toks_ are one-based,
-          // hence the + 1.
-          Token *next_tok = FindOrAddToken(arc.nextstate,
-                                           frame + 1, tot_cost, tok, NULL);
-          // NULL: no change indicator needed
-
-          // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLinkT(next_tok, arc.ilabel, arc.olabel,
-                                        graph_cost, ac_cost, tok->links);
-        }
-      } // for all arcs
+template <typename FST, typename Token>
+inline void LatticeFasterDecoderTpl<FST, Token>::ProcessEmittingToken(
+    DecodableInterface *decodable, int32 frame, StateId state, Token *tok,
+    BaseFloat cost_offset, BaseFloat adaptive_beam, BaseFloat *next_cutoff) {
+  for (fst::ArcIterator<FST> aiter(*fst_, state);
+       !aiter.Done();
+       aiter.Next()) {
+    const Arc &arc = aiter.Value();
+    if (arc.ilabel != 0) {  // propagate..
+      BaseFloat ac_cost = cost_offset -
+          decodable->LogLikelihood(frame, arc.ilabel),
+          graph_cost = arc.weight.Value(),
+          cur_cost = tok->tot_cost,
+          tot_cost = cur_cost + ac_cost + graph_cost;
+      if (tot_cost > *next_cutoff) continue;
+      else if (tot_cost + adaptive_beam < *next_cutoff)
+        *next_cutoff = tot_cost + adaptive_beam; // prune by best current token
+      // Note: the frame indexes into active_toks_ are one-based,
+      // hence the + 1.
+      Token *next_tok = FindOrAddToken(arc.nextstate,
+                                       frame + 1, tot_cost, tok, NULL);
+      // NULL: no change indicator needed
+
+      // Add ForwardLink from tok to next_tok (put on head of list tok->links)
+      tok->links = NewForwardLink(next_tok, arc.ilabel, arc.olabel,
+                                  graph_cost, ac_cost, tok->links);
+    }
+  } // for all arcs
+}
+
+template <typename FST, typename Token>
+bool LatticeFasterDecoderTpl<FST, Token>::EmittingThreadsSupported() const {
+  // The threads read the FST concurrently, which is only safe for types that
+  // are not expanded on demand.  If FST is fst::Fst, Decode() and
+  // AdvanceDecoding() call the ConstFst or VectorFst versions of themselves
+  // when fst_ is of one of those types.
+  return std::is_same<FST, fst::ConstFst<fst::StdArc> >::value ||
+      std::is_same<FST, fst::VectorFst<fst::StdArc> >::value ||
+      (std::is_same<FST, fst::Fst<fst::StdArc> >::value &&
+       (fst_->Type() == "const" || fst_->Type() == "vector"));
+}
+
+template <typename FST, typename Token>
+inline bool LatticeFasterDecoderTpl<FST, Token>::UseEmittingThreads(
+    size_t num_toks) const {
+  // This is called from the ConstFst or VectorFst version of the decoder if
+  // EmittingThreadsSupported(), so we don't need to look at fst_->Type().
+  // Frames with few tokens are not worth the overhead of starting threads.
+  const bool fst_is_thread_safe =
+      std::is_same<FST, fst::ConstFst<fst::StdArc> >::value ||
+      std::is_same<FST, fst::VectorFst<fst::StdArc> >::value;
+  const size_t min_toks_per_thread = 200;
+  return fst_is_thread_safe && config_.num_emitting_threads > 1 &&
+      num_toks >= min_toks_per_thread * config_.num_emitting_threads;
+}
+
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::ProcessEmittingParallel(
+    DecodableInterface *decodable, int32 frame, BaseFloat cur_cutoff,
+    BaseFloat cost_offset, BaseFloat adaptive_beam, BaseFloat *next_cutoff) {
+  // The threads don't use the decodable object, which need not be thread
+  // safe; we get all the log-likelihoods they might need here.
+  int32 num_indices = decodable->NumIndices();
+  frame_loglikes_.resize(num_indices + 1);
+  for (int32 i = 1; i <= num_indices; i++)
+    frame_loglikes_[i] = decodable->LogLikelihood(frame, i);
+
+  int32 num_threads = config_.num_emitting_threads;
+  emitting_arcs_.resize(num_threads);
+  BaseFloat initial_next_cutoff = *next_cutoff;
+  emitting_thread_pool_.Run(num_threads, [&](int32 thread) {
+      ExpandEmittingArcs(thread, num_threads, cur_cutoff, cost_offset,
+                         adaptive_beam, initial_next_cutoff);
+    });
+
+  // Merge the arcs in the order the serial code would have produced them,
+  // applying the serial code's pruning.  FindOrAddToken() keeps the best cost
+  // for each state.
+  for (int32 t = 0; t < num_threads; t++) {
+    const std::vector<EmittingArc> &arcs = emitting_arcs_[t];
+    typename std::vector<EmittingArc>::const_iterator iter = arcs.begin(),
+        end = arcs.end();
+    for (; iter != end; ++iter) {
+      BaseFloat tot_cost = iter->tot_cost;
+      if (tot_cost > *next_cutoff) continue;
+      else if (tot_cost + adaptive_beam < *next_cutoff)
+        *next_cutoff = tot_cost + adaptive_beam; // prune by best current token
+      Token *tok = iter->tok,
+          *next_tok = FindOrAddToken(iter->nextstate, frame + 1, tot_cost,
+                                     tok, NULL);
+      tok->links = NewForwardLink(next_tok, iter->ilabel, iter->olabel,
+                                  iter->graph_cost, iter->ac_cost, tok->links);
+    }
+  }
+}
+
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::ExpandEmittingArcs(
+    int32 thread, int32 num_threads, BaseFloat cur_cutoff,
+    BaseFloat cost_offset, BaseFloat adaptive_beam, BaseFloat next_cutoff) {
+  const std::vector<StateId> &states = prev_states_;
+  const std::vector<Token*> &toks = prev_toks_;
+  const std::vector<BaseFloat> &loglikes = frame_loglikes_;
+  std::vector<EmittingArc> &arcs = emitting_arcs_[thread];
+  arcs.clear();
+  size_t num_toks = toks.size(),
+      begin = (num_toks * thread) / num_threads,
+      end = (num_toks * (thread + 1)) / num_threads;
+  // "next_cutoff" is never tighter than the one the serial code would have at
+  // the corresponding point, because we have only seen a subset of the arcs;
+  // so we only discard arcs that the merge would discard anyway.
+  for (size_t i = begin; i < end; i++) {
+    Token *tok = toks[i];
+    if (tok->tot_cost > cur_cutoff) continue;
+    for (fst::ArcIterator<FST> aiter(*fst_, states[i]);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) {  // propagate..
+        BaseFloat ac_cost = cost_offset - loglikes[arc.ilabel],
+            graph_cost = arc.weight.Value(),
+            cur_cost = tok->tot_cost,
+            tot_cost = cur_cost + ac_cost + graph_cost;
+        if (tot_cost > next_cutoff) continue;
+        else if (tot_cost + adaptive_beam < next_cutoff)
+          next_cutoff = tot_cost + adaptive_beam;
+        EmittingArc emitting_arc;
+        emitting_arc.tok = tok;
+        emitting_arc.nextstate = arc.nextstate;
+        emitting_arc.ilabel = arc.ilabel;
+        emitting_arc.olabel = arc.olabel;
+        emitting_arc.graph_cost = graph_cost;
+        emitting_arc.ac_cost = ac_cost;
+        emitting_arc.tot_cost = tot_cost;
+        arcs.push_back(emitting_arc);
+      }
     }
-    e_tail = e->tail;
-    toks_.Delete(e); // delete Elem
   }
-  return next_cutoff;
 }
 
-// static inline
 template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::DeleteForwardLinks(Token *tok) {
+inline void LatticeFasterDecoderTpl<FST, Token>::DeleteForwardLinks(Token *tok) {
   ForwardLinkT *l = tok->links, *m;
   while (l != NULL) {
     m = l->next;
-    delete l;
+    DeleteForwardLink(l);
     l = m;
   }
   tok->links = NULL;
@@ -845,7 +1116,7 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
 
   KALDI_ASSERT(queue_.empty());
 
-  if (toks_.GetList() == NULL) {
+  if (toks_.GetList() == NULL && flat_toks_.NumElements() == 0) {
     if (!warned_) {
       KALDI_WARN << "Error, no surviving tokens: frame is " << frame;
       warned_ = true;
@@ -857,12 +1128,18 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
     if (fst_->NumInputEpsilons(state) != 0)
       queue_.push_back(state);
   }
+  const std::vector<StateId> &flat_states = flat_toks_.Keys();
+  for (size_t i = 0; i < flat_states.size(); i++) {
+    StateId state = flat_states[i];
+    if (fst_->NumInputEpsilons(state) != 0)
+      queue_.push_back(state);
+  }
 
   while (!queue_.empty()) {
     StateId state = queue_.back();
     queue_.pop_back();
 
-    Token *tok = toks_.Find(state)->val;  // would segfault if state not in toks_ but this can't happen.
+    Token *tok = FindToken(state);  // would segfault if state not in toks_ but this can't happen.
     BaseFloat cur_cost = tok->tot_cost;
     if (cur_cost > cutoff) // Don't bother processing successors.
       continue;
@@ -885,8 +1162,8 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLinkT(new_tok, 0, arc.olabel,
-                                        graph_cost, 0, tok->links);
+          tok->links = NewForwardLink(new_tok, 0, arc.olabel,
+                                      graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -907,21 +1184,30 @@ void LatticeFasterDecoderTpl<FST, Token>::DeleteElems(Elem *list) {
   }
 }
 
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::ClearToks() {
+  DeleteElems(toks_.Clear());
+  flat_toks_.Clear();
+}
+
 template <typename FST, typename Token>
 void LatticeFasterDecoderTpl<FST, Token>::ClearActiveTokens() { // a cleanup routine, at utt end/begin
-  for (size_t i = 0; i < active_toks_.size(); i++) {
-    // Delete all tokens alive on this frame, and any forward
-    // links they may have.
-    for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      DeleteForwardLinks(tok);
-      Token *next_tok = tok->next;
-      delete tok;
-      num_toks_--;
-      tok = next_tok;
-    }
-  }
+  // Delete all tokens alive on all frames, and any forward links they may
+  // have.  There is no need to visit them: all tokens and links come from
+  // token_allocator_ and link_allocator_, so we can free them in bulk.
+  KALDI_ASSERT(token_allocator_.NumInUse() ==
+               static_cast<size_t>(num_toks_));
+  token_allocator_.DeallocateAll();
+  link_allocator_.DeallocateAll();
+  num_toks_ = 0;
   active_toks_.clear();
-  KALDI_ASSERT(num_toks_ == 0);
+}
+
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::GetAllocatorStats(
+    SlabAllocatorStats *token_stats, SlabAllocatorStats *link_stats) const {
+  token_allocator_.GetStats(token_stats);
+  link_allocator_.GetStats(link_stats);
 }
 
 // static
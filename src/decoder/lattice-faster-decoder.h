@@ -26,6 +26,9 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/flat-hash-list.h"
+#include "util/slab-allocator.h"
+#include "base/kaldi-thread-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -45,6 +48,9 @@ struct LatticeFasterDecoderConfig {
                             // command-line program.
   BaseFloat beam_delta; // has nothing to do with beam_ratio
   BaseFloat hash_ratio;
+  bool flat_hash;  // If true, use FlatHashList rather than HashList to index
+                   // the tokens of the current frame.
+  int32 num_emitting_threads;
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
@@ -61,6 +67,8 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
+                                flat_hash(false),
+                                num_emitting_threads(1),
                                 prune_scale(0.1) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
@@ -80,11 +88,26 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to "
                    "control hash behavior");
+    opts->Register("flat-hash", &flat_hash, "If true, index the tokens of the "
+                   "current frame with an open-addressing hash whose states and "
+                   "tokens are stored in contiguous arrays (see "
+                   "util/flat-hash-list.h), instead of with a hashed linked "
+                   "list.  The search is the same, only the order in which "
+                   "tokens are visited may differ; it is usually faster.");
+    opts->Register("num-emitting-threads", &num_emitting_threads, "If >1, the "
+                   "number of threads used to expand the emitting arcs of each "
+                   "frame.  The output is the same as with 1 thread.  Only "
+                   "used with ConstFst or VectorFst graphs (otherwise it is "
+                   "ignored with a warning), and on frames with "
+                   "many active tokens.  The decodable object is queried for "
+                   "all indices on each such frame, so this is only worthwhile "
+                   "if its LogLikelihood() is cheap (e.g. nnet outputs).");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && min_active <= max_active
                  && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
+                 && num_emitting_threads >= 1
                  && prune_scale > 0.0 && prune_scale < 1.0);
   }
 };
@@ -342,13 +365,21 @@ class LatticeFasterDecoderTpl {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// Outputs statistics about the memory used for tokens and for forward links
+  /// (the peak bytes in use, the number of slabs and so on).  These are
+  /// allocated from slab allocators (see util/slab-allocator.h) that are
+  /// emptied in one go by InitDecoding(), and keep their memory for the next
+  /// utterance.
+  void GetAllocatorStats(SlabAllocatorStats *token_stats,
+                         SlabAllocatorStats *link_stats) const;
+
  protected:
   // we make things protected instead of private, as code in
   // LatticeFasterOnlineDecoderTpl, which inherits from this, also uses the
   // internals.
 
   // Deletes the elements of the singly linked list tok->links.
-  inline static void DeleteForwardLinks(Token *tok);
+  inline void DeleteForwardLinks(Token *tok);
 
   // head of per-frame list of Tokens (list is in topological order),
   // and something saying whether we ever pruned it using PruneForwardLinks.
@@ -370,6 +401,27 @@ class LatticeFasterDecoderTpl {
 
   void PossiblyResizeHash(size_t num_toks);
 
+  inline Token *NewToken(BaseFloat tot_cost, BaseFloat extra_cost,
+                         ForwardLinkT *links, Token *next, Token *backpointer) {
+    return new (token_allocator_.Allocate())
+        Token(tot_cost, extra_cost, links, next, backpointer);
+  }
+  inline void DeleteToken(Token *tok) { token_allocator_.Deallocate(tok); }
+  inline ForwardLinkT *NewForwardLink(Token *next_tok, Label ilabel,
+                                      Label olabel, BaseFloat graph_cost,
+                                      BaseFloat acoustic_cost,
+                                      ForwardLinkT *next) {
+    return new (link_allocator_.Allocate())
+        ForwardLinkT(next_tok, ilabel, olabel, graph_cost, acoustic_cost, next);
+  }
+  inline void DeleteForwardLink(ForwardLinkT *link) {
+    link_allocator_.Deallocate(link);
+  }
+
+  // Returns the token for "state" on the current frame, or NULL if there is
+  // none; it looks in whichever of toks_ and flat_toks_ is in use.
+  inline Token *FindToken(StateId state);
+
   // FindOrAddToken either locates a token in hash of toks_, or if necessary
   // inserts a new, empty token (i.e. with no forward links) for the current
   // frame.  [note: it's inserted if necessary into hash toks_ and also into the
@@ -442,11 +494,81 @@ class LatticeFasterDecoderTpl {
   BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
                       BaseFloat *adaptive_beam, Elem **best_elem);
 
+  /// This version of GetCutoff() is used if config_.flat_hash is true; it
+  /// works on the tokens in prev_toks_ and outputs the index of the best one
+  /// (or -1 if there are none) to *best_index.
+  BaseFloat GetCutoffFlat(size_t *tok_count, BaseFloat *adaptive_beam,
+                          int32 *best_index);
+
+  // Works out, from the costs in tmp_array_ and the best cost, the cutoff
+  // implied by max_active and min_active.  Called from GetCutoff() and
+  // GetCutoffFlat().
+  BaseFloat GetCutoffFromArray(BaseFloat best_weight, BaseFloat *adaptive_beam);
+
   /// Processes emitting arcs for one frame.  Propagates from prev_toks_ to
   /// cur_toks_.  Returns the cost cutoff for subsequent ProcessNonemitting() to
   /// use.
   BaseFloat ProcessEmitting(DecodableInterface *decodable);
 
+  /// Processes the emitting arcs out of "best_tok", the best token on the
+  /// previous frame (for state "best_state"; may be NULL if there are no
+  /// tokens), to get a hopefully reasonably tight initial value of the cutoff
+  /// for frame "frame", which it returns.  Also works out the offset on the
+  /// acoustic costs of this frame, which it outputs to *cost_offset and stores
+  /// in cost_offsets_.
+  BaseFloat ProcessEmittingBestToken(DecodableInterface *decodable,
+                                     int32 frame, StateId best_state,
+                                     Token *best_tok, BaseFloat adaptive_beam,
+                                     BaseFloat *cost_offset);
+
+  /// Propagates the emitting arcs out of one token "tok" (for state "state")
+  /// on frame "frame"; this is the inner loop of ProcessEmitting().
+  inline void ProcessEmittingToken(DecodableInterface *decodable, int32 frame,
+                                   StateId state, Token *tok,
+                                   BaseFloat cost_offset,
+                                   BaseFloat adaptive_beam,
+                                   BaseFloat *next_cutoff);
+
+  /// Returns true if config_.num_emitting_threads can be used with fst_, i.e.
+  /// if it is a ConstFst or VectorFst.
+  bool EmittingThreadsSupported() const;
+
+  /// Returns true if ProcessEmitting() should use ProcessEmittingParallel()
+  /// for a frame with "num_toks" active tokens.
+  inline bool UseEmittingThreads(size_t num_toks) const;
+
+  /// This does the work of ProcessEmitting() (after the cutoffs and the cost
+  /// offset have been worked out) with config_.num_emitting_threads threads,
+  /// for the tokens in prev_states_ and prev_toks_.  Each thread expands the
+  /// arcs out of a contiguous range of those tokens into its own buffer of
+  /// EmittingArcs, doing the same pruning as the serial code, only with a
+  /// cutoff that is no tighter.  The buffers are then merged in order by
+  /// FindOrAddToken(), which keeps the best cost for each state; because
+  /// this replays the arcs in the serial order with the serial cutoff, the
+  /// result is exactly the same as with one thread.
+  void ProcessEmittingParallel(DecodableInterface *decodable, int32 frame,
+                               BaseFloat cur_cutoff, BaseFloat cost_offset,
+                               BaseFloat adaptive_beam,
+                               BaseFloat *next_cutoff);
+
+  // An arc expanded by one of the threads in ProcessEmittingParallel().
+  struct EmittingArc {
+    Token *tok;  // The token we are expanding from.
+    StateId nextstate;
+    Label ilabel;
+    Label olabel;
+    BaseFloat graph_cost;
+    BaseFloat ac_cost;
+    BaseFloat tot_cost;
+  };
+
+  // The work done by thread "thread" (of "num_threads") in
+  // ProcessEmittingParallel(): it expands the arcs out of its range of
+  // prev_toks_ into emitting_arcs_[thread].
+  void ExpandEmittingArcs(int32 thread, int32 num_threads,
+                          BaseFloat cur_cutoff, BaseFloat cost_offset,
+                          BaseFloat adaptive_beam, BaseFloat next_cutoff);
+
   /// Processes nonemitting (epsilon) arcs for one frame.  Called after
   /// ProcessEmitting() on each frame.  The cost cutoff is computed by the
   /// preceding ProcessEmitting().
@@ -461,9 +583,32 @@ class LatticeFasterDecoderTpl {
   // the graph.
   HashList<StateId, Token*> toks_;
 
+  // flat_toks_ is used instead of toks_ if config_.flat_hash is true (only one
+  // of them is ever non-empty).  When we move on to a new frame, the states and
+  // tokens of the previous frame are swapped out of it into prev_states_ and
+  // prev_toks_.  (ProcessEmittingParallel() also copies the previous frame
+  // from toks_ into these if flat_toks_ is not in use.)
+  FlatHashList<StateId, Token*> flat_toks_;
+  std::vector<StateId> prev_states_;
+  std::vector<Token*> prev_toks_;
+
+  // Used in ProcessEmittingParallel(): the log-likelihoods of the current
+  // frame, indexed by (one-based) index, and the arcs expanded by each thread.
+  std::vector<BaseFloat> frame_loglikes_;
+  std::vector<std::vector<EmittingArc> > emitting_arcs_;
+  // The threads used by ProcessEmittingParallel(); they are started on the
+  // first frame that needs them and kept until the decoder is destroyed.
+  ThreadPool emitting_thread_pool_;
+
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
+
+  // Tokens and ForwardLinks are allocated from these rather than with new and
+  // delete.  Use NewToken(), DeleteToken(), NewForwardLink() and
+  // DeleteForwardLink().
+  SlabAllocator<Token> token_allocator_;
+  SlabAllocator<ForwardLinkT> link_allocator_;
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
 
@@ -508,6 +653,10 @@ class LatticeFasterDecoderTpl {
   // using the "next" pointer.  We delete them manually.
   void DeleteElems(Elem *list);
 
+  // Clears toks_ or flat_toks_, whichever is in use.  Does not delete any
+  // tokens.
+  void ClearToks();
+
   // This function takes a singly linked list of tokens for a single frame, and
   // outputs a list of them in topological order (it will crash if no such order
   // can be found, which will typically be due to decoding graphs with epsilon
@@ -94,6 +94,29 @@ class ExampleFeatureComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /**
+     Batched version of Compute(), which computes features for many frames at
+     once.  This is what OfflineFeatureTpl uses; it gives the same output as
+     calling Compute() on each frame (up to roundoff), but is faster because
+     operations like the mel filterbank and the DCT become matrix
+     multiplications over all the frames.
+
+     @param [in] signal_raw_log_energies  The raw log-energy of each frame,
+         as for the "signal_raw_log_energy" argument of Compute().  Its
+         dimension is signal_frames->NumRows(); it must be ignored if this
+         class returns false from this->NeedRawLogEnergy().
+     @param [in] vtln_warp  The VTLN warping factor, as for Compute().
+     @param [in] signal_frames  Frames of the signal, one per row, each as
+         extracted using ExtractWindow().  This is used as a workspace.
+     @param [out] features  Matrix with the same number of rows as
+         "signal_frames" and this->Dim() columns, to which the features
+         will be written.
+  */
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
  private:
   // disallow assignment.
   ExampleFeatureComputer &operator = (const ExampleFeatureComputer &in);
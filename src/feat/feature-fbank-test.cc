@@ -21,6 +21,7 @@
 #include <iostream>
 
 #include "feat/feature-fbank.h"
+#include "feat/feature-test-utils.h"
 #include "base/kaldi-math.h"
 #include "matrix/kaldi-matrix-inl.h"
 #include "feat/wave-reader.h"
@@ -443,6 +444,28 @@ static void UnitTestHTKCompare4() {
 
 
 
+static void UnitTestBatchedCompute() {
+  std::cout << "=== UnitTestBatchedCompute() ===\n";
+  for (int32 i = 0; i < 10; i++) {
+    // Long enough for several batches of frames.
+    Vector<BaseFloat> wave(RandInt(1000, 80000));
+    wave.SetRandn();
+    wave.Scale(1000.0);
+    FbankOptions opts;
+    opts.frame_opts.dither = 0.0;
+    opts.frame_opts.frame_length_ms = RandInt(20, 30);
+    opts.frame_opts.round_to_power_of_two = (RandInt(0, 1) == 0);
+    opts.frame_opts.snip_edges = (RandInt(0, 1) == 0);
+    opts.use_energy = (RandInt(0, 1) == 0);
+    opts.raw_energy = (RandInt(0, 1) == 0);
+    opts.htk_compat = (RandInt(0, 1) == 0);
+    opts.energy_floor = RandInt(0, 1) * 100.0;
+    opts.use_log_fbank = (RandInt(0, 1) == 0);
+    opts.use_power = (RandInt(0, 1) == 0);
+    CheckBatchedCompute<FbankComputer>(opts, wave, 0.9 + 0.2 * RandUniform());
+  }
+}
+
 static void UnitTestFeat() {
   UnitTestReadWave();
   UnitTestSimple();
@@ -450,6 +473,7 @@ static void UnitTestFeat() {
   UnitTestHTKCompare2();
   UnitTestHTKCompare3();
   UnitTestHTKCompare4();
+  UnitTestBatchedCompute();
 }
 
 
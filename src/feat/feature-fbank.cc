@@ -122,4 +122,66 @@ void FbankComputer::Compute(BaseFloat signal_log_energy,
   }
 }
 
+void FbankComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_frames->NumCols() ==
+               opts_.frame_opts.PaddedWindowSize() &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim() &&
+               signal_raw_log_energies.Dim() == num_frames);
+  if (num_frames == 0)
+    return;
+
+  const MelBanks &mel_banks = *(GetMelBanks(vtln_warp));
+
+  Vector<BaseFloat> signal_log_energies(signal_raw_log_energies);
+  if (opts_.use_energy && !opts_.raw_energy) {
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> signal_frame(*signal_frames, t);
+      // Compute energy after window function (not the raw one).
+      signal_log_energies(t) = Log(std::max<BaseFloat>(
+          VecVec(signal_frame, signal_frame),
+          std::numeric_limits<float>::min()));
+    }
+  }
+
+  if (srfft_ != NULL)  // Do the FFTs of all the frames at once.
+    srfft_->Compute(signal_frames, true);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, t);
+    if (srfft_ == NULL)
+      RealFft(&signal_frame, true);
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames, 0,
+                                     signal_frames->NumCols() / 2 + 1);
+
+  // Use magnitude instead of power if requested.
+  if (!opts_.use_power)
+    power_spectra.ApplyPow(0.5);
+
+  int32 mel_offset = ((opts_.use_energy && !opts_.htk_compat) ? 1 : 0);
+  SubMatrix<BaseFloat> mel_energies(*features, 0, num_frames,
+                                    mel_offset, opts_.mel_opts.num_bins);
+  mel_banks.Compute(power_spectra, &mel_energies);
+  if (opts_.use_log_fbank) {
+    mel_energies.ApplyFloor(std::numeric_limits<float>::epsilon());
+    mel_energies.ApplyLog();
+  }
+
+  if (opts_.use_energy) {
+    int32 energy_index = opts_.htk_compat ? opts_.mel_opts.num_bins : 0;
+    for (int32 t = 0; t < num_frames; t++) {
+      BaseFloat signal_log_energy = signal_log_energies(t);
+      if (opts_.energy_floor > 0.0 && signal_log_energy < log_energy_floor_)
+        signal_log_energy = log_energy_floor_;
+      (*features)(t, energy_index) = signal_log_energy;
+    }
+  }
+}
+
 }  // namespace kaldi
@@ -21,6 +21,8 @@
 #include <iostream>
 
 #include "feat/feature-mfcc.h"
+#include "feat/feature-spectrogram.h"
+#include "feat/feature-test-utils.h"
 #include "base/kaldi-math.h"
 #include "matrix/kaldi-matrix-inl.h"
 #include "feat/wave-reader.h"
@@ -653,6 +655,37 @@ void UnitTestVtln() {
   }
 }
 
+static void UnitTestBatchedCompute() {
+  std::cout << "=== UnitTestBatchedCompute() ===\n";
+  for (int32 i = 0; i < 10; i++) {
+    // Long enough for several batches of frames.
+    Vector<BaseFloat> wave(RandInt(1000, 80000));
+    wave.SetRandn();
+    wave.Scale(1000.0);
+    FrameExtractionOptions frame_opts;
+    frame_opts.dither = 0.0;
+    frame_opts.frame_length_ms = RandInt(20, 30);
+    frame_opts.round_to_power_of_two = (RandInt(0, 1) == 0);
+    frame_opts.snip_edges = (RandInt(0, 1) == 0);
+
+    MfccOptions mfcc_opts;
+    mfcc_opts.frame_opts = frame_opts;
+    mfcc_opts.use_energy = (RandInt(0, 1) == 0);
+    mfcc_opts.raw_energy = (RandInt(0, 1) == 0);
+    mfcc_opts.htk_compat = (RandInt(0, 1) == 0);
+    mfcc_opts.energy_floor = RandInt(0, 1) * 100.0;
+    mfcc_opts.cepstral_lifter = RandInt(0, 1) * 22.0;
+    CheckBatchedCompute<MfccComputer>(mfcc_opts, wave,
+                                      0.9 + 0.2 * RandUniform());
+
+    SpectrogramOptions spectrogram_opts;
+    spectrogram_opts.frame_opts = frame_opts;
+    spectrogram_opts.raw_energy = (RandInt(0, 1) == 0);
+    spectrogram_opts.energy_floor = RandInt(0, 1) * 100.0;
+    CheckBatchedCompute<SpectrogramComputer>(spectrogram_opts, wave, 1.0);
+  }
+}
+
 static void UnitTestFeat() {
   UnitTestVtln();
   UnitTestReadWave();
@@ -666,6 +699,7 @@ static void UnitTestFeat() {
   UnitTestHTKCompare4();
   UnitTestHTKCompare5();
   UnitTestHTKCompare6();
+  UnitTestBatchedCompute();
   std::cout << "Tests succeeded.\n";
 }
 
@@ -79,6 +79,74 @@ void MfccComputer::Compute(BaseFloat signal_log_energy,
   }
 }
 
+void MfccComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_frames->NumCols() ==
+               opts_.frame_opts.PaddedWindowSize() &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim() &&
+               signal_raw_log_energies.Dim() == num_frames);
+  if (num_frames == 0)
+    return;
+
+  const MelBanks &mel_banks = *(GetMelBanks(vtln_warp));
+
+  Vector<BaseFloat> signal_log_energies(signal_raw_log_energies);
+  if (opts_.use_energy && !opts_.raw_energy) {
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> signal_frame(*signal_frames, t);
+      signal_log_energies(t) = Log(std::max<BaseFloat>(
+          VecVec(signal_frame, signal_frame),
+          std::numeric_limits<float>::min()));
+    }
+  }
+
+  if (srfft_ != NULL)  // Do the FFTs of all the frames at once.
+    srfft_->Compute(signal_frames, true);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, t);
+    if (srfft_ == NULL)
+      RealFft(&signal_frame, true);
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames, 0,
+                                     signal_frames->NumCols() / 2 + 1);
+
+  Matrix<BaseFloat> mel_energies(num_frames, opts_.mel_opts.num_bins,
+                                 kUndefined);
+  mel_banks.Compute(power_spectra, &mel_energies);
+  mel_energies.ApplyFloor(std::numeric_limits<float>::epsilon());
+  mel_energies.ApplyLog();
+
+  // features = mel_energies * dct_matrix_^T, i.e. the DCT of each row.
+  features->AddMatMat(1.0, mel_energies, kNoTrans, dct_matrix_, kTrans, 0.0);
+
+  if (opts_.cepstral_lifter != 0.0)
+    features->MulColsVec(lifter_coeffs_);
+
+  for (int32 t = 0; t < num_frames; t++) {
+    BaseFloat *feature = features->RowData(t);
+    if (opts_.use_energy) {
+      BaseFloat signal_log_energy = signal_log_energies(t);
+      if (opts_.energy_floor > 0.0 && signal_log_energy < log_energy_floor_)
+        signal_log_energy = log_energy_floor_;
+      feature[0] = signal_log_energy;
+    }
+    if (opts_.htk_compat) {
+      BaseFloat energy = feature[0];
+      for (int32 i = 0; i < opts_.num_ceps - 1; i++)
+        feature[i] = feature[i + 1];
+      if (!opts_.use_energy)
+        energy *= M_SQRT2;  // See the comment in Compute().
+      feature[opts_.num_ceps - 1] = energy;
+    }
+  }
+}
+
 MfccComputer::MfccComputer(const MfccOptions &opts):
     opts_(opts), srfft_(NULL),
     mel_energies_(opts.mel_opts.num_bins) {
@@ -187,5 +187,22 @@ void PlpComputer::Compute(BaseFloat signal_log_energy,
   }
 }
 
+void PlpComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(features->NumRows() == num_frames &&
+               signal_raw_log_energies.Dim() == num_frames);
+  // The LPC analysis is inherently per-frame, so there is little to gain from
+  // batching here; we just call Compute() on each frame.
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, t),
+        feature(*features, t);
+    Compute(signal_raw_log_energies(t), vtln_warp, &signal_frame, &feature);
+  }
+}
+
 
 }  // namespace kaldi
@@ -138,6 +138,13 @@ class PlpComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// Computes features for many frames at once, which is faster than calling
+  /// Compute() for each one; see ExampleFeatureComputer::ComputeBatch().
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
   ~PlpComputer();
  private:
 
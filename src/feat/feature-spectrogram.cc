@@ -79,4 +79,52 @@ void SpectrogramComputer::Compute(BaseFloat signal_log_energy,
   (*feature)(0) = signal_log_energy;
 }
 
+void SpectrogramComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_frames->NumCols() ==
+               opts_.frame_opts.PaddedWindowSize() &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim() &&
+               signal_raw_log_energies.Dim() == num_frames);
+  if (num_frames == 0)
+    return;
+
+  Vector<BaseFloat> signal_log_energies(signal_raw_log_energies);
+  if (!opts_.raw_energy) {
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> signal_frame(*signal_frames, t);
+      // Compute energy after window function (not the raw one)
+      signal_log_energies(t) = Log(std::max<BaseFloat>(
+          VecVec(signal_frame, signal_frame),
+          std::numeric_limits<float>::epsilon()));
+    }
+  }
+
+  if (srfft_ != NULL)  // Do the FFTs of all the frames at once.
+    srfft_->Compute(signal_frames, true);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, t);
+    if (srfft_ == NULL)
+      RealFft(&signal_frame, true);
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames, 0,
+                                     this->Dim());
+  power_spectra.ApplyFloor(std::numeric_limits<float>::epsilon());
+  power_spectra.ApplyLog();
+  features->CopyFromMat(power_spectra);
+
+  for (int32 t = 0; t < num_frames; t++) {
+    BaseFloat signal_log_energy = signal_log_energies(t);
+    if (opts_.energy_floor > 0.0 && signal_log_energy < log_energy_floor_)
+      signal_log_energy = log_energy_floor_;
+    // As in Compute(), the zeroth component is the signal energy.
+    (*features)(t, 0) = signal_log_energy;
+  }
+}
+
 }  // namespace kaldi
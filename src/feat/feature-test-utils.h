@@ -0,0 +1,56 @@
+// feat/feature-test-utils.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FEAT_FEATURE_TEST_UTILS_H_
+#define KALDI_FEAT_FEATURE_TEST_UTILS_H_
+
+// This header contains things that are shared by the tests in this directory.
+
+#include "feat/feature-common.h"
+#include "feat/feature-window.h"
+#include "matrix/kaldi-matrix.h"
+
+namespace kaldi {
+
+/// Checks that OfflineFeatureTpl<F>, which computes the features in batches of
+/// frames, gives the same output as calling F::Compute() on each frame.
+template <class F>
+void CheckBatchedCompute(const typename F::Options &opts,
+                         const VectorBase<BaseFloat> &wave,
+                         BaseFloat vtln_warp) {
+  OfflineFeatureTpl<F> offline(opts);
+  Matrix<BaseFloat> features;
+  offline.Compute(wave, vtln_warp, &features);
+
+  F computer(opts);
+  FeatureWindowFunction window_function(opts.frame_opts);
+  int32 num_frames = NumFrames(wave.Dim(), opts.frame_opts);
+  Matrix<BaseFloat> ref_features(num_frames, computer.Dim());
+  Vector<BaseFloat> window;
+  for (int32 t = 0; t < num_frames; t++) {
+    BaseFloat raw_log_energy = 0.0;
+    ExtractWindow(0, wave, t, opts.frame_opts, window_function, &window,
+                  (computer.NeedRawLogEnergy() ? &raw_log_energy : NULL));
+    SubVector<BaseFloat> ref_feature(ref_features, t);
+    computer.Compute(raw_log_energy, vtln_warp, &window, &ref_feature);
+  }
+  AssertEqual(features, ref_features, 1.0e-04);
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_FEAT_FEATURE_TEST_UTILS_H_
@@ -30,6 +30,8 @@
 namespace kaldi {
 
 
+const int32 MelBanks::kBinsPerWeightBlock;
+
 MelBanks::MelBanks(const MelBanksOptions &opts,
                    const FrameExtractionOptions &frame_opts,
                    BaseFloat vtln_warp_factor):
@@ -133,6 +135,25 @@ MelBanks::MelBanks(const MelBanksOptions &opts,
       bins_[bin].second(0) = 0.0;
 
   }
+  // The same weights as block-sparse matrices, for the batched Compute().
+  for (int32 first_bin = 0; first_bin < num_bins;
+       first_bin += kBinsPerWeightBlock) {
+    int32 block_bins = std::min(kBinsPerWeightBlock, num_bins - first_bin),
+        first_index = bins_[first_bin].first, end_index = 0;
+    for (int32 bin = first_bin; bin < first_bin + block_bins; bin++) {
+      first_index = std::min(first_index, bins_[bin].first);
+      end_index = std::max(end_index,
+                           bins_[bin].first + bins_[bin].second.Dim());
+    }
+    weight_blocks_.push_back(std::make_pair(first_index, Matrix<BaseFloat>()));
+    Matrix<BaseFloat> &block = weight_blocks_.back().second;
+    block.Resize(block_bins, end_index - first_index);
+    for (int32 i = 0; i < block_bins; i++) {
+      const std::pair<int32, Vector<BaseFloat> > &bin = bins_[first_bin + i];
+      block.Row(i).Range(bin.first - first_index,
+                         bin.second.Dim()).CopyFromVec(bin.second);
+    }
+  }
   if (debug_) {
     for (size_t i = 0; i < bins_.size(); i++) {
       KALDI_LOG << "bin " << i << ", offset = " << bins_[i].first
@@ -144,6 +165,7 @@ MelBanks::MelBanks(const MelBanksOptions &opts,
 MelBanks::MelBanks(const MelBanks &other):
     center_freqs_(other.center_freqs_),
     bins_(other.bins_),
+    weight_blocks_(other.weight_blocks_),
     debug_(other.debug_),
     htk_mode_(other.htk_mode_) { }
 
@@ -250,6 +272,42 @@ void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
   }
 }
 
+void MelBanks::Compute(const MatrixBase<BaseFloat> &power_spectra,
+                       MatrixBase<BaseFloat> *mel_energies_out) const {
+  int32 num_frames = power_spectra.NumRows(), num_bins = bins_.size();
+  KALDI_ASSERT(mel_energies_out->NumRows() == num_frames &&
+               mel_energies_out->NumCols() == num_bins);
+  if (num_frames == 0)
+    return;
+  // Each block of weights is a dense matrix over the FFT bins that its mel
+  // bins cover, so this is a block-sparse times dense matrix product that
+  // skips the (mostly zero) rest of the filterbank.
+  for (size_t b = 0; b < weight_blocks_.size(); b++) {
+    const Matrix<BaseFloat> &block = weight_blocks_[b].second;
+    SubMatrix<BaseFloat> power(power_spectra, 0, num_frames,
+                               weight_blocks_[b].first, block.NumCols()),
+        mel_energies(*mel_energies_out, 0, num_frames,
+                     b * kBinsPerWeightBlock, block.NumRows());
+    mel_energies.AddMatMat(1.0, power, kNoTrans, block, kTrans, 0.0);
+  }
+
+  for (int32 t = 0; t < num_frames; t++) {
+    BaseFloat *mel_energies = mel_energies_out->RowData(t);
+    for (int32 i = 0; i < num_bins; i++) {
+      // HTK-like flooring- for testing purposes (we prefer dither)
+      if (htk_mode_ && mel_energies[i] < 1.0) mel_energies[i] = 1.0;
+      // See the comment in the one-frame version of Compute().
+      KALDI_ASSERT(!KALDI_ISNAN(mel_energies[i]));
+    }
+    if (debug_) {
+      fprintf(stderr, "MEL BANKS:\n");
+      for (int32 i = 0; i < num_bins; i++)
+        fprintf(stderr, " %f", mel_energies[i]);
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
 void ComputeLifterCoeffs(BaseFloat Q, VectorBase<BaseFloat> *coeffs) {
   // Compute liftering coefficients (scaling on cepstral coeffs)
   // coeffs are numbered slightly differently from HTK: the zeroth
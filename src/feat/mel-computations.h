@@ -111,6 +111,13 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                VectorBase<BaseFloat> *mel_energies_out) const;
 
+  /// Batched version of Compute(), for many frames at once: row t of
+  /// "mel_energies_out" is set to the mel energies of row t of
+  /// "power_spectra".  The rows of "power_spectra" are power spectra of
+  /// dimension (padded window size) / 2 + 1, as for the one-frame version.
+  void Compute(const MatrixBase<BaseFloat> &power_spectra,
+               MatrixBase<BaseFloat> *mel_energies_out) const;
+
   int32 NumBins() const { return bins_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
@@ -130,6 +137,13 @@ class MelBanks {
   // (the first nonzero fft-bin), (the vector of weights).
   std::vector<std::pair<int32, Vector<BaseFloat> > > bins_;
 
+  // The same weights as "bins_", grouped into blocks of kBinsPerWeightBlock
+  // consecutive bins, for the batched Compute(): each is a pair of
+  // (the first nonzero fft-bin of the block), (the matrix of weights, with
+  // one row per bin).
+  static const int32 kBinsPerWeightBlock = 8;
+  std::vector<std::pair<int32, Matrix<BaseFloat> > > weight_blocks_;
+
   bool debug_;
   bool htk_mode_;
 };
@@ -31,6 +31,8 @@
 #include "sys/stat.h"
 #include "sys/types.h"
 #include "base/timer.h"
+#include "util/kaldi-thread.h"
+#include "util/stl-utils.h"
 
 
 namespace kaldi {
@@ -593,12 +595,68 @@ void UnitTestProcess() {
   }
 }
 
+// Computes and processes the pitch of one utterance the way
+// compute-and-process-kaldi-pitch-feats does, with the delta-pitch noise
+// seeded from the utterance's key; used with TaskSequencer.
+class PitchTask {
+ public:
+  PitchTask(const std::string &utt, const VectorBase<BaseFloat> &wave,
+            Matrix<BaseFloat> *output):
+      utt_(utt), wave_(wave), output_(output) { }
+  void operator () () {
+    PitchExtractionOptions pitch_opts;
+    ProcessPitchOptions process_opts;
+    RandomState noise_state;
+    noise_state.seed = StringHasher()(utt_);
+    ComputeAndProcessKaldiPitch(pitch_opts, process_opts, wave_, output_,
+                                &noise_state);
+  }
+ private:
+  std::string utt_;
+  const VectorBase<BaseFloat> &wave_;
+  Matrix<BaseFloat> *output_;
+};
+
+// Checks that processing utterances with one thread and with several threads
+// gives exactly the same output, including the delta-pitch noise.
+static void UnitTestThreadedNoise() {
+  KALDI_LOG << "=== UnitTestThreadedNoise() ===";
+  int32 num_utts = 8;
+  std::vector<Vector<BaseFloat> > waves(num_utts);
+  for (int32 u = 0; u < num_utts; u++) {
+    waves[u].Resize(RandInt(2000, 8000));
+    for (int32 i = 0; i < waves[u].Dim(); i++)
+      waves[u](i) = 1000.0 * RandGauss();
+  }
+  std::vector<Matrix<BaseFloat> > outputs[2];
+  for (int32 i = 0; i < 2; i++) {
+    outputs[i].resize(num_utts);
+    TaskSequencerConfig config;
+    config.num_threads = (i == 0 ? 1 : 4);
+    TaskSequencer<PitchTask> sequencer(config);
+    for (int32 u = 0; u < num_utts; u++)
+      sequencer.Run(new PitchTask("utt" + ConvertIntToString(u), waves[u],
+                                  &(outputs[i][u])));
+    sequencer.Wait();
+  }
+  for (int32 u = 0; u < num_utts; u++) {
+    const Matrix<BaseFloat> &a = outputs[0][u], &b = outputs[1][u];
+    KALDI_ASSERT(a.NumRows() > 0 && a.NumRows() == b.NumRows() &&
+                 a.NumCols() == b.NumCols());
+    for (int32 r = 0; r < a.NumRows(); r++)
+      for (int32 c = 0; c < a.NumCols(); c++)
+        KALDI_ASSERT(a(r, c) == b(r, c));
+  }
+  KALDI_LOG << "Test passed :)";
+}
+
 static void UnitTestFeatNoKeele() {
   UnitTestSimple();
   UnitTestPieces();
   UnitTestSnipEdges();
   UnitTestDelay();
   UnitTestSearch();
+  UnitTestThreadedNoise();
 }
 
 static void UnitTestFeatWithKeele() {
@@ -97,7 +97,9 @@ BaseFloat NccfToPov(BaseFloat n) {
    outputs to (*norm_prod)(lag - start), e1 * e2, where
    e1 is the dot-product of the un-shifted window with itself,
    and d2 is the dot-product of the window shifted by "lag"
-   with itself.
+   with itself.  We compute e2 for successive lags as a running sum (in double
+   precision), adding the sample that enters the window and subtracting the one
+   that leaves it, so only the inner products need a dot-product per lag.
  */
 void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
                         int32 first_lag, int32 last_lag,
@@ -109,15 +111,23 @@ void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
   SubVector<BaseFloat> wave_part(wave, 0, nccf_window_size);
   // subtract mean-frame from wave
   zero_mean_wave.Add(-wave_part.Sum() / nccf_window_size);
-  BaseFloat e1, e2, sum;
+  BaseFloat e1;
   SubVector<BaseFloat> sub_vec1(zero_mean_wave, 0, nccf_window_size);
   e1 = VecVec(sub_vec1, sub_vec1);
+  SubVector<BaseFloat> first_vec2(zero_mean_wave, first_lag, nccf_window_size);
+  double e2 = VecVec(first_vec2, first_vec2);
+  const BaseFloat *data = zero_mean_wave.Data();
+  BaseFloat *inner_data = inner_prod->Data(), *norm_data = norm_prod->Data();
   for (int32 lag = first_lag; lag <= last_lag; lag++) {
+    if (lag > first_lag) {
+      double sample_out = data[lag - 1],
+          sample_in = data[lag + nccf_window_size - 1];
+      e2 += sample_in * sample_in - sample_out * sample_out;
+    }
     SubVector<BaseFloat> sub_vec2(zero_mean_wave, lag, nccf_window_size);
-    e2 = VecVec(sub_vec2, sub_vec2);
-    sum = VecVec(sub_vec1, sub_vec2);
-    (*inner_prod)(lag - first_lag) = sum;
-    (*norm_prod)(lag - first_lag) = e1 * e2;
+    inner_data[lag - first_lag] = VecVec(sub_vec1, sub_vec2);
+    // e2 can't really be negative, but the running sum could round below 0.
+    norm_data[lag - first_lag] = e1 * static_cast<BaseFloat>(std::max(e2, 0.0));
   }
 }
 
@@ -662,6 +672,9 @@ class OnlinePitchFeatureImpl {
 
   // This object is used to resample the signal.
   LinearResample *signal_resampler_;
+  // Holds the output of signal_resampler_; we keep it between calls to
+  // AcceptWaveform() so that it is not reallocated for each piece of input.
+  Vector<BaseFloat> downsampled_wave_buffer_;
 
   // frame_info_ is indexed by [frame-index + 1].  frame_info_[0] is an object
   // that corresponds to frame -1, which is not a real frame.
@@ -1050,7 +1063,12 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   // true.
   const bool flush = input_finished_;
 
-  Vector<BaseFloat> downsampled_wave;
+  int32 num_downsampled = signal_resampler_->NumOutputSamples(wave.Dim(),
+                                                              flush);
+  if (downsampled_wave_buffer_.Dim() < num_downsampled)
+    downsampled_wave_buffer_.Resize(num_downsampled, kUndefined);
+  SubVector<BaseFloat> downsampled_wave(downsampled_wave_buffer_, 0,
+                                        num_downsampled);
   signal_resampler_->Resample(wave, flush, &downsampled_wave);
 
   // these variables will be used to compute the root-mean-square value of the
@@ -1397,12 +1415,15 @@ inline void AppendVector(const VectorBase<Real> &src, Vector<Real> *dst) {
 */
 OnlineProcessPitch::OnlineProcessPitch(
     const ProcessPitchOptions &opts,
-    OnlineFeatureInterface *src):
+    OnlineFeatureInterface *src,
+    const RandomState *noise_state):
     opts_(opts), src_(src),
     dim_ ((opts.add_pov_feature ? 1 : 0)
           + (opts.add_normalized_log_pitch ? 1 : 0)
           + (opts.add_delta_pitch ? 1 : 0)
           + (opts.add_raw_log_pitch ? 1 : 0)) {
+  if (noise_state != NULL)
+    noise_state_ = *noise_state;
   KALDI_ASSERT(dim_ > 0 &&
                " At least one of the pitch features should be chosen. "
                "Check your post-process-pitch options.");
@@ -1457,7 +1478,7 @@ BaseFloat OnlineProcessPitch::GetDeltaPitchFeature(int32 frame) {
   delta_opts.window = opts_.delta_window;
   ComputeDeltas(delta_opts, feats, &delta_feats);
   while (delta_feature_noise_.size() <= static_cast<size_t>(frame)) {
-    delta_feature_noise_.push_back(RandGauss() *
+    delta_feature_noise_.push_back(RandGauss(&noise_state_) *
                                    opts_.delta_pitch_noise_stddev);
   }
   // note: delta_feats will have two columns, second contains deltas.
@@ -1580,10 +1601,11 @@ int32 OnlineProcessPitch::NumFramesReady() const {
 
 void ProcessPitch(const ProcessPitchOptions &opts,
                   const MatrixBase<BaseFloat> &input,
-                  Matrix<BaseFloat> *output) {
+                  Matrix<BaseFloat> *output,
+                  const RandomState *noise_state) {
   OnlineMatrixFeature pitch_feat(input);
 
-  OnlineProcessPitch online_process_pitch(opts, &pitch_feat);
+  OnlineProcessPitch online_process_pitch(opts, &pitch_feat, noise_state);
 
   output->Resize(online_process_pitch.NumFramesReady(),
                  online_process_pitch.Dim());
@@ -1598,7 +1620,8 @@ void ComputeAndProcessKaldiPitch(
     const PitchExtractionOptions &pitch_opts,
     const ProcessPitchOptions &process_opts,
     const VectorBase<BaseFloat> &wave,
-    Matrix<BaseFloat> *output) {
+    Matrix<BaseFloat> *output,
+    const RandomState *noise_state) {
 
   OnlinePitchFeature pitch_extractor(pitch_opts);
 
@@ -1608,7 +1631,8 @@ void ComputeAndProcessKaldiPitch(
                  "unless you specify --frames-per-chunk");
   }
 
-  OnlineProcessPitch post_process(process_opts, &pitch_extractor);
+  OnlineProcessPitch post_process(process_opts, &pitch_extractor,
+                                  noise_state);
 
   int32 cur_rows = 100;
   Matrix<BaseFloat> feats(cur_rows, post_process.Dim());
@@ -351,9 +351,14 @@ class OnlineProcessPitch: public OnlineFeatureInterface {
 
   virtual ~OnlineProcessPitch() {  }
 
-  // Does not take ownership of "src".
+  // Does not take ownership of "src".  If "noise_state" is non-NULL, the
+  // delta-pitch noise (see --delta-pitch-noise-stddev) is generated from a
+  // copy of it, so it does not depend on the global random number generator;
+  // this makes the output reproducible when several threads process
+  // utterances at the same time.
   OnlineProcessPitch(const ProcessPitchOptions &opts,
-                     OnlineFeatureInterface *src);
+                     OnlineFeatureInterface *src,
+                     const RandomState *noise_state = NULL);
 
  private:
   enum { kRawFeatureDim = 2};  // anonymous enum to define a constant.
@@ -377,6 +382,7 @@ class OnlineProcessPitch: public OnlineFeatureInterface {
   };
 
   std::vector<BaseFloat> delta_feature_noise_;
+  RandomState noise_state_;  // Generates delta_feature_noise_.
 
   std::vector<NormalizationStats> normalization_stats_;
 
@@ -427,10 +433,12 @@ void ComputeKaldiPitch(const PitchExtractionOptions &opts,
 /// requested (by default, 3; 4 is the max).  The four config variables
 /// --add-pov-feature, --add-normalized-log-pitch, --add-delta-pitch,
 /// --add-raw-log-pitch determine which features we create; by default we create
-/// the first three.
+/// the first three.  "noise_state" is as for the constructor of
+/// OnlineProcessPitch.
 void ProcessPitch(const ProcessPitchOptions &opts,
                   const MatrixBase<BaseFloat> &input,
-                  Matrix<BaseFloat> *output);
+                  Matrix<BaseFloat> *output,
+                  const RandomState *noise_state = NULL);
 
 /// This function combines ComputeKaldiPitch and ProcessPitch.  The reason
 /// why we need a separate function to do this is in order to be able to
@@ -438,11 +446,13 @@ void ProcessPitch(const ProcessPitchOptions &opts,
 /// training models matched to the "first-pass" features.  It is sensitive to
 /// the variables in pitch_opts that relate to online processing,
 /// i.e. max_frames_latency, frames_per_chunk, simulate_first_pass_online,
-/// recompute_frame.
+/// recompute_frame.  "noise_state" is as for the constructor of
+/// OnlineProcessPitch.
 void ComputeAndProcessKaldiPitch(const PitchExtractionOptions &pitch_opts,
                                  const ProcessPitchOptions &process_opts,
                                  const VectorBase<BaseFloat> &wave,
-                                 Matrix<BaseFloat> *output);
+                                 Matrix<BaseFloat> *output,
+                                 const RandomState *noise_state = NULL);
 
 
 /// @} End of "addtogroup feat"
@@ -275,6 +275,60 @@ void UnitTestLinearResample2() {
   AssertEqual(self1, cross, 0.001);
 }
 
+// Checks that resampling a signal in pieces with the version of
+// LinearResample::Resample() that writes to a fixed-size buffer gives the same
+// output as resampling it all at once.
+void UnitTestLinearResampleStreaming() {
+  int32 rates[] = { 8000, 16000, 22050, 44100, 48000 };
+  int32 samp_rate_in = rates[RandInt(0, 4)],
+      samp_rate_out = rates[RandInt(0, 4)];
+  BaseFloat cutoff = 0.99 * 0.5 * std::min(samp_rate_in, samp_rate_out);
+  LinearResample resampler(samp_rate_in, samp_rate_out, cutoff,
+                           RandInt(1, 8));
+  Vector<BaseFloat> signal(RandInt(0, 10000)), output_whole;
+  signal.SetRandn();
+  resampler.Resample(signal, true, &output_whole);
+
+  Vector<BaseFloat> output_buffer(20000), output_pieces(output_whole.Dim());
+  int32 input_offset = 0, output_offset = 0;
+  while (true) {
+    int32 piece_dim = std::min(RandInt(0, 2000), signal.Dim() - input_offset);
+    bool flush = (input_offset + piece_dim == signal.Dim() && WithProb(0.5));
+    SubVector<BaseFloat> piece(signal, input_offset, piece_dim),
+        output(output_buffer, 0, resampler.NumOutputSamples(piece_dim, flush));
+    resampler.Resample(piece, flush, &output);
+    output_pieces.Range(output_offset, output.Dim()).CopyFromVec(output);
+    input_offset += piece_dim;
+    output_offset += output.Dim();
+    if (flush)
+      break;
+  }
+  KALDI_ASSERT(output_offset == output_whole.Dim());
+  AssertEqual(output_whole, output_pieces, 1.0e-04);
+}
+
+// Checks that the matrix version of ArbitraryResample::Resample() (which is a
+// matrix multiplication for short inputs) agrees with the vector version.
+void UnitTestArbitraryResampleMatrix() {
+  BaseFloat samp_freq = 4000.0;
+  int32 num_samp = (rand() % 2 == 0 ? RandInt(10, 100) : RandInt(600, 800)),
+      num_resamp = RandInt(1, 300), num_rows = RandInt(1, 20);
+  Vector<BaseFloat> resample_points(num_resamp);
+  for (int32 i = 0; i < num_resamp; i++)
+    resample_points(i) = RandUniform() * num_samp / samp_freq;
+  ArbitraryResample resampler(num_samp, samp_freq, 1000.0, resample_points,
+                              RandInt(1, 5));
+  Matrix<BaseFloat> input(num_rows, num_samp), output(num_rows, num_resamp),
+      output2(num_rows, num_resamp);
+  input.SetRandn();
+  resampler.Resample(input, &output);
+  for (int32 r = 0; r < num_rows; r++) {
+    SubVector<BaseFloat> output2_row(output2, r);
+    resampler.Resample(input.Row(r), &output2_row);
+  }
+  AssertEqual(output, output2, 1.0e-04);
+}
+
 int main() {
   try {
     for (int32 x = 0; x < 50; x++)
@@ -283,6 +337,10 @@ int main() {
       UnitTestLinearResample2();    
     for (int32 x = 0; x < 50; x++)
       UnitTestArbitraryResample();
+    for (int32 x = 0; x < 50; x++)
+      UnitTestArbitraryResampleMatrix();
+    for (int32 x = 0; x < 50; x++)
+      UnitTestLinearResampleStreaming();
 
     KALDI_LOG << "Tests succeeded.\n";
     return 0;
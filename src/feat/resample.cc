@@ -22,8 +22,10 @@
 
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include "feat/feature-functions.h"
+#include "matrix/kaldi-simd.h"
 #include "matrix/matrix-functions.h"
 #include "feat/resample.h"
 
@@ -103,7 +105,7 @@ int64 LinearResample::GetNumOutputSamples(int64 input_num_samp,
 
 void LinearResample::SetIndexesAndWeights() {
   first_index_.resize(output_samples_in_unit_);
-  weights_.resize(output_samples_in_unit_);
+  std::vector<int32> num_indices(output_samples_in_unit_);
 
   double window_width = num_zeros_ / (2.0 * filter_cutoff_);
 
@@ -118,16 +120,26 @@ void LinearResample::SetIndexesAndWeights() {
     // that we unnecessarily include something with a zero coefficient,
     // but this is only a slight efficiency issue.
     int32 min_input_index = ceil(min_t * samp_rate_in_),
-        max_input_index = floor(max_t * samp_rate_in_),
-        num_indices = max_input_index - min_input_index + 1;
+        max_input_index = floor(max_t * samp_rate_in_);
     first_index_[i] = min_input_index;
-    weights_[i].Resize(num_indices);
-    for (int32 j = 0; j < num_indices; j++) {
-      int32 input_index = min_input_index + j;
+    num_indices[i] = max_input_index - min_input_index + 1;
+  }
+  // All the filters get the same number of taps, a multiple of
+  // kTapsMultiple, so the inner products have no loop remainder; the extra
+  // taps have zero weight.
+  int32 max_num_indices = *std::max_element(num_indices.begin(),
+                                            num_indices.end());
+  num_taps_ = kTapsMultiple * ((max_num_indices + kTapsMultiple - 1) /
+                               kTapsMultiple);
+  filter_bank_.Resize(output_samples_in_unit_, num_taps_);
+  for (int32 i = 0; i < output_samples_in_unit_; i++) {
+    double output_t = i / static_cast<double>(samp_rate_out_);
+    for (int32 j = 0; j < num_indices[i]; j++) {
+      int32 input_index = first_index_[i] + j;
       double input_t = input_index / static_cast<double>(samp_rate_in_),
           delta_t = input_t - output_t;
       // sign of delta_t doesn't matter.
-      weights_[i](j) = FilterFunc(delta_t) / samp_rate_in_;
+      filter_bank_(i, j) = FilterFunc(delta_t) / samp_rate_in_;
     }
   }
 }
@@ -149,68 +161,208 @@ void LinearResample::GetIndexes(int64 samp_out,
 }
 
 
+namespace {
+
+// The polyphase filter bank of a LinearResample object, as needed by the
+// ApplyFilterBank*() functions below.  Output sample k of a call (counting
+// from zero) uses filter (first_phase + k) % num_phases, and we advance the
+// input by input_step samples each time the phase wraps round to zero.
+struct FilterBankInfo {
+  const BaseFloat *filters;  // row i is the filter for phase i.
+  int32 stride;              // row stride of "filters".
+  int32 num_taps;            // a multiple of LinearResample::kTapsMultiple.
+  int32 num_phases;
+  const int32 *first_index;  // first input index for each phase.
+  int32 input_step;
+};
+
+// Sets output[k] to the inner product of the filter for output sample k with
+// the input starting at input + input_offset + info.first_index[phase] (see
+// FilterBankInfo), for 0 <= k < num_output.
+void ApplyFilterBankScalar(const FilterBankInfo &info, int32 phase,
+                           int64 input_offset, const BaseFloat *input,
+                           int32 num_output, BaseFloat *output) {
+  for (int32 k = 0; k < num_output; k++) {
+    const BaseFloat *filter = info.filters + phase * info.stride,
+        *x = input + input_offset + info.first_index[phase];
+    BaseFloat sum = 0.0;
+    for (int32 j = 0; j < info.num_taps; j++)
+      sum += filter[j] * x[j];
+    output[k] = sum;
+    if (++phase == info.num_phases) {
+      phase = 0;
+      input_offset += info.input_step;
+    }
+  }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// As in matrix/srfft.cc, the vector code is written with GCC vector types
+// and force-inlined into entry points that have target attributes, and we
+// choose between them at runtime.  The entry points call ClearAvxUpperState()
+// before returning.
+#define KALDI_RESAMPLE_SIMD 1
+
+// V is a vector of BaseFloat and M a vector of integers of the same size
+// (used to shuffle V).
+template<typename V, typename M>
+inline __attribute__((always_inline))
+void ApplyFilterBankGeneric(const FilterBankInfo &info, int32 phase,
+                            int64 input_offset, const BaseFloat *input,
+                            int32 num_output, BaseFloat *output) {
+  const int32 lanes = sizeof(V) / sizeof(BaseFloat);
+  // rotate[i] rotates a vector by lanes / 2^(i+1) positions; we use them to
+  // add up the lanes in log2(lanes) steps.
+  M rotate[8];
+  int32 num_rotations = 0;
+  for (int32 shift = lanes / 2; shift >= 1; shift /= 2, num_rotations++)
+    for (int32 l = 0; l < lanes; l++)
+      rotate[num_rotations][l] = (l + shift) % lanes;
+  // Copy these to local variables, or the compiler has to reload them after
+  // each store to "output".
+  const BaseFloat *filters = info.filters;
+  const int32 *first_index = info.first_index;
+  const int32 stride = info.stride, num_taps = info.num_taps,
+      num_phases = info.num_phases, input_step = info.input_step;
+  for (int32 k = 0; k < num_output; k++) {
+    const BaseFloat *filter = filters + phase * stride,
+        *x = input + input_offset + first_index[phase];
+    V sum = V();
+    for (int32 j = 0; j < num_taps; j += lanes) {
+      V f, v;  // memcpy() is how we do unaligned loads with vector types.
+      memcpy(&f, filter + j, sizeof(V));
+      memcpy(&v, x + j, sizeof(V));
+      sum += f * v;
+    }
+    for (int32 r = 0; r < num_rotations; r++)
+      sum += __builtin_shuffle(sum, rotate[r]);
+    output[k] = sum[0];
+    if (++phase == num_phases) {
+      phase = 0;
+      input_offset += input_step;
+    }
+  }
+}
+
+typedef BaseFloat Avx2Vector __attribute__((vector_size(32)));
+typedef BaseFloat Avx512Vector __attribute__((vector_size(64)));
+#if KALDI_DOUBLEPRECISION != 0
+typedef int64 Avx2Mask __attribute__((vector_size(32)));
+typedef int64 Avx512Mask __attribute__((vector_size(64)));
+#else
+typedef int32 Avx2Mask __attribute__((vector_size(32)));
+typedef int32 Avx512Mask __attribute__((vector_size(64)));
+#endif
+
+__attribute__((target("avx2")))
+void ApplyFilterBankAvx2(const FilterBankInfo &info, int32 phase,
+                         int64 input_offset, const BaseFloat *input,
+                         int32 num_output, BaseFloat *output) {
+  ApplyFilterBankGeneric<Avx2Vector, Avx2Mask>(info, phase, input_offset,
+                                               input, num_output, output);
+  ClearAvxUpperState();
+}
+
+__attribute__((target("avx512f")))
+void ApplyFilterBankAvx512(const FilterBankInfo &info, int32 phase,
+                           int64 input_offset, const BaseFloat *input,
+                           int32 num_output, BaseFloat *output) {
+  ApplyFilterBankGeneric<Avx512Vector, Avx512Mask>(info, phase, input_offset,
+                                                   input, num_output, output);
+  ClearAvxUpperState();
+}
+#endif  // defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+typedef void (*ApplyFilterBankFunc)(const FilterBankInfo &info, int32 phase,
+                                    int64 input_offset, const BaseFloat *input,
+                                    int32 num_output, BaseFloat *output);
+
+ApplyFilterBankFunc BestApplyFilterBank() {
+#ifdef KALDI_RESAMPLE_SIMD
+  if (__builtin_cpu_supports("avx512f")) return ApplyFilterBankAvx512;
+  if (__builtin_cpu_supports("avx2")) return ApplyFilterBankAvx2;
+#endif
+  return ApplyFilterBankScalar;
+}
+
+}  // namespace
+
+
+int32 LinearResample::NumOutputSamples(int32 input_dim, bool flush) const {
+  int64 tot_output_samp = GetNumOutputSamples(input_sample_offset_ + input_dim,
+                                              flush);
+  KALDI_ASSERT(tot_output_samp >= output_sample_offset_);
+  return static_cast<int32>(tot_output_samp - output_sample_offset_);
+}
+
 void LinearResample::Resample(const VectorBase<BaseFloat> &input,
                               bool flush,
                               Vector<BaseFloat> *output) {
-  int32 input_dim = input.Dim();
-  int64 tot_input_samp = input_sample_offset_ + input_dim,
-      tot_output_samp = GetNumOutputSamples(tot_input_samp, flush);
-
-  KALDI_ASSERT(tot_output_samp >= output_sample_offset_);
+  output->Resize(NumOutputSamples(input.Dim(), flush), kUndefined);
+  Resample(input, flush, static_cast<VectorBase<BaseFloat>*>(output));
+}
 
-  output->Resize(tot_output_samp - output_sample_offset_);
-
-  // samp_out is the index into the total output signal, not just the part
-  // of it we are producing here.
-  for (int64 samp_out = output_sample_offset_;
-       samp_out < tot_output_samp;
-       samp_out++) {
-    int64 first_samp_in;
-    int32 samp_out_wrapped;
-    GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
-    const Vector<BaseFloat> &weights = weights_[samp_out_wrapped];
-    // first_input_index is the first index into "input" that we have a weight
-    // for.
-    int32 first_input_index = static_cast<int32>(first_samp_in -
-                                                 input_sample_offset_);
-    BaseFloat this_output;
-    if (first_input_index >= 0 &&
-        first_input_index + weights.Dim() <= input_dim) {
-      SubVector<BaseFloat> input_part(input, first_input_index, weights.Dim());
-      this_output = VecVec(input_part, weights);
-    } else {  // Handle edge cases.
-      this_output = 0.0;
-      for (int32 i = 0; i < weights.Dim(); i++) {
-        BaseFloat weight = weights(i);
-        int32 input_index = first_input_index + i;
-        if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
-          this_output += weight *
-              input_remainder_(input_remainder_.Dim() + input_index);
-        } else if (input_index >= 0 && input_index < input_dim) {
-          this_output += weight * input(input_index);
-        } else if (input_index >= input_dim) {
-          // We're past the end of the input and are adding zero; should only
-          // happen if the user specified flush == true, or else we would not
-          // be trying to output this sample.
-          KALDI_ASSERT(flush);
-        }
-      }
-    }
-    int32 output_index = static_cast<int32>(samp_out - output_sample_offset_);
-    (*output)(output_index) = this_output;
+void LinearResample::Resample(const VectorBase<BaseFloat> &input,
+                              bool flush,
+                              VectorBase<BaseFloat> *output) {
+  int32 input_dim = input.Dim(), num_output = output->Dim();
+  KALDI_ASSERT(num_output == NumOutputSamples(input_dim, flush));
+
+  // buffer_ holds the remainder of the previous input (zero at the start of
+  // the signal), then "input", then num_taps_ zeros, which are the input past
+  // the end of the signal if we are flushing and are otherwise multiplied by
+  // zero weights.  This way each output sample is a plain inner product.
+  int32 remainder_dim = input_remainder_.Dim(),
+      buffer_dim = remainder_dim + input_dim + num_taps_;
+  buffer_.resize(buffer_dim);  // does not reallocate once it is large enough.
+  BaseFloat *buffer = &(buffer_[0]);
+  if (remainder_dim > 0)
+    memcpy(buffer, input_remainder_.Data(), remainder_dim * sizeof(BaseFloat));
+  if (input_dim > 0)
+    memcpy(buffer + remainder_dim, input.Data(),
+           input_dim * sizeof(BaseFloat));
+  std::fill(buffer + remainder_dim + input_dim, buffer + buffer_dim,
+            static_cast<BaseFloat>(0.0));
+
+  if (num_output > 0) {
+    // The input sample index corresponding to buffer[0].
+    int64 buffer_start = input_sample_offset_ - remainder_dim;
+    int64 first_samp_in, last_samp_in;
+    int32 phase, last_phase;
+    GetIndexes(output_sample_offset_, &first_samp_in, &phase);
+    GetIndexes(output_sample_offset_ + num_output - 1, &last_samp_in,
+               &last_phase);
+    // The remainder is long enough that this never fails.
+    KALDI_ASSERT(first_samp_in >= buffer_start &&
+                 last_samp_in + num_taps_ <= buffer_start + buffer_dim);
+    FilterBankInfo info;
+    info.filters = filter_bank_.Data();
+    info.stride = filter_bank_.Stride();
+    info.num_taps = num_taps_;
+    info.num_phases = output_samples_in_unit_;
+    info.first_index = &(first_index_[0]);
+    info.input_step = input_samples_in_unit_;
+    static const ApplyFilterBankFunc apply_filter_bank = BestApplyFilterBank();
+    apply_filter_bank(info, phase,
+                      first_samp_in - first_index_[phase] - buffer_start,
+                      buffer, num_output, output->Data());
   }
 
   if (flush) {
     Reset();  // Reset the internal state.
   } else {
-    SetRemainder(input);
-    input_sample_offset_ = tot_input_samp;
-    output_sample_offset_ = tot_output_samp;
+    // The new remainder is the last remainder_dim samples of the signal so
+    // far, which are just before the zeros in buffer_.
+    memcpy(input_remainder_.Data(), buffer + input_dim,
+           remainder_dim * sizeof(BaseFloat));
+    input_sample_offset_ += input_dim;
+    output_sample_offset_ += num_output;
   }
 }
 
-void LinearResample::SetRemainder(const VectorBase<BaseFloat> &input) {
-  Vector<BaseFloat> old_remainder(input_remainder_);
+void LinearResample::Reset() {
+  input_sample_offset_ = 0;
+  output_sample_offset_ = 0;
   // max_remainder_needed is the width of the filter from side to side,
   // measured in input samples.  you might think it should be half that,
   // but you have to consider that you might be wanting to output samples
@@ -218,24 +370,8 @@ void LinearResample::SetRemainder(const VectorBase<BaseFloat> &input) {
   // input... anyway, storing more remainder than needed is not harmful.
   int32 max_remainder_needed = ceil(samp_rate_in_ * num_zeros_ /
                                     filter_cutoff_);
+  // This zeroes the remainder; it only allocates the first time.
   input_remainder_.Resize(max_remainder_needed);
-  for (int32 index = - input_remainder_.Dim(); index < 0; index++) {
-    // we interpret "index" as an offset from the end of "input" and
-    // from the end of input_remainder_.
-    int32 input_index = index + input.Dim();
-    if (input_index >= 0)
-      input_remainder_(index + input_remainder_.Dim()) = input(input_index);
-    else if (input_index + old_remainder.Dim() >= 0)
-      input_remainder_(index + input_remainder_.Dim()) =
-          old_remainder(input_index + old_remainder.Dim());
-    // else leave it at zero.
-  }
-}
-
-void LinearResample::Reset() {
-  input_sample_offset_ = 0;
-  output_sample_offset_ = 0;
-  input_remainder_.Resize(0);
 }
 
 /** Here, t is a time in seconds representing an offset from
@@ -286,6 +422,10 @@ void ArbitraryResample::Resample(const MatrixBase<BaseFloat> &input,
                input.NumCols() == num_samples_in_ &&
                output->NumCols() == weights_.size());
 
+  if (dense_weights_.NumRows() != 0) {
+    output->AddMatMat(1.0, input, kNoTrans, dense_weights_, kNoTrans, 0.0);
+    return;
+  }
   Vector<BaseFloat> output_col(output->NumRows());
   for (int32 i = 0; i < NumSamplesOut(); i++) {
     SubMatrix<BaseFloat> input_part(input, 0, input.NumRows(),
@@ -343,6 +483,16 @@ void ArbitraryResample::SetWeights(const Vector<BaseFloat> &sample_points) {
       weights_[i](j) = FilterFunc(delta_t) / samp_rate_in_;
     }
   }
+  // If the input is short (as when we resample the NCCF in the pitch code),
+  // the matrix version of Resample() is much faster as one matrix
+  // multiplication by the (mostly zero) dense weight matrix than as a loop
+  // over the output samples.
+  if (num_samples_in_ <= kMaxDenseSamplesIn) {
+    dense_weights_.Resize(num_samples_in_, num_samples_out);
+    for (int32 i = 0; i < num_samples_out; i++)
+      for (int32 j = 0; j < weights_[i].Dim(); j++)
+        dense_weights_(first_index_[i] + j, i) = weights_[i](j);
+  }
 }
 
 /** Here, t is a time in seconds representing an offset from
@@ -131,6 +131,13 @@ class ArbitraryResample {
   std::vector<int32> first_index_;  // The first input-sample index that we sum
                                     // over, for this output-sample index.
   std::vector<Vector<BaseFloat> > weights_;
+
+  // If num_samples_in_ <= kMaxDenseSamplesIn, dense_weights_ is weights_ as a
+  // matrix of dimension num_samples_in_ by NumSamplesOut(), so the matrix
+  // version of Resample() is a single matrix multiplication; otherwise it is
+  // empty.
+  static const int32 kMaxDenseSamplesIn = 512;
+  Matrix<BaseFloat> dense_weights_;
 };
 
 
@@ -178,6 +185,20 @@ class LinearResample {
                 bool flush,
                 Vector<BaseFloat> *output);
 
+  /// This version of Resample() is the same as the one above, except that
+  /// "output" must already have the right dimension, which is
+  /// NumOutputSamples(input.Dim(), flush).  It is intended for streaming use:
+  /// once the object has seen a piece of input at least as long as the
+  /// current one, it does not allocate any memory.
+  void Resample(const VectorBase<BaseFloat> &input,
+                bool flush,
+                VectorBase<BaseFloat> *output);
+
+  /// Returns the number of output samples the next call to Resample() will
+  /// produce, if it is called with "input_dim" samples of input and this
+  /// value of "flush".
+  int32 NumOutputSamples(int32 input_dim, bool flush) const;
+
   /// Calling the function Reset() resets the state of the object prior to
   /// processing a new signal; it is only necessary if you have called
   /// Resample(x, y, false) for some signal, leading to a remainder of the
@@ -205,8 +226,6 @@ class LinearResample {
                          int64 *first_samp_in,
                          int32 *samp_out_wrapped) const;
 
-  void SetRemainder(const VectorBase<BaseFloat> &input);
-
   void SetIndexesAndWeights();
 
   BaseFloat FilterFunc(BaseFloat) const;
@@ -233,8 +252,14 @@ class LinearResample {
   /// extrapolate the correct input-sample index for arbitrary output samples.
   std::vector<int32> first_index_;
 
-  /// Weights on the input samples, for this output-sample index.
-  std::vector<Vector<BaseFloat> > weights_;
+  /// The polyphase filter bank: row i contains the weights on the input
+  /// samples for output-sample index i, starting from input sample
+  /// first_index_[i].  All rows have num_taps_ weights, a multiple of
+  /// kTapsMultiple (the filters are padded with zeros), which makes it easier
+  /// to compute the inner products with SIMD instructions.
+  Matrix<BaseFloat> filter_bank_;
+  int32 num_taps_;
+  static const int32 kTapsMultiple = 64 / sizeof(BaseFloat);
 
   // the following variables keep track of where we are in a particular signal,
   // if it is being provided over multiple calls to Resample().
@@ -245,7 +270,9 @@ class LinearResample {
   int64 output_sample_offset_;  ///< The number of samples we have already
                                 ///< output for this signal.
   Vector<BaseFloat> input_remainder_;  ///< A small trailing part of the
-                                       ///< previously seen input signal.
+                                       ///< previously seen input signal
+                                       ///< (zero-padded at the start).
+  std::vector<BaseFloat> buffer_;  ///< Working space for Resample().
 };
 
 /// Downsample a waveform. This is a convenience wrapper for the
@@ -55,7 +55,8 @@ void FFTbasedConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFloat>
   int32 fft_length = RoundUpToNearestPowerOfTwo(output_length);
   KALDI_VLOG(1) << "fft_length for full signal convolution is " << fft_length;
 
-  SplitRadixRealFft<BaseFloat> srfft(fft_length);
+  SplitRadixRealFft<BaseFloat> &srfft =
+      ThreadLocalSplitRadixRealFft<BaseFloat>(fft_length);
 
   Vector<BaseFloat> filter_padded(fft_length);
   filter_padded.Range(0, filter_length).CopyFromVec(filter);
@@ -87,7 +88,8 @@ void FFTbasedBlockConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFl
 
   int32 block_length = fft_length - filter_length + 1;
   KALDI_VLOG(1) << "Block size is " << block_length;
-  SplitRadixRealFft<BaseFloat> srfft(fft_length);
+  SplitRadixRealFft<BaseFloat> &srfft =
+      ThreadLocalSplitRadixRealFft<BaseFloat>(fft_length);
 
   Vector<BaseFloat> filter_padded(fft_length);
   filter_padded.Range(0, filter_length).CopyFromVec(filter);
@@ -0,0 +1,404 @@
+// featbin/apply-feat-pipeline.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/feature-functions.h"
+#include "transform/cmvn.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// One stage of the feature pipeline.  Prepare() is called from the thread that
+// reads the features, in the order of the input, so it may use
+// RandomAccessTableReaders; Apply() is called from the worker threads, so it
+// must not change the stage.
+class FeatureStage {
+ public:
+  // Looks up anything this stage needs for utterance "utt" (e.g. its CMVN
+  // stats) and puts it in "utt_data", which may be left empty.  Returns false,
+  // after printing a warning, if this utterance cannot be processed.
+  virtual bool Prepare(const std::string &utt, Matrix<double> *utt_data) {
+    return true;
+  }
+  // Applies this stage to "feats"; "utt_data" is as set by Prepare().  Throws
+  // on error.
+  virtual void Apply(const std::string &utt, const Matrix<double> &utt_data,
+                     Matrix<BaseFloat> *feats) const = 0;
+  virtual ~FeatureStage() { }
+};
+
+// As apply-cmvn.
+class CmvnStage: public FeatureStage {
+ public:
+  CmvnStage(const std::string &cmvn_rspecifier_or_rxfilename,
+            const std::string &utt2spk_rspecifier,
+            const std::vector<int32> &skip_dims, bool norm_vars):
+      skip_dims_(skip_dims), norm_vars_(norm_vars) {
+    if (ClassifyRspecifier(cmvn_rspecifier_or_rxfilename, NULL, NULL) ==
+        kNoRspecifier) {
+      if (utt2spk_rspecifier != "")
+        KALDI_ERR << "--utt2spk option not compatible with rxfilename as "
+                  << "--cmvn-stats (did you forget ark:?)";
+      ReadKaldiObject(cmvn_rspecifier_or_rxfilename, &global_stats_);
+      if (!skip_dims_.empty())
+        FakeStatsForSomeDims(skip_dims_, &global_stats_);
+    } else if (!cmvn_reader_.Open(cmvn_rspecifier_or_rxfilename,
+                                  utt2spk_rspecifier)) {
+      KALDI_ERR << "Problem opening CMVN stats with rspecifier "
+                << '"' << cmvn_rspecifier_or_rxfilename << '"'
+                << " and utt2spk rspecifier "
+                << '"' << utt2spk_rspecifier << '"';
+    }
+  }
+  virtual bool Prepare(const std::string &utt, Matrix<double> *utt_data) {
+    if (!cmvn_reader_.IsOpen())
+      return true;
+    if (!cmvn_reader_.HasKey(utt)) {
+      KALDI_WARN << "No normalization statistics available for key "
+                 << utt << ", producing no output for this utterance";
+      return false;
+    }
+    *utt_data = cmvn_reader_.Value(utt);
+    if (!skip_dims_.empty())
+      FakeStatsForSomeDims(skip_dims_, utt_data);
+    return true;
+  }
+  virtual void Apply(const std::string &utt, const Matrix<double> &utt_data,
+                     Matrix<BaseFloat> *feats) const {
+    ApplyCmvn(cmvn_reader_.IsOpen() ? utt_data : global_stats_, norm_vars_,
+              feats);
+  }
+ private:
+  RandomAccessDoubleMatrixReaderMapped cmvn_reader_;
+  Matrix<double> global_stats_;
+  std::vector<int32> skip_dims_;
+  bool norm_vars_;
+};
+
+// As add-deltas.
+class DeltasStage: public FeatureStage {
+ public:
+  explicit DeltasStage(const DeltaFeaturesOptions &opts): opts_(opts) { }
+  virtual void Apply(const std::string &utt, const Matrix<double> &utt_data,
+                     Matrix<BaseFloat> *feats) const {
+    Matrix<BaseFloat> new_feats;
+    ComputeDeltas(opts_, *feats, &new_feats);
+    feats->Swap(&new_feats);
+  }
+ private:
+  DeltaFeaturesOptions opts_;
+};
+
+// As splice-feats.
+class SpliceStage: public FeatureStage {
+ public:
+  SpliceStage(int32 left_context, int32 right_context):
+      left_context_(left_context), right_context_(right_context) { }
+  virtual void Apply(const std::string &utt, const Matrix<double> &utt_data,
+                     Matrix<BaseFloat> *feats) const {
+    Matrix<BaseFloat> spliced;
+    SpliceFrames(*feats, left_context_, right_context_, &spliced);
+    feats->Swap(&spliced);
+  }
+ private:
+  int32 left_context_;
+  int32 right_context_;
+};
+
+// As transform-feats: the transform is linear if it has as many columns as
+// the features have dimensions, or affine if it has one more.
+class TransformStage: public FeatureStage {
+ public:
+  TransformStage(const std::string &transform_rspecifier_or_rxfilename,
+                 const std::string &utt2spk_rspecifier) {
+    if (ClassifyRspecifier(transform_rspecifier_or_rxfilename, NULL, NULL) ==
+        kNoRspecifier) {
+      ReadKaldiObject(transform_rspecifier_or_rxfilename, &global_transform_);
+    } else if (!transform_reader_.Open(transform_rspecifier_or_rxfilename,
+                                       utt2spk_rspecifier)) {
+      KALDI_ERR << "Problem opening transforms with rspecifier "
+                << '"' << transform_rspecifier_or_rxfilename << '"'
+                << " and utt2spk rspecifier "
+                << '"' << utt2spk_rspecifier << '"';
+    }
+  }
+  virtual bool Prepare(const std::string &utt, Matrix<double> *utt_data) {
+    if (!transform_reader_.IsOpen())
+      return true;
+    if (!transform_reader_.HasKey(utt)) {
+      KALDI_WARN << "No transform available for utterance "
+                 << utt << ", producing no output for this utterance";
+      return false;
+    }
+    const Matrix<BaseFloat> &trans = transform_reader_.Value(utt);
+    utt_data->Resize(trans.NumRows(), trans.NumCols(), kUndefined);
+    utt_data->CopyFromMat(trans);
+    return true;
+  }
+  virtual void Apply(const std::string &utt, const Matrix<double> &utt_data,
+                     Matrix<BaseFloat> *feats) const {
+    if (!transform_reader_.IsOpen())
+      ApplyTransform(utt, global_transform_, feats);
+    else
+      ApplyTransform(utt, Matrix<BaseFloat>(utt_data), feats);
+  }
+ private:
+  static void ApplyTransform(const std::string &utt,
+                             const Matrix<BaseFloat> &trans,
+                             Matrix<BaseFloat> *feats) {
+    int32 transform_rows = trans.NumRows(),
+        transform_cols = trans.NumCols(),
+        feat_dim = feats->NumCols();
+    Matrix<BaseFloat> feat_out(feats->NumRows(), transform_rows,
+                               kUndefined);
+    if (transform_cols == feat_dim) {
+      feat_out.AddMatMat(1.0, *feats, kNoTrans, trans, kTrans, 0.0);
+    } else if (transform_cols == feat_dim + 1) {
+      // append the implicit 1.0 to the input features.
+      SubMatrix<BaseFloat> linear_part(trans, 0, transform_rows, 0, feat_dim);
+      feat_out.AddMatMat(1.0, *feats, kNoTrans, linear_part, kTrans, 0.0);
+      Vector<BaseFloat> offset(transform_rows);
+      offset.CopyColFromMat(trans, feat_dim);
+      feat_out.AddVecToRows(1.0, offset);
+    } else {
+      KALDI_ERR << "Transform matrix for utterance " << utt
+                << " has bad dimension " << transform_rows << "x"
+                << transform_cols << " versus feat dim " << feat_dim;
+    }
+    feats->Swap(&feat_out);
+  }
+
+  RandomAccessBaseFloatMatrixReaderMapped transform_reader_;
+  Matrix<BaseFloat> global_transform_;
+};
+
+// As subsample-feats.
+class SubsampleStage: public FeatureStage {
+ public:
+  SubsampleStage(int32 n, int32 offset): n_(n), offset_(offset) {
+    if (n == 0 || (n < 0 && offset != 0))
+      KALDI_ERR << "Bad --subsample-n=" << n << " and --subsample-offset="
+                << offset << " (with negative n, offset must be zero)";
+  }
+  virtual void Apply(const std::string &utt, const Matrix<double> &utt_data,
+                     Matrix<BaseFloat> *feats) const {
+    int32 num_indexes;
+    if (n_ > 0)
+      num_indexes = (feats->NumRows() > offset_ ?
+                     (feats->NumRows() - offset_ + n_ - 1) / n_ : 0);
+    else
+      num_indexes = feats->NumRows() * -n_;
+    if (num_indexes == 0)
+      KALDI_ERR << "For utterance " << utt << ", output would have no rows";
+    Matrix<BaseFloat> output(num_indexes, feats->NumCols(), kUndefined);
+    for (int32 i = 0; i < num_indexes; i++) {
+      int32 k = (n_ > 0 ? offset_ + i * n_ : i / -n_);
+      output.Row(i).CopyFromVec(feats->Row(k));
+    }
+    feats->Swap(&output);
+  }
+ private:
+  int32 n_;
+  int32 offset_;
+};
+
+// This class runs the pipeline on one utterance; the work happens in operator
+// (), and the output happens in the destructor, which TaskSequencer calls in
+// the order the utterances were read.  If "stage_data" is NULL, the utterance
+// has already failed in one of the stages' Prepare().
+class FeaturePipelineTask {
+ public:
+  FeaturePipelineTask(const std::vector<FeatureStage*> &stages,
+                      const std::string &utt,
+                      const Matrix<BaseFloat> &feats,
+                      std::vector<Matrix<double> > *stage_data,
+                      BaseFloatMatrixWriter *feat_writer,
+                      int32 *num_done, int32 *num_err):
+      stages_(stages), utt_(utt), feats_(feats), feat_writer_(feat_writer),
+      num_done_(num_done), num_err_(num_err), failed_(stage_data == NULL) {
+    if (stage_data != NULL)
+      stage_data_.swap(*stage_data);
+  }
+
+  void operator () () {
+    if (failed_)
+      return;
+    try {
+      for (size_t s = 0; s < stages_.size(); s++)
+        stages_[s]->Apply(utt_, stage_data_[s], &feats_);
+    } catch (...) {
+      failed_ = true;
+    }
+  }
+
+  ~FeaturePipelineTask() {
+    if (failed_) {
+      KALDI_WARN << "Failed to process utterance " << utt_;
+      (*num_err_)++;
+      return;
+    }
+    feat_writer_->Write(utt_, feats_);
+    (*num_done_)++;
+  }
+
+ private:
+  const std::vector<FeatureStage*> &stages_;
+  std::string utt_;
+  Matrix<BaseFloat> feats_;
+  std::vector<Matrix<double> > stage_data_;
+  BaseFloatMatrixWriter *feat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool failed_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    const char *usage =
+        "Apply a chain of feature-processing stages in one process, using\n"
+        "several threads; this is equivalent to piping the features through\n"
+        "the corresponding programs, but avoids writing and re-reading them\n"
+        "between stages.  <stages> is a comma-separated list of:\n"
+        "  cmvn       as apply-cmvn (see --cmvn-stats, --utt2spk, --norm-vars)\n"
+        "  deltas     as add-deltas (see --delta-order, --delta-window)\n"
+        "  splice     as splice-feats (see --left-context, --right-context)\n"
+        "  transform  as transform-feats (see --transform, --utt2spk)\n"
+        "  subsample  as subsample-feats (see --subsample-n, --subsample-offset)\n"
+        "which are applied in the order given.\n"
+        "Usage: apply-feat-pipeline [options] <stages> <feats-rspecifier> "
+        "<feats-wspecifier>\n"
+        "e.g.: apply-feat-pipeline --num-threads=4 --utt2spk=ark:utt2spk \\\n"
+        "  --cmvn-stats=scp:cmvn.scp --left-context=3 --right-context=3 \\\n"
+        "  --transform=final.mat cmvn,splice,transform scp:feats.scp ark:-\n"
+        "See also: apply-cmvn, add-deltas, splice-feats, transform-feats, "
+        "subsample-feats\n";
+
+    ParseOptions po(usage);
+    std::string cmvn_stats, utt2spk_rspecifier, skip_dims_str, transform;
+    bool norm_vars = false;
+    DeltaFeaturesOptions delta_opts;
+    int32 left_context = 4, right_context = 4,
+        subsample_n = 1, subsample_offset = 0;
+    TaskSequencerConfig sequencer_config;
+
+    po.Register("cmvn-stats", &cmvn_stats, "For the cmvn stage: rspecifier "
+                "for per-utterance or per-speaker CMVN stats, or rxfilename "
+                "for global stats.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "rspecifier for utterance to "
+                "speaker map, used to look up the CMVN stats and transforms.");
+    po.Register("norm-vars", &norm_vars, "For the cmvn stage: if true, "
+                "normalize variances.");
+    po.Register("skip-dims", &skip_dims_str, "For the cmvn stage: dimensions "
+                "for which to skip normalization: colon-separated list of "
+                "integers, e.g. 13:14:15)");
+    delta_opts.Register(&po);
+    po.Register("left-context", &left_context, "For the splice stage: number "
+                "of frames of left context");
+    po.Register("right-context", &right_context, "For the splice stage: "
+                "number of frames of right context");
+    po.Register("transform", &transform, "For the transform stage: "
+                "rspecifier for per-utterance or per-speaker transforms, or "
+                "rxfilename for a global transform.");
+    po.Register("subsample-n", &subsample_n, "For the subsample stage: take "
+                "every n'th frame (with a negative value, repeats each frame "
+                "n times)");
+    po.Register("subsample-offset", &subsample_offset, "For the subsample "
+                "stage: start with the frame with this offset.");
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string stages_str = po.GetArg(1),
+        feat_rspecifier = po.GetArg(2),
+        feat_wspecifier = po.GetArg(3);
+
+    std::vector<int32> skip_dims;
+    if (!SplitStringToIntegers(skip_dims_str, ":", false, &skip_dims)) {
+      KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
+                <<  "integers)";
+    }
+
+    std::vector<std::string> stage_names;
+    SplitStringToVector(stages_str, ",", true, &stage_names);
+    if (stage_names.empty())
+      KALDI_ERR << "No stages specified.";
+    std::vector<FeatureStage*> stages;
+    for (size_t s = 0; s < stage_names.size(); s++) {
+      const std::string &name = stage_names[s];
+      if (name == "cmvn") {
+        if (cmvn_stats == "")
+          KALDI_ERR << "The cmvn stage requires the --cmvn-stats option.";
+        stages.push_back(new CmvnStage(cmvn_stats, utt2spk_rspecifier,
+                                       skip_dims, norm_vars));
+      } else if (name == "deltas") {
+        stages.push_back(new DeltasStage(delta_opts));
+      } else if (name == "splice") {
+        stages.push_back(new SpliceStage(left_context, right_context));
+      } else if (name == "transform") {
+        if (transform == "")
+          KALDI_ERR << "The transform stage requires the --transform option.";
+        stages.push_back(new TransformStage(transform, utt2spk_rspecifier));
+      } else if (name == "subsample") {
+        stages.push_back(new SubsampleStage(subsample_n, subsample_offset));
+      } else {
+        KALDI_ERR << "Unknown stage '" << name << "' in '" << stages_str
+                  << "'";
+      }
+    }
+
+    SequentialBaseFloatMatrixReader feat_reader(feat_rspecifier);
+    BaseFloatMatrixWriter feat_writer(feat_wspecifier);
+
+    int32 num_done = 0, num_err = 0;
+    {
+      TaskSequencer<FeaturePipelineTask> sequencer(sequencer_config);
+      for (; !feat_reader.Done(); feat_reader.Next()) {
+        std::string utt = feat_reader.Key();
+        // The stages look up their per-utterance data here, in the reading
+        // thread, as table readers are not thread-safe.  Utterances that fail
+        // still go through the sequencer so that num_err is only touched by
+        // the (sequential) destructors.
+        std::vector<Matrix<double> > stage_data(stages.size());
+        bool ok = true;
+        for (size_t s = 0; s < stages.size() && ok; s++)
+          ok = stages[s]->Prepare(utt, &(stage_data[s]));
+        sequencer.Run(new FeaturePipelineTask(stages, utt, feat_reader.Value(),
+                                              (ok ? &stage_data : NULL),
+                                              &feat_writer, &num_done,
+                                              &num_err));
+      }
+      // The destructor of "sequencer" waits for any remaining tasks.
+    }
+    DeletePointers(&stages);
+    KALDI_LOG << "Applied " << stage_names.size() << " stages to "
+              << num_done << " utterances, " << num_err << " with errors.";
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
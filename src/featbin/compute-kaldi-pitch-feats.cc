@@ -22,6 +22,56 @@
 #include "util/common-utils.h"
 #include "feat/pitch-functions.h"
 #include "feat/wave-reader.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class is used to compute the pitch of several utterances in parallel;
+// the work happens in operator (), and the output happens in the destructor,
+// which TaskSequencer calls in the order the utterances were read.
+class PitchExtractionTask {
+ public:
+  PitchExtractionTask(const PitchExtractionOptions &pitch_opts,
+                      const std::string &utt,
+                      const VectorBase<BaseFloat> &waveform,
+                      BaseFloatMatrixWriter *feat_writer,
+                      int32 *num_done, int32 *num_err):
+      pitch_opts_(pitch_opts), utt_(utt), waveform_(waveform),
+      feat_writer_(feat_writer), num_done_(num_done), num_err_(num_err),
+      failed_(false) { }
+
+  void operator () () {
+    try {
+      ComputeKaldiPitch(pitch_opts_, waveform_, &features_);
+    } catch (...) {
+      failed_ = true;
+    }
+  }
+
+  ~PitchExtractionTask() {
+    if (failed_) {
+      KALDI_WARN << "Failed to compute pitch for utterance " << utt_;
+      (*num_err_)++;
+      return;
+    }
+    feat_writer_->Write(utt_, features_);
+    if (*num_done_ % 50 == 0 && *num_done_ != 0)
+      KALDI_VLOG(2) << "Processed " << *num_done_ << " utterances";
+    (*num_done_)++;
+  }
+
+ private:
+  const PitchExtractionOptions &pitch_opts_;
+  std::string utt_;
+  Vector<BaseFloat> waveform_;
+  BaseFloatMatrixWriter *feat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool failed_;
+  Matrix<BaseFloat> features_;
+};
+
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -45,7 +95,9 @@ int main(int argc, char *argv[]) {
                         // on the command line (in the .scp file) using sox or
                         // similar.
 
+    TaskSequencerConfig sequencer_config;
     pitch_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -61,51 +113,44 @@ int main(int argc, char *argv[]) {
     BaseFloatMatrixWriter feat_writer(feat_wspecifier);
 
     int32 num_done = 0, num_err = 0;
-    for (; !wav_reader.Done(); wav_reader.Next()) {
-      std::string utt = wav_reader.Key();
-      const WaveData &wave_data = wav_reader.Value();
-
-      int32 num_chan = wave_data.Data().NumRows(), this_chan = channel;
-      {
-        KALDI_ASSERT(num_chan > 0);
-        // reading code if no channels.
-        if (channel == -1) {
-          this_chan = 0;
-          if (num_chan != 1)
-            KALDI_WARN << "Channel not specified but you have data with "
-                       << num_chan  << " channels; defaulting to zero";
-        } else {
-          if (this_chan >= num_chan) {
-            KALDI_WARN << "File with id " << utt << " has "
-                       << num_chan << " channels but you specified channel "
-                       << channel << ", producing no output.";
-            continue;
+    {
+      TaskSequencer<PitchExtractionTask> sequencer(sequencer_config);
+      for (; !wav_reader.Done(); wav_reader.Next()) {
+        std::string utt = wav_reader.Key();
+        const WaveData &wave_data = wav_reader.Value();
+
+        int32 num_chan = wave_data.Data().NumRows(), this_chan = channel;
+        {
+          KALDI_ASSERT(num_chan > 0);
+          // reading code if no channels.
+          if (channel == -1) {
+            this_chan = 0;
+            if (num_chan != 1)
+              KALDI_WARN << "Channel not specified but you have data with "
+                         << num_chan  << " channels; defaulting to zero";
+          } else {
+            if (this_chan >= num_chan) {
+              KALDI_WARN << "File with id " << utt << " has "
+                         << num_chan << " channels but you specified channel "
+                         << channel << ", producing no output.";
+              continue;
+            }
           }
         }
-      }
 
-      if (pitch_opts.samp_freq != wave_data.SampFreq())
-        KALDI_ERR << "Sample frequency mismatch: you specified "
-                  << pitch_opts.samp_freq << " but data has "
-                  << wave_data.SampFreq() << " (use --sample-frequency "
-                  << "option).  Utterance is " << utt;
-
-
-      SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        ComputeKaldiPitch(pitch_opts, waveform, &features);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute pitch for utterance "
-                   << utt;
-        num_err++;
-        continue;
-      }
+        if (pitch_opts.samp_freq != wave_data.SampFreq())
+          KALDI_ERR << "Sample frequency mismatch: you specified "
+                    << pitch_opts.samp_freq << " but data has "
+                    << wave_data.SampFreq() << " (use --sample-frequency "
+                    << "option).  Utterance is " << utt;
 
-      feat_writer.Write(utt, features);
-      if (num_done % 50 == 0 && num_done != 0)
-        KALDI_VLOG(2) << "Processed " << num_done << " utterances";
-      num_done++;
+
+        SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
+        sequencer.Run(new PitchExtractionTask(pitch_opts, utt, waveform,
+                                              &feat_writer, &num_done,
+                                              &num_err));
+      }
+      // The destructor of "sequencer" waits for any remaining tasks.
     }
     KALDI_LOG << "Done " << num_done << " utterances, " << num_err
               << " with errors.";
@@ -22,6 +22,24 @@
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
 
+namespace kaldi {
+
+// This compresses the matrices as the writer writes them, so that with the
+// "bg" wspecifier option (e.g. ark,bgthreads=4:-) the compression happens in
+// the writer's background threads.
+class MatrixCompressor: public TableWriterPreprocessor<GeneralMatrix> {
+ public:
+  explicit MatrixCompressor(CompressionMethod method): method_(method) { }
+  virtual void Preprocess(const GeneralMatrix &in, GeneralMatrix *out) const {
+    CompressedMatrix cmat(in.GetFullMatrix(), method_);
+    out->Clear();
+    out->SwapCompressedMatrix(&cmat);
+  }
+ private:
+  CompressionMethod method_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -52,7 +70,7 @@ int main(int argc, char *argv[]) {
                 "(only currently supported for wxfilename, i.e. archive/script,"
                 "output)");
     po.Register("compression-method", &compression_method_in,
-                "Only relevant if --compress=true; the method (1 through 7) to "
+                "Only relevant if --compress=true; the method (1 through 9) to "
                 "compress the matrix.  Search for CompressionMethod in "
                 "src/matrix/compressed-matrix.h.");
     po.Register("write-num-frames", &num_frames_wspecifier,
@@ -107,13 +125,16 @@ int main(int argc, char *argv[]) {
           }
         }
       } else {
-        CompressedMatrixWriter kaldi_writer(wspecifier);
+        // The compressor must outlive kaldi_writer, which may still be using
+        // it in background threads until it is closed.
+        MatrixCompressor compressor(compression_method);
+        GeneralMatrixWriter kaldi_writer(wspecifier);
+        kaldi_writer.SetPreprocessor(&compressor);
         if (htk_in) {
           SequentialTableReader<HtkMatrixHolder> htk_reader(rspecifier);
           for (; !htk_reader.Done(); htk_reader.Next(), num_done++) {
             kaldi_writer.Write(htk_reader.Key(),
-                               CompressedMatrix(htk_reader.Value().first,
-                                                compression_method));
+                               GeneralMatrix(htk_reader.Value().first));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(htk_reader.Key(),
                                       htk_reader.Value().first.NumRows());
@@ -122,8 +143,7 @@ int main(int argc, char *argv[]) {
           SequentialTableReader<SphinxMatrixHolder<> > sphinx_reader(rspecifier);
           for (; !sphinx_reader.Done(); sphinx_reader.Next(), num_done++) {
             kaldi_writer.Write(sphinx_reader.Key(),
-                               CompressedMatrix(sphinx_reader.Value(),
-                                                compression_method));
+                               GeneralMatrix(sphinx_reader.Value()));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(sphinx_reader.Key(),
                                       sphinx_reader.Value().NumRows());
@@ -132,8 +152,7 @@ int main(int argc, char *argv[]) {
           SequentialBaseFloatMatrixReader kaldi_reader(rspecifier);
           for (; !kaldi_reader.Done(); kaldi_reader.Next(), num_done++) {
             kaldi_writer.Write(kaldi_reader.Key(),
-                               CompressedMatrix(kaldi_reader.Value(),
-                                                compression_method));
+                               GeneralMatrix(kaldi_reader.Value()));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(kaldi_reader.Key(),
                                       kaldi_reader.Value().NumRows());
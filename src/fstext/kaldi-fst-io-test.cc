@@ -0,0 +1,73 @@
+// fstext/kaldi-fst-io-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include <fstream>
+#include "fstext/rand-fst.h"
+#include "fstext/kaldi-fst-io.h"
+
+
+namespace fst {
+
+// Returns true if the file "filename" is memory-mapped into this process.
+// This only works on Linux, where it looks in /proc/self/maps.
+bool FileIsMapped(const std::string &filename) {
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  while (std::getline(maps, line))
+    if (line.find(filename) != std::string::npos)
+      return true;
+  return false;
+}
+
+// Tests ReadFstKaldiGeneric() with memory_map == true, for ConstFsts written
+// with and without aligned data; only the former can be mapped.
+void TestReadFstKaldiGenericMapped(bool align) {
+  const std::string filename = "kaldi-fst-io-test.fst";
+  VectorFst<StdArc> *vfst = RandFst<StdArc>();
+  ConstFst<StdArc> cfst(*vfst);
+  delete vfst;
+  {
+    std::ofstream os(filename.c_str(), std::ios::binary);
+    FstWriteOptions wopts(filename);
+    wopts.align = align;
+    KALDI_ASSERT(cfst.Write(os, wopts) && os.good());
+  }
+  Fst<StdArc> *fst = ReadFstKaldiGeneric(filename, true, true);
+  KALDI_ASSERT(fst->Type() == "const" && Equal(*fst, cfst));
+#ifdef __linux__
+  // An FST with no arcs or states has nothing to map.
+  if (cfst.NumStates() > 0)
+    KALDI_ASSERT(FileIsMapped(filename) == align);
+#endif
+  delete fst;
+#ifdef __linux__
+  KALDI_ASSERT(!FileIsMapped(filename));
+#endif
+  unlink(filename.c_str());
+}
+
+} // end namespace fst
+
+int main() {
+  using namespace fst;
+  for (int i = 0; i < 5; i++) {
+    TestReadFstKaldiGenericMapped(true);
+    TestReadFstKaldiGenericMapped(false);
+  }
+  std::cout << "Test OK\n";
+}
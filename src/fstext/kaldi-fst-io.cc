@@ -42,7 +42,8 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename) {
   return fst;
 }
 
-Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
+Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err,
+                                 bool memory_map) {
   if (rxfilename == "") rxfilename = "-"; // interpret "" as stdin,
   // for compatibility with OpenFst conventions.
   kaldi::Input ki(rxfilename);
@@ -73,8 +74,35 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   FstReadOptions ropts("<unspecified>", &hdr);
   Fst<StdArc> *fst = NULL;
   if (hdr.FstType() == "const") {
+    if (memory_map) {
+      if (kaldi::ClassifyRxfilename(rxfilename) != kaldi::kFileInput) {
+        KALDI_WARN << "Cannot memory-map FST from "
+                   << kaldi::PrintableRxfilename(rxfilename)
+                   << " as it is not an ordinary file; reading it instead.";
+      } else if (!(hdr.GetFlags() & fst::FstHeader::IS_ALIGNED)) {
+        // OpenFst only maps regions that start at a multiple of 16 bytes in
+        // the file, which is only guaranteed if the FST was written with
+        // alignment; otherwise it would quietly read them instead.
+        KALDI_WARN << "Cannot memory-map FST from "
+                   << kaldi::PrintableRxfilename(rxfilename)
+                   << " as it was not written with aligned data; reading it "
+                   << "instead.  Convert it with fstconvert --fst_align=true "
+                   << "to be able to memory-map it.";
+      } else {
+        // OpenFst maps the regions of the file starting at the current
+        // position of the stream, re-opening it by name; if that fails it
+        // falls back to reading them.
+        ropts.source = rxfilename;
+        ropts.mode = FstReadOptions::MAP;
+      }
+    }
     fst = ConstFst<StdArc>::Read(ki.Stream(), ropts);
   } else if (hdr.FstType() == "vector") {
+    if (memory_map)
+      KALDI_WARN << "Cannot memory-map FST of type vector from "
+                 << kaldi::PrintableRxfilename(rxfilename)
+                 << "; convert it with fstconvert --fst_type=const to "
+                 << "be able to do so.";
     fst = VectorFst<StdArc>::Read(ki.Stream(), ropts);
   }
   if (!fst) {
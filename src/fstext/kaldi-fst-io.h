@@ -47,8 +47,16 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename);
 // doesn't support the text-mode option that we generally like to support.
 // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
 // (const-fst can give better performance for decoding).
+// If memory_map == true and the FST is a ConstFst in an ordinary file (not a
+// pipe or stdin) that was written with aligned data (fstconvert
+// --fst_align=true), its states and arcs are memory-mapped from the file rather
+// than read into memory.  This makes loading a large decoding graph almost
+// instantaneous, and the pages are shared (via the page cache) between all
+// processes that map the same file.  In other cases memory_map is ignored,
+// with a warning.
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename,
-                                 bool throw_on_err = true);
+                                 bool throw_on_err = true,
+                                 bool memory_map = false);
 
 // This function attempts to dynamic_cast the pointer 'fst' (which will likely
 // have been returned by ReadFstGeneric()), to the more derived
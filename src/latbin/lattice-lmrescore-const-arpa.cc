@@ -45,9 +45,14 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    bool mmap_lm = false;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    po.Register("mmap-lm", &mmap_lm, "If true, memory-map the language model "
+                "rather than reading it, so that its memory is shared between "
+                "processes (it must be an ordinary file, written by "
+                "arpa-to-const-arpa --align=true).");
 
     po.Read(argc, argv);
 
@@ -62,7 +67,10 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    if (mmap_lm)
+      const_arpa.ReadMapped(lm_rxfilename);
+    else
+      ReadKaldiObject(lm_rxfilename, &const_arpa);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
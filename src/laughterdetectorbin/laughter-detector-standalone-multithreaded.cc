@@ -25,8 +25,10 @@
 #include "feat/feature-mfcc.h"
 #include "transform/cmvn.h"
 #include "nnet/nnet-nnet.h"
+#include "nnet/nnet-various.h"
 #include "util/kaldi-thread.h"
 
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
@@ -34,6 +36,7 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <mutex>
 
 using namespace kaldi;
 using namespace kaldi::nnet1;
@@ -278,6 +281,887 @@ class LaughterDetectorClassifier
   std::vector<Vector<BaseFloat>*> *laughter_labels_;
 };
 
+/** @brief Options for the --streaming mode. */
+struct StreamingOptions
+{
+  bool streaming;
+  BaseFloat chunkLength;
+
+  StreamingOptions(): streaming(false), chunkLength(10.0) { }
+
+  void Register(OptionsItf *opts)
+  {
+    opts->Register("streaming", &streaming,
+                   "If true, read and process the wave file in chunks, writing "
+                   "segments as soon as they are final; memory use does not "
+                   "grow with the file length (default false).");
+    opts->Register("chunk-length", &chunkLength,
+                   "Length in seconds of the chunks read and processed in "
+                   "--streaming mode (default 10s).");
+  }
+};
+
+/** @brief Writes one segment line: start and end times in seconds, and the confidence. */
+void writeSegment(std::ostream &os, MatrixIndexT start_frame, MatrixIndexT end_frame,
+                  BaseFloat confidence, BaseFloat frame_shift_ms, int32 time_width)
+{
+  int32 decimalPrecision = 2;
+  os << std::setfill('0') << std::setw(time_width) << std::fixed << std::setprecision(decimalPrecision) << (BaseFloat)(start_frame) * frame_shift_ms/1000 << " ";
+  os << std::setfill('0') << std::setw(time_width) << std::fixed << std::setprecision(decimalPrecision) << (BaseFloat)(end_frame) * frame_shift_ms/1000 << " ";
+  os << std::fixed <<  std::setprecision(decimalPrecision) << confidence << std::endl;
+}
+
+/** @brief Appends the rows of 'src' to 'dst'. */
+void appendRows(const MatrixBase<BaseFloat> &src, Matrix<BaseFloat> *dst)
+{
+  if (src.NumRows() == 0)
+    return;
+  MatrixIndexT num_rows = dst->NumRows();
+  dst->Resize(num_rows + src.NumRows(), src.NumCols(), kCopyData);
+  dst->RowRange(num_rows, src.NumRows()).CopyFromMat(src);
+}
+
+/** @brief Removes the first 'num_rows' rows of 'mat'. */
+void dropRows(MatrixIndexT num_rows, Matrix<BaseFloat> *mat)
+{
+  if (num_rows == 0)
+    return;
+  if (num_rows == mat->NumRows())
+  {
+    mat->Resize(0, 0);
+    return;
+  }
+  Matrix<BaseFloat> kept(mat->RowRange(num_rows, mat->NumRows() - num_rows));
+  mat->Swap(&kept);
+}
+
+/** @brief Gets the number of frames of left and right context the network
+    needs, i.e. the sum of the <Splice> offsets.  The recurrent and nested
+    components cannot be evaluated chunk by chunk, they are rejected. */
+void getNnetContext(const Nnet &nnet, int32 *left_context, int32 *right_context)
+{
+  for (int32 c = 0; c < nnet.NumComponents(); c++)
+  {
+    const Component &comp = nnet.GetComponent(c);
+    switch (comp.GetType())
+    {
+      case Component::kSplice:
+      {
+        std::vector<int32> offsets;
+        dynamic_cast<const Splice&>(comp).FrameOffsets().CopyToVec(&offsets);
+        KALDI_ASSERT(!offsets.empty());
+        *left_context += std::max(0, -*std::min_element(offsets.begin(), offsets.end()));
+        *right_context += std::max(0, *std::max_element(offsets.begin(), offsets.end()));
+        break;
+      }
+      case Component::kLstmProjected:
+      case Component::kBlstmProjected:
+      case Component::kRecurrentComponent:
+      case Component::kParallelComponent:
+      case Component::kMultiBasisComponent:
+        KALDI_ERR << "Component " << Component::TypeToMarker(comp.GetType())
+                  << " is not supported in --streaming mode.";
+      default:
+        break;
+    }
+  }
+}
+
+/** @brief Incremental front-end for the --streaming mode, computes the same
+    MFCC + CMVN + delta features as LaughterDetectorFrontend, but only keeps
+    the samples and frames still needed for the frames not computed yet. */
+class LaughterStreamingFrontend
+{
+ public:
+  LaughterStreamingFrontend(const MfccOptions &mfcc_opts, const Matrix<double> &cmvn_stats,
+                            const DeltaFeaturesOptions &delta_opts):
+      computer_(mfcc_opts), window_function_(computer_.GetFrameOptions()),
+      cmvn_stats_(cmvn_stats), delta_(delta_opts),
+      delta_context_(delta_opts.order * delta_opts.window),
+      dim_(computer_.Dim() * (delta_opts.order + 1)),
+      input_finished_(false), waveform_offset_(0), num_raw_frames_(0),
+      raw_offset_(0), num_frames_(0)
+  { }
+
+  /// Feature dimension, including the deltas.
+  int32 Dim() const { return dim_; }
+
+  void AcceptWaveform(const VectorBase<BaseFloat> &waveform)
+  {
+    KALDI_ASSERT(!input_finished_);
+    Vector<BaseFloat> appended_wave(waveform_remainder_.Dim() + waveform.Dim());
+    appended_wave.Range(0, waveform_remainder_.Dim()).CopyFromVec(waveform_remainder_);
+    appended_wave.Range(waveform_remainder_.Dim(), waveform.Dim()).CopyFromVec(waveform);
+    waveform_remainder_.Swap(&appended_wave);
+    ComputeRawFeatures();
+  }
+
+  void InputFinished()
+  {
+    input_finished_ = true;
+    ComputeRawFeatures();
+  }
+
+  /// Outputs the features of all frames that became ready since the last
+  /// call (possibly none), and returns the index of the first one.
+  MatrixIndexT GetFeatures(Matrix<BaseFloat> *features)
+  {
+    MatrixIndexT first_frame = num_frames_;
+    MatrixIndexT num_ready = input_finished_ ? num_raw_frames_ :
+        std::max<MatrixIndexT>(0, num_raw_frames_ - delta_context_);
+    if (num_ready == first_frame)
+    {
+      features->Resize(0, 0);
+      return first_frame;
+    }
+    features->Resize(num_ready - first_frame, dim_, kUndefined);
+    for (MatrixIndexT t = first_frame; t < num_ready; t++)
+    {
+      SubVector<BaseFloat> row(*features, t - first_frame);
+      delta_.Process(raw_features_, t - raw_offset_, &row);
+    }
+    num_frames_ = num_ready;
+
+    // Check there is no nan/inf
+    if (!KALDI_ISFINITE(features->Sum()))
+    {
+      KALDI_ERR << "NaN or inf found in features";
+    }
+
+    // Keep the left context of the next frame to compute.
+    MatrixIndexT new_offset = std::max<MatrixIndexT>(0, num_frames_ - delta_context_);
+    if (new_offset > raw_offset_)
+    {
+      dropRows(new_offset - raw_offset_, &raw_features_);
+      raw_offset_ = new_offset;
+    }
+    return first_frame;
+  }
+
+ private:
+  // Computes the MFCCs + CMVN of the frames now available, as
+  // OnlineGenericBaseFeature::ComputeFeatures() does.
+  void ComputeRawFeatures()
+  {
+    const FrameExtractionOptions &frame_opts = computer_.GetFrameOptions();
+    int64 num_samples_total = waveform_offset_ + waveform_remainder_.Dim();
+    MatrixIndexT num_frames_new = NumFrames(num_samples_total, frame_opts, input_finished_);
+    if (num_frames_new <= num_raw_frames_)
+      return;
+
+    Matrix<BaseFloat> new_features(num_frames_new - num_raw_frames_, computer_.Dim());
+    Vector<BaseFloat> window;
+    bool need_raw_log_energy = computer_.NeedRawLogEnergy();
+    for (MatrixIndexT frame = num_raw_frames_; frame < num_frames_new; frame++)
+    {
+      BaseFloat raw_log_energy = 0.0;
+      ExtractWindow(waveform_offset_, waveform_remainder_, frame, frame_opts,
+                    window_function_, &window, need_raw_log_energy ? &raw_log_energy : NULL);
+      SubVector<BaseFloat> feature(new_features, frame - num_raw_frames_);
+      computer_.Compute(raw_log_energy, 1.0, &window, &feature);
+    }
+    ApplyCmvn(cmvn_stats_, true, &new_features);
+    appendRows(new_features, &raw_features_);
+    num_raw_frames_ = num_frames_new;
+
+    // Discard the samples that are no longer needed.
+    int64 first_sample_of_next_frame = FirstSampleOfFrame(num_frames_new, frame_opts);
+    int32 samples_to_discard = first_sample_of_next_frame - waveform_offset_;
+    if (samples_to_discard > 0)
+    {
+      int32 new_num_samples = waveform_remainder_.Dim() - samples_to_discard;
+      if (new_num_samples <= 0)
+      {
+        waveform_offset_ += waveform_remainder_.Dim();
+        waveform_remainder_.Resize(0);
+      }
+      else
+      {
+        Vector<BaseFloat> new_remainder(waveform_remainder_.Range(samples_to_discard, new_num_samples));
+        waveform_offset_ += samples_to_discard;
+        waveform_remainder_.Swap(&new_remainder);
+      }
+    }
+  }
+
+  MfccComputer computer_;
+  FeatureWindowFunction window_function_;
+  Matrix<double> cmvn_stats_;
+  DeltaFeatures delta_;
+  int32 delta_context_;
+  int32 dim_;
+
+  bool input_finished_;
+  Vector<BaseFloat> waveform_remainder_;
+  int64 waveform_offset_;         // Index of the first sample of waveform_remainder_.
+  MatrixIndexT num_raw_frames_;   // Number of MFCC frames computed so far.
+  Matrix<BaseFloat> raw_features_;
+  MatrixIndexT raw_offset_;       // Index of the first frame in raw_features_.
+  MatrixIndexT num_frames_;       // Number of output frames so far.
+};
+
+/** @brief Per-thread copies of the feature transform and the network, so that
+    the chunks can be propagated concurrently (Nnet::Feedforward is not
+    thread-safe). The models are read once and copied. */
+class LaughterNnetPool
+{
+ public:
+  LaughterNnetPool(const Nnet &nnet_transf, const Nnet &nnet, int32 num_copies)
+  {
+    for (int32 i = 0; i < num_copies; i++)
+    {
+      free_.push_back(std::make_pair(new Nnet(nnet_transf), new Nnet(nnet)));
+    }
+  }
+
+  ~LaughterNnetPool()
+  {
+    for (size_t i = 0; i < free_.size(); i++)
+    {
+      delete free_[i].first;
+      delete free_[i].second;
+    }
+  }
+
+  /// Forwards the features through the feature transform and the network.
+  /// There must be at most 'num_copies' concurrent calls.
+  void Feedforward(const CuMatrixBase<BaseFloat> &features, CuMatrix<BaseFloat> *nnet_out)
+  {
+    std::pair<Nnet*, Nnet*> nnets;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      KALDI_ASSERT(!free_.empty());
+      nnets = free_.back();
+      free_.pop_back();
+    }
+
+    CuMatrix<BaseFloat> feats_transf;
+    nnets.first->Feedforward(features, &feats_transf);
+    if (!KALDI_ISFINITE(feats_transf.Sum())) {  // check there's no nan/inf,
+      KALDI_ERR << "NaN or inf found in transformed-features";
+    }
+    nnets.second->Feedforward(feats_transf, nnet_out);
+    if (!KALDI_ISFINITE(nnet_out->Sum())) {  // check there's no nan/inf,
+      KALDI_ERR << "NaN or inf found in nn-output";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(nnets);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::pair<Nnet*, Nnet*> > free_;
+};
+
+/** @brief Incremental version of applyHangover() for the --streaming mode.
+    The labels are accepted chunk by chunk.  The hangover labels and the
+    segments are handed out as soon as no later frame can change them: a
+    segment is final once it is followed by a gap longer than the bridge. */
+class LaughterHangover
+{
+ public:
+  LaughterHangover(const HangoverOptions &opts, BaseFloat frame_shift_ms):
+      opts_(opts),
+      laughterCountLimit_(ceil(opts.hangoverMinDuration/frame_shift_ms)),
+      laughterBridgeCountLimit_(ceil(opts.hangoverMinBridge/frame_shift_ms)),
+      laughterFlag_(false), contigousLaughterCount_(0), contigousNonLaughterCount_(0),
+      lastLaughterSegment_(0), startOfLaughter_(0), numFrames_(0),
+      inputFinished_(false), labelsOffset_(0), probOffset_(0)
+  { }
+
+  /// Accepts the labels of the next frames and their laughter probabilities.
+  void AcceptLabels(const VectorBase<BaseFloat> &laughter_labels,
+                    const VectorBase<BaseFloat> &laughter_prob)
+  {
+    KALDI_ASSERT(!inputFinished_ && laughter_labels.Dim() == laughter_prob.Dim());
+    for (MatrixIndexT i = 0; i < laughter_labels.Dim(); i++)
+    {
+      labels_.push_back(laughter_labels(i));
+      prob_.push_back(laughter_prob(i));
+      AcceptFrame(laughter_labels(i));
+    }
+  }
+
+  /// Declares there are no more labels; everything becomes final.
+  void InputFinished()
+  {
+    inputFinished_ = true;
+    // A segment still open lasts till the end, as in applyHangover().
+    if (!segments_.empty() && segments_.back().second < 0)
+    {
+      segments_.back().second = numFrames_ - 1;
+    }
+  }
+
+  /// Outputs the final hangover labels not output yet, and returns the index
+  /// of the first one.
+  MatrixIndexT GetFinalLabels(Vector<BaseFloat> *laughter_labels_hover)
+  {
+    MatrixIndexT first_frame = labelsOffset_;
+    MatrixIndexT num_final = FirstMutableFrame() - labelsOffset_;
+    laughter_labels_hover->Resize(num_final, kUndefined);
+    for (MatrixIndexT i = 0; i < num_final; i++)
+    {
+      (*laughter_labels_hover)(i) = labels_.front();
+      labels_.pop_front();
+    }
+    labelsOffset_ += num_final;
+    return first_frame;
+  }
+
+  /// Outputs the final segments not output yet with their confidences, the
+  /// average laughter probability over the segment.
+  void GetFinalSegments(LaughterSegment *laughter_segments, std::vector<BaseFloat> *confidences)
+  {
+    laughter_segments->clear();
+    confidences->clear();
+    bool final = inputFinished_ || (!laughterFlag_ &&
+        (segments_.empty() || contigousNonLaughterCount_ >= laughterBridgeCountLimit_));
+    if (final)
+    {
+      for (LaughterSegment::iterator segmentIter = segments_.begin(); segmentIter != segments_.end(); ++segmentIter)
+      {
+        KALDI_ASSERT(segmentIter->second >= segmentIter->first);
+        MatrixIndexT length = segmentIter->second - segmentIter->first + 1;
+        double sum = 0.0;
+        for (MatrixIndexT i = segmentIter->first; i <= segmentIter->second; i++)
+        {
+          sum += prob_[i - probOffset_];
+        }
+        laughter_segments->push_back(*segmentIter);
+        confidences->push_back(sum / (length + 1));
+      }
+      segments_.clear();
+    }
+
+    // Keep the probabilities of the frames that can still be in a segment.
+    MatrixIndexT keep_from = segments_.empty() ? std::min(numFrames_, FirstMutableFrame()) :
+                                                 segments_.front().first;
+    for (; probOffset_ < keep_from; probOffset_++)
+    {
+      prob_.pop_front();
+    }
+  }
+
+ private:
+  // One step of the state machine in applyHangover(), with global frame
+  // indexes; an open segment has end -1 until its end is known.
+  void AcceptFrame(BaseFloat label)
+  {
+    MatrixIndexT i = numFrames_++;
+    if (label == opts_.laughterLabel && laughterFlag_ == false)
+    {
+      if (laughterBridgeCountLimit_ > contigousNonLaughterCount_ && !segments_.empty())
+      {
+        MatrixIndexT origin = lastLaughterSegment_ + 1;
+        MatrixIndexT length = (i - 1) - origin;
+        SetLabels(origin, length + 1, opts_.laughterLabel);
+        contigousLaughterCount_ += length + 1;
+      }
+      else
+      {
+        startOfLaughter_ = i;
+        contigousLaughterCount_ = 1;
+        segments_.push_back(std::make_pair(startOfLaughter_, -1));
+      }
+      laughterFlag_ = true;
+    }
+    else if (label == opts_.laughterLabel && laughterFlag_ == true)
+    {
+      contigousLaughterCount_++;
+    }
+    else if (label == opts_.nonLaughterLabel && laughterFlag_ == true)
+    {
+      if (contigousLaughterCount_ < laughterCountLimit_)
+      {
+        MatrixIndexT origin = startOfLaughter_;
+        MatrixIndexT length = (i - 1) - origin;
+        SetLabels(origin, length + 1, opts_.nonLaughterLabel);
+        contigousNonLaughterCount_ += length + 1;
+        if (!segments_.empty())
+        {
+          segments_.pop_back();
+        }
+      }
+      else
+      {
+        lastLaughterSegment_ = i - 1;
+        contigousNonLaughterCount_ = 1;
+        segments_.back().second = lastLaughterSegment_;
+      }
+      laughterFlag_ = false;
+    }
+    else
+    {
+      contigousNonLaughterCount_++;
+    }
+  }
+
+  // The first frame whose hangover label may still be rewritten by a
+  // removal (from the start of the current laughter) or a bridge (from the
+  // end of the last laughter segment).
+  MatrixIndexT FirstMutableFrame() const
+  {
+    if (inputFinished_)
+      return numFrames_;
+    if (laughterFlag_)
+      return std::max(startOfLaughter_, labelsOffset_);
+    if (!segments_.empty() && contigousNonLaughterCount_ < laughterBridgeCountLimit_)
+      return std::max(lastLaughterSegment_ + 1, labelsOffset_);
+    return numFrames_;
+  }
+
+  void SetLabels(MatrixIndexT origin, MatrixIndexT length, BaseFloat label)
+  {
+    // Frames already output are final, see FirstMutableFrame().
+    for (MatrixIndexT i = std::max(origin, labelsOffset_); i < origin + length; i++)
+    {
+      labels_[i - labelsOffset_] = label;
+    }
+  }
+
+  HangoverOptions opts_;
+  int32 laughterCountLimit_;
+  int32 laughterBridgeCountLimit_;
+
+  bool laughterFlag_;
+  int32 contigousLaughterCount_;
+  int32 contigousNonLaughterCount_;
+  MatrixIndexT lastLaughterSegment_;
+  MatrixIndexT startOfLaughter_;
+  MatrixIndexT numFrames_;
+  bool inputFinished_;
+
+  LaughterSegment segments_;        // Segments not output yet.
+  std::deque<BaseFloat> labels_;    // Hangover labels not output yet.
+  MatrixIndexT labelsOffset_;       // Index of the first frame in labels_.
+  std::deque<BaseFloat> prob_;      // Laughter probabilities still needed.
+  MatrixIndexT probOffset_;         // Index of the first frame in prob_.
+};
+
+/** @brief Output stage of the --streaming mode: classification, hangover and
+    writing.  The chunks must be accepted in order. */
+class LaughterStreamingOutput
+{
+ public:
+  LaughterStreamingOutput(const std::string &utt, BaseFloat threshold,
+                          const HangoverOptions &hangover_opts, BaseFloat frame_shift_ms,
+                          int32 time_width, const std::string &laughter_prob_fname,
+                          const std::string &laughter_lables_fname,
+                          const std::string &laughter_lables_hangover_fname,
+                          const std::string &laughter_segments_fname):
+      utt_(utt), threshold_(threshold), frame_shift_ms_(frame_shift_ms),
+      time_width_(time_width), hangover_(hangover_opts, frame_shift_ms),
+      laughter_prob_writer_(laughter_prob_fname),
+      laughter_labels_writer_(laughter_lables_fname),
+      laughter_labels_hangover_writer_(laughter_lables_hangover_fname),
+      laughter_segments_file_(laughter_segments_fname.c_str())
+  {
+    if (!laughter_segments_file_.is_open())
+    {
+      KALDI_ERR << "Unable to open file " + laughter_segments_fname;
+    }
+  }
+
+  /// Accepts the laughter probabilities of the next chunk, starting at frame 'offset'.
+  void AcceptChunk(MatrixIndexT offset, const Vector<BaseFloat> &laughter_prob)
+  {
+    Vector<BaseFloat> laughter_labels(laughter_prob.Dim());
+    classification(laughter_prob, laughter_labels, threshold_);
+    laughter_prob_writer_.Write(ChunkKey(offset, laughter_prob.Dim()), laughter_prob);
+    laughter_labels_writer_.Write(ChunkKey(offset, laughter_labels.Dim()), laughter_labels);
+
+    hangover_.AcceptLabels(laughter_labels, laughter_prob);
+    WriteFinal();
+  }
+
+  void InputFinished()
+  {
+    hangover_.InputFinished();
+    WriteFinal();
+  }
+
+ private:
+  // The per-frame outputs are written per chunk, as <utt>-<first-frame>-<last-frame>.
+  std::string ChunkKey(MatrixIndexT offset, MatrixIndexT length) const
+  {
+    std::ostringstream key;
+    key << utt_ << '-' << std::setfill('0') << std::setw(7) << offset
+        << '-' << std::setw(7) << (offset + length - 1);
+    return key.str();
+  }
+
+  void WriteFinal()
+  {
+    Vector<BaseFloat> laughter_labels_hangover;
+    MatrixIndexT offset = hangover_.GetFinalLabels(&laughter_labels_hangover);
+    if (laughter_labels_hangover.Dim() > 0)
+    {
+      laughter_labels_hangover_writer_.Write(ChunkKey(offset, laughter_labels_hangover.Dim()),
+                                             laughter_labels_hangover);
+    }
+
+    LaughterSegment laughter_segments;
+    std::vector<BaseFloat> confidences;
+    hangover_.GetFinalSegments(&laughter_segments, &confidences);
+    for (size_t i = 0; i < laughter_segments.size(); i++)
+    {
+      writeSegment(laughter_segments_file_, laughter_segments[i].first,
+                   laughter_segments[i].second, confidences[i], frame_shift_ms_, time_width_);
+    }
+    if (!laughter_segments.empty())
+    {
+      laughter_segments_file_.flush();
+    }
+  }
+
+  std::string utt_;
+  BaseFloat threshold_;
+  BaseFloat frame_shift_ms_;
+  int32 time_width_;
+  LaughterHangover hangover_;
+  BaseFloatVectorWriter laughter_prob_writer_;
+  BaseFloatVectorWriter laughter_labels_writer_;
+  BaseFloatVectorWriter laughter_labels_hangover_writer_;
+  std::ofstream laughter_segments_file_;
+};
+
+/** @brief Network stage of the --streaming mode, run by a TaskSequencer: the
+    chunks are propagated in parallel, and passed in order to the output in
+    the destructor. */
+class LaughterStreamingChunk
+{
+ public:
+  // 'features' holds the chunk plus its context: the output frames are rows
+  // [skip, skip + num_frames) and the first one has index 'offset'.
+  LaughterStreamingChunk(LaughterNnetPool *nnet_pool, Matrix<BaseFloat> *features,
+                         MatrixIndexT skip, MatrixIndexT num_frames, MatrixIndexT offset,
+                         LaughterStreamingOutput *output):
+      nnet_pool_(nnet_pool), skip_(skip), num_frames_(num_frames), offset_(offset),
+      output_(output)
+  {
+    features_.Swap(features);
+  }
+
+  void operator() ()
+  {
+    CuMatrix<BaseFloat> features_gpu(features_);
+    features_.Resize(0, 0);
+    CuMatrix<BaseFloat> nnet_out;
+    nnet_pool_->Feedforward(features_gpu, &nnet_out);
+
+    Matrix<BaseFloat> nnet_out_host(nnet_out.RowRange(skip_, num_frames_));
+    laughter_prob_.Resize(num_frames_);
+    laughter_prob_.CopyColFromMat(nnet_out_host, 1);
+  }
+
+  ~LaughterStreamingChunk()
+  {
+    output_->AcceptChunk(offset_, laughter_prob_);
+  }
+
+ private:
+  LaughterNnetPool *nnet_pool_;
+  Matrix<BaseFloat> features_;
+  MatrixIndexT skip_;
+  MatrixIndexT num_frames_;
+  MatrixIndexT offset_;
+  LaughterStreamingOutput *output_;
+  Vector<BaseFloat> laughter_prob_;
+};
+
+/** @brief Laughter detection in --streaming mode: the wave file is read chunk by
+    chunk, and the features, the network and the hangover run as a pipeline. */
+void detectLaughterStreaming(const std::string &wav_fname, const MfccOptions &mfcc_ops,
+                             const Matrix<double> &cmvn_stats, const Nnet &nnet_transf,
+                             const Nnet &nnet, const StreamingOptions &streaming_opts,
+                             int32 num_threads, LaughterStreamingOutput *output)
+{
+  std::ifstream iswav(wav_fname.c_str(), std::ios_base::binary);
+  WaveInfo winfo;
+  winfo.Read(iswav);
+  if (winfo.NumChannels() != 1)
+  {
+    KALDI_ERR << wav_fname << " has " << winfo.NumChannels() << " channels, expected 1.";
+  }
+
+  DeltaFeaturesOptions delta_opts;
+  LaughterStreamingFrontend frontend(mfcc_ops, cmvn_stats, delta_opts);
+
+  int32 left_context = 0, right_context = 0;
+  getNnetContext(nnet_transf, &left_context, &right_context);
+  getNnetContext(nnet, &left_context, &right_context);
+
+  BaseFloat frame_shift_ms = mfcc_ops.frame_opts.frame_shift_ms;
+  MatrixIndexT chunk_frames = std::max<MatrixIndexT>(1, streaming_opts.chunkLength * 1000 / frame_shift_ms);
+  MatrixIndexT chunk_samples = std::max<MatrixIndexT>(1, streaming_opts.chunkLength * winfo.SampFreq());
+
+  TaskSequencerConfig config;
+  config.num_threads = num_threads;
+  config.num_threads_total = 2 * num_threads;   // bounds the chunks in flight.
+  LaughterNnetPool nnet_pool(nnet_transf, nnet, num_threads);
+  TaskSequencer<LaughterStreamingChunk> sequencer(config);
+
+  // The features not propagated yet, and the left context of the next chunk.
+  Matrix<BaseFloat> pending;
+  MatrixIndexT pending_offset = 0, next_frame = 0;
+
+  std::vector<char> buffer(chunk_samples * winfo.BlockAlign());
+  int64 bytes_to_go = winfo.IsStreamed() ? -1 : winfo.DataBytes();
+  bool input_finished = false;
+  while (!input_finished)
+  {
+    // Read the next chunk of samples.
+    size_t bytes = buffer.size();
+    if (bytes_to_go >= 0 && bytes_to_go < bytes)
+      bytes = bytes_to_go;
+    iswav.read(&buffer[0], bytes);
+    size_t bytes_read = iswav.gcount();
+    if (iswav.bad())
+      KALDI_ERR << "Error reading " << wav_fname;
+    if (bytes_to_go >= 0)
+      bytes_to_go -= bytes_read;
+    input_finished = (bytes_read < bytes || bytes_to_go == 0);
+
+    Vector<BaseFloat> waveform(bytes_read / winfo.BlockAlign(), kUndefined);
+    const int16 *data_ptr = reinterpret_cast<const int16*>(&buffer[0]);
+    for (MatrixIndexT i = 0; i < waveform.Dim(); i++)
+    {
+      int16 k = data_ptr[i];
+      if (winfo.ReverseBytes())
+        KALDI_SWAP2(k);
+      waveform(i) = k;
+    }
+
+    // Features.
+    frontend.AcceptWaveform(waveform);
+    if (input_finished)
+      frontend.InputFinished();
+    Matrix<BaseFloat> features;
+    frontend.GetFeatures(&features);
+    appendRows(features, &pending);
+
+    // Network, for the chunks whose right context is available.
+    MatrixIndexT end_frame = pending_offset + pending.NumRows();
+    while (next_frame < end_frame &&
+           (input_finished || next_frame + chunk_frames + right_context <= end_frame))
+    {
+      MatrixIndexT num_frames = std::min(chunk_frames, end_frame - next_frame);
+      MatrixIndexT first = std::max<MatrixIndexT>(pending_offset, next_frame - left_context),
+          last = std::min(end_frame, next_frame + num_frames + right_context);
+      Matrix<BaseFloat> chunk(pending.RowRange(first - pending_offset, last - first));
+      sequencer.Run(new LaughterStreamingChunk(&nnet_pool, &chunk, next_frame - first,
+                                               num_frames, next_frame, output));
+      next_frame += num_frames;
+    }
+
+    // Drop the features no longer needed.
+    MatrixIndexT new_offset = std::max<MatrixIndexT>(pending_offset, next_frame - left_context);
+    dropRows(new_offset - pending_offset, &pending);
+    pending_offset = new_offset;
+  }
+  sequencer.Wait();
+  output->InputFinished();
+}
+
+/** @brief Output of the multi-file mode: the per-frame outputs go to
+    (optional) tables, and the segments to one text file, with lines
+    <utt> <start> <end> <confidence>. */
+class LaughterUtteranceWriter
+{
+ public:
+  LaughterUtteranceWriter(const std::string &laughter_prob_wspecifier,
+                          const std::string &laughter_labels_wspecifier,
+                          const std::string &laughter_labels_hangover_wspecifier,
+                          const std::string &laughter_segments_wxfilename,
+                          BaseFloat frame_shift_ms):
+      frame_shift_ms_(frame_shift_ms), num_done_(0), num_fail_(0),
+      laughter_segments_output_(laughter_segments_wxfilename, false)
+  {
+    if (laughter_prob_wspecifier != "")
+      laughter_prob_writer_.Open(laughter_prob_wspecifier);
+    if (laughter_labels_wspecifier != "")
+      laughter_labels_writer_.Open(laughter_labels_wspecifier);
+    if (laughter_labels_hangover_wspecifier != "")
+      laughter_labels_hangover_writer_.Open(laughter_labels_hangover_wspecifier);
+  }
+
+  void Write(const std::string &utt, const Vector<BaseFloat> &laughter_prob,
+             const Vector<BaseFloat> &laughter_labels,
+             const Vector<BaseFloat> &laughter_labels_hangover,
+             const LaughterSegment &laughter_segments, BaseFloat duration)
+  {
+    if (laughter_prob_writer_.IsOpen())
+      laughter_prob_writer_.Write(utt, laughter_prob);
+    if (laughter_labels_writer_.IsOpen())
+      laughter_labels_writer_.Write(utt, laughter_labels);
+    if (laughter_labels_hangover_writer_.IsOpen())
+      laughter_labels_hangover_writer_.Write(utt, laughter_labels_hangover);
+
+    int32 timeWidth = std::to_string((int32)duration).length() + 2 + 1;
+    std::ostream &os = laughter_segments_output_.Stream();
+    for (LaughterSegment::const_iterator segmentIter = laughter_segments.begin(); segmentIter != laughter_segments.end(); ++segmentIter)
+    {
+      KALDI_ASSERT(segmentIter->second >= segmentIter->first);
+      MatrixIndexT length = segmentIter->second - segmentIter->first + 1;
+      BaseFloat confidence = laughter_prob.Range(segmentIter->first, length).Sum() / (length + 1);
+      os << utt << " ";
+      writeSegment(os, segmentIter->first, segmentIter->second, confidence,
+                   frame_shift_ms_, timeWidth);
+    }
+    num_done_++;
+  }
+
+  void WriteFailed() { num_fail_++; }
+
+  int32 NumDone() const { return num_done_; }
+  int32 NumFail() const { return num_fail_; }
+
+ private:
+  BaseFloat frame_shift_ms_;
+  int32 num_done_;
+  int32 num_fail_;
+  BaseFloatVectorWriter laughter_prob_writer_;
+  BaseFloatVectorWriter laughter_labels_writer_;
+  BaseFloatVectorWriter laughter_labels_hangover_writer_;
+  Output laughter_segments_output_;
+};
+
+/** @brief Laughter detection of one utterance in the multi-file mode.  The
+    utterances are processed in parallel by a TaskSequencer, one utterance
+    per thread, and written in order from the destructor. */
+class LaughterDetectorUtterance
+{
+ public:
+  LaughterDetectorUtterance(const std::string &utt, WaveData *wave, const Mfcc &mfcc,
+                            const Matrix<double> &cmvn_stats, LaughterNnetPool *nnet_pool,
+                            BaseFloat threshold, const HangoverOptions &hangover_opts,
+                            BaseFloat frame_shift_ms, LaughterUtteranceWriter *writer):
+      utt_(utt), mfcc_(mfcc), cmvn_stats_(cmvn_stats), nnet_pool_(nnet_pool),
+      threshold_(threshold), hangover_opts_(hangover_opts),
+      frame_shift_ms_(frame_shift_ms), writer_(writer), failed_(false)
+  {
+    wave_.Swap(wave);
+  }
+
+  void operator() ()
+  {
+    // Compute MFCCs & Apply CMVN & the deltas, over the whole utterance.
+    SubVector<BaseFloat> waveform(wave_.Data(), 0);
+    Matrix<BaseFloat> raw_features;
+    mfcc_.Compute(waveform, 1.0, &raw_features);
+    duration_ = wave_.Duration();
+    wave_.Clear();
+    if (raw_features.NumRows() == 0)
+    {
+      KALDI_WARN << "No frames in " << utt_;
+      failed_ = true;
+      return;
+    }
+    ApplyCmvn(cmvn_stats_, true, &raw_features);
+    Matrix<BaseFloat> features;
+    DeltaFeaturesOptions delta_opts;
+    ComputeDeltas(delta_opts, raw_features, &features);
+    if (!KALDI_ISFINITE(features.Sum()))
+    {
+      KALDI_ERR << "NaN or inf found in features of " << utt_;
+    }
+
+    // Neural network,
+    CuMatrix<BaseFloat> features_gpu(features), nnet_out;
+    nnet_pool_->Feedforward(features_gpu, &nnet_out);
+    Matrix<BaseFloat> nnet_out_host(nnet_out);
+    laughter_prob_.Resize(nnet_out_host.NumRows());
+    laughter_prob_.CopyColFromMat(nnet_out_host, 1);
+
+    // Classification & hangover,
+    laughter_labels_.Resize(laughter_prob_.Dim());
+    classification(laughter_prob_, laughter_labels_, threshold_);
+    laughter_labels_hangover_ = laughter_labels_;
+    applyHangover(laughter_labels_, laughter_labels_hangover_, laughter_segments_,
+                  hangover_opts_, frame_shift_ms_);
+  }
+
+  ~LaughterDetectorUtterance()
+  {
+    if (failed_)
+      writer_->WriteFailed();
+    else
+      writer_->Write(utt_, laughter_prob_, laughter_labels_, laughter_labels_hangover_,
+                     laughter_segments_, duration_);
+  }
+
+ private:
+  std::string utt_;
+  WaveData wave_;
+  const Mfcc &mfcc_;
+  const Matrix<double> &cmvn_stats_;
+  LaughterNnetPool *nnet_pool_;
+  BaseFloat threshold_;
+  HangoverOptions hangover_opts_;
+  BaseFloat frame_shift_ms_;
+  LaughterUtteranceWriter *writer_;
+
+  bool failed_;
+  BaseFloat duration_;
+  Vector<BaseFloat> laughter_prob_;
+  Vector<BaseFloat> laughter_labels_;
+  Vector<BaseFloat> laughter_labels_hangover_;
+  LaughterSegment laughter_segments_;
+};
+
+/** @brief Laughter detection of all the utterances of 'wav_rspecifier'.  The
+    models are read once and shared by all the utterances (one copy per
+    thread); a free thread picks up the next utterance, so the cores stay busy
+    whatever the lengths of the files. */
+void detectLaughterMultiFile(const std::string &wav_rspecifier, const MfccOptions &mfcc_ops,
+                             const Matrix<double> &cmvn_stats, const Nnet &nnet_transf,
+                             const Nnet &nnet, BaseFloat threshold,
+                             const HangoverOptions &hangover_ops, int32 num_threads,
+                             LaughterUtteranceWriter *writer)
+{
+  Mfcc mfcc(mfcc_ops);
+  LaughterNnetPool nnet_pool(nnet_transf, nnet, num_threads);
+
+  TaskSequencerConfig config;
+  config.num_threads = num_threads;
+  config.num_threads_total = 2 * num_threads;   // bounds the waves in memory.
+  TaskSequencer<LaughterDetectorUtterance> sequencer(config);
+
+  SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+  for (; !wav_reader.Done(); wav_reader.Next())
+  {
+    std::string utt = wav_reader.Key();
+    WaveData &wave = wav_reader.Value();
+    if (wave.SampFreq() != mfcc_ops.frame_opts.samp_freq)
+    {
+      KALDI_WARN << utt << " needs to be at a sample rate of " << mfcc_ops.frame_opts.samp_freq
+                 << "Hz not " << wave.SampFreq() << "Hz";
+      writer->WriteFailed();
+      continue;
+    }
+    if (wave.Data().NumRows() != 1)
+    {
+      KALDI_WARN << utt << " has " << wave.Data().NumRows() << " channels, expected 1.";
+      writer->WriteFailed();
+      continue;
+    }
+    // As in the single-file mode, laughter shorter than ~100ms is not expected
+    // to be detectable.
+    if (wave.Data().NumCols() < (MatrixIndexT)(0.1 * mfcc_ops.frame_opts.samp_freq))
+    {
+      KALDI_WARN << utt << " is too short, minimum duration is 100ms";
+      writer->WriteFailed();
+      continue;
+    }
+    sequencer.Run(new LaughterDetectorUtterance(utt, &wave, mfcc, cmvn_stats, &nnet_pool,
+                                                threshold, hangover_ops,
+                                                mfcc_ops.frame_opts.frame_shift_ms, writer));
+  }
+  sequencer.Wait();
+}
+
 /** @brief Peforms laughter detection. */
 int main(int argc, char *argv[]) {
 
@@ -285,8 +1169,15 @@ int main(int argc, char *argv[]) {
     const char *usage =
       "Performs laughter detection. \n"
       "Usage:  laughter-detector [options] <wav_file> <model_bin>\n"
+      "   or:  laughter-detector [options] <wav-rspecifier> <model_bin> <segments-wxfilename>\n"
       "e.g.:\n"
-      " laughter-detector [options...] testFile.wav  final.nnet\n";
+      " laughter-detector [options...] testFile.wav  final.nnet\n"
+      " laughter-detector [options...] scp:wav.scp final.nnet laughter.segments\n"
+      "The second form processes many files in one process, one file per thread,\n"
+      "and writes lines <utt> <start> <end> <confidence> to <segments-wxfilename>.\n"
+      "With --streaming=true the wave file is processed in chunks of --chunk-length\n"
+      "seconds and the segments are written as soon as they are final; the frame\n"
+      "outputs are then written per chunk, with keys <utt>-<first-frame>-<last-frame>.\n";
 
     ParseOptions po(usage);
     MfccOptions mfcc_ops;
@@ -298,6 +1189,10 @@ int main(int argc, char *argv[]) {
     // Register the mfcc options
     mfcc_ops.Register(&po);
 
+    // Register the streaming options
+    StreamingOptions streaming_ops;
+    streaming_ops.Register(&po);
+
     BaseFloat threshold = 0.9;
     po.Register("threshold", &threshold, "The threshold to apply for classifying laughter (default 0.9)");
 
@@ -310,9 +1205,19 @@ int main(int argc, char *argv[]) {
     int32 num_threads = 1;
     po.Register("num-threads", &num_threads, "The number of threads to use (default 1)");
 
+    std::string laughter_prob_wspecifier = "",
+        laughter_labels_wspecifier = "",
+        laughter_labels_hangover_wspecifier = "";
+    po.Register("prob-wspecifier", &laughter_prob_wspecifier,
+                "With a <wav-rspecifier>, wspecifier for the laughter probabilities (optional)");
+    po.Register("labels-wspecifier", &laughter_labels_wspecifier,
+                "With a <wav-rspecifier>, wspecifier for the laughter labels (optional)");
+    po.Register("hangover-labels-wspecifier", &laughter_labels_hangover_wspecifier,
+                "With a <wav-rspecifier>, wspecifier for the labels after hangover (optional)");
+
     po.Read(argc, argv);
 
-    if (po.NumArgs() != 2) 
+    if (po.NumArgs() != 2 && po.NumArgs() != 3)
     {
       KALDI_LOG << "Incorrect number of arguments " << po.NumArgs();
       po.PrintUsage();
@@ -324,6 +1229,53 @@ int main(int argc, char *argv[]) {
 
     std::string model_path = model_fname.substr(0, model_fname.find_last_of("/"));
 
+    // if cmvn-stats is empty assume it is in the same location as the nnet.model
+    if (cmvn_stats_file == "") 
+    {
+        cmvn_stats_file =  model_path + "/training_cmvn_stats";
+        KALDI_LOG << "cmvn-stats option not specified, assumed to be at: " + cmvn_stats_file;
+    }
+
+    // if feature-transform" is empty assume it is in the same location as the nnet.model
+    if (feature_transform_file == "") 
+    {
+        feature_transform_file = model_path + "/final.feature_transform";
+        KALDI_LOG << "feature-transform option not specified, assumed to be at: " + feature_transform_file;
+    }
+
+    // Multi-file mode =========================================================
+    if (po.NumArgs() == 3)
+    {
+      if (streaming_ops.streaming)
+        KALDI_ERR << "--streaming is not supported with a <wav-rspecifier>.";
+
+#if HAVE_CUDA == 1
+      CuDevice::Instantiate().SelectGpuId("yes");
+      if (num_threads > 1)
+        CuDevice::Instantiate().AllowMultithreading();
+#endif
+
+      // CMVN Stats
+      Matrix<double> cmvn_stats;
+      ReadKaldiObject(cmvn_stats_file, &cmvn_stats);
+
+      // The models are read once, each thread propagates a copy.
+      Nnet nnet_transf, nnet;
+      nnet_transf.Read(feature_transform_file);
+      nnet.Read(model_fname);
+      nnet_transf.SetDropoutRate(0.0);
+      nnet.SetDropoutRate(0.0);
+
+      LaughterUtteranceWriter writer(laughter_prob_wspecifier, laughter_labels_wspecifier,
+                                     laughter_labels_hangover_wspecifier, po.GetArg(3),
+                                     mfcc_ops.frame_opts.frame_shift_ms);
+      detectLaughterMultiFile(wav_fname, mfcc_ops, cmvn_stats, nnet_transf, nnet, threshold,
+                              hangover_ops, num_threads, &writer);
+      KALDI_LOG << "Detected laughter in " << writer.NumDone() << " files, "
+                << writer.NumFail() << " failed.";
+      return (writer.NumDone() != 0 ? 0 : 1);
+    }
+
     // File names for various results
     size_t wav_ext_point = wav_fname.find_last_of(".");
     size_t wav_filename_start_point = wav_fname.find_last_of("/") + 1;
@@ -333,31 +1285,12 @@ int main(int argc, char *argv[]) {
     std::string laughter_segments_fname = wav_fname.substr(0, wav_ext_point) + ".net.segments";
     std::string utt = wav_fname.substr(wav_filename_start_point, wav_ext_point);
     
-    // File writers
-    BaseFloatVectorWriter laughter_prob_writer(laughter_prob_fname);
-    BaseFloatVectorWriter laughter_labels_writer(laughter_lables_fname);
-    BaseFloatVectorWriter laughter_labels_hangover_writer(laughter_lables_hangover_fname);
-
     // Check if it is a .wav file
     if(wav_fname.substr(wav_ext_point) != ".wav")
     {
         KALDI_ERR << wav_fname << " is not a .wav file, it is: " << wav_fname.substr(wav_ext_point);
     }
 
-    // if cmvn-stats is empty assume it is in the same location as the nnet.model
-    if (cmvn_stats_file == "") 
-    {
-        cmvn_stats_file =  model_path + "/training_cmvn_stats";
-        KALDI_LOG << "cmvn-stats option not specified, assumed to be at: " + cmvn_stats_file;
-    }
-
-    // if feature-transform" is empty assume it is in the same location as the nnet.model
-    if (feature_transform_file == "") 
-    {
-        feature_transform_file = model_path + "/final.feature_transform";
-        KALDI_LOG << "feature-transform option not specified, assumed to be at: " + feature_transform_file;
-    }
-
     // Error Check wav file ===============================================
 
     // Check that the correct sample rate is being used.
@@ -372,6 +1305,45 @@ int main(int argc, char *argv[]) {
         << " not " << winfo.SampFreq() << "Hz";
     }
 
+#if HAVE_CUDA == 1
+    // Select the GPU
+    CuDevice::Instantiate().SelectGpuId("yes");
+    if (num_threads > 1)
+      CuDevice::Instantiate().AllowMultithreading();
+#endif
+
+    if (streaming_ops.streaming)
+    {
+      // CMVN Stats
+      bool binary;
+      Input ki(cmvn_stats_file, &binary);
+      Matrix<double> cmvn_stats;
+      cmvn_stats.Read(ki.Stream(), binary);
+
+      // The models are read once, each thread propagates a copy.
+      Nnet nnet_transf, nnet;
+      nnet_transf.Read(feature_transform_file);
+      nnet.Read(model_fname);
+      nnet_transf.SetDropoutRate(0.0);
+      nnet.SetDropoutRate(0.0);
+
+      // The duration is unknown if the header does not give the data size.
+      int32 timeWidth = winfo.IsStreamed() ? 0 :
+          std::to_string((int32)winfo.Duration()).length() + 2 + 1;
+      LaughterStreamingOutput output(utt, threshold, hangover_ops,
+                                     mfcc_ops.frame_opts.frame_shift_ms, timeWidth,
+                                     laughter_prob_fname, laughter_lables_fname,
+                                     laughter_lables_hangover_fname, laughter_segments_fname);
+      detectLaughterStreaming(wav_fname, mfcc_ops, cmvn_stats, nnet_transf, nnet,
+                              streaming_ops, num_threads, &output);
+      return 0;
+    }
+
+    // File writers
+    BaseFloatVectorWriter laughter_prob_writer(laughter_prob_fname);
+    BaseFloatVectorWriter laughter_labels_writer(laughter_lables_fname);
+    BaseFloatVectorWriter laughter_labels_hangover_writer(laughter_lables_hangover_fname);
+
     std::ifstream iswav(wav_fname, std::ios_base::binary);
     WaveData* wave = new WaveData;
     wave->Read(iswav);
@@ -412,10 +1384,7 @@ int main(int argc, char *argv[]) {
     delete wave;
 
     // Neural Network Processing ==============================================
-    
-    // Select the GPU
-    CuDevice::Instantiate().SelectGpuId("yes");
-    
+
     // Nnet transf
     Nnet* nnet_transf = new Nnet;
     nnet_transf->Read(feature_transform_file);
@@ -515,8 +1484,7 @@ int main(int argc, char *argv[]) {
     BaseFloat confidence = 0.0;
     MatrixIndexT origin = 0;
     MatrixIndexT length = 0;
-    int32 decimalPrecision = 2;
-    int32 timeWidth = std::to_string((int32)max_duration_s).length() + decimalPrecision + 1;
+    int32 timeWidth = std::to_string((int32)max_duration_s).length() + 2 + 1;
 
     if (laughter_segments_file.is_open())
     {
@@ -529,9 +1497,8 @@ int main(int argc, char *argv[]) {
           // Condifence is the average probability of laughter frames
           confidence = (laughter_prob.Range(origin, length)).Sum() / (length + 1);
           
-          laughter_segments_file << std::setfill('0') << std::setw(timeWidth) << std::fixed << std::setprecision(decimalPrecision) << (BaseFloat)(segmentIter->first) * mfcc_ops.frame_opts.frame_shift_ms/1000 << " ";
-          laughter_segments_file << std::setfill('0') << std::setw(timeWidth) << std::fixed << std::setprecision(decimalPrecision) << (BaseFloat)(segmentIter->second) * mfcc_ops.frame_opts.frame_shift_ms/1000 << " ";
-          laughter_segments_file << std::fixed <<  std::setprecision(decimalPrecision) << confidence << std::endl;
+          writeSegment(laughter_segments_file, segmentIter->first, segmentIter->second,
+                       confidence, mfcc_ops.frame_opts.frame_shift_ms, timeWidth);
         }
 
       laughter_segments_file.close();
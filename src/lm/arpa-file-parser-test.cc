@@ -62,6 +62,7 @@ template <class T>
 struct CountedArray {
   template <size_t N>
   CountedArray(T(&array)[N]) : array(array), count(N) { }
+  CountedArray(const T *array, size_t count) : array(array), count(count) { }
   const T *array;
   const size_t count;
 };
@@ -204,6 +205,55 @@ ngram 3=2\n\
                   MakeCountedArray(expect_ngrams));
 }
 
+// Read a randomly generated integer LM that is large enough for the n-gram
+// sections to be split into several blocks and parsed by several threads, and
+// check that the n-grams (and their line numbers) come out in the file order.
+void ReadIntegerLmMultiThreaded() {
+  KALDI_LOG << "ReadIntegerLmMultiThreaded()";
+
+  int32 counts[] = { 500, 20000, 70000 };
+  std::vector<NGramTestData> expect_ngrams;
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(3);
+  os << "\\data\\\n";
+  for (int32 order = 1; order <= 3; order++)
+    os << "ngram " << order << "=" << counts[order - 1] << "\n";
+  int32 line_number = 4;
+  for (int32 order = 1; order <= 3; order++) {
+    os << "\n\\" << order << "-grams:\n";
+    line_number += 2;
+    for (int32 i = 0; i < counts[order - 1]; i++) {
+      NGramTestData data = { 0 };
+      data.line_number = ++line_number;
+      data.logprob = -RandInt(0, 99999) / 1000.0;
+      os << data.logprob;
+      for (int32 j = 0; j < order; j++) {
+        data.words[j] = RandInt(1, 10000);
+        os << (j == 0 ? '\t' : ' ') << data.words[j];
+      }
+      if (order < 3 && RandInt(0, 1) == 0) {
+        data.backoff = -RandInt(0, 9999) / 1000.0;
+        os << '\t' << data.backoff;
+      }
+      os << "\n";
+      expect_ngrams.push_back(data);
+    }
+  }
+  os << "\n\\end\\\n";
+
+  ArpaParseOptions options;
+  options.bos_symbol = 1;
+  options.eos_symbol = 2;
+  options.num_threads = 4;
+
+  TestableArpaFileParser parser(options, NULL);
+  std::istringstream stm(os.str(), std::ios_base::in);
+  parser.Read(stm);
+  parser.Validate(CountedArray<int32>(counts),
+                  CountedArray<NGramTestData>(&(expect_ngrams[0]),
+                                              expect_ngrams.size()));
+}
+
 // \xCE\xB2 = UTF-8 for Greek beta, to churn some UTF-8 cranks.
 static std::string symbolic_lm = "\
 We also allow random text coming before the \\data\\\n\
@@ -367,6 +417,7 @@ void ReadSymbolicLmWithOovTests() {
 
 int main(int argc, char *argv[]) {
   kaldi::ReadIntegerLmLogconvExpectSuccess();
+  kaldi::ReadIntegerLmMultiThreaded();
   kaldi::ReadSymbolicLmNoOovTests();
   kaldi::ReadSymbolicLmWithOovTests();
 }
@@ -25,6 +25,7 @@
 #include "base/kaldi-error.h"
 #include "base/kaldi-math.h"
 #include "lm/arpa-file-parser.h"
+#include "util/kaldi-thread.h"
 #include "util/text-utils.h"
 
 namespace kaldi {
@@ -42,6 +43,125 @@ void TrimTrailingWhitespace(std::string *str) {
   str->erase(str->find_last_not_of(" \n\r\t") + 1);
 }
 
+// The number of n-gram lines that we read at a time, to be parsed in parallel.
+static const size_t kArpaBlockSize = 65536;
+
+enum ArpaLineStatus {
+  kArpaLineOk,
+  kArpaLineSkip,   // The n-gram has an OOV word and is to be skipped.
+  kArpaLineError
+};
+
+// Parses an n-gram data line of order "order" into "ngram", and returns one
+// of the values of enum ArpaLineStatus.  In the case kArpaLineSkip, "message"
+// is set to the OOV word; in the case kArpaLineError, to the error message.
+// This only modifies the symbol table if options.oov_handling is
+// kAddToSymbols; otherwise it can be called from several threads at once.
+static int32 ParseNGramLine(const std::string &line, int32 order,
+                            bool is_highest_order,
+                            const ArpaParseOptions &options,
+                            fst::SymbolTable *symbols,
+                            NGram *ngram, std::string *message) {
+  std::vector<std::string> col;
+  SplitStringToVector(line, " \t", true, &col);
+
+  if (col.size() < 1 + order || col.size() > 2 + order ||
+      (is_highest_order && col.size() != 1 + order)) {
+    *message = "Invalid n-gram data line";
+    return kArpaLineError;
+  }
+
+  // Parse out n-gram logprob and, if present, backoff weight.
+  if (!ConvertStringToReal(col[0], &ngram->logprob)) {
+    *message = "invalid n-gram logprob '" + col[0] + "'";
+    return kArpaLineError;
+  }
+  ngram->backoff = 0.0;
+  if (col.size() > order + 1) {
+    if (!ConvertStringToReal(col[order + 1], &ngram->backoff)) {
+      *message = "invalid backoff weight '" + col[order + 1] + "'";
+      return kArpaLineError;
+    }
+  }
+  // Convert to natural log.
+  ngram->logprob *= M_LN10;
+  ngram->backoff *= M_LN10;
+
+  ngram->words.resize(order);
+  for (int32 index = 0; index < order; ++index) {
+    const std::string &str = col[1 + index];
+    int32 word;
+    if (symbols) {
+      // Symbol table provided, so symbol labels are expected.
+      if (options.oov_handling == ArpaParseOptions::kAddToSymbols) {
+        word = symbols->AddSymbol(str);
+      } else {
+        word = symbols->Find(str);
+        if (word == -1) { // fst::kNoSymbol
+          switch (options.oov_handling) {
+            case ArpaParseOptions::kReplaceWithUnk:
+              word = options.unk_symbol;
+              break;
+            case ArpaParseOptions::kSkipNGram:
+              *message = str;
+              return kArpaLineSkip;
+            default:
+              *message = "word '" + str + "' not in symbol table";
+              return kArpaLineError;
+          }
+        }
+      }
+    } else {
+      // Symbols not provided, LM file should contain integers.
+      if (!ConvertStringToInteger(str, &word) || word < 0) {
+        *message = "invalid symbol '" + str + "'";
+        return kArpaLineError;
+      }
+    }
+    // Whichever way we got it, an epsilon is invalid.
+    if (word == 0) {
+      *message = "epsilon symbol '" + str + "' is illegal in ARPA LM";
+      return kArpaLineError;
+    }
+    ngram->words[index] = word;
+  }
+  return kArpaLineOk;
+}
+
+// Parses a block of n-gram lines with ParseNGramLine(); each thread does a
+// contiguous range of the lines.
+class ArpaParseTask: public MultiThreadable {
+ public:
+  ArpaParseTask(const std::vector<std::string> &lines, int32 order,
+                bool is_highest_order, const ArpaParseOptions &options,
+                fst::SymbolTable *symbols, std::vector<NGram> *ngrams,
+                std::vector<int32> *status,
+                std::vector<std::string> *messages):
+      lines_(&lines), order_(order), is_highest_order_(is_highest_order),
+      options_(&options), symbols_(symbols), ngrams_(ngrams),
+      status_(status), messages_(messages) { }
+
+  void operator() () {
+    size_t num_lines = lines_->size(),
+        begin = num_lines * thread_id_ / num_threads_,
+        end = num_lines * (thread_id_ + 1) / num_threads_;
+    for (size_t i = begin; i < end; i++)
+      (*status_)[i] = ParseNGramLine((*lines_)[i], order_, is_highest_order_,
+                                     *options_, symbols_, &((*ngrams_)[i]),
+                                     &((*messages_)[i]));
+  }
+
+ private:
+  const std::vector<std::string> *lines_;
+  int32 order_;
+  bool is_highest_order_;
+  const ArpaParseOptions *options_;
+  fst::SymbolTable *symbols_;
+  std::vector<NGram> *ngrams_;
+  std::vector<int32> *status_;
+  std::vector<std::string> *messages_;
+};
+
 void ArpaFileParser::Read(std::istream &is) {
   // Argument sanity checks.
   if (options_.bos_symbol <= 0 || options_.eos_symbol <= 0 ||
@@ -129,8 +249,19 @@ void ArpaFileParser::Read(std::istream &is) {
   // Signal that grammar order and n-gram counts are known.
   HeaderAvailable();
 
-  NGram ngram;
-  ngram.words.reserve(ngram_counts_.size());
+  // The n-gram lines are read in blocks; each block is parsed by
+  // options_.num_threads threads, and then the n-grams are given to
+  // ConsumeNGram() in the file order.  If we may have to add words to the
+  // symbol table, the parsing is done in this thread.
+  int32 num_threads = options_.num_threads;
+  if (symbols_ != NULL &&
+      options_.oov_handling == ArpaParseOptions::kAddToSymbols)
+    num_threads = 0;
+  std::vector<std::string> lines;
+  std::vector<int32> line_numbers;
+  std::vector<NGram> ngrams;
+  std::vector<int32> status;
+  std::vector<std::string> messages;
 
   // Processes "\N-grams:" section.
   for (int32 cur_order = 1; cur_order <= ngram_counts_.size(); ++cur_order) {
@@ -149,99 +280,83 @@ void ArpaFileParser::Read(std::istream &is) {
     KALDI_LOG << "Reading " << current_line_ << " section.";
 
     int32 ngram_count = 0;
-    while (++line_number_, getline(is, current_line_) && !is.eof()) {
-      if (current_line_.find_first_not_of(" \n\t\r") == std::string::npos) {
-        continue;
-      }
-      if (current_line_[0] == '\\') {
-        TrimTrailingWhitespace(&current_line_);
-        std::ostringstream next_keyword;
-        next_keyword << "\\" << cur_order + 1 << "-grams:";
-        if ((current_line_ != next_keyword.str()) &&
-            (current_line_ != "\\end\\")) {
-          if (ShouldWarn()) {
-            KALDI_WARN << "ignoring possible directive '" << current_line_
-                       << "' expecting '" << next_keyword.str() << "'";
-
-            if (warning_count_ > 0 &&
-                warning_count_ > static_cast<uint32>(options_.max_warnings)) {
-              KALDI_WARN << "Of " << warning_count_ << " parse warnings, "
-                         << options_.max_warnings << " were reported. "
-                         << "Run program with --max-arpa-warnings=-1 "
-                         << "to see all warnings";
+    bool section_done = false;
+    while (!section_done) {
+      lines.clear();
+      line_numbers.clear();
+      section_done = true;
+      while (++line_number_, getline(is, current_line_) && !is.eof()) {
+        if (current_line_.find_first_not_of(" \n\t\r") == std::string::npos) {
+          continue;
+        }
+        if (current_line_[0] == '\\') {
+          TrimTrailingWhitespace(&current_line_);
+          std::ostringstream next_keyword;
+          next_keyword << "\\" << cur_order + 1 << "-grams:";
+          if ((current_line_ != next_keyword.str()) &&
+              (current_line_ != "\\end\\")) {
+            if (ShouldWarn()) {
+              KALDI_WARN << "ignoring possible directive '" << current_line_
+                         << "' expecting '" << next_keyword.str() << "'";
+
+              if (warning_count_ > 0 &&
+                  warning_count_ > static_cast<uint32>(options_.max_warnings)) {
+                KALDI_WARN << "Of " << warning_count_ << " parse warnings, "
+                           << options_.max_warnings << " were reported. "
+                           << "Run program with --max-arpa-warnings=-1 "
+                           << "to see all warnings";
+              }
             }
+          } else {
+            break;
           }
-        } else {
+        }
+        lines.push_back(current_line_);
+        line_numbers.push_back(line_number_);
+        if (lines.size() == kArpaBlockSize) {
+          section_done = false;
           break;
         }
       }
-
-      std::vector<std::string> col;
-      SplitStringToVector(current_line_, " \t", true, &col);
-
-      if (col.size() < 1 + cur_order ||
-          col.size() > 2 + cur_order ||
-          (cur_order == ngram_counts_.size() && col.size() != 1 + cur_order)) {
-        PARSE_ERR << "Invalid n-gram data line";
+      // Remember where we are (the directive that ended the section, if we
+      // saw it), as we set current_line_ and line_number_ for each n-gram for
+      // the sake of LineReference().
+      std::string next_line(current_line_);
+      int32 next_line_number = line_number_;
+
+      size_t num_lines = lines.size();
+      ngrams.resize(num_lines);
+      status.resize(num_lines);
+      messages.resize(num_lines);
+      {
+        ArpaParseTask task(lines, cur_order,
+                           cur_order == ngram_counts_.size(), options_,
+                           symbols_, &ngrams, &status, &messages);
+        // With zero threads, MultiThreader runs the task in this thread.
+        // Small blocks are not worth starting threads for.
+        int32 this_num_threads = num_threads;
+        if (num_threads <= 1 || num_lines < kArpaBlockSize / 16)
+          this_num_threads = 0;
+        MultiThreader<ArpaParseTask> m(this_num_threads, task);
       }
-      ++ngram_count;
 
-      // Parse out n-gram logprob and, if present, backoff weight.
-      if (!ConvertStringToReal(col[0], &ngram.logprob)) {
-        PARSE_ERR << "invalid n-gram logprob '" << col[0] << "'";
-      }
-      ngram.backoff = 0.0;
-      if (col.size() > cur_order + 1) {
-        if (!ConvertStringToReal(col[cur_order + 1], &ngram.backoff))
-          PARSE_ERR << "invalid backoff weight '" << col[cur_order + 1] << "'";
-      }
-      // Convert to natural log.
-      ngram.logprob *= M_LN10;
-      ngram.backoff *= M_LN10;
-
-      ngram.words.resize(cur_order);
-      bool skip_ngram = false;
-      for (int32 index = 0; !skip_ngram && index < cur_order; ++index) {
-        int32 word;
-        if (symbols_) {
-          // Symbol table provided, so symbol labels are expected.
-          if (options_.oov_handling == ArpaParseOptions::kAddToSymbols) {
-            word = symbols_->AddSymbol(col[1 + index]);
-          } else {
-            word = symbols_->Find(col[1 + index]);
-            if (word == -1) { // fst::kNoSymbol
-              switch (options_.oov_handling) {
-                case ArpaParseOptions::kReplaceWithUnk:
-                  word = options_.unk_symbol;
-                  break;
-                case ArpaParseOptions::kSkipNGram:
-                  if (ShouldWarn())
-                    KALDI_WARN << LineReference() << " skipped: word '"
-                               << col[1 + index] << "' not in symbol table";
-                  skip_ngram = true;
-                  break;
-                default:
-                  PARSE_ERR << "word '"  << col[1 + index]
-                            << "' not in symbol table";
-              }
-            }
-          }
-        } else {
-          // Symbols not provided, LM file should contain integers.
-          if (!ConvertStringToInteger(col[1 + index], &word) || word < 0) {
-            PARSE_ERR << "invalid symbol '" << col[1 + index] << "'";
-          }
+      for (size_t i = 0; i < num_lines; i++) {
+        current_line_.swap(lines[i]);
+        line_number_ = line_numbers[i];
+        if (status[i] == kArpaLineError) {
+          PARSE_ERR << messages[i];
         }
-        // Whichever way we got it, an epsilon is invalid.
-        if (word == 0) {
-          PARSE_ERR << "epsilon symbol '" << col[1 + index]
-                    << "' is illegal in ARPA LM";
+        ++ngram_count;
+        if (status[i] == kArpaLineSkip) {
+          if (ShouldWarn())
+            KALDI_WARN << LineReference() << " skipped: word '"
+                       << messages[i] << "' not in symbol table";
+        } else {
+          ConsumeNGram(ngrams[i]);
         }
-        ngram.words[index] = word;
-      }
-      if (!skip_ngram) {
-        ConsumeNGram(ngram);
       }
+      current_line_.swap(next_line);
+      line_number_ = next_line_number;
     }
     if (ngram_count > ngram_counts_[cur_order - 1]) {
       PARSE_ERR << "header said there would be " << ngram_counts_[cur_order - 1]
@@ -249,7 +364,6 @@ void ArpaFileParser::Read(std::istream &is) {
                 << ", but we saw more already.";
     }
   }
-
   if (current_line_ != "\\end\\") {
     PARSE_ERR << "invalid or unexpected directive line, expecting \\end\\";
   }
@@ -44,15 +44,20 @@ struct ArpaParseOptions {
 
   ArpaParseOptions():
       bos_symbol(-1), eos_symbol(-1), unk_symbol(-1),
-      oov_handling(kRaiseError), max_warnings(30) { }
+      oov_handling(kRaiseError), max_warnings(30), num_threads(1) { }
 
   void Register(OptionsItf *opts) {
-    // Registering only the max_warnings count, since other options are
-    // treated differently by client programs: some want integer symbols,
-    // while other are passed words in their command line.
+    // Registering only the max_warnings count and the number of threads,
+    // since other options are treated differently by client programs: some
+    // want integer symbols, while other are passed words in their command
+    // line.
     opts->Register("max-arpa-warnings", &max_warnings,
                    "Maximum warnings to report on ARPA parsing, "
                    "0 to disable, -1 to show all");
+    opts->Register("num-threads", &num_threads,
+                   "Number of threads used to parse the n-grams of the ARPA "
+                   "file (the reading itself, and the consumption of the "
+                   "n-grams, is done in one thread).");
   }
 
   int32 bos_symbol;  ///< Symbol for <s>, Required non-epsilon.
@@ -60,6 +65,7 @@ struct ArpaParseOptions {
   int32 unk_symbol;  ///< Symbol for <unk>, Required for kReplaceWithUnk.
   OovHandling oov_handling;  ///< How to handle OOV words in the file.
   int32 max_warnings;  ///< Maximum warnings to report, <0 unlimited.
+  int32 num_threads;  ///< Number of threads for parsing n-gram lines.
 };
 
 /**
@@ -109,7 +115,9 @@ class ArpaFileParser {
 
   /// Pure override that must be implemented to process current n-gram. The
   /// n-grams are sent in the file order, which guarantees that all
-  /// (k-1)-grams are processed before the first k-gram is.
+  /// (k-1)-grams are processed before the first k-gram is.  It is always
+  /// called from the thread that called Read(), even if options.num_threads
+  /// is more than one.
   virtual void ConsumeNGram(const NGram&) = 0;
 
   /// Override function called after the last n-gram has been consumed.
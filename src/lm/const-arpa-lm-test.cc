@@ -0,0 +1,130 @@
+// lm/const-arpa-lm-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-math.h"
+#include "lm/const-arpa-lm.h"
+
+namespace kaldi {
+
+static const int32 kBos = 1, kEos = 2;
+
+// Writes a random trigram ARPA file with integer words to "filename": <s> is
+// 1, </s> is 2 and the other words are 3 ... "num_words" + 2.  Every n-gram's
+// history is itself an n-gram, as ConstArpaLm requires.  The n-grams of each
+// order are written in random order, so that the sorted runs of
+// BuildConstArpaLmExternal() overlap.
+static void WriteRandomArpa(int32 num_words, int32 num_bigrams,
+                            int32 num_trigrams, const std::string &filename) {
+  std::vector<std::vector<int32> > ngrams[3];
+  for (int32 w = kBos; w <= num_words + 2; w++)
+    ngrams[0].push_back(std::vector<int32>(1, w));
+
+  std::set<std::vector<int32> > seen;
+  for (int32 i = 0; i < num_bigrams; i++) {
+    std::vector<int32> bigram(2);
+    bigram[0] = (RandInt(0, 3) == 0 ? kBos : RandInt(3, num_words + 2));
+    bigram[1] = (RandInt(0, 9) == 0 ? kEos : RandInt(3, num_words + 2));
+    if (seen.insert(bigram).second)
+      ngrams[1].push_back(bigram);
+  }
+  for (int32 i = 0; i < num_trigrams; i++) {
+    std::vector<int32> trigram(ngrams[1][RandInt(0, ngrams[1].size() - 1)]);
+    if (trigram[1] == kEos)
+      continue;
+    trigram.push_back(RandInt(0, 9) == 0 ? kEos : RandInt(3, num_words + 2));
+    if (seen.insert(trigram).second)
+      ngrams[2].push_back(trigram);
+  }
+
+  std::ofstream os(filename.c_str());
+  os << "\n\\data\\\n";
+  for (int32 order = 1; order <= 3; order++)
+    os << "ngram " << order << "=" << ngrams[order - 1].size() << "\n";
+  for (int32 order = 1; order <= 3; order++) {
+    std::vector<std::vector<int32> > &this_ngrams = ngrams[order - 1];
+    for (size_t i = this_ngrams.size(); i > 1; i--)
+      std::swap(this_ngrams[i - 1], this_ngrams[RandInt(0, i - 1)]);
+    os << "\n\\" << order << "-grams:\n";
+    for (size_t i = 0; i < this_ngrams.size(); i++) {
+      const std::vector<int32> &ngram = this_ngrams[i];
+      // <s> is never predicted, so by convention it gets log-prob -99.
+      os << (ngram[0] == kBos && order == 1 ? -99.0 : -5.0 * RandUniform());
+      for (size_t j = 0; j < ngram.size(); j++)
+        os << (j == 0 ? '\t' : ' ') << ngram[j];
+      if (order < 3 && ngram.back() != kEos)
+        os << '\t' << -2.0 * RandUniform();
+      os << "\n";
+    }
+  }
+  os << "\n\\end\\\n";
+  KALDI_ASSERT(os.good());
+}
+
+static std::string ReadFileContents(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(is),
+                     std::istreambuf_iterator<char>());
+}
+
+// Checks that BuildConstArpaLmExternal() gives byte-for-byte the same output
+// as BuildConstArpaLm().  The memory limit is so small that the n-grams are
+// sorted in many runs of 15 to 60 n-grams each (a trigram record takes 32
+// bytes with its pointer), which are then merged.
+static void UnitTestBuildConstArpaLmExternal(bool align) {
+  const std::string arpa_filename = "const-arpa-lm-test.arpa",
+      lm_filename = "const-arpa-lm-test.lm",
+      external_lm_filename = "const-arpa-lm-test.external.lm";
+  WriteRandomArpa(RandInt(10, 50), RandInt(50, 300), RandInt(50, 500),
+                  arpa_filename);
+
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  BaseFloat max_memory_mb = RandInt(500, 2000) / 1048576.0;
+  KALDI_ASSERT(BuildConstArpaLm(options, arpa_filename, lm_filename, align));
+  KALDI_ASSERT(BuildConstArpaLmExternal(options, arpa_filename,
+                                        external_lm_filename, max_memory_mb,
+                                        "", align));
+  std::string lm = ReadFileContents(lm_filename),
+      external_lm = ReadFileContents(external_lm_filename);
+  KALDI_ASSERT(!lm.empty() && lm == external_lm);
+
+  unlink(arpa_filename.c_str());
+  unlink(lm_filename.c_str());
+  unlink(external_lm_filename.c_str());
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    UnitTestBuildConstArpaLmExternal(false);
+    UnitTestBuildConstArpaLmExternal(true);
+  }
+  std::cout << "Test OK\n";
+  return 0;
+}
@@ -17,7 +17,14 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -31,6 +38,88 @@
 
 namespace kaldi {
 
+// This is written at the start of the LmStates section by
+// ConstArpaLm::Write() when asked for the aligned layout, so that we can detect files that were written on a
+// machine with a different byte order (our binary format is native-endian).
+static const int32 kConstArpaLmByteOrderMarker = 0x01020304;
+
+// Writes the parts of the ConstArpaLm format that come before the LmStates
+// data: the header, the LmInfo section, and the beginning of the LmStates
+// section up to and including its size.  If "align" is true it writes the
+// <Align> record (see ConstArpaLm::Write()).  This and
+// WriteConstArpaLmTrailer() are shared by ConstArpaLm::Write() and
+// ConstArpaLmExternalBuilder::Write().
+static void WriteConstArpaLmHeader(std::ostream &os, int32 bos_symbol,
+                                   int32 eos_symbol, int32 unk_symbol,
+                                   int32 ngram_order, int64 lm_states_size,
+                                   bool align) {
+  bool binary = true;
+  WriteToken(os, binary, "<ConstArpaLm>");
+
+  // Misc info.
+  WriteToken(os, binary, "<LmInfo>");
+  WriteBasicType(os, binary, bos_symbol);
+  WriteBasicType(os, binary, eos_symbol);
+  WriteBasicType(os, binary, unk_symbol);
+  WriteBasicType(os, binary, ngram_order);
+  WriteToken(os, binary, "</LmInfo>");
+
+  // LmStates section.
+  WriteToken(os, binary, "<LmStates>");
+  if (align) {
+    WriteToken(os, binary, "<Align>");
+    WriteBasicType(os, binary, kConstArpaLmByteOrderMarker);
+    // Work out how much padding we need so that the LmStates (which follow the
+    // padding, and the 9 bytes of the int32 and int64 below) start at a
+    // multiple of 8 bytes from the start of the file.  If we can't tell the
+    // position (e.g. we are writing to a pipe), it doesn't matter as the
+    // output could not be memory-mapped anyway.
+    int32 num_pad = 0;
+    std::streamoff pos = os.tellp();
+    if (pos >= 0)
+      num_pad = (8 - (pos + 5 + 9) % 8) % 8;
+    WriteBasicType(os, binary, num_pad);
+    for (int32 i = 0; i < num_pad; i++)
+      os.put('\0');
+  }
+  WriteBasicType(os, binary, lm_states_size);
+}
+
+// Writes the parts of the ConstArpaLm format that come after the LmStates
+// data.  The addresses are offsets into the LmStates plus one, or zero for
+// NULL (see ConstArpaLm::Write()).
+static void WriteConstArpaLmTrailer(
+    std::ostream &os, const std::vector<int64> &unigram_addresses,
+    const std::vector<int64> &overflow_addresses) {
+  bool binary = true;
+  WriteToken(os, binary, "</LmStates>");
+
+  // Unigram section.
+  WriteToken(os, binary, "<LmUnigram>");
+  int32 num_words = unigram_addresses.size();
+  WriteBasicType(os, binary, num_words);
+  if (num_words > 0)
+    os.write(reinterpret_cast<const char *>(&(unigram_addresses[0])),
+             sizeof(int64) * num_words);
+  if (!os.good()) {
+    KALDI_ERR << "ConstArpaLm <LmUnigram> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmUnigram>");
+
+  // Overflow section.
+  WriteToken(os, binary, "<LmOverflow>");
+  int32 overflow_buffer_size = overflow_addresses.size();
+  WriteBasicType(os, binary, overflow_buffer_size);
+  if (overflow_buffer_size > 0)
+    os.write(reinterpret_cast<const char *>(&(overflow_addresses[0])),
+             sizeof(int64) * overflow_buffer_size);
+  if (!os.good()) {
+    KALDI_ERR << "ConstArpaLm <LmOverflow> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmOverflow>");
+  WriteToken(os, binary, "</ConstArpaLm>");
+}
+
 // Auxiliary struct for converting ConstArpaLm format langugae model to Arpa
 // format.
 struct ArpaLine {
@@ -184,6 +273,7 @@ class ConstArpaLmBuilder : public ArpaFileParser {
     lm_states_size_ = 0;
     max_address_offset_ = pow(2, 30) - 1;
     is_built_ = false;
+    align_ = false;
     lm_states_ = NULL;
     unigram_states_ = NULL;
     overflow_buffer_ = NULL;
@@ -205,6 +295,10 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Writes ConstArpaLm.
   void Write(std::ostream &os, bool binary) const;
 
+  // If "align" is true, Write() uses the aligned layout that
+  // ConstArpaLm::ReadMapped() can memory-map (see ConstArpaLm::Write()).
+  void SetAlign(bool align) { align_ = align; }
+
   void SetMaxAddressOffset(const int32 max_address_offset) {
     KALDI_WARN << "You are changing <max_address_offset_>; the default should "
         << "not be changed unless you are in testing mode.";
@@ -230,6 +324,9 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Indicating if ConstArpaLm has been built or not.
   bool is_built_;
 
+  // If true, Write() writes the aligned layout.
+  bool align_;
+
   // Maximum relative address for the child. We put it here just for testing.
   // The default value is 30-bits and should not be changed except for testing.
   int32 max_address_offset_;
@@ -491,83 +588,511 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
       Options().bos_symbol, Options().eos_symbol, Options().unk_symbol,
       ngram_order_, num_words_, overflow_buffer_size_, lm_states_size_,
       unigram_states_, overflow_buffer_, lm_states_);
-  const_arpa_lm.Write(os, binary);
+  const_arpa_lm.Write(os, binary, align_);
 }
 
-void ConstArpaLm::Write(std::ostream &os, bool binary) const {
-  KALDI_ASSERT(initialized_);
+// Opens an anonymous temporary file in directory "tmp_dir" (or in the system's
+// default temporary directory if "tmp_dir" is empty); the file is deleted when
+// it is closed.
+static FILE *OpenTempFile(const std::string &tmp_dir) {
+  FILE *file = NULL;
+#ifndef _MSC_VER
+  if (!tmp_dir.empty()) {
+    std::string pattern = tmp_dir + "/const-arpa-lm.XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    int fd = mkstemp(&(name[0]));
+    if (fd != -1) {
+      unlink(&(name[0]));
+      file = fdopen(fd, "w+b");
+      if (file == NULL)
+        close(fd);
+    }
+  } else {
+    file = tmpfile();
+  }
+#else
+  if (!tmp_dir.empty()) {
+    KALDI_WARN << "Temporary directory " << tmp_dir << " is ignored on this "
+               << "platform.";
+  }
+  file = tmpfile();
+#endif
+  if (file == NULL) {
+    KALDI_ERR << "Could not create a temporary file in "
+              << (tmp_dir.empty() ? "the default temporary directory" : tmp_dir)
+              << ": " << strerror(errno);
+  }
+  return file;
+}
+
+static void SeekTempFile(FILE *file, int64 pos) {
+#ifndef _MSC_VER
+  int ret = fseeko(file, static_cast<off_t>(pos), SEEK_SET);
+#else
+  int ret = _fseeki64(file, pos, SEEK_SET);
+#endif
+  if (ret != 0)
+    KALDI_ERR << "Seeking in temporary file failed: " << strerror(errno);
+}
+
+static void WriteTempFile(FILE *file, const int32 *data, size_t size) {
+  if (size > 0 && fwrite(data, sizeof(int32), size, file) != size)
+    KALDI_ERR << "Writing to temporary file failed (disk full?): "
+              << strerror(errno);
+}
+
+// Class to build ConstArpaLm from an Arpa format language model that may be
+// too large for ConstArpaLmBuilder, which keeps every LmState (and a hash table
+// indexing them) in memory.  Here the n-grams are stored as fixed-size
+// records, which are sorted in chunks of at most --max-memory-mb and written to
+// temporary "run" files.  ReadComplete() merges the runs and visits the
+// n-grams in descending lexicographic order, in which every n-gram comes after
+// all the n-grams that extend it.  This means that when we get to an LmState we
+// already know the sizes of, and relative addresses to, all its children, so
+// we can write it out straight away (to a temporary file, in reverse order)
+// while only keeping in memory the children of the LmStates on the current
+// path.  Write() then copies the LmStates to the output in the forward order.
+// The output is the same as that of ConstArpaLmBuilder, except that entries of
+// the overflow buffer may be in a different order.
+class ConstArpaLmExternalBuilder : public ArpaFileParser {
+ public:
+  ConstArpaLmExternalBuilder(ArpaParseOptions options, BaseFloat max_memory_mb,
+                             const std::string &tmp_dir)
+      : ArpaFileParser(options, NULL), max_memory_mb_(max_memory_mb),
+        tmp_dir_(tmp_dir), ngram_order_(0), record_size_(0),
+        max_chunk_records_(0), max_address_offset_(pow(2, 30) - 1),
+        align_(false), lm_states_size_(0), lm_states_file_(NULL) {
+    KALDI_ASSERT(max_memory_mb > 0);
+  }
+
+  ~ConstArpaLmExternalBuilder() {
+    for (size_t i = 0; i < run_files_.size(); i++)
+      fclose(run_files_[i]);
+    if (lm_states_file_ != NULL)
+      fclose(lm_states_file_);
+  }
+
+  // Writes ConstArpaLm.
+  void Write(std::ostream &os, bool binary) const;
+
+  // As ConstArpaLmBuilder::SetAlign().
+  void SetAlign(bool align) { align_ = align; }
+
+ protected:
+  // ArpaFileParser overrides.
+  virtual void HeaderAvailable();
+  virtual void ConsumeNGram(const NGram& ngram);
+  virtual void ReadComplete();
+
+ private:
+  // The n-gram records are "record_size_" int32's:
+  //   order, words[0] ... words[ngram_order_ - 1], logprob, backoff_logprob
+  // where the words past "order" are unused, and the log-probs are the bits
+  // of the floats.
+
+  // Compares the word sequences of two records lexicographically.
+  struct RecordLessThan {
+    bool operator()(const int32 *lhs, const int32 *rhs) const {
+      int32 lhs_order = lhs[0], rhs_order = rhs[0],
+          min_order = std::min(lhs_order, rhs_order);
+      for (int32 i = 1; i <= min_order; i++)
+        if (lhs[i] != rhs[i])
+          return lhs[i] < rhs[i];
+      return lhs_order < rhs_order;
+    }
+  };
+  struct RecordGreaterThan {
+    bool operator()(const int32 *lhs, const int32 *rhs) const {
+      return RecordLessThan()(rhs, lhs);
+    }
+  };
+
+  // Reads back the records of a sorted run file.
+  class RunReader {
+   public:
+    RunReader(FILE *file, int32 record_size): file_(file),
+        record_size_(record_size), pos_(0), end_(0) {
+      rewind(file_);
+      buffer_.resize(record_size * 4096);
+      Fill();
+    }
+    bool Done() const { return pos_ == end_; }
+    const int32 *Value() const { return &(buffer_[pos_]); }
+    void Next() {
+      pos_ += record_size_;
+      if (pos_ == end_)
+        Fill();
+    }
+   private:
+    void Fill() {
+      size_t num_records = fread(&(buffer_[0]), sizeof(int32) * record_size_,
+                                 buffer_.size() / record_size_, file_);
+      if (num_records == 0 && ferror(file_))
+        KALDI_ERR << "Reading temporary file failed: " << strerror(errno);
+      pos_ = 0;
+      end_ = num_records * record_size_;
+    }
+    FILE *file_;
+    int32 record_size_;
+    std::vector<int32> buffer_;
+    size_t pos_, end_;
+  };
+
+  struct RunReaderLessThan {
+    bool operator()(const RunReader *lhs, const RunReader *rhs) const {
+      return RecordLessThan()(lhs->Value(), rhs->Value());
+    }
+  };
+
+  // A child of an LmState that we have not written yet.
+  struct PendingChild {
+    int32 word;
+    // If "suffix_size" is -1 the child has no LmState, and this is the final
+    // <child_info> (the logprob of the child).
+    int32 child_info;
+    // The total size of the child's LmState and of all the LmStates that
+    // follow it in the output, from which we work out relative addresses.
+    int64 suffix_size;
+  };
+
+  // The children of one history, which are in descending order of word.
+  struct PendingChildren {
+    std::vector<int32> history;
+    std::vector<PendingChild> children;
+  };
+
+  // Sorts the current chunk and writes it out to a new run file.
+  void WriteRun();
+
+  // Handles one n-gram of the merged (descending) sequence.
+  void ProcessRecord(const int32 *record);
+
+  void AddPendingChild(const int32 *words, int32 order, int32 child_info,
+                       int64 suffix_size);
+
+  // Dies with an error about the children of pending_[order].
+  void OrphanError(int32 order) const;
+
+  // Maximum memory for the records we sort in memory.
+  BaseFloat max_memory_mb_;
+
+  // Directory for the temporary files.
+  std::string tmp_dir_;
+
+  // N-gram order of language model.
+  int32 ngram_order_;
+
+  // Size of the n-gram records, in int32's.
+  int32 record_size_;
+
+  // The maximum number of records in <chunk_>.
+  size_t max_chunk_records_;
+
+  // Maximum relative address for the child, as in ConstArpaLmBuilder.
+  int32 max_address_offset_;
+
+  // If true, Write() writes the aligned layout.
+  bool align_;
+
+  // The records that we have not written to a run file yet.
+  std::vector<int32> chunk_;
+
+  // The sorted runs.
+  std::vector<FILE*> run_files_;
+
+  // The previous record of the merged sequence, to catch duplicates.
+  std::vector<int32> prev_record_;
+
+  // pending_[k] holds the children of the order-k history that we will get to
+  // next; pending_[0] is unused.
+  std::vector<PendingChildren> pending_;
+
+  // Buffer for the current LmState.
+  std::vector<int32> lm_state_;
+
+  // The total size of the LmStates written so far, which at the end is the
+  // size of the <lm_states_> array.
+  int64 lm_states_size_;
+
+  // The LmStates, each of them reversed, in the reverse of the output order.
+  FILE *lm_states_file_;
+
+  // The "suffix_size" (see PendingChild) of the unigram LmStates, indexed by
+  // word, or zero if there is no such unigram.
+  std::vector<int64> unigram_suffix_sizes_;
+
+  // The "suffix_size" of the children in the overflow buffer.
+  std::vector<int64> overflow_suffix_sizes_;
+};
+
+void ConstArpaLmExternalBuilder::HeaderAvailable() {
+  ngram_order_ = NgramCounts().size();
+  record_size_ = ngram_order_ + 3;
+  // When we sort a chunk, we also need a pointer for each record.
+  max_chunk_records_ = std::max<int64>(
+      1, static_cast<int64>(max_memory_mb_ * 1048576.0) /
+      (sizeof(int32) * record_size_ + sizeof(int32*)));
+  pending_.resize(ngram_order_);
+}
+
+void ConstArpaLmExternalBuilder::ConsumeNGram(const NGram &ngram) {
+  int32 cur_order = ngram.words.size();
+  chunk_.push_back(cur_order);
+  chunk_.insert(chunk_.end(), ngram.words.begin(), ngram.words.end());
+  chunk_.resize(chunk_.size() + ngram_order_ - cur_order, 0);
+  Int32AndFloat logprob_f(ngram.logprob), backoff_logprob_f(ngram.backoff);
+  chunk_.push_back(logprob_f.i);
+  chunk_.push_back(backoff_logprob_f.i);
+  if (chunk_.size() >= max_chunk_records_ * record_size_)
+    WriteRun();
+}
+
+void ConstArpaLmExternalBuilder::WriteRun() {
+  size_t num_records = chunk_.size() / record_size_;
+  if (num_records == 0)
+    return;
+  std::vector<const int32*> records(num_records);
+  for (size_t i = 0; i < num_records; i++)
+    records[i] = &(chunk_[i * record_size_]);
+  std::sort(records.begin(), records.end(), RecordGreaterThan());
+  FILE *file = OpenTempFile(tmp_dir_);
+  run_files_.push_back(file);
+  for (size_t i = 0; i < num_records; i++)
+    WriteTempFile(file, records[i], record_size_);
+  if (fflush(file) != 0)
+    KALDI_ERR << "Writing to temporary file failed (disk full?): "
+              << strerror(errno);
+  chunk_.clear();
+}
+
+void ConstArpaLmExternalBuilder::OrphanError(int32 order) const {
+  const PendingChildren &pending = pending_[order];
+  std::ostringstream ss;
+  for (int32 i = 0; i < order; ++i)
+    ss << (i == 0 ? '[' : ' ') << pending.history[i];
+  ss << ' ' << pending.children.back().word;
+  KALDI_ERR << (order + 1) << "-gram " << ss.str() << "] does not have "
+            << "a parent model " << order << "-gram.";
+}
+
+void ConstArpaLmExternalBuilder::AddPendingChild(const int32 *words,
+                                                 int32 order, int32 child_info,
+                                                 int64 suffix_size) {
+  PendingChildren &pending = pending_[order - 1];
+  if (pending.children.empty())
+    pending.history.assign(words, words + order - 1);
+  PendingChild child;
+  child.word = words[order - 1];
+  child.child_info = child_info;
+  child.suffix_size = suffix_size;
+  pending.children.push_back(child);
+}
+
+void ConstArpaLmExternalBuilder::ProcessRecord(const int32 *record) {
+  int32 cur_order = record[0];
+  const int32 *words = record + 1;
+  Int32AndFloat logprob_f, backoff_logprob_f;
+  logprob_f.i = record[ngram_order_ + 1];
+  backoff_logprob_f.i = record[ngram_order_ + 2];
+
+  if (!prev_record_.empty() && prev_record_[0] == cur_order &&
+      std::equal(words, words + cur_order, prev_record_.begin() + 1)) {
+    std::ostringstream os;
+    os << "[ ";
+    for (int32 i = 0; i < cur_order; i++) {
+      os << words[i] << " ";
+    }
+    os <<"]";
+    KALDI_ERR << "N-gram " << os.str() << " appears twice in the arpa file";
+  }
+  prev_record_.assign(record, record + record_size_);
+
+  // The n-grams that extend the history of a pending child come before it, so
+  // if we get to an n-gram that does not extend it, the history is missing.
+  for (int32 order = cur_order; order < ngram_order_; order++) {
+    const PendingChildren &pending = pending_[order];
+    if (!pending.children.empty() &&
+        !(order == cur_order &&
+          std::equal(words, words + cur_order, pending.history.begin())))
+      OrphanError(order);
+  }
+  if (cur_order > 1) {
+    const PendingChildren &pending = pending_[cur_order - 1];
+    if (!pending.children.empty() &&
+        !std::equal(words, words + cur_order - 1, pending.history.begin()))
+      OrphanError(cur_order - 1);
+  }
+
+  // As in ConstArpaLmBuilder, we do not create LmStates for the final order
+  // n-grams, or for leaves that are not unigrams; their logprob is stored in
+  // the same int32 that we would normally store the pointer in.
+  int32 num_children = (cur_order < ngram_order_ ?
+                        pending_[cur_order].children.size() : 0);
+  if (cur_order > 1 && (cur_order == ngram_order_ ||
+                        (backoff_logprob_f.f == 0.0 && num_children == 0))) {
+    AddPendingChild(words, cur_order, logprob_f.i & ~1, -1);
+    return;
+  }
+
+  int64 suffix_size = lm_states_size_ + 3 + 2 * num_children;
+  // We write the LmState reversed (see Write()), so the children come first,
+  // from the last to the first, which is the order in which we got them.
+  lm_state_.clear();
+  for (int32 i = 0; i < num_children; i++) {
+    const PendingChild &child = pending_[cur_order].children[i];
+    int32 child_info;
+    if (child.suffix_size == -1) {
+      child_info = child.child_info;
+    } else {
+      int64 offset = suffix_size - child.suffix_size;
+      KALDI_ASSERT(offset > 0);
+      if (offset <= max_address_offset_) {
+        child_info = offset * 2;
+        child_info |= 1;
+      } else {
+        overflow_suffix_sizes_.push_back(child.suffix_size);
+        int32 overflow_buffer_index = overflow_suffix_sizes_.size() - 1;
+        child_info = overflow_buffer_index * 2;
+        child_info |= 1;
+        child_info *= -1;
+      }
+    }
+    lm_state_.push_back(child_info);
+    lm_state_.push_back(child.word);
+  }
+  lm_state_.push_back(num_children);
+  lm_state_.push_back(backoff_logprob_f.i);
+  lm_state_.push_back(logprob_f.i);
+  WriteTempFile(lm_states_file_, &(lm_state_[0]), lm_state_.size());
+  lm_states_size_ = suffix_size;
+  if (cur_order < ngram_order_) {
+    pending_[cur_order].history.clear();
+    pending_[cur_order].children.clear();
+  }
+
+  if (cur_order == 1) {
+    int32 word = words[0];
+    if (word >= static_cast<int32>(unigram_suffix_sizes_.size()))
+      unigram_suffix_sizes_.resize(word + 1, 0);
+    unigram_suffix_sizes_[word] = suffix_size;
+  } else {
+    AddPendingChild(words, cur_order, 0, suffix_size);
+  }
+}
+
+void ConstArpaLmExternalBuilder::ReadComplete() {
+  WriteRun();
+  std::vector<int32>().swap(chunk_);  // Frees the memory.
+  KALDI_LOG << "Merging " << run_files_.size() << " sorted runs of n-grams.";
+
+  lm_states_file_ = OpenTempFile(tmp_dir_);
+  std::vector<RunReader> runs;
+  runs.reserve(run_files_.size());
+  for (size_t i = 0; i < run_files_.size(); i++)
+    runs.push_back(RunReader(run_files_[i], record_size_));
+  // "readers" is a heap with the run that has the largest n-gram at the top.
+  std::vector<RunReader*> readers;
+  for (size_t i = 0; i < runs.size(); i++)
+    if (!runs[i].Done())
+      readers.push_back(&(runs[i]));
+  std::make_heap(readers.begin(), readers.end(), RunReaderLessThan());
+  while (!readers.empty()) {
+    std::pop_heap(readers.begin(), readers.end(), RunReaderLessThan());
+    RunReader *reader = readers.back();
+    ProcessRecord(reader->Value());
+    reader->Next();
+    if (reader->Done())
+      readers.pop_back();
+    else
+      std::push_heap(readers.begin(), readers.end(), RunReaderLessThan());
+  }
+  for (int32 order = 1; order < ngram_order_; order++)
+    if (!pending_[order].children.empty())
+      OrphanError(order);
+  if (fflush(lm_states_file_) != 0)
+    KALDI_ERR << "Writing to temporary file failed (disk full?): "
+              << strerror(errno);
+
+  for (size_t i = 0; i < run_files_.size(); i++)
+    fclose(run_files_[i]);
+  run_files_.clear();
+}
+
+void ConstArpaLmExternalBuilder::Write(std::ostream &os, bool binary) const {
   if (!binary) {
-    KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
+    KALDI_ERR << "text-mode writing is not implemented for "
+              << "ConstArpaLmExternalBuilder.";
+  }
+  KALDI_ASSERT(lm_states_file_ != NULL);
+
+  WriteConstArpaLmHeader(os, Options().bos_symbol, Options().eos_symbol,
+                         Options().unk_symbol, ngram_order_, lm_states_size_,
+                         align_);
+  // Copies the LmStates, reading the temporary file backwards one block at a
+  // time and reversing the blocks.
+  std::vector<int32> buffer(1 << 20);
+  for (int64 end = lm_states_size_; end > 0; ) {
+    int64 begin = std::max<int64>(0, end - static_cast<int64>(buffer.size()));
+    size_t size = end - begin;
+    SeekTempFile(lm_states_file_, begin * sizeof(int32));
+    if (fread(&(buffer[0]), sizeof(int32), size, lm_states_file_) != size)
+      KALDI_ERR << "Reading temporary file failed: " << strerror(errno);
+    std::reverse(buffer.begin(), buffer.begin() + size);
+    os.write(reinterpret_cast<char *>(&(buffer[0])), sizeof(int32) * size);
+    if (!os.good()) {
+      KALDI_ERR << "ConstArpaLm <LmStates> section writing failed.";
+    }
+    end = begin;
   }
 
-  WriteToken(os, binary, "<ConstArpaLm>");
+  // The address of an LmState is the size of the LmStates that come before
+  // it, i.e. lm_states_size_ minus its "suffix_size"; as in
+  // ConstArpaLm::Write() we add one so that zero can mean NULL.
+  std::vector<int64> unigram_addresses(unigram_suffix_sizes_.size()),
+      overflow_addresses(overflow_suffix_sizes_.size());
+  for (size_t i = 0; i < unigram_addresses.size(); i++) {
+    unigram_addresses[i] = (unigram_suffix_sizes_[i] == 0) ? 0 :
+        lm_states_size_ - unigram_suffix_sizes_[i] + 1;
+  }
+  for (size_t i = 0; i < overflow_addresses.size(); i++) {
+    overflow_addresses[i] = lm_states_size_ - overflow_suffix_sizes_[i] + 1;
+  }
+  WriteConstArpaLmTrailer(os, unigram_addresses, overflow_addresses);
+}
 
-  // Misc info.
-  WriteToken(os, binary, "<LmInfo>");
-  WriteBasicType(os, binary, bos_symbol_);
-  WriteBasicType(os, binary, eos_symbol_);
-  WriteBasicType(os, binary, unk_symbol_);
-  WriteBasicType(os, binary, ngram_order_);
-  WriteToken(os, binary, "</LmInfo>");
+void ConstArpaLm::Write(std::ostream &os, bool binary, bool align) const {
+  KALDI_ASSERT(initialized_);
+  if (!binary) {
+    KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
+  }
 
-  // LmStates section.
-  WriteToken(os, binary, "<LmStates>");
-  WriteBasicType(os, binary, lm_states_size_);
+  WriteConstArpaLmHeader(os, bos_symbol_, eos_symbol_, unk_symbol_,
+                         ngram_order_, lm_states_size_, align);
   os.write(reinterpret_cast<char *>(lm_states_),
            sizeof(int32) * lm_states_size_);
   if (!os.good()) {
     KALDI_ERR << "ConstArpaLm <LmStates> section writing failed.";
   }
-  WriteToken(os, binary, "</LmStates>");
 
-  // Unigram section. We write memory offset to disk instead of the absolute
-  // pointers.
-  WriteToken(os, binary, "<LmUnigram>");
-  WriteBasicType(os, binary, num_words_);
-  int64* tmp_unigram_address = new int64[num_words_];
+  // We write memory offset to disk instead of the absolute pointers. The
+  // relative address here is a little bit tricky:
+  // 1. If the original address is NULL, then we set the relative address to
+  //    zero.
+  // 2. If the original address is not NULL, we set it to the following:
+  //      unigram_states_[i] - lm_states_ + 1
+  //    we plus 1 to ensure that the above value is positive.
+  std::vector<int64> unigram_addresses(num_words_),
+      overflow_addresses(overflow_buffer_size_);
   for (int32 i = 0; i < num_words_; ++i) {
-    // The relative address here is a little bit tricky:
-    // 1. If the original address is NULL, then we set the relative address to
-    //    zero.
-    // 2. If the original address is not NULL, we set it to the following:
-    //      unigram_states_[i] - lm_states_ + 1
-    //    we plus 1 to ensure that the above value is positive.
-    tmp_unigram_address[i] = (unigram_states_[i] == NULL) ? 0 :
+    unigram_addresses[i] = (unigram_states_[i] == NULL) ? 0 :
         unigram_states_[i] - lm_states_ + 1;
   }
-  os.write(reinterpret_cast<char *>(tmp_unigram_address),
-           sizeof(int64) * num_words_);
-  if (!os.good()) {
-    KALDI_ERR << "ConstArpaLm <LmUnigram> section writing failed.";
-  }
-  delete[] tmp_unigram_address;   // Releases the memory.
-  tmp_unigram_address = NULL;
-  WriteToken(os, binary, "</LmUnigram>");
-
-  // Overflow section. We write memory offset to disk instead of the absolute
-  // pointers.
-  WriteToken(os, binary, "<LmOverflow>");
-  WriteBasicType(os, binary, overflow_buffer_size_);
-  int64* tmp_overflow_address = new int64[overflow_buffer_size_];
   for (int32 i = 0; i < overflow_buffer_size_; ++i) {
-    // The relative address here is a little bit tricky:
-    // 1. If the original address is NULL, then we set the relative address to
-    //    zero.
-    // 2. If the original address is not NULL, we set it to the following:
-    //      overflow_buffer_[i] - lm_states_ + 1
-    //    we plus 1 to ensure that the above value is positive.
-    tmp_overflow_address[i] = (overflow_buffer_[i] == NULL) ? 0 :
+    overflow_addresses[i] = (overflow_buffer_[i] == NULL) ? 0 :
         overflow_buffer_[i] - lm_states_ + 1;
   }
-  os.write(reinterpret_cast<char *>(tmp_overflow_address),
-           sizeof(int64) * overflow_buffer_size_);
-  if (!os.good()) {
-    KALDI_ERR << "ConstArpaLm <LmOverflow> section writing failed.";
-  }
-  delete[] tmp_overflow_address;
-  tmp_overflow_address = NULL;
-  WriteToken(os, binary, "</LmOverflow>");
-  WriteToken(os, binary, "</ConstArpaLm>");
+  WriteConstArpaLmTrailer(os, unigram_addresses, overflow_addresses);
 }
 
 void ConstArpaLm::Read(std::istream &is, bool binary) {
@@ -584,7 +1109,31 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   }
 }
 
-void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
+void ConstArpaLm::ReadMapped(const std::string &rxfilename) {
+  KALDI_ASSERT(!initialized_);
+  if (ClassifyRxfilename(rxfilename) != kFileInput ||
+      !MappedFileRegion::Supported()) {
+    KALDI_WARN << "Cannot memory-map ConstArpaLm from "
+               << PrintableRxfilename(rxfilename) << "; reading it instead.";
+    ReadKaldiObject(rxfilename, this);
+    return;
+  }
+  bool binary;
+  Input ki(rxfilename, &binary);
+  if (!binary) {
+    KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
+  }
+  if (ki.Stream().peek() == 4) {
+    KALDI_WARN << "Cannot memory-map ConstArpaLm in the old on-disk format "
+               << "from " << rxfilename << "; reading it instead.";
+    ReadInternalOldFormat(ki.Stream(), binary);
+  } else {
+    ReadInternal(ki.Stream(), binary, rxfilename);
+  }
+}
+
+void ConstArpaLm::ReadInternal(std::istream &is, bool binary,
+                               const std::string &map_filename) {
   KALDI_ASSERT(!initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
@@ -602,10 +1151,38 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
 
   // LmStates section.
   ExpectToken(is, binary, "<LmStates>");
+  if (is.peek() == '<') {  // Files written by older code have no <Align>.
+    ExpectToken(is, binary, "<Align>");
+    int32 marker, num_pad;
+    ReadBasicType(is, binary, &marker);
+    if (marker != kConstArpaLmByteOrderMarker) {
+      KALDI_ERR << "ConstArpaLm was written on a machine with a different "
+                << "byte order.";
+    }
+    ReadBasicType(is, binary, &num_pad);
+    is.ignore(num_pad);
+  }
   ReadBasicType(is, binary, &lm_states_size_);
-  lm_states_ = new int32[lm_states_size_];
-  is.read(reinterpret_cast<char *>(lm_states_),
-          sizeof(int32) * lm_states_size_);
+  int64 lm_states_bytes = sizeof(int32) * lm_states_size_;
+  bool mapped = false;
+  if (!map_filename.empty()) {
+    std::streamoff pos = is.tellg();
+    if (pos < 0 || pos % sizeof(int32) != 0) {
+      KALDI_WARN << "Cannot memory-map ConstArpaLm from " << map_filename
+                 << " as its LmStates are not aligned (it was probably "
+                 << "written by older code); reading it instead.";
+    } else if (lm_states_region_.Open(map_filename, pos, lm_states_bytes)) {
+      // The mapping is read-only; we never write to lm_states_.
+      lm_states_ = const_cast<int32*>(
+          reinterpret_cast<const int32*>(lm_states_region_.Data()));
+      is.seekg(lm_states_bytes, std::ios::cur);
+      mapped = true;
+    }
+  }
+  if (!mapped) {
+    lm_states_ = new int32[lm_states_size_];
+    is.read(reinterpret_cast<char *>(lm_states_), lm_states_bytes);
+  }
   if (!is.good()) {
     KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
   }
@@ -1073,8 +1650,25 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
 
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename) {
+                      const std::string& const_arpa_wxfilename,
+                      bool align) {
   ConstArpaLmBuilder lm_builder(options);
+  lm_builder.SetAlign(align);
+  KALDI_LOG << "Reading " << arpa_rxfilename;
+  Input ki(arpa_rxfilename);
+  lm_builder.Read(ki.Stream());
+  WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  return true;
+}
+
+bool BuildConstArpaLmExternal(const ArpaParseOptions& options,
+                              const std::string& arpa_rxfilename,
+                              const std::string& const_arpa_wxfilename,
+                              BaseFloat max_memory_mb,
+                              const std::string& tmp_dir,
+                              bool align) {
+  ConstArpaLmExternalBuilder lm_builder(options, max_memory_mb, tmp_dir);
+  lm_builder.SetAlign(align);
   KALDI_LOG << "Reading " << arpa_rxfilename;
   Input ki(arpa_rxfilename);
   lm_builder.Read(ki.Stream());
@@ -27,6 +27,7 @@
 #include "fstext/deterministic-fst.h"
 #include "lm/arpa-file-parser.h"
 #include "util/common-utils.h"
+#include "util/kaldi-mmap.h"
 
 namespace kaldi {
 
@@ -248,7 +249,8 @@ class ConstArpaLm {
 
   ~ConstArpaLm() {
     if (memory_assigned_) {
-      delete[] lm_states_;
+      if (!lm_states_region_.IsOpen())  // else it is unmapped automatically.
+        delete[] lm_states_;
       delete[] unigram_states_;
       delete[] overflow_buffer_;
     }
@@ -258,8 +260,23 @@ class ConstArpaLm {
   // ReadInternalOldFormat() to do the actual reading.
   void Read(std::istream &is, bool binary);
 
-  // Writes the language model in ConstArpaLm format.
-  void Write(std::ostream &os, bool binary) const;
+  // Reads the language model from "rxfilename", like ReadKaldiObject(), except
+  // that if it is an ordinary file the LmStates section (which is nearly all
+  // of the model) is memory-mapped from the file rather than read into memory.
+  // This makes loading fast, and processes that map the same file share its
+  // pages.  Mapping requires the aligned layout that Write() produces when
+  // called with align == true (see the comment there); for other files, or
+  // for pipes, this prints a warning and reads the model instead.
+  void ReadMapped(const std::string &rxfilename);
+
+  // Writes the language model in ConstArpaLm format.  If "align" is true, the
+  // LmStates section starts with an <Align> record, which contains a marker
+  // that lets us detect files that were written on a machine with a different
+  // byte order, and enough padding that the int32 array of LmStates starts at
+  // a file offset that is a multiple of 8 (if the position in the stream is
+  // known), so that ReadMapped() can map it.  Older versions of Kaldi cannot
+  // read files with the <Align> record, which is why it is not the default.
+  void Write(std::ostream &os, bool binary, bool align = false) const;
 
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
@@ -279,8 +296,11 @@ class ConstArpaLm {
   int32 NgramOrder() const { return ngram_order_; }
 
  private:
-  // Function that loads data from stream to the class.
-  void ReadInternal(std::istream &is, bool binary);
+  // Function that loads data from stream to the class.  If "map_filename" is
+  // nonempty it is the name of the file that "is" is reading, and we try to
+  // memory-map the LmStates section from it.
+  void ReadInternal(std::istream &is, bool binary,
+                    const std::string &map_filename = "");
 
   // Function that loads data from stream to the class. This is a deprecated one
   // that handles the old on-disk format. We keep this for back-compatibility
@@ -382,6 +402,10 @@ class ConstArpaLm {
   //
   // x = 1 + 1 + 1 + 2 * children.size() = 3 + 2 * children.size()
   int32* lm_states_;
+
+  // If the LmStates were memory-mapped by ReadMapped(), this is the mapping,
+  // and lm_states_ points into it.
+  MappedFileRegion lm_states_region_;
 };
 
 /**
@@ -418,10 +442,28 @@ class ConstArpaLmDeterministicFst
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
 // format. We assume that the words in the input Arpa format language model have
-// been converted into integers.
+// been converted into integers.  If "align" is true, the output has the
+// aligned layout that ConstArpaLm::ReadMapped() can memory-map (see
+// ConstArpaLm::Write()).
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename);
+                      const std::string& const_arpa_wxfilename,
+                      bool align = false);
+
+// As BuildConstArpaLm(), but for language models that are too large to build
+// in memory.  It sorts the n-grams in chunks of at most about "max_memory_mb"
+// megabytes (which need not be a whole number), which it writes to temporary
+// files in directory "tmp_dir" (or in the system's default temporary directory
+// if it is empty), and then merges them.  Apart from the chunks, the memory it needs is only that for the
+// children of the history states on the current path, e.g. all the bigrams
+// that start with <s>.  The output is byte-for-byte the same as that of
+// BuildConstArpaLm().
+bool BuildConstArpaLmExternal(const ArpaParseOptions& options,
+                              const std::string& arpa_rxfilename,
+                              const std::string& const_arpa_wxfilename,
+                              BaseFloat max_memory_mb,
+                              const std::string& tmp_dir,
+                              bool align = false);
 
 }  // namespace kaldi
 
@@ -60,6 +60,23 @@ int main(int argc, char *argv[]) {
                 "Integer corresponds to </s>. You must set this to your actual "
                 "EOS integer.");
 
+    BaseFloat max_memory_mb = 0.0;
+    std::string tmp_dir;
+    po.Register("max-memory-mb", &max_memory_mb,
+                "If >0, build the ConstArpaLm by sorting the n-grams in chunks "
+                "of at most about this many megabytes in temporary files, "
+                "instead of in memory; use this for very large language "
+                "models.");
+    po.Register("tmp-dir", &tmp_dir,
+                "Directory for the temporary files used with --max-memory-mb "
+                "(if empty, the system's default temporary directory).");
+    bool align = false;
+    po.Register("align", &align,
+                "If true, write the language model in a layout that can be "
+                "memory-mapped (see lattice-lmrescore-const-arpa --mmap-lm). "
+                "Versions of Kaldi older than this one cannot read such "
+                "files.");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -75,8 +92,14 @@ int main(int argc, char *argv[]) {
     std::string arpa_rxfilename = po.GetArg(1),
         const_arpa_wxfilename = po.GetOptArg(2);
 
-    bool ans = BuildConstArpaLm(options, arpa_rxfilename,
-                                const_arpa_wxfilename);
+    bool ans;
+    if (max_memory_mb > 0)
+      ans = BuildConstArpaLmExternal(options, arpa_rxfilename,
+                                     const_arpa_wxfilename, max_memory_mb,
+                                     tmp_dir, align);
+    else
+      ans = BuildConstArpaLm(options, arpa_rxfilename,
+                             const_arpa_wxfilename, align);
     if (ans)
       return 0;
     else
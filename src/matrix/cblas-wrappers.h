@@ -27,6 +27,7 @@
 #include "matrix/kaldi-matrix.h"
 #include "matrix/matrix-functions.h"
 #include "matrix/kaldi-blas.h"
+#include "matrix/kaldi-gemm.h"
 
 // Do not include this file directly.  It is to be included
 // by .cc files in this directory.
@@ -163,15 +164,25 @@ inline void cblas_Xgemv(MatrixTransposeType trans, MatrixIndexT num_rows,
                         MatrixIndexT num_cols, float alpha, const float *Mdata,
                         MatrixIndexT stride, const float *xdata,
                         MatrixIndexT incX, float beta, float *ydata, MatrixIndexT incY) {
+#ifdef KALDI_BUILTIN_GEMM
+  BuiltinGemv(trans, num_rows, num_cols, alpha, Mdata, stride, xdata, incX,
+              beta, ydata, incY);
+#else
   cblas_sgemv(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans), num_rows,
               num_cols, alpha, Mdata, stride, xdata, incX, beta, ydata, incY);
+#endif
 }
 inline void cblas_Xgemv(MatrixTransposeType trans, MatrixIndexT num_rows,
                         MatrixIndexT num_cols, double alpha, const double *Mdata,
                         MatrixIndexT stride, const double *xdata,
                         MatrixIndexT incX, double beta, double *ydata, MatrixIndexT incY) {
+#ifdef KALDI_BUILTIN_GEMM
+  BuiltinGemv(trans, num_rows, num_cols, alpha, Mdata, stride, xdata, incX,
+              beta, ydata, incY);
+#else
   cblas_dgemv(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans), num_rows,
               num_cols, alpha, Mdata, stride, xdata, incX, beta, ydata, incY);
+#endif
 }
 
 // sgbmv, dgmmv: y = alpha M x +  + beta * y.
@@ -230,11 +241,17 @@ inline void cblas_Xgemm(const float alpha,
                         const float beta,
                         float *Mdata, 
                         MatrixIndexT num_rows, MatrixIndexT num_cols,MatrixIndexT stride) {
+#ifdef KALDI_BUILTIN_GEMM
+  BuiltinGemm(transA, transB, num_rows, num_cols,
+              transA == kNoTrans ? a_num_cols : a_num_rows,
+              alpha, Adata, a_stride, Bdata, b_stride, beta, Mdata, stride);
+#else
   cblas_sgemm(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(transA), 
               static_cast<CBLAS_TRANSPOSE>(transB),
               num_rows, num_cols, transA == kNoTrans ? a_num_cols : a_num_rows,
               alpha, Adata, a_stride, Bdata, b_stride,
               beta, Mdata, stride); 
+#endif
 }
 inline void cblas_Xgemm(const double alpha,
                         MatrixTransposeType transA,
@@ -245,11 +262,17 @@ inline void cblas_Xgemm(const double alpha,
                         const double beta,
                         double *Mdata, 
                         MatrixIndexT num_rows, MatrixIndexT num_cols,MatrixIndexT stride) {
+#ifdef KALDI_BUILTIN_GEMM
+  BuiltinGemm(transA, transB, num_rows, num_cols,
+              transA == kNoTrans ? a_num_cols : a_num_rows,
+              alpha, Adata, a_stride, Bdata, b_stride, beta, Mdata, stride);
+#else
   cblas_dgemm(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(transA), 
               static_cast<CBLAS_TRANSPOSE>(transB),
               num_rows, num_cols, transA == kNoTrans ? a_num_cols : a_num_rows,
               alpha, Adata, a_stride, Bdata, b_stride,
               beta, Mdata, stride); 
+#endif
 }
 
 
@@ -0,0 +1,124 @@
+// matrix/compressed-matrix-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/matrix-lib.h"
+#include "base/timer.h"
+
+// This measures the speed of compressing and decompressing a CompressedMatrix,
+// for each CompressionMethod: decompression for each implementation (see
+// CompressedMatrixImpl) that this machine supports, and compression with 1 and
+// 4 threads.  The output is in CSV format: test, method, implementation or
+// number of threads, rows, columns, and GB/s, counted in bytes of the
+// uncompressed float matrix.
+
+namespace kaldi {
+
+static const char *ImplName(CompressedMatrixImpl impl) {
+  switch (impl) {
+    case kCompressedMatrixScalar: return "scalar";
+    case kCompressedMatrixAvx2: return "avx2";
+    default: return "auto";
+  }
+}
+
+static const char *MethodName(CompressionMethod method) {
+  switch (method) {
+    case kAutomaticMethod: return "kAutomaticMethod";
+    case kSpeechFeature: return "kSpeechFeature";
+    case kTwoByteAuto: return "kTwoByteAuto";
+    case kTwoByteSignedInteger: return "kTwoByteSignedInteger";
+    case kOneByteAuto: return "kOneByteAuto";
+    case kOneByteUnsignedInteger: return "kOneByteUnsignedInteger";
+    case kOneByteZeroOne: return "kOneByteZeroOne";
+    case kDeltaCoded: return "kDeltaCoded";
+    case kDeltaCodedFine: return "kDeltaCodedFine";
+    default: return "unknown";
+  }
+}
+
+// Returns GB/s for decompressing "cmat" into "mat".
+static double TimeDecompress(const CompressedMatrix &cmat,
+                             Matrix<float> *mat) {
+  int64 num_bytes = 0;
+  Timer timer;
+  do {
+    for (int32 i = 0; i < 10; i++) {
+      cmat.CopyToMat(mat);
+      num_bytes += sizeof(float) * mat->NumRows() * mat->NumCols();
+    }
+  } while (timer.Elapsed() < 0.2);
+  return num_bytes / timer.Elapsed() * 1.0e-09;
+}
+
+// Returns GB/s for compressing "mat" with "method".
+static double TimeCompress(const Matrix<float> &mat,
+                           CompressionMethod method) {
+  int64 num_bytes = 0;
+  CompressedMatrix cmat;
+  Timer timer;
+  do {
+    for (int32 i = 0; i < 3; i++) {
+      cmat.CopyFromMat(mat, method);
+      num_bytes += sizeof(float) * mat.NumRows() * mat.NumCols();
+    }
+  } while (timer.Elapsed() < 0.2);
+  return num_bytes / timer.Elapsed() * 1.0e-09;
+}
+
+static void CompressedMatrixSpeedTest() {
+  CompressedMatrixImpl impls[] = { kCompressedMatrixScalar,
+                                   kCompressedMatrixAvx2 };
+  MatrixIndexT sizes[][2] = { { 1000, 40 }, { 2000, 440 } };
+  for (int32 m = kAutomaticMethod; m <= kDeltaCodedFine; m++) {
+    CompressionMethod method = static_cast<CompressionMethod>(m);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      MatrixIndexT num_rows = sizes[s][0], num_cols = sizes[s][1];
+      Matrix<float> mat(num_rows, num_cols), mat2(num_rows, num_cols);
+      mat.SetRandn();
+      if (method == kTwoByteSignedInteger || method == kOneByteUnsignedInteger)
+        mat.Scale(100.0);
+      CompressedMatrix cmat(mat, method);
+      for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (!CompressedMatrixImplSupported(impls[i]))
+          continue;
+        SetCompressedMatrixImpl(impls[i]);
+        std::cout << "decompress," << MethodName(method) << ","
+                  << ImplName(impls[i]) << "," << num_rows << "," << num_cols
+                  << "," << TimeDecompress(cmat, &mat2) << "\n";
+      }
+      SetCompressedMatrixImpl(kCompressedMatrixAuto);
+      for (int32 num_threads = 1; num_threads <= 4; num_threads *= 4) {
+        SetCompressedMatrixNumThreads(num_threads);
+        std::cout << "compress," << MethodName(method) << ","
+                  << num_threads << "-threads," << num_rows << ","
+                  << num_cols << "," << TimeCompress(mat, method) << "\n";
+      }
+      SetCompressedMatrixNumThreads(1);
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  std::cout << "test,method,impl,rows,cols,gb_per_second\n";
+  CompressedMatrixSpeedTest();
+  KALDI_LOG << "Default implementation is "
+            << ImplName(GetCompressedMatrixImpl());
+  std::cout << "Test OK.\n";
+}
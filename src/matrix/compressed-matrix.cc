@@ -21,9 +21,220 @@
 
 #include "matrix/compressed-matrix.h"
 #include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// We compile the SIMD code with target attributes and choose between them at
+// runtime, so no special compiler flags are needed.
+#define KALDI_COMPRESSED_MATRIX_SIMD 1
+#include <immintrin.h>
+#include "matrix/kaldi-simd.h"
+#endif
 
 namespace kaldi {
 
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+namespace {
+
+// The AVX2 decoding kernels.  They do exactly the same arithmetic as the
+// scalar code in CompressedMatrix (Uint16ToFloat(), CharToFloat() and the
+// "min_value + i * increment" of the other formats), including the
+// double-precision steps in CharToFloat(), so the output is the same.  AVX2
+// does not include fused multiply-add, so the compiler cannot change that.
+
+#define KALDI_AVX2_INLINE inline __attribute__((target("avx2"), always_inline))
+
+KALDI_AVX2_INLINE void Store8(__m256 v, float *dest) {
+  _mm256_storeu_ps(dest, v);
+}
+
+KALDI_AVX2_INLINE void Store8(__m256 v, double *dest) {
+  _mm256_storeu_pd(dest, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+  _mm256_storeu_pd(dest + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+// Decodes dest[i] = min_value + data[i] * increment for the first dim - dim % 8
+// elements and returns how many it did.
+template<typename Real>
+__attribute__((target("avx2")))
+int32 Avx2DecodeRow(float min_value, float increment, const uint8 *data,
+                    int32 dim, Real *dest) {
+  __m256 min_v = _mm256_set1_ps(min_value), inc_v = _mm256_set1_ps(increment);
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256i x = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i)));
+    Store8(_mm256_add_ps(min_v, _mm256_mul_ps(_mm256_cvtepi32_ps(x), inc_v)),
+           dest + i);
+  }
+  ClearAvxUpperState();
+  return i;
+}
+
+template<typename Real>
+__attribute__((target("avx2")))
+int32 Avx2DecodeRow(float min_value, float increment, const uint16 *data,
+                    int32 dim, Real *dest) {
+  __m256 min_v = _mm256_set1_ps(min_value), inc_v = _mm256_set1_ps(increment);
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256i x = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+    Store8(_mm256_add_ps(min_v, _mm256_mul_ps(_mm256_cvtepi32_ps(x), inc_v)),
+           dest + i);
+  }
+  ClearAvxUpperState();
+  return i;
+}
+
+// Transposes the 8x8 matrix whose rows are r[0] ... r[7].
+KALDI_AVX2_INLINE void Transpose8x8(__m256 *r) {
+  __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]),
+      t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]),
+      t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]),
+      t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+  __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+      u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+      u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+      u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+      u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)),
+      u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2)),
+      u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)),
+      u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+// The second half of CharToFloat(): returns base + prod * mult, computed in
+// double precision, for 4 lanes; "lo" and "hi" are the 32-bit masks of the
+// first and third ranges.
+KALDI_AVX2_INLINE __m128 CombineInDouble(__m128 base, __m128 prod,
+                                         __m128i lo, __m128i hi) {
+  __m256d lo_d = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(lo)),
+      hi_d = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(hi)),
+      mult = _mm256_blendv_pd(
+          _mm256_blendv_pd(_mm256_set1_pd(1/128.0), _mm256_set1_pd(1/64.0),
+                           lo_d),
+          _mm256_set1_pd(1/63.0), hi_d);
+  return _mm256_cvtpd_ps(_mm256_add_pd(
+      _mm256_cvtps_pd(base), _mm256_mul_pd(_mm256_cvtps_pd(prod), mult)));
+}
+
+// CharToFloat() for 8 consecutive bytes of a column, whose quartiles are
+// p[0] ... p[3].
+KALDI_AVX2_INLINE __m256 DecodeColumn8(const uint8 *data, const float *p) {
+  __m256i x = _mm256_cvtepu8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)));
+  __m256i lo = _mm256_cmpgt_epi32(_mm256_set1_epi32(65), x),   // x <= 64
+      hi = _mm256_cmpgt_epi32(x, _mm256_set1_epi32(192)),      // x > 192
+      // the offset is 0, 64 or 192 for the 3 ranges.
+      offset = _mm256_or_si256(_mm256_andnot_si256(lo, _mm256_set1_epi32(64)),
+                               _mm256_and_si256(hi, _mm256_set1_epi32(128)));
+  __m256 lo_f = _mm256_castsi256_ps(lo), hi_f = _mm256_castsi256_ps(hi),
+      base = _mm256_blendv_ps(
+          _mm256_blendv_ps(_mm256_set1_ps(p[1]), _mm256_set1_ps(p[0]), lo_f),
+          _mm256_set1_ps(p[2]), hi_f),
+      scale = _mm256_blendv_ps(
+          _mm256_blendv_ps(_mm256_set1_ps(p[2] - p[1]),
+                           _mm256_set1_ps(p[1] - p[0]), lo_f),
+          _mm256_set1_ps(p[3] - p[2]), hi_f),
+      prod = _mm256_mul_ps(scale,
+                           _mm256_cvtepi32_ps(_mm256_sub_epi32(x, offset)));
+  __m128 first = CombineInDouble(_mm256_castps256_ps128(base),
+                                 _mm256_castps256_ps128(prod),
+                                 _mm256_castsi256_si128(lo),
+                                 _mm256_castsi256_si128(hi)),
+      second = CombineInDouble(_mm256_extractf128_ps(base, 1),
+                               _mm256_extractf128_ps(prod, 1),
+                               _mm256_extracti128_si256(lo, 1),
+                               _mm256_extracti128_si256(hi, 1));
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(first), second, 1);
+}
+
+// Decodes a num_rows by num_cols block (both multiples of 8) of the
+// kOneByteWithColHeaders format into "dest".  "percentiles" has the 4
+// quartiles of each column, as floats; "data" points to the first byte of the
+// block and "col_stride" is the distance between columns.
+template<typename Real>
+__attribute__((target("avx2")))
+void Avx2DecodeColumns(const float *percentiles, const uint8 *data,
+                       int32 col_stride, int32 num_rows, int32 num_cols,
+                       Real *dest, MatrixIndexT dest_stride) {
+  __m256 tile[8];
+  for (int32 c = 0; c < num_cols; c += 8) {
+    for (int32 r = 0; r < num_rows; r += 8) {
+      for (int32 k = 0; k < 8; k++)
+        tile[k] = DecodeColumn8(data + (c + k) * col_stride + r,
+                                percentiles + 4 * (c + k));
+      Transpose8x8(tile);
+      for (int32 k = 0; k < 8; k++)
+        Store8(tile[k], dest + (r + k) * dest_stride + c);
+    }
+  }
+  ClearAvxUpperState();
+}
+
+#undef KALDI_AVX2_INLINE
+
+}  // namespace
+#endif  // KALDI_COMPRESSED_MATRIX_SIMD
+
+// Set by SetCompressedMatrixImpl().
+static CompressedMatrixImpl g_compressed_matrix_impl = kCompressedMatrixAuto;
+
+bool CompressedMatrixImplSupported(CompressedMatrixImpl impl) {
+  switch (impl) {
+    case kCompressedMatrixAuto: case kCompressedMatrixScalar:
+      return true;
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+    case kCompressedMatrixAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+void SetCompressedMatrixImpl(CompressedMatrixImpl impl) {
+  if (!CompressedMatrixImplSupported(impl))
+    KALDI_ERR << "Implementation " << impl << " of CompressedMatrix is "
+              << "not supported on this machine.";
+  g_compressed_matrix_impl = impl;
+}
+
+CompressedMatrixImpl GetCompressedMatrixImpl() {
+  if (g_compressed_matrix_impl != kCompressedMatrixAuto)
+    return g_compressed_matrix_impl;
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+  static const CompressedMatrixImpl best =
+      (__builtin_cpu_supports("avx2") ? kCompressedMatrixAvx2 :
+       kCompressedMatrixScalar);
+  return best;
+#else
+  return kCompressedMatrixScalar;
+#endif
+}
+
+// Set by SetCompressedMatrixNumThreads().
+static int32 g_compressed_matrix_num_threads = 1;
+
+void SetCompressedMatrixNumThreads(int32 num_threads) {
+  KALDI_ASSERT(num_threads > 0);
+  g_compressed_matrix_num_threads = num_threads;
+}
+
+int32 GetCompressedMatrixNumThreads() {
+  return g_compressed_matrix_num_threads;
+}
+
 //static
 MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   // Returns size in bytes of the data.
@@ -34,6 +245,9 @@ MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   } else if (format == kTwoByte) {
     return sizeof(GlobalHeader) +
         2 * header.num_rows * header.num_cols;
+  } else if (format == kEntropyCoded) {
+    // The size is stored after the header.
+    return *reinterpret_cast<const int32*>(&header + 1);
   } else {
     KALDI_ASSERT(format == kOneByte);
     return sizeof(GlobalHeader) +
@@ -50,6 +264,13 @@ void CompressedMatrix::Scale(float alpha) {
     // and leave all integers the same.
     h->min_value *= alpha;
     h->range *= alpha;
+    if (h->format == kEntropyCoded) {
+      DeltaColHeader *col_headers = GetDeltaColHeaders();
+      for (int32 c = 0; c < h->num_cols; c++) {
+        col_headers[c].min_value *= alpha;
+        col_headers[c].step *= alpha;
+      }
+    }
   }
 }
 
@@ -72,6 +293,9 @@ void CompressedMatrix::ComputeGlobalHeader(
     case kOneByteAuto: case kOneByteUnsignedInteger: case kOneByteZeroOne:
       header->format = static_cast<int32>(kOneByte);  // 3.
       break;
+    case kDeltaCoded: case kDeltaCodedFine:
+      header->format = static_cast<int32>(kEntropyCoded);  // 4.
+      break;
     default:
       KALDI_ERR << "Invalid compression type: "
                 << static_cast<int32>(method);
@@ -82,7 +306,8 @@ void CompressedMatrix::ComputeGlobalHeader(
 
   // Now compute 'min_value' and 'range'.
   switch (method) {
-    case kSpeechFeature: case kTwoByteAuto: case kOneByteAuto: {
+    case kSpeechFeature: case kTwoByteAuto: case kOneByteAuto:
+    case kDeltaCoded: case kDeltaCodedFine: {
       float min_value = mat.Min(), max_value = mat.Max();
       // ensure that max_value is strictly greater than min_value, even if matrix is
       // constant; this avoids crashes in ComputeColHeader when compressing speech
@@ -137,6 +362,10 @@ void CompressedMatrix::CopyFromMat(
 
   GlobalHeader global_header;
   ComputeGlobalHeader(mat, method, &global_header);
+  if (global_header.format == kEntropyCoded) {
+    CopyFromMatDeltaCoded(mat, method, global_header);
+    return;
+  }
 
   int32 data_size = DataSize(global_header);
 
@@ -144,17 +373,50 @@ void CompressedMatrix::CopyFromMat(
 
   *(reinterpret_cast<GlobalHeader*>(data_)) = global_header;
 
+  // The columns (for format kOneByteWithColHeaders) or the rows (for the other
+  // formats) are compressed independently, so we can split a large matrix
+  // between threads.
+  DataFormat format = static_cast<DataFormat>(global_header.format);
+  int32 num_units = (format == kOneByteWithColHeaders ? mat.NumCols() :
+                     mat.NumRows());
+  const int64 min_elements_per_thread = 65536;
+  int64 num_elements = static_cast<int64>(mat.NumRows()) * mat.NumCols();
+  int32 num_threads = std::min<int64>(
+      std::min<int64>(GetCompressedMatrixNumThreads(), num_units),
+      num_elements / min_elements_per_thread);
+  if (num_threads <= 1) {
+    CompressRange(mat, 0, num_units);
+  } else {
+    std::vector<std::thread> threads;
+    for (int32 t = 1; t < num_threads; t++)
+      threads.push_back(std::thread(&CompressedMatrix::CompressRange<Real>,
+                                    this, std::cref(mat),
+                                    (num_units * int64(t)) / num_threads,
+                                    (num_units * int64(t + 1)) / num_threads));
+    CompressRange(mat, 0, num_units / num_threads);
+    for (size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+  }
+}
+
+template<typename Real>
+void CompressedMatrix::CompressRange(const MatrixBase<Real> &mat,
+                                     int32 begin, int32 end) {
+  const GlobalHeader &global_header =
+      *reinterpret_cast<const GlobalHeader*>(data_);
   DataFormat format = static_cast<DataFormat>(global_header.format);
   if (format == kOneByteWithColHeaders) {
     PerColHeader *header_data =
         reinterpret_cast<PerColHeader*>(static_cast<char*>(data_) +
                                         sizeof(GlobalHeader));
     uint8 *byte_data =
-        reinterpret_cast<uint8*>(header_data + global_header.num_cols);
+        reinterpret_cast<uint8*>(header_data + global_header.num_cols) +
+        static_cast<size_t>(begin) * global_header.num_rows;
+    header_data += begin;
 
     const Real *matrix_data = mat.Data();
 
-    for (int32 col = 0; col < global_header.num_cols; col++) {
+    for (int32 col = begin; col < end; col++) {
       CompressColumn(global_header,
                      matrix_data + col, mat.Stride(),
                      global_header.num_rows,
@@ -163,10 +425,11 @@ void CompressedMatrix::CopyFromMat(
       byte_data += global_header.num_rows;
     }
   } else if (format == kTwoByte) {
+    int32 num_cols = mat.NumCols();
     uint16 *data = reinterpret_cast<uint16*>(static_cast<char*>(data_) +
-                                             sizeof(GlobalHeader));
-    int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
-    for (int32 r = 0; r < num_rows; r++) {
+                                             sizeof(GlobalHeader)) +
+        static_cast<size_t>(begin) * num_cols;
+    for (int32 r = begin; r < end; r++) {
       const Real *row_data = mat.RowData(r);
       for (int32 c = 0; c < num_cols; c++)
         data[c] = FloatToUint16(global_header, row_data[c]);
@@ -174,10 +437,11 @@ void CompressedMatrix::CopyFromMat(
     }
   } else {
     KALDI_ASSERT(format == kOneByte);
+    int32 num_cols = mat.NumCols();
     uint8 *data = reinterpret_cast<uint8*>(static_cast<char*>(data_) +
-                                           sizeof(GlobalHeader));
-    int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
-    for (int32 r = 0; r < num_rows; r++) {
+                                           sizeof(GlobalHeader)) +
+        static_cast<size_t>(begin) * num_cols;
+    for (int32 r = begin; r < end; r++) {
       const Real *row_data = mat.RowData(r);
       for (int32 c = 0; c < num_cols; c++)
         data[c] = FloatToUint8(global_header, row_data[c]);
@@ -236,6 +500,33 @@ CompressedMatrix::CompressedMatrix(
   // is needed, we will do this below by creating a temporary Matrix.
   new_global_header.format = old_global_header->format;
 
+  if (new_global_header.format == kEntropyCoded) {
+    // We decode only the blocks we need, and re-encode the integers, so there
+    // is no loss of precision.
+    int32 old_row_begin = std::min(std::max(row_offset, 0), old_num_rows - 1),
+        old_row_end = std::max(std::min(row_offset + num_rows, old_num_rows),
+                               old_row_begin + 1);
+    std::vector<int32> old_values, values(static_cast<size_t>(num_rows) *
+                                          num_cols);
+    cmat.DecodeDeltaCoded(old_row_begin, old_row_end, &old_values);
+    for (int32 row = 0; row < num_rows; row++) {
+      int32 old_row = row + row_offset;
+      // The next two lines are only relevant if padding_is_used.
+      if (old_row < old_row_begin) old_row = old_row_begin;
+      else if (old_row >= old_row_end) old_row = old_row_end - 1;
+      memcpy(&(values[static_cast<size_t>(row) * num_cols]),
+             &(old_values[static_cast<size_t>(old_row - old_row_begin) *
+                          old_num_cols + col_offset]),
+             sizeof(int32) * num_cols);
+    }
+    const DeltaColHeader *old_col_headers =
+        cmat.GetDeltaColHeaders() + col_offset;
+    std::vector<DeltaColHeader> col_headers(old_col_headers,
+                                            old_col_headers + num_cols);
+    EncodeDeltaCoded(new_global_header, col_headers, values);
+    return;
+  }
+
   data_ = AllocateData(DataSize(new_global_header));  // allocate memory
   *(reinterpret_cast<GlobalHeader*>(data_)) = new_global_header;
 
@@ -539,6 +830,8 @@ void CompressedMatrix::Write(std::ostream &os, bool binary) const {
         WriteToken(os, binary, "CM2");
       } else if (format == kOneByte) {
         WriteToken(os, binary, "CM3");
+      } else if (format == kEntropyCoded) {
+        WriteToken(os, binary, "CM4");
       }
       MatrixIndexT size = DataSize(h);  // total size of data in data_
       // We don't write out the "int32 format", hence the + 4, - 4.
@@ -577,8 +870,10 @@ void CompressedMatrix::Read(std::istream &is, bool binary) {
       if (tok == "CM") { h.format = 1; } //  kOneByteWithColHeaders
       else if (tok == "CM2") { h.format = 2; }  // kTwoByte
       else if (tok == "CM3") { h.format = 3; }  // kOneByte
+      else if (tok == "CM4") { h.format = 4; }  // kEntropyCoded
       else {
-        KALDI_ERR << "Unexpected token " << tok << ", expecting CM, CM2 or CM3";
+        KALDI_ERR << "Unexpected token " << tok << ", expecting CM, CM2, CM3 "
+                  << "or CM4";
       }
       // don't read the "format" -> hence + 4, - 4.
       is.read(reinterpret_cast<char*>(&h) + 4, sizeof(h) - 4);
@@ -586,10 +881,24 @@ void CompressedMatrix::Read(std::istream &is, bool binary) {
         KALDI_ERR << "Failed to read header";
       if (h.num_cols == 0) // empty matrix.
         return;
-      int32 size = DataSize(h), remaining_size = size - sizeof(GlobalHeader);
+      int32 size, header_size = sizeof(GlobalHeader);
+      if (h.format == kEntropyCoded) {
+        // the size is stored after the header.
+        is.read(reinterpret_cast<char*>(&size), sizeof(size));
+        header_size += sizeof(size);
+        if (is.fail() || size < header_size || h.num_rows <= 0 ||
+            h.num_cols <= 0)
+          KALDI_ERR << "Failed to read header";
+      } else {
+        size = DataSize(h);
+      }
+      int32 remaining_size = size - header_size;
       data_ = AllocateData(size);
       *(reinterpret_cast<GlobalHeader*>(data_)) = h;
-      is.read(reinterpret_cast<char*>(data_) + sizeof(GlobalHeader),
+      if (h.format == kEntropyCoded)
+        *reinterpret_cast<int32*>(reinterpret_cast<GlobalHeader*>(data_) + 1) =
+            size;
+      is.read(reinterpret_cast<char*>(data_) + header_size,
               remaining_size);
     } else {
       // Assume that what we're reading is a regular Matrix.  This might be the
@@ -625,48 +934,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
     KALDI_ASSERT(mat->NumCols() == 0);
     return;
   }
-  GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
-  int32 num_cols = h->num_cols, num_rows = h->num_rows;
-  KALDI_ASSERT(mat->NumRows() == num_rows);
-  KALDI_ASSERT(mat->NumCols() == num_cols);
-
-  DataFormat format = static_cast<DataFormat>(h->format);
-  if (format == kOneByteWithColHeaders) {
-    PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
-    uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
-                                                h->num_cols);
-    for (int32 i = 0; i < num_cols; i++, per_col_header++) {
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < num_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*mat)(j, i) = f;
-      }
-    }
-  } else if (format == kTwoByte) {
-    const uint16 *data = reinterpret_cast<const uint16*>(h + 1);
-    float min_value = h->min_value,
-        increment = h->range * (1.0 / 65535.0);
-    for (int32 i = 0; i < num_rows; i++) {
-      Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = min_value + data[j] * increment;
-      data += num_cols;
-    }
-  } else {
-    KALDI_ASSERT(format == kOneByte);
-    float min_value = h->min_value, increment = h->range * (1.0 / 255.0);
-
-    const uint8 *data = reinterpret_cast<const uint8*>(h + 1);
-    for (int32 i = 0; i < num_rows; i++) {
-      Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = min_value + data[j] * increment;
-      data += num_cols;
-    }
-  }
+  KALDI_ASSERT(mat->NumRows() == NumRows());
+  KALDI_ASSERT(mat->NumCols() == NumCols());
+  CopyToMat(0, 0, mat);
 }
 
 // Instantiate the template for float and double.
@@ -686,7 +956,10 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
 
   GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
   DataFormat format = static_cast<DataFormat>(h->format);
-  if (format == kOneByteWithColHeaders) {
+  if (format == kEntropyCoded) {
+    SubMatrix<Real> dest(v->Data(), 1, v->Dim(), v->Dim());
+    CopyToMat(row, 0, &dest);
+  } else if (format == kOneByteWithColHeaders) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
                                                 h->num_cols);
@@ -706,7 +979,12 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
         increment = h->range * (1.0 / 65535.0);
     const uint16 *row_data = reinterpret_cast<uint16*>(h + 1) + (num_cols * row);
     Real *v_data = v->Data();
-    for (int32 c = 0; c < num_cols; c++)
+    int32 c = 0;
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+    if (GetCompressedMatrixImpl() == kCompressedMatrixAvx2)
+      c = Avx2DecodeRow(min_value, increment, row_data, num_cols, v_data);
+#endif
+    for (; c < num_cols; c++)
       v_data[c] = min_value + row_data[c] * increment;
   } else {
     KALDI_ASSERT(format == kOneByte);
@@ -715,7 +993,12 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
         increment = h->range * (1.0 / 255.0);
     const uint8 *row_data = reinterpret_cast<uint8*>(h + 1) + (num_cols * row);
     Real *v_data = v->Data();
-    for (int32 c = 0; c < num_cols; c++)
+    int32 c = 0;
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+    if (GetCompressedMatrixImpl() == kCompressedMatrixAvx2)
+      c = Avx2DecodeRow(min_value, increment, row_data, num_cols, v_data);
+#endif
+    for (; c < num_cols; c++)
       v_data[c] = min_value + row_data[c] * increment;
   }
 }
@@ -730,7 +1013,11 @@ void CompressedMatrix::CopyColToVec(MatrixIndexT col,
   GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
 
   DataFormat format = static_cast<DataFormat>(h->format);
-  if (format == kOneByteWithColHeaders) {
+  if (format == kEntropyCoded) {
+    Matrix<Real> temp(h->num_rows, 1, kUndefined);
+    CopyToMat(0, col, &temp);
+    v->CopyColFromMat(temp, 0);
+  } else if (format == kOneByteWithColHeaders) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
                                                 h->num_cols);
@@ -789,8 +1076,20 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
   int32 num_rows = h->num_rows, num_cols = h->num_cols,
       tgt_cols = dest->NumCols(), tgt_rows = dest->NumRows();
 
+  CompressedMatrixImpl impl = GetCompressedMatrixImpl();
   DataFormat format = static_cast<DataFormat>(h->format);
-  if (format == kOneByteWithColHeaders) {
+  if (format == kEntropyCoded) {
+    const DeltaColHeader *col_headers = GetDeltaColHeaders() + col_offset;
+    std::vector<int32> values;
+    DecodeDeltaCoded(row_offset, row_offset + tgt_rows, &values);
+    const int32 *row_values = &(values[0]) + col_offset;
+    for (int32 row = 0; row < tgt_rows; row++, row_values += num_cols) {
+      Real *dest_row = dest->RowData(row);
+      for (int32 col = 0; col < tgt_cols; col++)
+        dest_row[col] = col_headers[col].min_value +
+            col_headers[col].step * row_values[col];
+    }
+  } else if (format == kOneByteWithColHeaders) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
                                                 h->num_cols);
@@ -801,15 +1100,40 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
 
     per_col_header += col_offset;  // skip the appropriate number of headers
 
+    // The SIMD code does the first simd_rows rows of the first simd_cols
+    // columns, and the scalar code below does the rest.
+    int32 simd_rows = 0, simd_cols = 0;
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+    if (impl == kCompressedMatrixAvx2 && tgt_rows >= 8 && tgt_cols >= 8) {
+      simd_rows = tgt_rows - tgt_rows % 8;
+      simd_cols = tgt_cols - tgt_cols % 8;
+      std::vector<float> percentiles(4 * simd_cols);
+      for (int32 i = 0; i < simd_cols; i++) {
+        percentiles[4 * i] = Uint16ToFloat(*h, per_col_header[i].percentile_0);
+        percentiles[4 * i + 1] =
+            Uint16ToFloat(*h, per_col_header[i].percentile_25);
+        percentiles[4 * i + 2] =
+            Uint16ToFloat(*h, per_col_header[i].percentile_75);
+        percentiles[4 * i + 3] =
+            Uint16ToFloat(*h, per_col_header[i].percentile_100);
+      }
+      Avx2DecodeColumns(&(percentiles[0]), start_of_subcol, num_rows,
+                        simd_rows, simd_cols, dest->Data(), dest->Stride());
+    }
+#endif
+
     for (int32 i = 0;
          i < tgt_cols;
          i++, per_col_header++, start_of_subcol+=num_rows) {
-      byte_data = start_of_subcol;
+      int32 j = (i < simd_cols ? simd_rows : 0);
+      if (j == tgt_rows)
+        continue;
+      byte_data = start_of_subcol + j;
       float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
           p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
           p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
           p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < tgt_rows; j++, byte_data++) {
+      for (; j < tgt_rows; j++, byte_data++) {
         float f = CharToFloat(p0, p25, p75, p100, *byte_data);
         (*dest)(j, i) = f;
       }
@@ -822,7 +1146,12 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
 
     for (int32 row = 0; row < tgt_rows; row++) {
       Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
+      int32 col = 0;
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+      if (impl == kCompressedMatrixAvx2)
+        col = Avx2DecodeRow(min_value, increment, data, tgt_cols, dest_row);
+#endif
+      for (; col < tgt_cols; col++)
         dest_row[col] = min_value + increment * data[col];
       data += num_cols;
     }
@@ -834,7 +1163,12 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
         increment = h->range * (1.0 / 255.0);
     for (int32 row = 0; row < tgt_rows; row++) {
       Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
+      int32 col = 0;
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+      if (impl == kCompressedMatrixAvx2)
+        col = Avx2DecodeRow(min_value, increment, data, tgt_cols, dest_row);
+#endif
+      for (; col < tgt_cols; col++)
         dest_row[col] = min_value + increment * data[col];
       data += num_cols;
     }
@@ -849,6 +1183,343 @@ template void CompressedMatrix::CopyToMat(int32,
                                           int32,
                                           MatrixBase<double> *dest) const;
 
+// The format kEntropyCoded.  After the GlobalHeader, the int32 total size and
+// the DeltaColHeaders, there are num_blocks + 1 uint32 offsets, where
+// num_blocks = ceil(num_rows / kDeltaCodedBlockSize); block b contains rows
+// [b * kDeltaCodedBlockSize, (b + 1) * kDeltaCodedBlockSize), and its code
+// starts at byte offsets[b] of the code that follows (offsets[num_blocks] is
+// the size of the code).  The code is followed by 8 bytes of padding, so the
+// decoder can read whole 64-bit words.
+//
+// Within a block the columns are coded one after the other: 2 bits for the
+// predictor p, 5 bits for the Rice parameter k, then the first integer with
+// DeltaColHeader::num_bits bits if p > 0, then the residuals of the rest,
+// i.e. the integer minus its prediction, which is
+//    p = 0:  0
+//    p = 1:  the previous integer,
+//    p = 2:  twice the previous integer minus the one before that,
+//    p = 3:  the previous integer plus the difference between the same two
+//            integers of the previous column (this helps for filterbank
+//            features, whose neighbouring dimensions change together).  The
+// residuals are mapped to unsigned integers u (0, -1, 1, -2 ... map to
+// 0, 1, 2, 3 ...) and Rice coded: u >> k in unary (that many 1's, then a 0)
+// followed by the low k bits of u; if u >> k is kRiceEscape or more, we
+// instead write kRiceEscape 1's followed by u in 32 bits.  The bits are
+// written starting from the least significant bit of each byte, and, like the
+// rest of this class, the decoder assumes a little-endian machine.  The
+// encoder chooses p and k for each block and column to minimize the size.
+
+namespace {
+
+const int32 kDeltaCodedBlockSize = 64;
+const int32 kRiceEscape = 24;
+// We limit the integers to 28 bits so the residuals fit in 31 bits.
+const int32 kDeltaCodedMaxBits = 28;
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8> *output):
+      output_(output), buffer_(0), num_bits_(0) { }
+
+  // Writes the low "num_bits" bits of "value"; num_bits <= 32.
+  void Write(uint64 value, int32 num_bits) {
+    buffer_ |= (value & ((static_cast<uint64>(1) << num_bits) - 1))
+        << num_bits_;
+    num_bits_ += num_bits;
+    for (; num_bits_ >= 8; num_bits_ -= 8, buffer_ >>= 8)
+      output_->push_back(static_cast<uint8>(buffer_));
+  }
+
+  void WriteRice(uint32 u, int32 k) {
+    uint32 high = u >> k;
+    if (high < kRiceEscape) {
+      Write((static_cast<uint64>(1) << high) - 1, high + 1);
+      Write(u, k);
+    } else {
+      Write((static_cast<uint64>(1) << kRiceEscape) - 1, kRiceEscape);
+      Write(u, 32);
+    }
+  }
+
+  // Pads the output to a whole number of bytes.
+  void Flush() {
+    if (num_bits_ > 0)
+      output_->push_back(static_cast<uint8>(buffer_));
+    buffer_ = 0;
+    num_bits_ = 0;
+  }
+
+ private:
+  std::vector<uint8> *output_;
+  uint64 buffer_;
+  int32 num_bits_;
+};
+
+class BitReader {
+ public:
+  explicit BitReader(const uint8 *data): data_(data), pos_(0) { }
+
+  // Reads "num_bits" bits; num_bits <= 32.
+  uint32 Read(int32 num_bits) {
+    uint64 bits = Peek();
+    pos_ += num_bits;
+    return static_cast<uint32>(bits & ((static_cast<uint64>(1) << num_bits) -
+                                       1));
+  }
+
+  uint32 ReadRice(int32 k) {
+    // "bits" has at least 57 valid bits, which is enough for the unary part
+    // and k bits, as k < 32 and the unary part is at most kRiceEscape.
+    uint64 bits = Peek();
+    int32 high = 0;
+    while (high < kRiceEscape && (bits & 1)) {
+      bits >>= 1;
+      high++;
+    }
+    if (high == kRiceEscape) {
+      pos_ += kRiceEscape;
+      return Read(32);
+    }
+    pos_ += high + 1 + k;
+    bits >>= 1;
+    return (static_cast<uint32>(high) << k) |
+        static_cast<uint32>(bits & ((static_cast<uint64>(1) << k) - 1));
+  }
+
+ private:
+  uint64 Peek() const {
+    uint64 bits;
+    memcpy(&bits, data_ + (pos_ >> 3), sizeof(bits));
+    return bits >> (pos_ & 7);
+  }
+  const uint8 *data_;
+  int64 pos_;
+};
+
+inline uint32 ZigZag(int32 r) {
+  return (static_cast<uint32>(r) << 1) ^ static_cast<uint32>(r >> 31);
+}
+
+inline int32 UnZigZag(uint32 u) {
+  return static_cast<int32>(u >> 1) ^ -static_cast<int32>(u & 1);
+}
+
+// Returns the number of bits that Rice coding the residuals u with parameter k
+// takes.
+int64 RiceCost(const std::vector<uint32> &u, int32 num_u, int32 k) {
+  int64 cost = 0;
+  for (int32 i = 0; i < num_u; i++) {
+    uint32 high = u[i] >> k;
+    cost += (high < kRiceEscape ? high + 1 + k : kRiceEscape + 32);
+  }
+  return cost;
+}
+
+// Computes the residuals of the first "n" integers of "q" for predictor
+// "predictor", skipping the first if predictor > 0 (it is stored directly);
+// "prev_q" is the previous column, only used for predictor 3.  Returns the
+// number of residuals.
+int32 ComputeResiduals(const int32 *q, const int32 *prev_q, int32 n,
+                       int32 predictor, std::vector<uint32> *u) {
+  int32 i = (predictor == 0 ? 0 : 1);
+  for (int32 j = 0; i < n; i++, j++) {
+    int32 prediction;
+    switch (predictor) {
+      case 0: prediction = 0; break;
+      case 1: prediction = q[i - 1]; break;
+      case 2: prediction = (i == 1 ? q[0] : 2 * q[i - 1] - q[i - 2]); break;
+      default: prediction = q[i - 1] + prev_q[i] - prev_q[i - 1];
+    }
+    (*u)[j] = ZigZag(q[i] - prediction);
+  }
+  return (predictor == 0 ? n : n - 1);
+}
+
+}  // namespace
+
+template<typename Real>
+void CompressedMatrix::CopyFromMatDeltaCoded(const MatrixBase<Real> &mat,
+                                             CompressionMethod method,
+                                             const GlobalHeader &global_header) {
+  int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
+  double steps_per_stddev = (method == kDeltaCodedFine ? 1024.0 : 32.0);
+  std::vector<DeltaColHeader> col_headers(num_cols);
+  for (int32 c = 0; c < num_cols; c++) {
+    double sum = 0.0, sumsq = 0.0;
+    Real min_value = mat(0, c), max_value = mat(0, c);
+    for (int32 r = 0; r < num_rows; r++) {
+      Real x = mat(r, c);
+      sum += x;
+      sumsq += static_cast<double>(x) * x;
+      min_value = std::min(min_value, x);
+      max_value = std::max(max_value, x);
+    }
+    double mean = sum / num_rows,
+        variance = std::max(0.0, sumsq / num_rows - mean * mean),
+        range = static_cast<double>(max_value) - min_value,
+        step = std::sqrt(variance) / steps_per_stddev;
+    // The step must be positive, and not so small that the integers need more
+    // than kDeltaCodedMaxBits bits.
+    double min_step = range / ((1 << kDeltaCodedMaxBits) - 1) * 1.01;
+    if (!(step >= min_step)) step = min_step;
+    if (!(step > std::numeric_limits<float>::min())) step = 1.0;
+    col_headers[c].min_value = min_value;
+    col_headers[c].step = step;
+    col_headers[c].num_bits = 0;
+  }
+  std::vector<int32> values(static_cast<size_t>(num_rows) * num_cols);
+  for (int32 r = 0; r < num_rows; r++) {
+    const Real *row_data = mat.RowData(r);
+    int32 *row_values = &(values[static_cast<size_t>(r) * num_cols]);
+    for (int32 c = 0; c < num_cols; c++) {
+      int32 q = static_cast<int32>(
+          (static_cast<double>(row_data[c]) - col_headers[c].min_value) /
+          col_headers[c].step + 0.5);
+      q = std::max<int32>(0, std::min<int32>(q, (1 << kDeltaCodedMaxBits) - 1));
+      row_values[c] = q;
+      while ((q >> col_headers[c].num_bits) != 0)
+        col_headers[c].num_bits++;
+    }
+  }
+  EncodeDeltaCoded(global_header, col_headers, values);
+}
+
+void CompressedMatrix::EncodeDeltaCoded(
+    const GlobalHeader &global_header,
+    const std::vector<DeltaColHeader> &col_headers,
+    const std::vector<int32> &values) {
+  int32 num_rows = global_header.num_rows, num_cols = global_header.num_cols,
+      num_blocks = (num_rows + kDeltaCodedBlockSize - 1) / kDeltaCodedBlockSize;
+  KALDI_ASSERT(col_headers.size() == static_cast<size_t>(num_cols) &&
+               values.size() == static_cast<size_t>(num_rows) * num_cols);
+  std::vector<uint32> offsets(num_blocks + 1, 0);
+  std::vector<uint8> code;
+  BitWriter writer(&code);
+  // q is the current column of the block, and prev_q the previous one.
+  std::vector<int32> q(kDeltaCodedBlockSize), prev_q(kDeltaCodedBlockSize);
+  std::vector<uint32> u(kDeltaCodedBlockSize);
+  for (int32 b = 0; b < num_blocks; b++) {
+    offsets[b] = code.size();
+    int32 row_begin = b * kDeltaCodedBlockSize,
+        n = std::min(kDeltaCodedBlockSize, num_rows - row_begin);
+    for (int32 c = 0; c < num_cols; c++) {
+      q.swap(prev_q);
+      for (int32 i = 0; i < n; i++)
+        q[i] = values[static_cast<size_t>(row_begin + i) * num_cols + c];
+      int32 num_bits = col_headers[c].num_bits, best_predictor = 0, best_k = 0;
+      int64 best_cost = -1;
+      for (int32 predictor = 0; predictor <= (c > 0 ? 3 : 2); predictor++) {
+        int32 num_u = ComputeResiduals(&(q[0]), &(prev_q[0]), n, predictor,
+                                       &u);
+        uint64 sum = 0;
+        for (int32 i = 0; i < num_u; i++)
+          sum += u[i];
+        // The best k is close to log2 of the mean residual; we try the
+        // neighbours too.
+        int32 k0 = 0;
+        while (k0 < 30 && (static_cast<uint64>(num_u) << (k0 + 1)) <= sum)
+          k0++;
+        for (int32 k = std::max(0, k0 - 1); k <= k0 + 1; k++) {
+          int64 cost = (predictor == 0 ? 0 : num_bits) + RiceCost(u, num_u, k);
+          if (best_cost < 0 || cost < best_cost) {
+            best_cost = cost;
+            best_predictor = predictor;
+            best_k = k;
+          }
+        }
+      }
+      int32 num_u = ComputeResiduals(&(q[0]), &(prev_q[0]), n,
+                                     best_predictor, &u);
+      writer.Write(best_predictor, 2);
+      writer.Write(best_k, 5);
+      if (best_predictor != 0)
+        writer.Write(q[0], num_bits);
+      for (int32 i = 0; i < num_u; i++)
+        writer.WriteRice(u[i], best_k);
+    }
+    writer.Flush();
+  }
+  offsets[num_blocks] = code.size();
+
+  int32 header_size = sizeof(GlobalHeader) + sizeof(int32) +
+      num_cols * sizeof(DeltaColHeader) + (num_blocks + 1) * sizeof(uint32),
+      data_size = header_size + code.size() + 8;
+  Clear();
+  data_ = AllocateData(data_size);
+  char *data = static_cast<char*>(data_);
+  *reinterpret_cast<GlobalHeader*>(data) = global_header;
+  reinterpret_cast<GlobalHeader*>(data)->format =
+      static_cast<int32>(kEntropyCoded);
+  *reinterpret_cast<int32*>(data + sizeof(GlobalHeader)) = data_size;
+  data += sizeof(GlobalHeader) + sizeof(int32);
+  memcpy(data, &(col_headers[0]), num_cols * sizeof(DeltaColHeader));
+  data += num_cols * sizeof(DeltaColHeader);
+  memcpy(data, &(offsets[0]), (num_blocks + 1) * sizeof(uint32));
+  data += (num_blocks + 1) * sizeof(uint32);
+  if (!code.empty())
+    memcpy(data, &(code[0]), code.size());
+  memset(data + code.size(), 0, 8);
+}
+
+void CompressedMatrix::DecodeDeltaCoded(int32 row_begin, int32 row_end,
+                                        std::vector<int32> *values) const {
+  const GlobalHeader *h = reinterpret_cast<const GlobalHeader*>(data_);
+  KALDI_ASSERT(h->format == kEntropyCoded && row_begin >= 0 &&
+               row_begin <= row_end && row_end <= h->num_rows);
+  int32 num_rows = h->num_rows, num_cols = h->num_cols,
+      num_blocks = (num_rows + kDeltaCodedBlockSize - 1) / kDeltaCodedBlockSize;
+  const DeltaColHeader *col_headers = GetDeltaColHeaders();
+  const uint32 *offsets =
+      reinterpret_cast<const uint32*>(col_headers + num_cols);
+  const uint8 *code = reinterpret_cast<const uint8*>(offsets + num_blocks + 1);
+
+  values->resize(static_cast<size_t>(row_end - row_begin) * num_cols);
+  // q is the current column of the block, and prev_q the previous one.
+  int32 q_data[2][kDeltaCodedBlockSize];
+  for (int32 b = row_begin / kDeltaCodedBlockSize;
+       b * kDeltaCodedBlockSize < row_end; b++) {
+    int32 block_begin = b * kDeltaCodedBlockSize,
+        n = std::min(kDeltaCodedBlockSize, num_rows - block_begin),
+        // the rows of this block that we output.
+        i_begin = std::max(row_begin - block_begin, 0),
+        i_end = std::min(row_end - block_begin, n);
+    BitReader reader(code + offsets[b]);
+    for (int32 c = 0; c < num_cols; c++) {
+      int32 *q = q_data[c % 2], *prev_q = q_data[(c + 1) % 2];
+      int32 predictor = reader.Read(2), k = reader.Read(5), i = 0;
+      if (predictor != 0)
+        q[i++] = reader.Read(col_headers[c].num_bits);
+      switch (predictor) {
+        case 0:
+          for (; i < n; i++)
+            q[i] = UnZigZag(reader.ReadRice(k));
+          break;
+        case 1:
+          for (; i < n; i++)
+            q[i] = q[i - 1] + UnZigZag(reader.ReadRice(k));
+          break;
+        case 2:
+          if (i < n) {
+            q[i] = q[0] + UnZigZag(reader.ReadRice(k));
+            i++;
+          }
+          for (; i < n; i++)
+            q[i] = 2 * q[i - 1] - q[i - 2] + UnZigZag(reader.ReadRice(k));
+          break;
+        default:
+          KALDI_ASSERT(c > 0);
+          for (; i < n; i++)
+            q[i] = q[i - 1] + prev_q[i] - prev_q[i - 1] +
+                UnZigZag(reader.ReadRice(k));
+      }
+      int32 *dest = &((*values)[static_cast<size_t>(block_begin + i_begin -
+                                                    row_begin) * num_cols + c]);
+      for (i = i_begin; i < i_end; i++, dest += num_cols)
+        *dest = q[i];
+    }
+  }
+}
+
 void CompressedMatrix::Clear() {
   if (data_ != NULL) {
     delete [] static_cast<float*>(data_);
@@ -67,6 +67,18 @@ namespace kaldi {
                         one byte as a uint8, with the representable range of
                         values equal to [0.0, 1.0].  Suitable for image data
                         that has previously been compressed as int8.
+    kDeltaCoded = 8     Each column is quantized uniformly with a step of 1/32
+                        of its standard deviation (so the error is similar to
+                        kSpeechFeature), and the integers are predicted from
+                        the previous rows and entropy coded, in blocks of 64
+                        rows that can be decoded independently.  The size
+                        depends on the data: for filterbank and MFCC features
+                        it is about 0.75 to 0.9 bytes per element, versus
+                        about 1.05 for kSpeechFeature.  Compressing is slower
+                        than for the other methods.
+    kDeltaCodedFine = 9 As kDeltaCoded but with a step of 1/1024 of the
+                        standard deviation, which is close to lossless for
+                        most purposes; it takes about 5 more bits per element.
 
     // We can add new methods here as needed: if they just imply different ways
     // of selecting the min_value and range, and a num-bytes = 1 or 2, they will
@@ -79,10 +91,44 @@ enum CompressionMethod {
   kTwoByteSignedInteger = 4,
   kOneByteAuto = 5,
   kOneByteUnsignedInteger = 6,
-  kOneByteZeroOne = 7
+  kOneByteZeroOne = 7,
+  kDeltaCoded = 8,
+  kDeltaCodedFine = 9
 };
 
 
+/// The implementations of decompression (CompressedMatrix::CopyToMat(), and
+/// CopyRowToVec() for the formats without column headers).  The AVX2 one
+/// decodes 8 elements at a time, and for the kSpeechFeature format it decodes
+/// 8x8 tiles and transposes them in registers; the output is the same as the
+/// scalar code.  By default (kCompressedMatrixAuto) the fastest one this CPU
+/// supports is chosen at runtime.
+enum CompressedMatrixImpl {
+  kCompressedMatrixAuto,
+  kCompressedMatrixScalar,
+  kCompressedMatrixAvx2
+};
+
+/// Returns true if "impl" can be used on this machine.
+bool CompressedMatrixImplSupported(CompressedMatrixImpl impl);
+
+/// Overrides the choice of implementation, e.g. to compare their speed; it is
+/// an error if "impl" is not supported.  This is not thread-safe with respect
+/// to matrices that are being decompressed.
+void SetCompressedMatrixImpl(CompressedMatrixImpl impl);
+
+/// Returns the implementation that is in use (never kCompressedMatrixAuto).
+CompressedMatrixImpl GetCompressedMatrixImpl();
+
+/// Sets the maximum number of threads that CompressedMatrix::CopyFromMat() may
+/// use to compress a large matrix (the default is 1).  Each thread gets at
+/// least 64k elements, so this only affects big matrices; the output does not
+/// depend on the number of threads.
+void SetCompressedMatrixNumThreads(int32 num_threads);
+
+int32 GetCompressedMatrixNumThreads();
+
+
 /*
   This class does lossy compression of a matrix.  It supports various compression
   methods, see enum CompressionMethod.
@@ -198,10 +244,17 @@ class CompressedMatrix {
   //    order and is decompressed as:
   //       uint8 i;  GlobalHeader g;
   //       float f = g.min_value + i * (g.range / 255.0)
+  //  kEntropyCoded means there is a global header, then the total size of the
+  //    data in bytes as an int32, then a DeltaColHeader per column, then the
+  //    offsets of the blocks of rows, then the entropy-coded blocks (see
+  //    compressed-matrix.cc for details).  Each element is an integer i,
+  //    decompressed as:
+  //       DeltaColHeader c;  float f = c.min_value + c.step * i
   enum DataFormat {
     kOneByteWithColHeaders = 1,
     kTwoByte = 2,
-    kOneByte = 3
+    kOneByte = 3,
+    kEntropyCoded = 4
   };
 
 
@@ -227,9 +280,18 @@ class CompressedMatrix {
                                          GlobalHeader *header);
 
 
-  // The number of bytes we need to request when allocating 'data_'.
+  // The number of bytes we need to request when allocating 'data_'.  For
+  // format kEntropyCoded this depends on the data, and "header" must be the one
+  // at the start of data_.
   static MatrixIndexT DataSize(const GlobalHeader &header);
 
+  // Compresses columns [begin, end) of "mat" (for format
+  // kOneByteWithColHeaders) or rows [begin, end) (for the other formats) into
+  // data_, whose GlobalHeader must already be set up.  Called by
+  // CopyFromMat(), possibly from several threads at once.
+  template<typename Real>
+  void CompressRange(const MatrixBase<Real> &mat, int32 begin, int32 end);
+
   // This struct is only used in format kOneByteWithColHeaders.
   struct PerColHeader {
     uint16 percentile_0;
@@ -238,6 +300,39 @@ class CompressedMatrix {
     uint16 percentile_100;
   };
 
+  // This struct is only used in format kEntropyCoded.
+  struct DeltaColHeader {
+    float min_value;  // The value represented by the integer 0.
+    float step;       // The difference between consecutive integers.
+    int32 num_bits;   // The number of bits needed for the largest integer.
+  };
+
+  // Compresses "mat" in format kEntropyCoded; "global_header" has been set up
+  // by ComputeGlobalHeader().
+  template<typename Real>
+  void CopyFromMatDeltaCoded(const MatrixBase<Real> &mat,
+                             CompressionMethod method,
+                             const GlobalHeader &global_header);
+
+  // Sets data_ to the format kEntropyCoded, with headers "global_header" and
+  // "col_headers" (one per column) and the integers "values", which are in
+  // row-major order.
+  void EncodeDeltaCoded(const GlobalHeader &global_header,
+                        const std::vector<DeltaColHeader> &col_headers,
+                        const std::vector<int32> &values);
+
+  // For format kEntropyCoded: returns the first DeltaColHeader.
+  DeltaColHeader *GetDeltaColHeaders() const {
+    return reinterpret_cast<DeltaColHeader*>(
+        static_cast<char*>(data_) + sizeof(GlobalHeader) + sizeof(int32));
+  }
+
+  // For format kEntropyCoded: outputs the integers of rows [row_begin, row_end)
+  // to "values", in row-major order.  Only the blocks that contain those rows
+  // are decoded.
+  void DecodeDeltaCoded(int32 row_begin, int32 row_end,
+                        std::vector<int32> *values) const;
+
   template<typename Real>
   static void CompressColumn(const GlobalHeader &global_header,
                              const Real *data, MatrixIndexT stride,
@@ -0,0 +1,253 @@
+// matrix/gemm-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <thread>
+#include <vector>
+
+#include "matrix/matrix-lib.h"
+#include "matrix/kaldi-blas.h"
+#include "base/timer.h"
+
+// This compares the speed of BuiltinGemm(), BuiltinGemv() and Int8Gemm(), for
+// each implementation (see GemmImpl) that this machine supports and with 1 and
+// all CPUs, with the BLAS that Kaldi was linked with (called directly, whether
+// or not Kaldi was configured with --builtin-gemm).  The output is in CSV
+// format: test, type, transposes, m, n, k (for gemv, rows, columns and 1),
+// implementation, threads, GFLOPS, speedup relative to the BLAS.  For int8 the
+// BLAS does the same product in float, and the time of Int8Gemm() includes
+// quantizing A, as a quantized nnet3 component does.
+
+namespace kaldi {
+
+static const char *ImplName(GemmImpl impl) {
+  switch (impl) {
+    case kGemmScalar: return "scalar";
+    case kGemmAvx2: return "avx2";
+    case kGemmAvx512Vnni: return "avx512vnni";
+    default: return "auto";
+  }
+}
+
+static void BlasGemm(MatrixTransposeType trans_a, MatrixTransposeType trans_b,
+                     MatrixIndexT m, MatrixIndexT n, MatrixIndexT k,
+                     const float *a, MatrixIndexT lda, const float *b,
+                     MatrixIndexT ldb, float *c, MatrixIndexT ldc) {
+  cblas_sgemm(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans_a),
+              static_cast<CBLAS_TRANSPOSE>(trans_b), m, n, k, 1.0, a, lda,
+              b, ldb, 0.0, c, ldc);
+}
+
+static void BlasGemm(MatrixTransposeType trans_a, MatrixTransposeType trans_b,
+                     MatrixIndexT m, MatrixIndexT n, MatrixIndexT k,
+                     const double *a, MatrixIndexT lda, const double *b,
+                     MatrixIndexT ldb, double *c, MatrixIndexT ldc) {
+  cblas_dgemm(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans_a),
+              static_cast<CBLAS_TRANSPOSE>(trans_b), m, n, k, 1.0, a, lda,
+              b, ldb, 0.0, c, ldc);
+}
+
+static void BlasGemv(MatrixTransposeType trans, MatrixIndexT num_rows,
+                     MatrixIndexT num_cols, const float *m,
+                     MatrixIndexT stride, const float *x, float *y) {
+  cblas_sgemv(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans), num_rows,
+              num_cols, 1.0, m, stride, x, 1, 0.0, y, 1);
+}
+
+static void BlasGemv(MatrixTransposeType trans, MatrixIndexT num_rows,
+                     MatrixIndexT num_cols, const double *m,
+                     MatrixIndexT stride, const double *x, double *y) {
+  cblas_dgemv(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans), num_rows,
+              num_cols, 1.0, m, stride, x, 1, 0.0, y, 1);
+}
+
+// Returns GFLOPS for C = op(A) op(B), with C m by n and op(A) m by k, using
+// the BLAS if "blas" is true and otherwise BuiltinGemm() as currently set up.
+template<typename Real>
+static double TimeGemm(MatrixTransposeType trans_a,
+                       MatrixTransposeType trans_b, MatrixIndexT m,
+                       MatrixIndexT n, MatrixIndexT k, bool blas) {
+  Matrix<Real> a(trans_a == kNoTrans ? m : k, trans_a == kNoTrans ? k : m),
+      b(trans_b == kNoTrans ? k : n, trans_b == kNoTrans ? n : k), c(m, n);
+  a.SetRandn();
+  b.SetRandn();
+  double num_flops = 0.0;
+  Timer timer;
+  do {
+    if (blas)
+      BlasGemm(trans_a, trans_b, m, n, k, a.Data(), a.Stride(), b.Data(),
+               b.Stride(), c.Data(), c.Stride());
+    else
+      BuiltinGemm(trans_a, trans_b, m, n, k, Real(1.0), a.Data(), a.Stride(),
+                  b.Data(), b.Stride(), Real(0.0), c.Data(), c.Stride());
+    num_flops += 2.0 * m * n * k;
+  } while (timer.Elapsed() < 0.2);
+  return num_flops / timer.Elapsed() * 1.0e-09;
+}
+
+// As TimeGemm() but for y = op(M) x, with M num_rows by num_cols.
+template<typename Real>
+static double TimeGemv(MatrixTransposeType trans, MatrixIndexT num_rows,
+                       MatrixIndexT num_cols, bool blas) {
+  Matrix<Real> mat(num_rows, num_cols);
+  Vector<Real> x(trans == kNoTrans ? num_cols : num_rows),
+      y(trans == kNoTrans ? num_rows : num_cols);
+  mat.SetRandn();
+  x.SetRandn();
+  double num_flops = 0.0;
+  Timer timer;
+  do {
+    for (int32 i = 0; i < 10; i++) {
+      if (blas)
+        BlasGemv(trans, num_rows, num_cols, mat.Data(), mat.Stride(),
+                 x.Data(), y.Data());
+      else
+        BuiltinGemv(trans, num_rows, num_cols, Real(1.0), mat.Data(),
+                    mat.Stride(), x.Data(), 1, Real(0.0), y.Data(), 1);
+      num_flops += 2.0 * num_rows * num_cols;
+    }
+  } while (timer.Elapsed() < 0.2);
+  return num_flops / timer.Elapsed() * 1.0e-09;
+}
+
+// Returns GFLOPS (counting the multiply-adds as 2) for quantizing the m by k
+// matrix A and adding A B^T to C, where B is n by k and already quantized.
+static double TimeInt8Gemm(MatrixIndexT m, MatrixIndexT n, MatrixIndexT k) {
+  Matrix<float> a(m, k), b(n, k), c(m, n);
+  a.SetRandn();
+  b.SetRandn();
+  std::vector<int8> a_quantized(m * k), b_quantized(n * k);
+  std::vector<float> a_scales(m), b_scales(n);
+  QuantizeRowsInt8(n, k, b.Data(), b.Stride(), &(b_quantized[0]), k,
+                   &(b_scales[0]));
+  double num_flops = 0.0;
+  Timer timer;
+  do {
+    QuantizeRowsInt8(m, k, a.Data(), a.Stride(), &(a_quantized[0]), k,
+                     &(a_scales[0]));
+    Int8Gemm(m, n, k, &(a_quantized[0]), k, &(a_scales[0]),
+             &(b_quantized[0]), k, &(b_scales[0]), c.Data(), c.Stride());
+    num_flops += 2.0 * m * n * k;
+  } while (timer.Elapsed() < 0.2);
+  return num_flops / timer.Elapsed() * 1.0e-09;
+}
+
+static void Int8GemmSpeedTest() {
+  GemmImpl impls[] = { kGemmScalar, kGemmAvx2, kGemmAvx512Vnni };
+  int32 max_threads = std::max<int32>(1, std::thread::hardware_concurrency());
+  // The shapes of typical nnet3 affine and TDNN layers: frames by input-dim,
+  // times input-dim by output-dim.
+  MatrixIndexT sizes[][3] = { { 64, 256, 256 }, { 128, 1024, 512 },
+                              { 150, 1536, 1536 }, { 150, 1536, 160 },
+                              { 150, 160, 1536 } };
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    MatrixIndexT m = sizes[s][0], n = sizes[s][1], k = sizes[s][2];
+    double blas_speed = TimeGemm<float>(kNoTrans, kTrans, m, n, k, true);
+    std::cout << "int8gemm,float,NT," << m << "," << n << "," << k
+              << ",blas,-," << blas_speed << ",1\n";
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+      if (!GemmImplSupported(impls[i]))
+        continue;
+      SetGemmImpl(impls[i]);
+      for (int32 num_threads = 1; num_threads <= max_threads;
+           num_threads = (num_threads == max_threads ? max_threads + 1 :
+                          max_threads)) {
+        SetGemmNumThreads(num_threads);
+        double speed = TimeInt8Gemm(m, n, k);
+        std::cout << "int8gemm,int8,NT," << m << "," << n << "," << k << ","
+                  << ImplName(impls[i]) << "," << num_threads << "," << speed
+                  << "," << (speed / blas_speed) << "\n";
+      }
+    }
+  }
+  SetGemmImpl(kGemmAuto);
+  SetGemmNumThreads(1);
+}
+
+template<typename Real>
+static void GemmSpeedTest() {
+  const char *type = (sizeof(Real) == 8 ? "double" : "float");
+  GemmImpl impls[] = { kGemmScalar, kGemmAvx2 };
+  int32 max_threads = std::max<int32>(1, std::thread::hardware_concurrency());
+  // Square matrices, then the shapes of a typical nnet3 affine layer: (frames
+  // by input-dim) times (input-dim by output-dim), and its backprop.
+  MatrixIndexT sizes[][3] = { { 64, 64, 64 }, { 256, 256, 256 },
+                              { 1024, 1024, 1024 }, { 128, 1024, 512 },
+                              { 512, 512, 128 } };
+  const char *trans_names[] = { "NN", "NT", "TN", "TT" };
+  for (int32 t = 0; t < 4; t++) {
+    MatrixTransposeType trans_a = (t / 2 ? kTrans : kNoTrans),
+        trans_b = (t % 2 ? kTrans : kNoTrans);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      MatrixIndexT m = sizes[s][0], n = sizes[s][1], k = sizes[s][2];
+      double blas_speed = TimeGemm<Real>(trans_a, trans_b, m, n, k, true);
+      std::cout << "gemm," << type << "," << trans_names[t] << "," << m << ","
+                << n << "," << k << ",blas,-," << blas_speed << ",1\n";
+      for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (!GemmImplSupported(impls[i]))
+          continue;
+        SetGemmImpl(impls[i]);
+        for (int32 num_threads = 1; num_threads <= max_threads;
+             num_threads = (num_threads == max_threads ? max_threads + 1 :
+                            max_threads)) {
+          SetGemmNumThreads(num_threads);
+          double speed = TimeGemm<Real>(trans_a, trans_b, m, n, k, false);
+          std::cout << "gemm," << type << "," << trans_names[t] << "," << m
+                    << "," << n << "," << k << "," << ImplName(impls[i])
+                    << "," << num_threads << "," << speed << ","
+                    << (speed / blas_speed) << "\n";
+        }
+      }
+    }
+  }
+  for (int32 t = 0; t < 2; t++) {
+    MatrixTransposeType trans = (t ? kTrans : kNoTrans);
+    for (MatrixIndexT dim = 256; dim <= 4096; dim *= 4) {
+      double blas_speed = TimeGemv<Real>(trans, dim, dim, true);
+      std::cout << "gemv," << type << "," << (t ? "T" : "N") << "," << dim
+                << "," << dim << ",1,blas,-," << blas_speed << ",1\n";
+      for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (!GemmImplSupported(impls[i]))
+          continue;
+        SetGemmImpl(impls[i]);
+        for (int32 num_threads = 1; num_threads <= max_threads;
+             num_threads = (num_threads == max_threads ? max_threads + 1 :
+                            max_threads)) {
+          SetGemmNumThreads(num_threads);
+          double speed = TimeGemv<Real>(trans, dim, dim, false);
+          std::cout << "gemv," << type << "," << (t ? "T" : "N") << ","
+                    << dim << "," << dim << ",1," << ImplName(impls[i])
+                    << "," << num_threads << "," << speed << ","
+                    << (speed / blas_speed) << "\n";
+        }
+      }
+    }
+  }
+  SetGemmImpl(kGemmAuto);
+  SetGemmNumThreads(1);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  std::cout << "test,type,trans,m,n,k,impl,threads,gflops,speedup\n";
+  GemmSpeedTest<float>();
+  GemmSpeedTest<double>();
+  Int8GemmSpeedTest();
+  KALDI_LOG << "Default implementation is " << ImplName(GetGemmImpl());
+  std::cout << "Test OK.\n";
+}
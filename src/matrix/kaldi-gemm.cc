@@ -0,0 +1,1128 @@
+// matrix/kaldi-gemm.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <new>
+#include <thread>
+
+#include "base/kaldi-thread-pool.h"
+#include "matrix/kaldi-gemm.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// We compile the SIMD code with target attributes and choose between them at
+// runtime, so no special compiler flags are needed.
+#define KALDI_GEMM_SIMD 1
+#include <immintrin.h>
+#include "matrix/kaldi-simd.h"
+// The AVX-512 VNNI kernel of Int8Gemm() needs a compiler that knows the
+// instructions.
+#if (defined(__clang__) && __clang_major__ >= 7) || \
+    (!defined(__clang__) && __GNUC__ >= 8)
+#define KALDI_GEMM_VNNI 1
+#endif
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// Products with fewer multiply-adds than this per thread are not split
+// further; nor are matrix-vector products with fewer elements than
+// kGemvMinElementsPerTask per thread.
+const int64 kGemmMinWorkPerTask = 1 << 21;
+const int64 kGemvMinElementsPerTask = 1 << 17;
+
+// The worker threads of BuiltinGemm() and BuiltinGemv().  It is never
+// destroyed, as its threads may still be waiting for work when the program
+// exits.  Products that find it busy do all their work in the calling thread,
+// so we never have more threads than SetGemmNumThreads() asked for.
+ThreadPool *GemmThreadPool() {
+  static ThreadPool *pool = new ThreadPool();
+  return pool;
+}
+
+// A thread's buffer for packed matrices or vectors; it keeps its memory, as
+// products tend to be repeated with the same sizes.
+class GemmBuffer {
+ public:
+  GemmBuffer(): data_(NULL), size_(0) { }
+
+  template<typename Real>
+  Real *Get(size_t num_elements) {
+    size_t size = num_elements * sizeof(Real);
+    if (size > size_) {
+      if (data_ != NULL)
+        KALDI_MEMALIGN_FREE(data_);
+      void *data;
+      if ((data_ = KALDI_MEMALIGN(64, size, &data)) == NULL)
+        throw std::bad_alloc();
+      size_ = size;
+    }
+    return static_cast<Real*>(data_);
+  }
+
+  ~GemmBuffer() {
+    if (data_ != NULL)
+      KALDI_MEMALIGN_FREE(data_);
+  }
+
+ private:
+  void *data_;
+  size_t size_;
+};
+
+// The micro-kernels, and the blocking parameters that go with them.
+template<typename Real>
+struct GemmKernels {
+  int32 mr, nr;  // The tile of C that the kernel keeps in registers.
+  MatrixIndexT mc, kc, nc;  // The cache blocking: see GemmSerial().
+
+  // Sets the mc by nc block "c" (row stride ldc) to alpha a b + beta c (or to
+  // alpha a b if beta == 0), where a is an mc by kc block of op(A) packed by
+  // PackA() and b a kc by nc block of op(B) packed by PackB().
+  void (*macro_kernel)(MatrixIndexT mc, MatrixIndexT nc, MatrixIndexT kc,
+                       const Real *a, const Real *b, Real alpha, Real beta,
+                       Real *c, MatrixIndexT ldc);
+  // Sets y[i] to the dot product of row i of m with x, for i < num_rows.
+  void (*dot_rows)(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                   const Real *m, MatrixIndexT stride, const Real *x, Real *y);
+  // Adds x[i] times row i of m to y, for i < num_rows.
+  void (*add_rows)(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                   const Real *m, MatrixIndexT stride, const Real *x, Real *y);
+};
+
+// Copies the mc by kc block "a" of op(A) to "a_packed" as slivers of mr rows,
+// each stored as kc columns of mr elements and padded with zeros if mc is not
+// a multiple of mr.
+template<typename Real>
+void PackA(MatrixTransposeType trans_a, const Real *a, MatrixIndexT lda,
+           MatrixIndexT mc, MatrixIndexT kc, int32 mr, Real *a_packed) {
+  for (MatrixIndexT i0 = 0; i0 < mc; i0 += mr, a_packed += mr * kc) {
+    int32 rows = std::min<MatrixIndexT>(mr, mc - i0);
+    if (trans_a == kNoTrans) {
+      for (int32 i = 0; i < rows; i++) {
+        const Real *src = a + (i0 + i) * lda;
+        for (MatrixIndexT p = 0; p < kc; p++)
+          a_packed[p * mr + i] = src[p];
+      }
+    } else {
+      for (MatrixIndexT p = 0; p < kc; p++) {
+        const Real *src = a + p * lda + i0;
+        for (int32 i = 0; i < rows; i++)
+          a_packed[p * mr + i] = src[i];
+      }
+    }
+    for (MatrixIndexT p = 0; p < kc; p++)
+      for (int32 i = rows; i < mr; i++)
+        a_packed[p * mr + i] = 0.0;
+  }
+}
+
+// Copies the kc by nc block "b" of op(B) to "b_packed" as slivers of nr
+// columns, each stored as kc rows of nr elements and padded with zeros if nc
+// is not a multiple of nr.
+template<typename Real>
+void PackB(MatrixTransposeType trans_b, const Real *b, MatrixIndexT ldb,
+           MatrixIndexT kc, MatrixIndexT nc, int32 nr, Real *b_packed) {
+  for (MatrixIndexT j0 = 0; j0 < nc; j0 += nr, b_packed += nr * kc) {
+    int32 cols = std::min<MatrixIndexT>(nr, nc - j0);
+    if (trans_b == kNoTrans) {
+      for (MatrixIndexT p = 0; p < kc; p++) {
+        const Real *src = b + p * ldb + j0;
+        for (int32 j = 0; j < cols; j++)
+          b_packed[p * nr + j] = src[j];
+      }
+    } else {
+      for (int32 j = 0; j < cols; j++) {
+        const Real *src = b + (j0 + j) * ldb;
+        for (MatrixIndexT p = 0; p < kc; p++)
+          b_packed[p * nr + j] = src[p];
+      }
+    }
+    for (MatrixIndexT p = 0; p < kc; p++)
+      for (int32 j = cols; j < nr; j++)
+        b_packed[p * nr + j] = 0.0;
+  }
+}
+
+// Sets the rows by cols block c to alpha ab + beta c, where ab has row
+// stride ab_stride; c is not read if beta == 0.
+template<typename Real>
+inline void AddTile(int32 rows, int32 cols, const Real *ab,
+                    int32 ab_stride, Real alpha, Real beta, Real *c,
+                    MatrixIndexT ldc) {
+  for (int32 i = 0; i < rows; i++, ab += ab_stride, c += ldc) {
+    if (beta == 0.0) {
+      for (int32 j = 0; j < cols; j++)
+        c[j] = alpha * ab[j];
+    } else {
+      for (int32 j = 0; j < cols; j++)
+        c[j] = alpha * ab[j] + beta * c[j];
+    }
+  }
+}
+
+const int32 kScalarMr = 4, kScalarNr = 4;
+
+template<typename Real>
+void ScalarMacroKernel(MatrixIndexT mc, MatrixIndexT nc, MatrixIndexT kc,
+                       const Real *a, const Real *b, Real alpha, Real beta,
+                       Real *c, MatrixIndexT ldc) {
+  for (MatrixIndexT j0 = 0; j0 < nc; j0 += kScalarNr) {
+    for (MatrixIndexT i0 = 0; i0 < mc; i0 += kScalarMr) {
+      const Real *ap = a + i0 * kc, *bp = b + j0 * kc;
+      Real ab[kScalarMr * kScalarNr] = { 0.0 };
+      for (MatrixIndexT p = 0; p < kc;
+           p++, ap += kScalarMr, bp += kScalarNr)
+        for (int32 i = 0; i < kScalarMr; i++)
+          for (int32 j = 0; j < kScalarNr; j++)
+            ab[i * kScalarNr + j] += ap[i] * bp[j];
+      AddTile(std::min<MatrixIndexT>(kScalarMr, mc - i0),
+              std::min<MatrixIndexT>(kScalarNr, nc - j0), ab, kScalarNr,
+              alpha, beta, c + i0 * ldc + j0, ldc);
+    }
+  }
+}
+
+template<typename Real>
+void ScalarDotRows(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                   const Real *m, MatrixIndexT stride, const Real *x,
+                   Real *y) {
+  for (MatrixIndexT i = 0; i < num_rows; i++, m += stride) {
+    Real sum = 0.0;
+    for (MatrixIndexT j = 0; j < num_cols; j++)
+      sum += m[j] * x[j];
+    y[i] = sum;
+  }
+}
+
+template<typename Real>
+void ScalarAddRows(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                   const Real *m, MatrixIndexT stride, const Real *x,
+                   Real *y) {
+  for (MatrixIndexT i = 0; i < num_rows; i++, m += stride) {
+    Real x_i = x[i];
+    for (MatrixIndexT j = 0; j < num_cols; j++)
+      y[j] += x_i * m[j];
+  }
+}
+
+// Int8Gemm() works on blocks of up to kInt8BlockRows rows of B.  Its kernels
+// set sums[i * n + j] to the dot product of row i of a with row j of b, for
+// i < m and j < n (with n <= kInt8BlockRows).
+const MatrixIndexT kInt8BlockRows = 64;
+
+typedef void (*Int8DotsFn)(MatrixIndexT m, MatrixIndexT n, MatrixIndexT k,
+                           const int8 *a, MatrixIndexT lda, const int8 *b,
+                           MatrixIndexT ldb, int32 *sums);
+
+void ScalarInt8Dots(MatrixIndexT m, MatrixIndexT n, MatrixIndexT k,
+                    const int8 *a, MatrixIndexT lda, const int8 *b,
+                    MatrixIndexT ldb, int32 *sums) {
+  for (MatrixIndexT i = 0; i < m; i++, a += lda) {
+    const int8 *b_j = b;
+    for (MatrixIndexT j = 0; j < n; j++, b_j += ldb) {
+      int32 sum = 0;
+      for (MatrixIndexT p = 0; p < k; p++)
+        sum += static_cast<int32>(a[p]) * b_j[p];
+      sums[i * n + j] = sum;
+    }
+  }
+}
+
+// Returns x(j) / scale rounded to the nearest integer (ties to even, as the
+// SIMD code does), given inv_scale = 1 / scale.
+template<typename Real>
+inline int8 QuantizeInt8(Real x, Real inv_scale) {
+  int32 q = static_cast<int32>(std::nearbyint(x * inv_scale));
+  return static_cast<int8>(std::max(-127, std::min(127, q)));
+}
+
+template<typename Real>
+void ScalarQuantizeRows(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                        const Real *x, MatrixIndexT stride, int8 *q,
+                        MatrixIndexT q_stride, float *scales) {
+  for (MatrixIndexT i = 0; i < num_rows; i++, x += stride, q += q_stride) {
+    Real max_abs = 0.0;
+    for (MatrixIndexT j = 0; j < num_cols; j++)
+      max_abs = std::max(max_abs, std::abs(x[j]));
+    if (max_abs == 0.0) {
+      scales[i] = 0.0;
+      std::fill(q, q + num_cols, 0);
+      continue;
+    }
+    Real inv_scale = Real(127.0) / max_abs;
+    scales[i] = max_abs / Real(127.0);
+    for (MatrixIndexT j = 0; j < num_cols; j++)
+      q[j] = QuantizeInt8(x[j], inv_scale);
+  }
+}
+
+#ifdef KALDI_GEMM_SIMD
+
+// The AVX2 kernels.  Each entry point calls ClearAvxUpperState() before
+// returning.
+
+#define KALDI_GEMM_AVX2 __attribute__((target("avx2,fma")))
+#define KALDI_GEMM_AVX2_INLINE \
+  inline __attribute__((target("avx2,fma"), always_inline))
+
+template<typename Real> struct Avx2Ops;
+
+template<> struct Avx2Ops<float> {
+  typedef __m256 Vec;
+  static const int32 kLanes = 8;
+  KALDI_GEMM_AVX2_INLINE static Vec Zero() { return _mm256_setzero_ps(); }
+  KALDI_GEMM_AVX2_INLINE static Vec Set1(float f) {
+    return _mm256_set1_ps(f);
+  }
+  KALDI_GEMM_AVX2_INLINE static Vec Load(const float *p) {
+    return _mm256_loadu_ps(p);
+  }
+  KALDI_GEMM_AVX2_INLINE static void Store(float *p, Vec v) {
+    _mm256_storeu_ps(p, v);
+  }
+  KALDI_GEMM_AVX2_INLINE static Vec Mul(Vec a, Vec b) {
+    return _mm256_mul_ps(a, b);
+  }
+  // Returns a * b + c.
+  KALDI_GEMM_AVX2_INLINE static Vec Fma(Vec a, Vec b, Vec c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  KALDI_GEMM_AVX2_INLINE static float Sum(Vec v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    s = _mm_hadd_ps(s, s);
+    return _mm_cvtss_f32(_mm_hadd_ps(s, s));
+  }
+};
+
+template<> struct Avx2Ops<double> {
+  typedef __m256d Vec;
+  static const int32 kLanes = 4;
+  KALDI_GEMM_AVX2_INLINE static Vec Zero() { return _mm256_setzero_pd(); }
+  KALDI_GEMM_AVX2_INLINE static Vec Set1(double f) {
+    return _mm256_set1_pd(f);
+  }
+  KALDI_GEMM_AVX2_INLINE static Vec Load(const double *p) {
+    return _mm256_loadu_pd(p);
+  }
+  KALDI_GEMM_AVX2_INLINE static void Store(double *p, Vec v) {
+    _mm256_storeu_pd(p, v);
+  }
+  KALDI_GEMM_AVX2_INLINE static Vec Mul(Vec a, Vec b) {
+    return _mm256_mul_pd(a, b);
+  }
+  KALDI_GEMM_AVX2_INLINE static Vec Fma(Vec a, Vec b, Vec c) {
+    return _mm256_fmadd_pd(a, b, c);
+  }
+  KALDI_GEMM_AVX2_INLINE static double Sum(Vec v) {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v),
+                           _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_hadd_pd(s, s));
+  }
+};
+
+// The tile is 6 rows by 2 vectors, so the 12 sums and the 2 vectors of b fit
+// in the 16 registers.
+const int32 kAvx2Mr = 6;
+
+template<typename Real>
+KALDI_GEMM_AVX2_INLINE void Avx2StoreRow(typename Avx2Ops<Real>::Vec ab0,
+                                         typename Avx2Ops<Real>::Vec ab1,
+                                         Real alpha, Real beta, Real *c) {
+  typedef Avx2Ops<Real> T;
+  typename T::Vec va = T::Set1(alpha);
+  if (beta == 0.0) {
+    T::Store(c, T::Mul(va, ab0));
+    T::Store(c + T::kLanes, T::Mul(va, ab1));
+  } else {
+    typename T::Vec vb = T::Set1(beta);
+    T::Store(c, T::Fma(va, ab0, T::Mul(vb, T::Load(c))));
+    T::Store(c + T::kLanes,
+             T::Fma(va, ab1, T::Mul(vb, T::Load(c + T::kLanes))));
+  }
+}
+
+// Sets the 6 by 2 * kLanes tile c to alpha a b + beta c.
+template<typename Real>
+KALDI_GEMM_AVX2 void Avx2Tile(MatrixIndexT kc, const Real *a, const Real *b,
+                              Real alpha, Real beta, Real *c,
+                              MatrixIndexT ldc) {
+  typedef Avx2Ops<Real> T;
+  typedef typename T::Vec Vec;
+  const int32 L = T::kLanes;
+  Vec c00 = T::Zero(), c01 = T::Zero(), c10 = T::Zero(), c11 = T::Zero(),
+      c20 = T::Zero(), c21 = T::Zero(), c30 = T::Zero(), c31 = T::Zero(),
+      c40 = T::Zero(), c41 = T::Zero(), c50 = T::Zero(), c51 = T::Zero();
+  for (MatrixIndexT p = 0; p < kc; p++, a += kAvx2Mr, b += 2 * L) {
+    Vec b0 = T::Load(b), b1 = T::Load(b + L), a_i;
+    a_i = T::Set1(a[0]);
+    c00 = T::Fma(a_i, b0, c00);
+    c01 = T::Fma(a_i, b1, c01);
+    a_i = T::Set1(a[1]);
+    c10 = T::Fma(a_i, b0, c10);
+    c11 = T::Fma(a_i, b1, c11);
+    a_i = T::Set1(a[2]);
+    c20 = T::Fma(a_i, b0, c20);
+    c21 = T::Fma(a_i, b1, c21);
+    a_i = T::Set1(a[3]);
+    c30 = T::Fma(a_i, b0, c30);
+    c31 = T::Fma(a_i, b1, c31);
+    a_i = T::Set1(a[4]);
+    c40 = T::Fma(a_i, b0, c40);
+    c41 = T::Fma(a_i, b1, c41);
+    a_i = T::Set1(a[5]);
+    c50 = T::Fma(a_i, b0, c50);
+    c51 = T::Fma(a_i, b1, c51);
+  }
+  Avx2StoreRow<Real>(c00, c01, alpha, beta, c);
+  Avx2StoreRow<Real>(c10, c11, alpha, beta, c + ldc);
+  Avx2StoreRow<Real>(c20, c21, alpha, beta, c + 2 * ldc);
+  Avx2StoreRow<Real>(c30, c31, alpha, beta, c + 3 * ldc);
+  Avx2StoreRow<Real>(c40, c41, alpha, beta, c + 4 * ldc);
+  Avx2StoreRow<Real>(c50, c51, alpha, beta, c + 5 * ldc);
+}
+
+template<typename Real>
+KALDI_GEMM_AVX2 void Avx2MacroKernel(MatrixIndexT mc, MatrixIndexT nc,
+                                     MatrixIndexT kc, const Real *a,
+                                     const Real *b, Real alpha, Real beta,
+                                     Real *c, MatrixIndexT ldc) {
+  const int32 mr = kAvx2Mr, nr = 2 * Avx2Ops<Real>::kLanes;
+  for (MatrixIndexT j0 = 0; j0 < nc; j0 += nr) {
+    for (MatrixIndexT i0 = 0; i0 < mc; i0 += mr) {
+      const Real *ap = a + i0 * kc, *bp = b + j0 * kc;
+      Real *cp = c + i0 * ldc + j0;
+      if (i0 + mr <= mc && j0 + nr <= nc) {
+        Avx2Tile(kc, ap, bp, alpha, beta, cp, ldc);
+      } else {
+        Real ab[kAvx2Mr * 2 * Avx2Ops<Real>::kLanes];
+        Avx2Tile(kc, ap, bp, Real(1.0), Real(0.0), ab, nr);
+        AddTile(std::min<MatrixIndexT>(mr, mc - i0),
+                std::min<MatrixIndexT>(nr, nc - j0), ab, nr, alpha, beta,
+                cp, ldc);
+      }
+    }
+  }
+  ClearAvxUpperState();
+}
+
+template<typename Real>
+KALDI_GEMM_AVX2 void Avx2DotRows(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                                 const Real *m, MatrixIndexT stride,
+                                 const Real *x, Real *y) {
+  typedef Avx2Ops<Real> T;
+  typedef typename T::Vec Vec;
+  const int32 L = T::kLanes;
+  MatrixIndexT vec_cols = num_cols - num_cols % L, i = 0;
+  for (; i + 4 <= num_rows; i += 4) {
+    const Real *m0 = m + i * stride, *m1 = m0 + stride, *m2 = m1 + stride,
+        *m3 = m2 + stride;
+    Vec s0 = T::Zero(), s1 = T::Zero(), s2 = T::Zero(), s3 = T::Zero();
+    for (MatrixIndexT j = 0; j < vec_cols; j += L) {
+      Vec x_j = T::Load(x + j);
+      s0 = T::Fma(T::Load(m0 + j), x_j, s0);
+      s1 = T::Fma(T::Load(m1 + j), x_j, s1);
+      s2 = T::Fma(T::Load(m2 + j), x_j, s2);
+      s3 = T::Fma(T::Load(m3 + j), x_j, s3);
+    }
+    Real r0 = T::Sum(s0), r1 = T::Sum(s1), r2 = T::Sum(s2), r3 = T::Sum(s3);
+    for (MatrixIndexT j = vec_cols; j < num_cols; j++) {
+      r0 += m0[j] * x[j];
+      r1 += m1[j] * x[j];
+      r2 += m2[j] * x[j];
+      r3 += m3[j] * x[j];
+    }
+    y[i] = r0;
+    y[i + 1] = r1;
+    y[i + 2] = r2;
+    y[i + 3] = r3;
+  }
+  for (; i < num_rows; i++) {
+    const Real *m0 = m + i * stride;
+    Vec s0 = T::Zero();
+    for (MatrixIndexT j = 0; j < vec_cols; j += L)
+      s0 = T::Fma(T::Load(m0 + j), T::Load(x + j), s0);
+    Real r0 = T::Sum(s0);
+    for (MatrixIndexT j = vec_cols; j < num_cols; j++)
+      r0 += m0[j] * x[j];
+    y[i] = r0;
+  }
+  ClearAvxUpperState();
+}
+
+template<typename Real>
+KALDI_GEMM_AVX2 void Avx2AddRows(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                                 const Real *m, MatrixIndexT stride,
+                                 const Real *x, Real *y) {
+  typedef Avx2Ops<Real> T;
+  typedef typename T::Vec Vec;
+  const int32 L = T::kLanes;
+  MatrixIndexT vec_cols = num_cols - num_cols % L, i = 0;
+  for (; i + 4 <= num_rows; i += 4) {
+    const Real *m0 = m + i * stride, *m1 = m0 + stride, *m2 = m1 + stride,
+        *m3 = m2 + stride;
+    Vec x0 = T::Set1(x[i]), x1 = T::Set1(x[i + 1]), x2 = T::Set1(x[i + 2]),
+        x3 = T::Set1(x[i + 3]);
+    for (MatrixIndexT j = 0; j < vec_cols; j += L) {
+      Vec y_j = T::Load(y + j);
+      y_j = T::Fma(x0, T::Load(m0 + j), y_j);
+      y_j = T::Fma(x1, T::Load(m1 + j), y_j);
+      y_j = T::Fma(x2, T::Load(m2 + j), y_j);
+      y_j = T::Fma(x3, T::Load(m3 + j), y_j);
+      T::Store(y + j, y_j);
+    }
+    for (MatrixIndexT j = vec_cols; j < num_cols; j++)
+      y[j] += x[i] * m0[j] + x[i + 1] * m1[j] + x[i + 2] * m2[j] +
+          x[i + 3] * m3[j];
+  }
+  for (; i < num_rows; i++) {
+    const Real *m0 = m + i * stride;
+    Vec x0 = T::Set1(x[i]);
+    for (MatrixIndexT j = 0; j < vec_cols; j += L)
+      T::Store(y + j, T::Fma(x0, T::Load(m0 + j), T::Load(y + j)));
+    for (MatrixIndexT j = vec_cols; j < num_cols; j++)
+      y[j] += x[i] * m0[j];
+  }
+  ClearAvxUpperState();
+}
+
+// Sets row i of q to row i of x quantized (see QuantizeRowsInt8()).
+KALDI_GEMM_AVX2 void Avx2QuantizeRows(MatrixIndexT num_rows,
+                                      MatrixIndexT num_cols, const float *x,
+                                      MatrixIndexT stride, int8 *q,
+                                      MatrixIndexT q_stride, float *scales) {
+  const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+  // Undoes the interleaving of _mm256_packs_epi32() and _mm256_packs_epi16().
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  MatrixIndexT vec8_cols = num_cols - num_cols % 8,
+      vec32_cols = num_cols - num_cols % 32;
+  for (MatrixIndexT i = 0; i < num_rows; i++, x += stride, q += q_stride) {
+    __m256 max8 = _mm256_setzero_ps();
+    for (MatrixIndexT j = 0; j < vec8_cols; j += 8)
+      max8 = _mm256_max_ps(max8, _mm256_andnot_ps(sign_bit,
+                                                  _mm256_loadu_ps(x + j)));
+    __m128 max4 = _mm_max_ps(_mm256_castps256_ps128(max8),
+                             _mm256_extractf128_ps(max8, 1));
+    max4 = _mm_max_ps(max4, _mm_movehl_ps(max4, max4));
+    max4 = _mm_max_ss(max4, _mm_shuffle_ps(max4, max4, 1));
+    float max_abs = _mm_cvtss_f32(max4);
+    for (MatrixIndexT j = vec8_cols; j < num_cols; j++)
+      max_abs = std::max(max_abs, std::abs(x[j]));
+    if (max_abs == 0.0) {
+      scales[i] = 0.0;
+      std::fill(q, q + num_cols, 0);
+      continue;
+    }
+    float inv_scale = 127.0f / max_abs;
+    scales[i] = max_abs / 127.0f;
+    __m256 inv8 = _mm256_set1_ps(inv_scale);
+    for (MatrixIndexT j = 0; j < vec32_cols; j += 32) {
+      __m256i q0 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j),
+                                                    inv8)),
+          q1 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j + 8),
+                                                inv8)),
+          q2 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j + 16),
+                                                inv8)),
+          q3 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j + 24),
+                                                inv8));
+      __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(q0, q1),
+                                          _mm256_packs_epi32(q2, q3));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(q + j),
+                          _mm256_permutevar8x32_epi32(packed, order));
+    }
+    for (MatrixIndexT j = vec32_cols; j < num_cols; j++)
+      q[j] = QuantizeInt8(x[j], inv_scale);
+  }
+  ClearAvxUpperState();
+}
+
+// Returns the sums of s0 ... s3.
+KALDI_GEMM_AVX2_INLINE __m128i Avx2Sum4(__m256i s0, __m256i s1, __m256i s2,
+                                        __m256i s3) {
+  __m256i h = _mm256_hadd_epi32(_mm256_hadd_epi32(s0, s1),
+                                _mm256_hadd_epi32(s2, s3));
+  return _mm_add_epi32(_mm256_castsi256_si128(h),
+                       _mm256_extracti128_si256(h, 1));
+}
+
+// Loads 16 int8 values as 16-bit integers.
+KALDI_GEMM_AVX2_INLINE __m256i Avx2LoadInt8(const int8 *p) {
+  return _mm256_cvtepi8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// Works on tiles of 2 rows of a by 4 rows of b, multiplying 16-bit integers
+// with _mm256_madd_epi16(); the last tiles repeat rows, and only the valid
+// sums are stored.
+KALDI_GEMM_AVX2 void Avx2Int8Dots(MatrixIndexT m, MatrixIndexT n,
+                                  MatrixIndexT k, const int8 *a,
+                                  MatrixIndexT lda, const int8 *b,
+                                  MatrixIndexT ldb, int32 *sums) {
+  MatrixIndexT vec_k = k - k % 16;
+  for (MatrixIndexT i0 = 0; i0 < m; i0 += 2) {
+    const int8 *a_rows[2] = { a + i0 * lda,
+                              a + std::min(i0 + 1, m - 1) * lda };
+    for (MatrixIndexT j0 = 0; j0 < n; j0 += 4) {
+      const int8 *b_rows[4];
+      for (int32 j = 0; j < 4; j++)
+        b_rows[j] = b + std::min(j0 + j, n - 1) * ldb;
+      __m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00,
+          c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+      for (MatrixIndexT p = 0; p < vec_k; p += 16) {
+        __m256i x0 = Avx2LoadInt8(a_rows[0] + p),
+            x1 = Avx2LoadInt8(a_rows[1] + p), y;
+        y = Avx2LoadInt8(b_rows[0] + p);
+        c00 = _mm256_add_epi32(c00, _mm256_madd_epi16(x0, y));
+        c10 = _mm256_add_epi32(c10, _mm256_madd_epi16(x1, y));
+        y = Avx2LoadInt8(b_rows[1] + p);
+        c01 = _mm256_add_epi32(c01, _mm256_madd_epi16(x0, y));
+        c11 = _mm256_add_epi32(c11, _mm256_madd_epi16(x1, y));
+        y = Avx2LoadInt8(b_rows[2] + p);
+        c02 = _mm256_add_epi32(c02, _mm256_madd_epi16(x0, y));
+        c12 = _mm256_add_epi32(c12, _mm256_madd_epi16(x1, y));
+        y = Avx2LoadInt8(b_rows[3] + p);
+        c03 = _mm256_add_epi32(c03, _mm256_madd_epi16(x0, y));
+        c13 = _mm256_add_epi32(c13, _mm256_madd_epi16(x1, y));
+      }
+      int32 tile[8];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(tile),
+                       Avx2Sum4(c00, c01, c02, c03));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(tile + 4),
+                       Avx2Sum4(c10, c11, c12, c13));
+      for (int32 i = 0; i < 2 && i0 + i < m; i++) {
+        for (int32 j = 0; j < 4 && j0 + j < n; j++) {
+          int32 sum = tile[i * 4 + j];
+          for (MatrixIndexT p = vec_k; p < k; p++)
+            sum += static_cast<int32>(a_rows[i][p]) * b_rows[j][p];
+          sums[(i0 + i) * n + j0 + j] = sum;
+        }
+      }
+    }
+  }
+  ClearAvxUpperState();
+}
+
+#ifdef KALDI_GEMM_VNNI
+
+#define KALDI_GEMM_AVX512_VNNI \
+  __attribute__((target("avx2,fma,avx512f,avx512vl,avx512vnni")))
+
+// Returns the sums of s0 ... s7.
+inline __attribute__((target("avx2"), always_inline))
+__m256i Avx2Sum8(__m256i s0, __m256i s1, __m256i s2, __m256i s3, __m256i s4,
+                 __m256i s5, __m256i s6, __m256i s7) {
+  __m256i h0 = _mm256_hadd_epi32(_mm256_hadd_epi32(s0, s1),
+                                 _mm256_hadd_epi32(s2, s3)),
+      h1 = _mm256_hadd_epi32(_mm256_hadd_epi32(s4, s5),
+                             _mm256_hadd_epi32(s6, s7));
+  return _mm256_add_epi32(_mm256_permute2x128_si256(h0, h1, 0x20),
+                          _mm256_permute2x128_si256(h0, h1, 0x31));
+}
+
+// The VNNI instruction vpdpbusd multiplies unsigned by signed bytes and adds
+// groups of 4 products to 32-bit sums.  We make b unsigned by adding 128 to
+// it (in a copy), and subtract 128 times the sum of a from the results.  The
+// tiles are 2 rows of a by 8 rows of b, which needs 16 of the 32 vector
+// registers for the sums.
+KALDI_GEMM_AVX512_VNNI void Avx512VnniInt8Dots(MatrixIndexT m, MatrixIndexT n,
+                                               MatrixIndexT k, const int8 *a,
+                                               MatrixIndexT lda,
+                                               const int8 *b,
+                                               MatrixIndexT ldb,
+                                               int32 *sums) {
+  static thread_local GemmBuffer b_buffer;
+  MatrixIndexT vec_k = k - k % 32, padded_n = (n + 7) / 8 * 8;
+  uint8 *b_unsigned = b_buffer.Get<uint8>(padded_n * vec_k);
+  const __m256i flip = _mm256_set1_epi8(-128), ones = _mm256_set1_epi8(1);
+  for (MatrixIndexT j = 0; j < n; j++)
+    for (MatrixIndexT p = 0; p < vec_k; p += 32)
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(b_unsigned + j * vec_k + p),
+          _mm256_xor_si256(_mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(b + j * ldb + p)), flip));
+  std::fill(b_unsigned + n * vec_k, b_unsigned + padded_n * vec_k, 0);
+
+  for (MatrixIndexT i0 = 0; i0 < m; i0 += 2) {
+    const int8 *a_rows[2] = { a + i0 * lda,
+                              a + std::min(i0 + 1, m - 1) * lda };
+    __m256i a_sum0 = _mm256_setzero_si256(), a_sum1 = a_sum0;
+    for (MatrixIndexT p = 0; p < vec_k; p += 32) {
+      a_sum0 = _mm256_dpbusd_epi32(a_sum0, ones, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(a_rows[0] + p)));
+      a_sum1 = _mm256_dpbusd_epi32(a_sum1, ones, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(a_rows[1] + p)));
+    }
+    __m256i a_sums = Avx2Sum8(a_sum0, a_sum0, a_sum0, a_sum0, a_sum1, a_sum1,
+                              a_sum1, a_sum1);
+    __m256i offset0 = _mm256_slli_epi32(
+        _mm256_permutevar8x32_epi32(a_sums, _mm256_setzero_si256()), 7),
+        offset1 = _mm256_slli_epi32(
+            _mm256_permutevar8x32_epi32(a_sums, _mm256_set1_epi32(4)), 7);
+    for (MatrixIndexT j0 = 0; j0 < n; j0 += 8) {
+      const uint8 *bp = b_unsigned + j0 * vec_k;
+      __m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00,
+          c04 = c00, c05 = c00, c06 = c00, c07 = c00, c10 = c00, c11 = c00,
+          c12 = c00, c13 = c00, c14 = c00, c15 = c00, c16 = c00, c17 = c00;
+      for (MatrixIndexT p = 0; p < vec_k; p += 32) {
+        __m256i x0 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(a_rows[0] + p)),
+            x1 = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(a_rows[1] + p)), y;
+        const __m256i *y_p = reinterpret_cast<const __m256i*>(bp + p);
+        MatrixIndexT y_step = vec_k / 32;
+        y = _mm256_loadu_si256(y_p);
+        c00 = _mm256_dpbusd_epi32(c00, y, x0);
+        c10 = _mm256_dpbusd_epi32(c10, y, x1);
+        y = _mm256_loadu_si256(y_p + y_step);
+        c01 = _mm256_dpbusd_epi32(c01, y, x0);
+        c11 = _mm256_dpbusd_epi32(c11, y, x1);
+        y = _mm256_loadu_si256(y_p + 2 * y_step);
+        c02 = _mm256_dpbusd_epi32(c02, y, x0);
+        c12 = _mm256_dpbusd_epi32(c12, y, x1);
+        y = _mm256_loadu_si256(y_p + 3 * y_step);
+        c03 = _mm256_dpbusd_epi32(c03, y, x0);
+        c13 = _mm256_dpbusd_epi32(c13, y, x1);
+        y = _mm256_loadu_si256(y_p + 4 * y_step);
+        c04 = _mm256_dpbusd_epi32(c04, y, x0);
+        c14 = _mm256_dpbusd_epi32(c14, y, x1);
+        y = _mm256_loadu_si256(y_p + 5 * y_step);
+        c05 = _mm256_dpbusd_epi32(c05, y, x0);
+        c15 = _mm256_dpbusd_epi32(c15, y, x1);
+        y = _mm256_loadu_si256(y_p + 6 * y_step);
+        c06 = _mm256_dpbusd_epi32(c06, y, x0);
+        c16 = _mm256_dpbusd_epi32(c16, y, x1);
+        y = _mm256_loadu_si256(y_p + 7 * y_step);
+        c07 = _mm256_dpbusd_epi32(c07, y, x0);
+        c17 = _mm256_dpbusd_epi32(c17, y, x1);
+      }
+      int32 tile[16];
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile), _mm256_sub_epi32(
+          Avx2Sum8(c00, c01, c02, c03, c04, c05, c06, c07), offset0));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile + 8),
+                          _mm256_sub_epi32(Avx2Sum8(c10, c11, c12, c13, c14,
+                                                    c15, c16, c17), offset1));
+      for (int32 i = 0; i < 2 && i0 + i < m; i++) {
+        for (int32 j = 0; j < 8 && j0 + j < n; j++) {
+          int32 sum = tile[i * 8 + j];
+          const int8 *b_j = b + (j0 + j) * ldb;
+          for (MatrixIndexT p = vec_k; p < k; p++)
+            sum += static_cast<int32>(a_rows[i][p]) * b_j[p];
+          sums[(i0 + i) * n + j0 + j] = sum;
+        }
+      }
+    }
+  }
+  ClearAvxUpperState();
+}
+
+#undef KALDI_GEMM_AVX512_VNNI
+
+#endif  // KALDI_GEMM_VNNI
+
+#undef KALDI_GEMM_AVX2
+#undef KALDI_GEMM_AVX2_INLINE
+
+bool Avx2Supported() {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+bool Avx512VnniSupported() {
+#ifdef KALDI_GEMM_VNNI
+  return Avx2Supported() && __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512vnni");
+#else
+  return false;
+#endif
+}
+
+#endif  // KALDI_GEMM_SIMD
+
+// The block sizes are chosen so that a kc by nr sliver of op(B) fits in the
+// L1 cache, an mc by kc block of op(A) in L2 and a kc by nc panel of op(B) in
+// L3 (on typical x86 machines).
+template<typename Real>
+const GemmKernels<Real> &GetGemmKernels() {
+  static const GemmKernels<Real> scalar_kernels = {
+    kScalarMr, kScalarNr, 128, 256, 2048, &ScalarMacroKernel<Real>,
+    &ScalarDotRows<Real>, &ScalarAddRows<Real> };
+#ifdef KALDI_GEMM_SIMD
+  static const GemmKernels<Real> avx2_kernels = {
+    kAvx2Mr, 2 * Avx2Ops<Real>::kLanes, (sizeof(Real) == 4 ? 144 : 72), 256,
+    3072, &Avx2MacroKernel<Real>, &Avx2DotRows<Real>, &Avx2AddRows<Real> };
+  if (GetGemmImpl() != kGemmScalar)  // kGemmAvx2 or kGemmAvx512Vnni.
+    return avx2_kernels;
+#endif
+  return scalar_kernels;
+}
+
+Int8DotsFn GetInt8Dots() {
+  switch (GetGemmImpl()) {
+#ifdef KALDI_GEMM_SIMD
+    case kGemmAvx2:
+      return &Avx2Int8Dots;
+#ifdef KALDI_GEMM_VNNI
+    case kGemmAvx512Vnni:
+      return &Avx512VnniInt8Dots;
+#endif
+#endif
+    default:
+      return &ScalarInt8Dots;
+  }
+}
+
+// Only the float version has SIMD code.
+void QuantizeRowsImpl(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                      const float *x, MatrixIndexT stride, int8 *q,
+                      MatrixIndexT q_stride, float *scales) {
+#ifdef KALDI_GEMM_SIMD
+  if (GetGemmImpl() != kGemmScalar) {
+    Avx2QuantizeRows(num_rows, num_cols, x, stride, q, q_stride, scales);
+    return;
+  }
+#endif
+  ScalarQuantizeRows(num_rows, num_cols, x, stride, q, q_stride, scales);
+}
+
+void QuantizeRowsImpl(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                      const double *x, MatrixIndexT stride, int8 *q,
+                      MatrixIndexT q_stride, float *scales) {
+  ScalarQuantizeRows(num_rows, num_cols, x, stride, q, q_stride, scales);
+}
+
+// Sets the m by n matrix c to beta c (or to zero if beta == 0).
+template<typename Real>
+void ScaleMatrix(MatrixIndexT m, MatrixIndexT n, Real beta, Real *c,
+                 MatrixIndexT ldc) {
+  for (MatrixIndexT i = 0; i < m; i++, c += ldc) {
+    if (beta == 0.0)
+      std::fill(c, c + n, Real(0.0));
+    else if (beta != 1.0)
+      for (MatrixIndexT j = 0; j < n; j++)
+        c[j] *= beta;
+  }
+}
+
+// The single-threaded BuiltinGemm(), for products of at least two rows and
+// columns.  This is the usual blocking: for each kc by nc panel of op(B), and
+// each mc by kc block of op(A), we pack them and call the macro-kernel.
+template<typename Real>
+void GemmSerial(const GemmKernels<Real> &kernels,
+                MatrixTransposeType trans_a, MatrixTransposeType trans_b,
+                MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, Real alpha,
+                const Real *a, MatrixIndexT lda, const Real *b,
+                MatrixIndexT ldb, Real beta, Real *c, MatrixIndexT ldc) {
+  static thread_local GemmBuffer a_buffer, b_buffer;
+  const int32 mr = kernels.mr, nr = kernels.nr;
+  MatrixIndexT mc = std::min(kernels.mc, m), kc = std::min(kernels.kc, k),
+      nc = std::min(kernels.nc, n);
+  Real *a_packed = a_buffer.Get<Real>((mc + mr - 1) / mr * mr * kc),
+      *b_packed = b_buffer.Get<Real>((nc + nr - 1) / nr * nr * kc);
+  for (MatrixIndexT jc = 0; jc < n; jc += nc) {
+    MatrixIndexT nc_cur = std::min(nc, n - jc);
+    for (MatrixIndexT pc = 0; pc < k; pc += kc) {
+      MatrixIndexT kc_cur = std::min(kc, k - pc);
+      // The first block of op(A) op(B) replaces beta c; the others add to it.
+      Real beta_cur = (pc == 0 ? beta : Real(1.0));
+      PackB(trans_b, (trans_b == kNoTrans ? b + pc * ldb + jc :
+                      b + jc * ldb + pc), ldb, kc_cur, nc_cur, nr, b_packed);
+      for (MatrixIndexT ic = 0; ic < m; ic += mc) {
+        MatrixIndexT mc_cur = std::min(mc, m - ic);
+        PackA(trans_a, (trans_a == kNoTrans ? a + ic * lda + pc :
+                        a + pc * lda + ic), lda, mc_cur, kc_cur, mr, a_packed);
+        kernels.macro_kernel(mc_cur, nc_cur, kc_cur, a_packed, b_packed,
+                             alpha, beta_cur, c + ic * ldc + jc, ldc);
+      }
+    }
+  }
+}
+
+// The single-threaded Int8Gemm(): for each block of rows of B we get the dot
+// products with all the rows of A, and add them to c, scaled.
+template<typename Real>
+void Int8GemmSerial(Int8DotsFn dots, MatrixIndexT m, MatrixIndexT n,
+                    MatrixIndexT k, const int8 *a, MatrixIndexT lda,
+                    const float *a_scales, const int8 *b, MatrixIndexT ldb,
+                    const float *b_scales, Real *c, MatrixIndexT ldc) {
+  static thread_local GemmBuffer sums_buffer;
+  int32 *sums = sums_buffer.Get<int32>(m * std::min(n, kInt8BlockRows));
+  for (MatrixIndexT j0 = 0; j0 < n; j0 += kInt8BlockRows) {
+    MatrixIndexT nb = std::min(kInt8BlockRows, n - j0);
+    dots(m, nb, k, a, lda, b + j0 * ldb, ldb, sums);
+    for (MatrixIndexT i = 0; i < m; i++) {
+      Real a_scale = a_scales[i], *c_row = c + i * ldc + j0;
+      const int32 *sums_row = sums + i * nb;
+      for (MatrixIndexT j = 0; j < nb; j++)
+        c_row[j] += a_scale * b_scales[j0 + j] * sums_row[j];
+    }
+  }
+}
+
+}  // namespace
+
+// Set by SetGemmImpl().
+static GemmImpl g_gemm_impl = kGemmAuto;
+
+bool GemmImplSupported(GemmImpl impl) {
+  switch (impl) {
+    case kGemmAuto: case kGemmScalar:
+      return true;
+#ifdef KALDI_GEMM_SIMD
+    case kGemmAvx2:
+      return Avx2Supported();
+    case kGemmAvx512Vnni:
+      return Avx512VnniSupported();
+#endif
+    default:
+      return false;
+  }
+}
+
+void SetGemmImpl(GemmImpl impl) {
+  if (!GemmImplSupported(impl))
+    KALDI_ERR << "Implementation " << impl << " of BuiltinGemm() is "
+              << "not supported on this machine.";
+  g_gemm_impl = impl;
+}
+
+GemmImpl GetGemmImpl() {
+  if (g_gemm_impl != kGemmAuto)
+    return g_gemm_impl;
+#ifdef KALDI_GEMM_SIMD
+  static const GemmImpl best = (Avx512VnniSupported() ? kGemmAvx512Vnni :
+                                (Avx2Supported() ? kGemmAvx2 : kGemmScalar));
+  return best;
+#else
+  return kGemmScalar;
+#endif
+}
+
+// Set by SetGemmNumThreads(); 0 means the default.
+static int32 g_gemm_num_threads = 0;
+
+void SetGemmNumThreads(int32 num_threads) {
+  KALDI_ASSERT(num_threads > 0);
+  g_gemm_num_threads = num_threads;
+}
+
+int32 GetGemmNumThreads() {
+  if (g_gemm_num_threads > 0)
+    return g_gemm_num_threads;
+#ifdef KALDI_BUILTIN_GEMM_THREADED
+  static const int32 num_cpus =
+      std::max<int32>(1, std::thread::hardware_concurrency());
+  return num_cpus;
+#else
+  return 1;
+#endif
+}
+
+template<typename Real>
+void BuiltinGemm(MatrixTransposeType trans_a, MatrixTransposeType trans_b,
+                 MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, Real alpha,
+                 const Real *a, MatrixIndexT lda, const Real *b,
+                 MatrixIndexT ldb, Real beta, Real *c, MatrixIndexT ldc) {
+  KALDI_ASSERT(m >= 0 && n >= 0 && k >= 0);
+  if (m == 0 || n == 0)
+    return;
+  if (k == 0 || alpha == 0.0) {
+    ScaleMatrix(m, n, beta, c, ldc);
+    return;
+  }
+  // Products with one row or column are matrix-vector products; the blocked
+  // code would waste most of its time packing.
+  if (m == 1) {
+    MatrixIndexT inc_a = (trans_a == kNoTrans ? 1 : lda);
+    if (trans_b == kNoTrans)
+      BuiltinGemv(kTrans, k, n, alpha, b, ldb, a, inc_a, beta, c, 1);
+    else
+      BuiltinGemv(kNoTrans, n, k, alpha, b, ldb, a, inc_a, beta, c, 1);
+    return;
+  }
+  if (n == 1) {
+    MatrixIndexT inc_b = (trans_b == kNoTrans ? ldb : 1);
+    if (trans_a == kNoTrans)
+      BuiltinGemv(kNoTrans, m, k, alpha, a, lda, b, inc_b, beta, c, ldc);
+    else
+      BuiltinGemv(kTrans, k, m, alpha, a, lda, b, inc_b, beta, c, ldc);
+    return;
+  }
+
+  const GemmKernels<Real> &kernels = GetGemmKernels<Real>();
+  // We split the larger of the dimensions of C between the threads, so each
+  // thread packs its own part of the larger of op(A) and op(B) and all of the
+  // smaller.
+  bool split_cols = (n >= m);
+  MatrixIndexT dim = (split_cols ? n : m),
+      unit = (split_cols ? kernels.nr : kernels.mr),
+      num_units = (dim + unit - 1) / unit;
+  int64 work = static_cast<int64>(m) * n * k;
+  int32 num_tasks = std::min<int64>(
+      std::min<int64>(GetGemmNumThreads(), num_units),
+      std::max<int64>(1, work / kGemmMinWorkPerTask));
+  MatrixIndexT chunk = (num_units + num_tasks - 1) / num_tasks * unit;
+  num_tasks = (dim + chunk - 1) / chunk;
+  if (num_tasks == 1) {
+    GemmSerial(kernels, trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb,
+               beta, c, ldc);
+    return;
+  }
+  GemmThreadPool()->Run(num_tasks, [&](int32 task) {
+      MatrixIndexT begin = task * chunk, size = std::min(chunk, dim - begin);
+      if (split_cols)
+        GemmSerial(kernels, trans_a, trans_b, m, size, k, alpha, a, lda,
+                   (trans_b == kNoTrans ? b + begin : b + begin * ldb), ldb,
+                   beta, c + begin, ldc);
+      else
+        GemmSerial(kernels, trans_a, trans_b, size, n, k, alpha,
+                   (trans_a == kNoTrans ? a + begin * lda : a + begin), lda,
+                   b, ldb, beta, c + begin * ldc, ldc);
+    });
+}
+
+template<typename Real>
+void BuiltinGemv(MatrixTransposeType trans, MatrixIndexT num_rows,
+                 MatrixIndexT num_cols, Real alpha, const Real *m,
+                 MatrixIndexT stride, const Real *x, MatrixIndexT incx,
+                 Real beta, Real *y, MatrixIndexT incy) {
+  KALDI_ASSERT(num_rows >= 0 && num_cols >= 0 && incx > 0 && incy > 0);
+  MatrixIndexT x_dim = (trans == kNoTrans ? num_cols : num_rows),
+      y_dim = (trans == kNoTrans ? num_rows : num_cols);
+  if (y_dim == 0)
+    return;
+  if (x_dim == 0 || alpha == 0.0) {
+    ScaleMatrix(y_dim, 1, beta, y, incy);
+    return;
+  }
+  static thread_local GemmBuffer x_buffer, y_buffer;
+  if (incx != 1) {
+    Real *x_copy = x_buffer.Get<Real>(x_dim);
+    for (MatrixIndexT i = 0; i < x_dim; i++)
+      x_copy[i] = x[i * incx];
+    x = x_copy;
+  }
+  // We compute op(M) x in "prod" and then add it to y.
+  Real *prod = y_buffer.Get<Real>(y_dim);
+  const GemmKernels<Real> &kernels = GetGemmKernels<Real>();
+  // Each thread does a range of elements of y (with kNoTrans, rows of M; with
+  // kTrans, columns of M).  We keep the ranges to multiples of 16 elements so
+  // the threads do not write to the same cache line.
+  const MatrixIndexT unit = 16,
+      num_units = (y_dim + unit - 1) / unit;
+  int64 num_elements = static_cast<int64>(num_rows) * num_cols;
+  int32 num_tasks = std::min<int64>(
+      std::min<int64>(GetGemmNumThreads(), num_units),
+      std::max<int64>(1, num_elements / kGemvMinElementsPerTask));
+  MatrixIndexT chunk = (num_units + num_tasks - 1) / num_tasks * unit;
+  num_tasks = (y_dim + chunk - 1) / chunk;
+  std::function<void(int32)> task = [&](int32 i) {
+    MatrixIndexT begin = i * chunk, size = std::min(chunk, y_dim - begin);
+    if (trans == kNoTrans) {
+      kernels.dot_rows(size, num_cols, m + begin * stride, stride, x,
+                       prod + begin);
+    } else {
+      std::fill(prod + begin, prod + begin + size, Real(0.0));
+      kernels.add_rows(num_rows, size, m + begin, stride, x, prod + begin);
+    }
+  };
+  if (num_tasks == 1)
+    task(0);
+  else
+    GemmThreadPool()->Run(num_tasks, task);
+  AddTile<Real>(y_dim, 1, prod, 1, alpha, beta, y, incy);
+}
+
+template<typename Real>
+void QuantizeRowsInt8(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                      const Real *x, MatrixIndexT stride, int8 *q,
+                      MatrixIndexT q_stride, float *scales) {
+  KALDI_ASSERT(num_rows >= 0 && num_cols >= 0);
+  QuantizeRowsImpl(num_rows, num_cols, x, stride, q, q_stride, scales);
+}
+
+template<typename Real>
+void Int8Gemm(MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, const int8 *a,
+              MatrixIndexT lda, const float *a_scales, const int8 *b,
+              MatrixIndexT ldb, const float *b_scales, Real *c,
+              MatrixIndexT ldc) {
+  KALDI_ASSERT(m >= 0 && n >= 0 && k >= 0 && k < 65536);
+  if (m == 0 || n == 0 || k == 0)
+    return;
+  Int8DotsFn dots = GetInt8Dots();
+  // As in BuiltinGemm(), but we only split the rows of B (i.e. the columns of
+  // C), in whole blocks.
+  MatrixIndexT unit = kInt8BlockRows, num_units = (n + unit - 1) / unit;
+  int64 work = static_cast<int64>(m) * n * k;
+  int32 num_tasks = std::min<int64>(
+      std::min<int64>(GetGemmNumThreads(), num_units),
+      std::max<int64>(1, work / kGemmMinWorkPerTask));
+  MatrixIndexT chunk = (num_units + num_tasks - 1) / num_tasks * unit;
+  num_tasks = (n + chunk - 1) / chunk;
+  if (num_tasks == 1) {
+    Int8GemmSerial(dots, m, n, k, a, lda, a_scales, b, ldb, b_scales, c, ldc);
+    return;
+  }
+  GemmThreadPool()->Run(num_tasks, [&](int32 task) {
+      MatrixIndexT begin = task * chunk, size = std::min(chunk, n - begin);
+      Int8GemmSerial(dots, m, size, k, a, lda, a_scales, b + begin * ldb, ldb,
+                     b_scales + begin, c + begin, ldc);
+    });
+}
+
+template
+void BuiltinGemm(MatrixTransposeType trans_a, MatrixTransposeType trans_b,
+                 MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, float alpha,
+                 const float *a, MatrixIndexT lda, const float *b,
+                 MatrixIndexT ldb, float beta, float *c, MatrixIndexT ldc);
+template
+void BuiltinGemm(MatrixTransposeType trans_a, MatrixTransposeType trans_b,
+                 MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, double alpha,
+                 const double *a, MatrixIndexT lda, const double *b,
+                 MatrixIndexT ldb, double beta, double *c, MatrixIndexT ldc);
+template
+void BuiltinGemv(MatrixTransposeType trans, MatrixIndexT num_rows,
+                 MatrixIndexT num_cols, float alpha, const float *m,
+                 MatrixIndexT stride, const float *x, MatrixIndexT incx,
+                 float beta, float *y, MatrixIndexT incy);
+template
+void BuiltinGemv(MatrixTransposeType trans, MatrixIndexT num_rows,
+                 MatrixIndexT num_cols, double alpha, const double *m,
+                 MatrixIndexT stride, const double *x, MatrixIndexT incx,
+                 double beta, double *y, MatrixIndexT incy);
+template
+void QuantizeRowsInt8(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                      const float *x, MatrixIndexT stride, int8 *q,
+                      MatrixIndexT q_stride, float *scales);
+template
+void QuantizeRowsInt8(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                      const double *x, MatrixIndexT stride, int8 *q,
+                      MatrixIndexT q_stride, float *scales);
+template
+void Int8Gemm(MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, const int8 *a,
+              MatrixIndexT lda, const float *a_scales, const int8 *b,
+              MatrixIndexT ldb, const float *b_scales, float *c,
+              MatrixIndexT ldc);
+template
+void Int8Gemm(MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, const int8 *a,
+              MatrixIndexT lda, const float *a_scales, const int8 *b,
+              MatrixIndexT ldb, const float *b_scales, double *c,
+              MatrixIndexT ldc);
+
+}  // namespace kaldi
@@ -0,0 +1,132 @@
+// matrix/kaldi-gemm.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_KALDI_GEMM_H_
+#define KALDI_MATRIX_KALDI_GEMM_H_
+
+#include "matrix/matrix-common.h"
+
+namespace kaldi {
+
+/// @addtogroup matrix_funcs_misc
+/// @{
+
+/*
+  Kaldi's own matrix-matrix and matrix-vector products, for builds whose BLAS
+  is slow or single-threaded (e.g. the reference ATLAS or CLAPACK from tools/).
+  If Kaldi is configured with --builtin-gemm (which defines
+  KALDI_BUILTIN_GEMM), cblas_Xgemm() and cblas_Xgemv() in cblas-wrappers.h call
+  these instead of the BLAS, so MatrixBase::AddMatMat(), VectorBase::AddMatVec()
+  and everything built on them use them; the rest of BLAS and LAPACK is still
+  used as before.  They can also be called directly in any build.
+
+  BuiltinGemm() is blocked for the caches in the usual way: panels of op(B)
+  and blocks of op(A) are copied ("packed") into buffers laid out for a
+  micro-kernel that keeps a small tile of C in registers.  Large products are
+  split between a pool of worker threads (see SetGemmNumThreads()).
+*/
+
+/// The micro-kernels of BuiltinGemm(), BuiltinGemv() and Int8Gemm().  By
+/// default (kGemmAuto) the fastest one this CPU supports is chosen at runtime.
+/// kGemmAvx2 also requires FMA instructions.  kGemmAvx512Vnni is kGemmAvx2
+/// plus the AVX-512 VNNI instructions (used on 256-bit vectors), which only
+/// Int8Gemm() makes use of.  kGemmScalar is plain C++ and is much slower than
+/// a good BLAS; it is there so the code works everywhere.
+enum GemmImpl {
+  kGemmAuto,
+  kGemmScalar,
+  kGemmAvx2,
+  kGemmAvx512Vnni
+};
+
+/// Returns true if "impl" can be used on this machine.
+bool GemmImplSupported(GemmImpl impl);
+
+/// Overrides the choice of implementation, e.g. to compare their speed; it is
+/// an error if "impl" is not supported.  This is not thread-safe with respect
+/// to products that are being computed.
+void SetGemmImpl(GemmImpl impl);
+
+/// Returns the implementation that is in use (never kGemmAuto).
+GemmImpl GetGemmImpl();
+
+/// Sets the maximum number of threads that one call to BuiltinGemm() or
+/// BuiltinGemv() may use (including the calling thread); small products use
+/// fewer.  The default is 1, or the number of CPUs if Kaldi was configured
+/// with --threaded-math.  The worker threads are shared by the whole program,
+/// and a call made while another thread is using them runs single-threaded.
+void SetGemmNumThreads(int32 num_threads);
+
+int32 GetGemmNumThreads();
+
+/// Computes C = alpha op(A) op(B) + beta C, where C is m by n with row stride
+/// ldc, op(A) is m by k and op(B) is k by n, and A and B are stored row-major
+/// with row strides lda and ldb.  This has the same meaning as cblas_Xgemm()
+/// in row-major order: in particular, if beta == 0 the old contents of C are
+/// ignored (so they may be NaN).  C may not overlap A or B.
+template<typename Real>
+void BuiltinGemm(MatrixTransposeType trans_a, MatrixTransposeType trans_b,
+                 MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, Real alpha,
+                 const Real *a, MatrixIndexT lda, const Real *b,
+                 MatrixIndexT ldb, Real beta, Real *c, MatrixIndexT ldc);
+
+/// Computes y = alpha op(M) x + beta y, where M is num_rows by num_cols with
+/// row stride "stride", and x and y have strides incx and incy (which must
+/// be positive).  Same meaning as cblas_Xgemv() in row-major order.
+template<typename Real>
+void BuiltinGemv(MatrixTransposeType trans, MatrixIndexT num_rows,
+                 MatrixIndexT num_cols, Real alpha, const Real *m,
+                 MatrixIndexT stride, const Real *x, MatrixIndexT incx,
+                 Real beta, Real *y, MatrixIndexT incy);
+
+/*
+  8-bit integer products, for quantized inference (see
+  nnet3/nnet-quantized-component.h).  Matrices are quantized row by row and
+  symmetrically: row i of a float matrix X is stored as int8 values q(i, j) in
+  [-127, 127] and one scale s(i), with X(i, j) ~= s(i) q(i, j).  The products
+  of the int8 values are summed exactly in int32 and only then converted back
+  to floating point, so Int8Gemm() is about as accurate as the quantization
+  itself.
+*/
+
+/// Quantizes the num_rows by num_cols matrix x (row stride "stride") to the
+/// int8 matrix q (row stride q_stride) and the scales "scales" (one per row),
+/// as described above: scales[i] is the largest absolute value in row i,
+/// divided by 127, and q(i, j) is x(i, j) / scales[i] rounded to the nearest
+/// integer.  Rows that are all zero get a scale of zero.
+template<typename Real>
+void QuantizeRowsInt8(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                      const Real *x, MatrixIndexT stride, int8 *q,
+                      MatrixIndexT q_stride, float *scales);
+
+/// Adds to the m by n matrix C (row stride ldc) the product A B^T of two
+/// quantized matrices: A is m by k, B is n by k, both int8 and row-major, and
+/// C(i, j) += a_scales[i] * b_scales[j] * sum_p A(i, p) B(j, p).  The elements
+/// of A and B must be in [-127, 127] (as from QuantizeRowsInt8()), and k must
+/// be less than 65536 so the sums cannot overflow.  Large products are split
+/// between threads as for BuiltinGemm().
+template<typename Real>
+void Int8Gemm(MatrixIndexT m, MatrixIndexT n, MatrixIndexT k, const int8 *a,
+              MatrixIndexT lda, const float *a_scales, const int8 *b,
+              MatrixIndexT ldb, const float *b_scales, Real *c,
+              MatrixIndexT ldc);
+
+/// @} end of "addtogroup matrix_funcs_misc"
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_KALDI_GEMM_H_
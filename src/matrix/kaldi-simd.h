@@ -0,0 +1,45 @@
+// matrix/kaldi-simd.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_KALDI_SIMD_H_
+#define KALDI_MATRIX_KALDI_SIMD_H_
+
+// Helpers for the SIMD code that is compiled with target attributes (e.g.
+// __attribute__((target("avx2")))) and chosen at runtime, in srfft.cc,
+// kaldi-gemm.cc, compressed-matrix.cc and feat/resample.cc.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+namespace kaldi {
+
+/// Clears the upper halves of the AVX registers (the vzeroupper instruction).
+/// Every function with an AVX2 or AVX-512 target attribute that is called
+/// from ordinary code must call this before returning.  GCC only inserts
+/// vzeroupper itself when optimizing at -O2 or above, and Kaldi is normally
+/// built with -O1; without it, SSE code that runs afterwards (e.g. in BLAS)
+/// pays the AVX-SSE transition penalty and can be several times slower.
+__attribute__((target("avx"), always_inline))
+inline void ClearAvxUpperState() {
+  _mm256_zeroupper();
+}
+
+}  // namespace kaldi
+
+#endif  // defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#endif  // KALDI_MATRIX_KALDI_SIMD_H_
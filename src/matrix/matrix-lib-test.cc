@@ -3671,6 +3671,44 @@ template<typename Real> static void UnitTestSplitRadixRealFft() {
   }
 }
 
+// Checks that the multi-row versions of SplitRadixComplexFft::Compute() and
+// SplitRadixRealFft::Compute() give the same output as doing the rows one by
+// one, for all the implementations this machine supports.
+template<typename Real> static void UnitTestSplitRadixFftRows() {
+  SplitRadixFftImpl impls[] = { kSplitRadixFftScalar, kSplitRadixFftAvx2,
+                                kSplitRadixFftAvx512 };
+  for (MatrixIndexT p = 0; p < 10; p++) {
+    MatrixIndexT logn = 2 + Rand() % 10, N = 1 << logn,
+        num_rows = 1 + Rand() % 40;
+    bool forward = (Rand() % 2 == 0);
+    SplitRadixComplexFft<Real> complex_fft(N / 2);
+    SplitRadixRealFft<Real> &real_fft = ThreadLocalSplitRadixRealFft<Real>(N);
+    KALDI_ASSERT(&real_fft == &ThreadLocalSplitRadixRealFft<Real>(N));
+    Matrix<Real> x(num_rows, N), complex_ref(x), real_ref(x);
+    x.SetRandn();
+    for (MatrixIndexT r = 0; r < num_rows; r++) {
+      complex_ref.Row(r).CopyFromVec(x.Row(r));
+      complex_fft.Compute(complex_ref.RowData(r), forward);
+      real_ref.Row(r).CopyFromVec(x.Row(r));
+      real_fft.Compute(real_ref.RowData(r), forward);
+    }
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+      if (!SplitRadixFftImplSupported(impls[i]))
+        continue;
+      SetSplitRadixFftImpl(impls[i]);
+      KALDI_ASSERT(GetSplitRadixFftImpl() == impls[i]);
+      Matrix<Real> complex(x), real(x);
+      complex_fft.Compute(&complex, forward);
+      real_fft.Compute(&real, forward);
+      // The arithmetic is the same, so they should agree exactly unless the
+      // compiler used fused multiply-adds for one of them.
+      AssertEqual(complex_ref, complex, 1.0e-05);
+      AssertEqual(real_ref, real, 1.0e-05);
+    }
+    SetSplitRadixFftImpl(kSplitRadixFftAuto);
+  }
+  KALDI_ASSERT(GetSplitRadixFftImpl() != kSplitRadixFftAuto);
+}
 
 
 template<typename Real> static void UnitTestRealFftSpeed() {
@@ -4464,6 +4502,322 @@ static void UnitTestExtractCompressedMatrix() {
 }
 
 
+// Tests the methods kDeltaCoded and kDeltaCodedFine, which are not covered by
+// UnitTestCompressedMatrix() because compressing twice is not idempotent.
+template<typename Real>
+static void UnitTestCompressedMatrixDeltaCoded() {
+  for (int32 n = 0; n < 50; n++) {
+    MatrixIndexT num_rows = 1 + Rand() % 150, num_cols = 1 + Rand() % 20;
+    CompressionMethod method = (n % 2 == 0 ? kDeltaCoded : kDeltaCodedFine);
+    // A random walk plus noise, so the rows are correlated, as in speech
+    // features, with some outliers and some constant columns.
+    Matrix<Real> mat(num_rows, num_cols);
+    mat.Row(0).SetRandn();
+    for (MatrixIndexT r = 1; r < num_rows; r++) {
+      mat.Row(r).SetRandn();
+      mat.Row(r).AddVec(0.9, mat.Row(r - 1));
+    }
+    for (MatrixIndexT i = 0; i < 3; i++)
+      mat(Rand() % num_rows, Rand() % num_cols) = 1000.0 * RandGauss();
+    if (Rand() % 2 == 0)
+      mat.ColRange(Rand() % num_cols, 1).Set(RandGauss());
+
+    CompressedMatrix cmat(mat, method);
+    KALDI_ASSERT(cmat.NumRows() == num_rows && cmat.NumCols() == num_cols);
+    Matrix<Real> mat2(cmat);
+    for (MatrixIndexT c = 0; c < num_cols; c++) {
+      // The error should be at most half the step, which is the standard
+      // deviation of the column divided by 32 or 1024.
+      Vector<Real> col(num_rows);
+      col.CopyColFromMat(mat, c);
+      Real mean = col.Sum() / num_rows,
+          stddev = std::sqrt(std::max<Real>(0.0, VecVec(col, col) / num_rows -
+                                                     mean * mean)),
+          max_error = (method == kDeltaCoded ? 1 / 64.0 : 1 / 2048.0) *
+          stddev * 1.01 + 1.0e-05 * (1.0 + col.Max() - col.Min());
+      for (MatrixIndexT r = 0; r < num_rows; r++)
+        KALDI_ASSERT(std::abs(mat(r, c) - mat2(r, c)) <= max_error);
+    }
+
+    // Binary I/O keeps the compressed form.
+    std::ostringstream os;
+    cmat.Write(os, true);
+    CompressedMatrix cmat2;
+    std::istringstream is(os.str());
+    cmat2.Read(is, true);
+    std::ostringstream os2;
+    cmat2.Write(os2, true);
+    KALDI_ASSERT(os.str() == os2.str());
+
+    // Getting rows, columns and submatrices (with and without padding) should
+    // give exactly the same values as decompressing the whole matrix.
+    MatrixIndexT row = Rand() % num_rows, col = Rand() % num_cols;
+    Vector<Real> row_vec(num_cols), col_vec(num_rows);
+    cmat.CopyRowToVec(row, &row_vec);
+    cmat.CopyColToVec(col, &col_vec);
+    for (MatrixIndexT c = 0; c < num_cols; c++)
+      KALDI_ASSERT(row_vec(c) == mat2(row, c));
+    for (MatrixIndexT r = 0; r < num_rows; r++)
+      KALDI_ASSERT(col_vec(r) == mat2(r, col));
+    MatrixIndexT row_offset = RandInt(-4, num_rows - 1),
+        col_offset = Rand() % num_cols,
+        sub_num_rows = RandInt(1, num_rows - row_offset + 4),
+        sub_num_cols = RandInt(1, num_cols - col_offset);
+    CompressedMatrix cmat_sub(cmat, row_offset, sub_num_rows, col_offset,
+                              sub_num_cols, true);
+    Matrix<Real> sub(cmat_sub);
+    for (MatrixIndexT r = 0; r < sub_num_rows; r++) {
+      MatrixIndexT old_r = std::max<MatrixIndexT>(
+          0, std::min<MatrixIndexT>(r + row_offset, num_rows - 1));
+      for (MatrixIndexT c = 0; c < sub_num_cols; c++)
+        KALDI_ASSERT(sub(r, c) == mat2(old_r, c + col_offset));
+    }
+    if (row_offset >= 0 && row_offset + sub_num_rows <= num_rows) {
+      Matrix<Real> sub2(sub_num_rows, sub_num_cols);
+      cmat.CopyToMat(row_offset, col_offset, &sub2);
+      AssertEqual(sub, sub2, 0.0);
+    }
+
+    cmat.Scale(-2.0);
+    Matrix<Real> mat3(cmat);
+    mat3.Scale(-0.5);
+    AssertEqual(mat2, mat3, 1.0e-05);
+  }
+}
+
+// Checks that all the implementations of decompression this machine supports
+// give the same output, and that compressing with several threads gives the
+// same output as with one.
+template<typename Real>
+static void UnitTestCompressedMatrixImpl() {
+  CompressedMatrixImpl impls[] = { kCompressedMatrixScalar,
+                                   kCompressedMatrixAvx2 };
+  for (int32 n = 0; n < 20; n++) {
+    MatrixIndexT num_rows = 1 + Rand() % 40, num_cols = 1 + Rand() % 40;
+    CompressionMethod method = static_cast<CompressionMethod>(1 + Rand() % 9);
+    Matrix<Real> mat(num_rows, num_cols);
+    mat.SetRandn();
+    if (method == kTwoByteSignedInteger || method == kOneByteUnsignedInteger)
+      mat.Scale(100.0);
+    CompressedMatrix cmat(mat, method);
+    MatrixIndexT row_offset = Rand() % num_rows, col_offset = Rand() % num_cols,
+        sub_num_rows = 1 + Rand() % (num_rows - row_offset),
+        sub_num_cols = 1 + Rand() % (num_cols - col_offset),
+        row = Rand() % num_rows;
+
+    SetCompressedMatrixImpl(kCompressedMatrixScalar);
+    Matrix<Real> ref(num_rows, num_cols), ref_sub(sub_num_rows, sub_num_cols);
+    Vector<Real> ref_row(num_cols);
+    cmat.CopyToMat(&ref);
+    cmat.CopyToMat(row_offset, col_offset, &ref_sub);
+    cmat.CopyRowToVec(row, &ref_row);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+      if (!CompressedMatrixImplSupported(impls[i]))
+        continue;
+      SetCompressedMatrixImpl(impls[i]);
+      KALDI_ASSERT(GetCompressedMatrixImpl() == impls[i]);
+      Matrix<Real> full(num_rows, num_cols), sub(sub_num_rows, sub_num_cols);
+      Vector<Real> this_row(num_cols);
+      cmat.CopyToMat(&full);
+      cmat.CopyToMat(row_offset, col_offset, &sub);
+      cmat.CopyRowToVec(row, &this_row);
+      // The arithmetic is the same, so they should agree exactly unless the
+      // compiler used fused multiply-adds for one of them.
+      AssertEqual(ref, full, 1.0e-05);
+      AssertEqual(ref_sub, sub, 1.0e-05);
+      AssertEqual(ref_row, this_row, 1.0e-05);
+      SubVector<Real> full_row(full, row);
+      AssertEqual(full_row, this_row, 1.0e-05);
+    }
+    SetCompressedMatrixImpl(kCompressedMatrixAuto);
+  }
+  KALDI_ASSERT(GetCompressedMatrixImpl() != kCompressedMatrixAuto);
+
+  for (int32 n = 0; n < 3; n++) {
+    // big enough to use more than one thread.
+    MatrixIndexT num_rows = 300 + Rand() % 100, num_cols = 500 + Rand() % 100;
+    CompressionMethod method = static_cast<CompressionMethod>(1 + Rand() % 9);
+    Matrix<Real> mat(num_rows, num_cols);
+    mat.SetRandn();
+    CompressedMatrix cmat(mat, method);
+    SetCompressedMatrixNumThreads(3);
+    CompressedMatrix cmat_threaded(mat, method);
+    SetCompressedMatrixNumThreads(1);
+    std::ostringstream os, os_threaded;
+    cmat.Write(os, true);
+    cmat_threaded.Write(os_threaded, true);
+    KALDI_ASSERT(os.str() == os_threaded.str());
+  }
+}
+
+// Compares BuiltinGemm() and BuiltinGemv(), with each implementation and with
+// several threads, with the obvious loops (in double precision).
+template<typename Real>
+static void UnitTestBuiltinGemm() {
+  GemmImpl impls[] = { kGemmScalar, kGemmAvx2, kGemmAvx512Vnni };
+  Real nan = std::numeric_limits<Real>::quiet_NaN();
+  for (int32 n = 0; n < 40; n++) {
+    // Now and then, big enough to cross the cache blocks and use threads.
+    int32 max_dim = (n % 8 == 0 ? 400 : 40);
+    MatrixIndexT m = 1 + Rand() % max_dim, num_cols = 1 + Rand() % max_dim,
+        k = 1 + Rand() % max_dim;
+    if (n % 4 == 1) m = 1;
+    if (n % 4 == 2) num_cols = 1;
+    MatrixTransposeType trans_a = (Rand() % 2 ? kTrans : kNoTrans),
+        trans_b = (Rand() % 2 ? kTrans : kNoTrans);
+    Real alpha = (Rand() % 5 == 0 ? 1.0 : RandGauss()),
+        beta = (Rand() % 3 == 0 ? 0.0 : RandGauss());
+    // Sub-matrices, so the strides are not the same as the widths.
+    Matrix<Real> a_big(m + k + 1, m + k + 3), b_big(num_cols + k + 1,
+                                                    num_cols + k + 3),
+        c_init(m, num_cols);
+    a_big.SetRandn();
+    b_big.SetRandn();
+    c_init.SetRandn();
+    SubMatrix<Real> a(a_big, 1, (trans_a == kNoTrans ? m : k), 2,
+                      (trans_a == kNoTrans ? k : m)),
+        b(b_big, 1, (trans_b == kNoTrans ? k : num_cols), 2,
+          (trans_b == kNoTrans ? num_cols : k));
+    Matrix<double> ref(m, num_cols);
+    for (MatrixIndexT i = 0; i < m; i++) {
+      for (MatrixIndexT j = 0; j < num_cols; j++) {
+        double sum = 0.0;
+        for (MatrixIndexT p = 0; p < k; p++)
+          sum += (trans_a == kNoTrans ? a(i, p) : a(p, i)) *
+              static_cast<double>(trans_b == kNoTrans ? b(p, j) : b(j, p));
+        ref(i, j) = alpha * sum + (beta == 0.0 ? 0.0 : beta * c_init(i, j));
+      }
+    }
+    Matrix<Real> ref_real(ref);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+      if (!GemmImplSupported(impls[i]))
+        continue;
+      SetGemmImpl(impls[i]);
+      KALDI_ASSERT(GetGemmImpl() == impls[i]);
+      for (int32 num_threads = 1; num_threads <= 3; num_threads += 2) {
+        SetGemmNumThreads(num_threads);
+        Matrix<Real> c(c_init);
+        if (beta == 0.0)
+          c.Set(nan);  // it should not be read.
+        BuiltinGemm(trans_a, trans_b, m, num_cols, k, alpha, a.Data(),
+                    a.Stride(), b.Data(), b.Stride(), beta, c.Data(),
+                    c.Stride());
+        AssertEqual(ref_real, c, 1.0e-04);
+      }
+    }
+    SetGemmImpl(kGemmAuto);
+    SetGemmNumThreads(1);
+  }
+  KALDI_ASSERT(GetGemmImpl() != kGemmAuto);
+
+  for (int32 n = 0; n < 40; n++) {
+    int32 max_dim = (n % 8 == 0 ? 1000 : 40);
+    MatrixIndexT num_rows = 1 + Rand() % max_dim,
+        num_cols = 1 + Rand() % max_dim, incx = 1 + Rand() % 2, incy = 1 + Rand() % 2;
+    MatrixTransposeType trans = (Rand() % 2 ? kTrans : kNoTrans);
+    MatrixIndexT x_dim = (trans == kNoTrans ? num_cols : num_rows),
+        y_dim = (trans == kNoTrans ? num_rows : num_cols);
+    Real alpha = RandGauss(), beta = (Rand() % 3 == 0 ? 0.0 : RandGauss());
+    Matrix<Real> mat(num_rows, num_cols);
+    mat.SetRandn();
+    Vector<Real> x(x_dim * incx), y_init(y_dim * incy);
+    x.SetRandn();
+    y_init.SetRandn();
+    Vector<Real> ref(y_init);
+    for (MatrixIndexT i = 0; i < y_dim; i++) {
+      double sum = 0.0;
+      for (MatrixIndexT j = 0; j < x_dim; j++)
+        sum += (trans == kNoTrans ? mat(i, j) : mat(j, i)) *
+            static_cast<double>(x(j * incx));
+      ref(i * incy) = alpha * sum +
+          (beta == 0.0 ? 0.0 : beta * y_init(i * incy));
+    }
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+      if (!GemmImplSupported(impls[i]))
+        continue;
+      SetGemmImpl(impls[i]);
+      for (int32 num_threads = 1; num_threads <= 3; num_threads += 2) {
+        SetGemmNumThreads(num_threads);
+        Vector<Real> y(y_init);
+        if (beta == 0.0) {
+          for (MatrixIndexT j = 0; j < y_dim; j++)
+            y(j * incy) = nan;
+        }
+        BuiltinGemv(trans, num_rows, num_cols, alpha, mat.Data(),
+                    mat.Stride(), x.Data(), incx, beta, y.Data(), incy);
+        AssertEqual(ref, y, 1.0e-04);
+      }
+    }
+    SetGemmImpl(kGemmAuto);
+    SetGemmNumThreads(1);
+  }
+}
+
+template<typename Real>
+static void UnitTestInt8Gemm() {
+  GemmImpl impls[] = { kGemmScalar, kGemmAvx2, kGemmAvx512Vnni };
+  for (int32 n = 0; n < 30; n++) {
+    // Now and then, big enough to use several blocks and threads.
+    int32 max_dim = (n % 8 == 0 ? 300 : 70);
+    MatrixIndexT m = 1 + Rand() % max_dim, num_cols = 1 + Rand() % max_dim,
+        k = 1 + Rand() % max_dim;
+    Matrix<Real> x(m, k + 3), w(num_cols, k), c_init(m, num_cols);
+    x.SetRandn();
+    w.SetRandn();
+    c_init.SetRandn();
+    if (n % 5 == 0)
+      x.Row(0).SetZero();
+    SubMatrix<Real> x_part(x, 0, m, 1, k);  // Stride not equal to width.
+
+    // The quantization, which should be the same for all implementations.
+    std::vector<int8> qx_ref(m * k), qw(num_cols * k);
+    std::vector<float> x_scales_ref(m), w_scales(num_cols);
+    SetGemmImpl(kGemmScalar);
+    QuantizeRowsInt8(m, k, x_part.Data(), x_part.Stride(), &(qx_ref[0]), k,
+                     &(x_scales_ref[0]));
+    QuantizeRowsInt8(num_cols, k, w.Data(), w.Stride(), &(qw[0]), k,
+                     &(w_scales[0]));
+    for (MatrixIndexT i = 0; i < m; i++) {
+      for (MatrixIndexT p = 0; p < k; p++) {
+        int32 q = qx_ref[i * k + p];
+        KALDI_ASSERT(q >= -127 && q <= 127 &&
+                     std::abs(x_scales_ref[i] * q - x_part(i, p)) <=
+                     0.5001 * x_scales_ref[i]);
+      }
+    }
+    // Reference: the products of the quantized matrices, in double.
+    Matrix<double> ref(c_init);
+    for (MatrixIndexT i = 0; i < m; i++) {
+      for (MatrixIndexT j = 0; j < num_cols; j++) {
+        int64 sum = 0;
+        for (MatrixIndexT p = 0; p < k; p++)
+          sum += qx_ref[i * k + p] * qw[j * k + p];
+        ref(i, j) += static_cast<double>(x_scales_ref[i]) * w_scales[j] * sum;
+      }
+    }
+    Matrix<Real> ref_real(ref);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+      if (!GemmImplSupported(impls[i]))
+        continue;
+      SetGemmImpl(impls[i]);
+      std::vector<int8> qx(m * k);
+      std::vector<float> x_scales(m);
+      QuantizeRowsInt8(m, k, x_part.Data(), x_part.Stride(), &(qx[0]), k,
+                       &(x_scales[0]));
+      KALDI_ASSERT(qx == qx_ref && x_scales == x_scales_ref);
+      for (int32 num_threads = 1; num_threads <= 3; num_threads += 2) {
+        SetGemmNumThreads(num_threads);
+        Matrix<Real> c(c_init);
+        Int8Gemm(m, num_cols, k, &(qx[0]), k, &(x_scales[0]), &(qw[0]), k,
+                 &(w_scales[0]), c.Data(), c.Stride());
+        AssertEqual(ref_real, c, 1.0e-05);
+      }
+    }
+    SetGemmImpl(kGemmAuto);
+    SetGemmNumThreads(1);
+  }
+}
+
 template<typename Real>
 static void UnitTestTridiag() {
   SpMatrix<Real> A(3);
@@ -4603,6 +4957,10 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestCompressedMatrix<Real>();
   UnitTestCompressedMatrix2<Real>();
   UnitTestExtractCompressedMatrix<Real>();
+  UnitTestCompressedMatrixImpl<Real>();
+  UnitTestCompressedMatrixDeltaCoded<Real>();
+  UnitTestBuiltinGemm<Real>();
+  UnitTestInt8Gemm<Real>();
   UnitTestResize<Real>();
   UnitTestResizeCopyDataDifferentStrideType<Real>();
   UnitTestNonsymmetricPower<Real>();
@@ -4624,6 +4982,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestRealFft<Real>();
   KALDI_LOG << " Point C";
   UnitTestSplitRadixRealFft<Real>();
+  UnitTestSplitRadixFftRows<Real>();
   UnitTestSvd<Real>();
   UnitTestSvdNodestroy<Real>();
   UnitTestSvdJustvec<Real>();
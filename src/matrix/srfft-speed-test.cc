@@ -0,0 +1,111 @@
+// matrix/srfft-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/matrix-lib.h"
+#include "matrix/srfft.h"
+#include "base/timer.h"
+
+// This compares the speed of the multi-row FFTs in SplitRadixComplexFft and
+// SplitRadixRealFft, for each implementation (see SplitRadixFftImpl) that this
+// machine supports, with the one-row Compute() called on each row.  The output
+// is in CSV format: test, type, implementation, dim, FFTs per second, speedup
+// relative to the one-row code.
+
+namespace kaldi {
+
+static const char *ImplName(SplitRadixFftImpl impl) {
+  switch (impl) {
+    case kSplitRadixFftScalar: return "scalar";
+    case kSplitRadixFftAvx2: return "avx2";
+    case kSplitRadixFftAvx512: return "avx512";
+    default: return "auto";
+  }
+}
+
+// Returns the number of FFTs per second.  If "impl" is kSplitRadixFftAuto we
+// time the one-row Compute() instead of the multi-row one.
+template<typename Real>
+static double TimeSplitRadixFft(MatrixIndexT N, bool real,
+                                SplitRadixFftImpl impl) {
+  const MatrixIndexT num_rows = 64;
+  SplitRadixComplexFft<Real> complex_fft(N / 2);
+  SplitRadixRealFft<Real> real_fft(N);
+  Matrix<Real> x(num_rows, N), y(num_rows, N);
+  x.SetRandn();
+  if (impl != kSplitRadixFftAuto)
+    SetSplitRadixFftImpl(impl);
+  // We transform a fresh copy of the same data each time, so the numbers stay
+  // in a normal range.
+  int32 num_ffts = 0;
+  Timer timer;
+  do {
+    for (int32 i = 0; i < 10; i++, num_ffts += num_rows) {
+      y.CopyFromMat(x);
+      if (impl == kSplitRadixFftAuto) {
+        for (MatrixIndexT r = 0; r < num_rows; r++) {
+          if (real)
+            real_fft.Compute(y.RowData(r), true);
+          else
+            complex_fft.Compute(y.RowData(r), true);
+        }
+      } else {
+        if (real)
+          real_fft.Compute(&y, true);
+        else
+          complex_fft.Compute(&y, true);
+      }
+    }
+  } while (timer.Elapsed() < 0.2);
+  SetSplitRadixFftImpl(kSplitRadixFftAuto);
+  return num_ffts / timer.Elapsed();
+}
+
+template<typename Real>
+static void SplitRadixFftSpeedTest() {
+  SplitRadixFftImpl impls[] = { kSplitRadixFftScalar, kSplitRadixFftAvx2,
+                                kSplitRadixFftAvx512 };
+  for (int32 real = 0; real <= 1; real++) {
+    const char *test = (real ? "SplitRadixRealFft" : "SplitRadixComplexFft"),
+        *type = (sizeof(Real) == 8 ? "double" : "float");
+    for (MatrixIndexT N = 256; N <= 4096; N *= 2) {
+      double one_row_speed = TimeSplitRadixFft<Real>(N, real != 0,
+                                                     kSplitRadixFftAuto);
+      std::cout << test << "," << type << ",one-row," << N << ","
+                << one_row_speed << ",1\n";
+      for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (!SplitRadixFftImplSupported(impls[i]))
+          continue;
+        double speed = TimeSplitRadixFft<Real>(N, real != 0, impls[i]);
+        std::cout << test << "," << type << "," << ImplName(impls[i]) << ","
+                  << N << "," << speed << "," << (speed / one_row_speed)
+                  << "\n";
+      }
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  std::cout << "test,type,impl,dim,ffts_per_second,speedup\n";
+  SplitRadixFftSpeedTest<float>();
+  SplitRadixFftSpeedTest<double>();
+  KALDI_LOG << "Default implementation is "
+            << ImplName(GetSplitRadixFftImpl());
+  std::cout << "Test OK.\n";
+}
@@ -25,11 +25,336 @@
 // License v2.0.
 
 
+#include <map>
+
 #include "matrix/srfft.h"
 #include "matrix/matrix-functions.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// We compile the SIMD code with target attributes and choose between them at
+// runtime, so no special compiler flags are needed.
+#define KALDI_SRFFT_SIMD 1
+#include <immintrin.h>
+#include "matrix/kaldi-simd.h"
+#endif
+
 namespace kaldi {
 
+#ifdef KALDI_SRFFT_SIMD
+namespace {
+
+// The multi-row FFTs.  The Lanes*() functions below do exactly the same
+// computation as the one-row code further down, but on GCC vector types V,
+// each holding one number from each of several rows (the "lanes"), so the
+// loops need no shuffling at all and the overhead of the recursion and of the
+// bit-reversal is shared between the rows.  They are force-inlined into the
+// entry points at the end, which have target attributes, so the vector code
+// is generated for the right instruction set.  (None of the instruction sets
+// we use has fused multiply-add, so the output is the same as the one-row
+// code).
+
+#define KALDI_SRFFT_INLINE inline __attribute__((always_inline))
+
+// What the multi-row code needs from SplitRadixComplexFft.
+template<typename Real>
+struct SplitRadixTables {
+  MatrixIndexT N;  // number of complex points.
+  MatrixIndexT logn;
+  const MatrixIndexT *brseed;
+  Real *const *tab;
+};
+
+// See SplitRadixComplexFft::ComputeRecursive(); this uses a stack instead of
+// recursion, which does the same computations in a different order.
+template<typename V, typename Real>
+KALDI_SRFFT_INLINE void LanesComputeRecursive(
+    const SplitRadixTables<Real> &t, V *xr, V *xi) {
+  const Real sqhalf = M_SQRT1_2;
+  MatrixIndexT stack_offset[64], stack_logn[64];
+  int32 stack_size = 1;
+  stack_offset[0] = 0;
+  stack_logn[0] = t.logn;
+  while (stack_size > 0) {
+    stack_size--;
+    MatrixIndexT logn = stack_logn[stack_size];
+    V *r = xr + stack_offset[stack_size], *i = xi + stack_offset[stack_size];
+    if (logn < 3) {
+      V tmp1, tmp2;
+      if (logn == 2) {  /* length m = 4 */
+        tmp1 = r[0] + r[2]; r[2] = r[0] - r[2]; r[0] = tmp1;
+        tmp1 = i[0] + i[2]; i[2] = i[0] - i[2]; i[0] = tmp1;
+        tmp1 = r[1] + r[3]; r[3] = r[1] - r[3]; r[1] = tmp1;
+        tmp1 = i[1] + i[3]; i[3] = i[1] - i[3]; i[1] = tmp1;
+        tmp1 = r[0] + r[1]; r[1] = r[0] - r[1]; r[0] = tmp1;
+        tmp1 = i[0] + i[1]; i[1] = i[0] - i[1]; i[0] = tmp1;
+        tmp1 = r[2] + i[3];
+        tmp2 = i[2] + r[3];
+        i[2] = i[2] - r[3];
+        r[3] = r[2] - i[3];
+        r[2] = tmp1;
+        i[3] = tmp2;
+      } else if (logn == 1) {  /* length m = 2 */
+        tmp1 = r[0] + r[1]; r[1] = r[0] - r[1]; r[0] = tmp1;
+        tmp1 = i[0] + i[1]; i[1] = i[0] - i[1]; i[0] = tmp1;
+      }
+      continue;
+    }
+    MatrixIndexT m = 1 << logn, m2 = m / 2, m4 = m2 / 2, m8 = m4 / 2;
+
+    /* Step 1 */
+    for (MatrixIndexT n = 0; n < m2; n++) {
+      V tmp1 = r[n] + r[n + m2];
+      r[n + m2] = r[n] - r[n + m2];
+      r[n] = tmp1;
+      V tmp2 = i[n] + i[n + m2];
+      i[n + m2] = i[n] - i[n + m2];
+      i[n] = tmp2;
+    }
+
+    /* Step 2 */
+    V *r1 = r + m2, *r2 = r1 + m4, *i1 = i + m2, *i2 = i1 + m4;
+    for (MatrixIndexT n = 0; n < m4; n++) {
+      V tmp1 = r1[n] + i2[n], tmp2 = i1[n] + r2[n];
+      i1[n] = i1[n] - r2[n];
+      r2[n] = r1[n] - i2[n];
+      r1[n] = tmp1;
+      i2[n] = tmp2;
+    }
+
+    /* Steps 3 & 4 */
+    const Real *cn = NULL, *spcn = NULL, *smcn = NULL, *c3n = NULL,
+        *spc3n = NULL, *smc3n = NULL;
+    if (logn >= 4) {
+      MatrixIndexT nel = m4 - 2;
+      cn = t.tab[logn - 4]; spcn = cn + nel; smcn = spcn + nel;
+      c3n = smcn + nel; spc3n = c3n + nel; smc3n = spc3n + nel;
+    }
+    for (MatrixIndexT n = 1; n < m4; n++) {
+      V tmp1, tmp2;
+      if (n == m8) {
+        tmp1 = sqhalf * (r1[n] + i1[n]);
+        i1[n] = sqhalf * (i1[n] - r1[n]);
+        r1[n] = tmp1;
+        tmp2 = sqhalf * (i2[n] - r2[n]);
+        i2[n] = -sqhalf * (r2[n] + i2[n]);
+        r2[n] = tmp2;
+      } else {
+        MatrixIndexT j = (n < m8 ? n - 1 : n - 2);  // the tables skip m8.
+        tmp2 = cn[j] * (r1[n] + i1[n]);
+        tmp1 = spcn[j] * r1[n] + tmp2;
+        r1[n] = smcn[j] * i1[n] + tmp2;
+        i1[n] = tmp1;
+        tmp2 = c3n[j] * (r2[n] + i2[n]);
+        tmp1 = spc3n[j] * r2[n] + tmp2;
+        r2[n] = smc3n[j] * i2[n] + tmp2;
+        i2[n] = tmp1;
+      }
+    }
+
+    // The "recursive calls"; the one with half DFT length goes on top.
+    MatrixIndexT offset = stack_offset[stack_size];
+    stack_offset[stack_size] = offset + 3 * m4;
+    stack_logn[stack_size++] = logn - 2;
+    stack_offset[stack_size] = offset + m2;
+    stack_logn[stack_size++] = logn - 2;
+    stack_offset[stack_size] = offset;
+    stack_logn[stack_size++] = logn - 1;
+  }
+}
+
+// See SplitRadixComplexFft::BitReversePermute().
+template<typename V, typename Real>
+KALDI_SRFFT_INLINE void LanesBitReversePermute(
+    const SplitRadixTables<Real> &t, V *x) {
+  MatrixIndexT lg2 = t.logn >> 1, n = 1 << lg2;
+  for (MatrixIndexT off = 1; off < n; off++) {
+    MatrixIndexT fj = n * t.brseed[off], i = off;
+    V tmp = x[i]; x[i] = x[fj]; x[fj] = tmp;
+    for (MatrixIndexT gno = 1; gno < t.brseed[off]; gno++) {
+      i += n;
+      MatrixIndexT j = fj + t.brseed[gno];
+      tmp = x[i]; x[i] = x[j]; x[j] = tmp;
+    }
+  }
+}
+
+// See SplitRadixComplexFft::Compute().
+template<typename V, typename Real>
+KALDI_SRFFT_INLINE void LanesComplexFft(const SplitRadixTables<Real> &t,
+                                        V *xr, V *xi, bool forward) {
+  if (!forward) {  // reverse real and imaginary parts for complex FFT.
+    V *tmp = xr;
+    xr = xi;
+    xi = tmp;
+  }
+  LanesComputeRecursive(t, xr, xi);
+  if (t.logn > 1) {
+    LanesBitReversePermute(t, xr);
+    LanesBitReversePermute(t, xi);
+  }
+}
+
+// See SplitRadixRealFft::Compute(); here "re" and "im" are the real and
+// imaginary parts of the data, which that code has interleaved.
+template<typename V, typename Real>
+KALDI_SRFFT_INLINE void LanesRealFft(const SplitRadixTables<Real> &t,
+                                     V *re, V *im, bool forward) {
+  MatrixIndexT N2 = t.N, N = N2 * 2;
+  if (forward)
+    LanesComplexFft(t, re, im, true);
+
+  Real rootN_re, rootN_im;
+  int forward_sign = forward ? -1 : 1;
+  ComplexImExp(static_cast<Real>(M_2PI/N *forward_sign), &rootN_re, &rootN_im);
+  Real kN_re = -forward_sign, kN_im = 0.0;
+  const Real half = 0.5;
+  for (MatrixIndexT k = 1; 2*k <= N2; k++) {
+    ComplexMul(rootN_re, rootN_im, &kN_re, &kN_im);
+    MatrixIndexT kdash = N2 - k;
+    V Ck_re = half * (re[k] + re[kdash]),
+        Ck_im = half * (im[k] - im[kdash]),
+        Dk_re = half * (im[k] + im[kdash]),
+        Dk_im = -half * (re[k] - re[kdash]);
+    re[k] = Ck_re + (kN_re * Dk_re - kN_im * Dk_im);
+    im[k] = Ck_im + (kN_re * Dk_im + kN_im * Dk_re);
+    if (kdash != k) {
+      re[kdash] = Ck_re + ((-kN_re) * Dk_re - kN_im * (-Dk_im));
+      im[kdash] = (-Ck_im) + ((-kN_re) * (-Dk_im) + kN_im * Dk_re);
+    }
+  }
+  V zeroth = re[0] + im[0], n2th = re[0] - im[0];
+  re[0] = zeroth;
+  im[0] = n2th;
+  if (!forward) {
+    const Real two = 2;
+    re[0] = re[0] / two;
+    im[0] = im[0] / two;
+    LanesComplexFft(t, re, im, false);
+    for (MatrixIndexT i = 0; i < N2; i++) {
+      re[i] = re[i] * two;
+      im[i] = im[i] * two;
+    }
+  }
+}
+
+// Does the FFTs of the rows of "x", kWidth at a time; "buffer" must have space
+// for 2 * t.N vectors.
+template<typename V, typename Real>
+KALDI_SRFFT_INLINE void LanesComputeRows(const SplitRadixTables<Real> &t,
+                                         bool real, bool forward,
+                                         MatrixBase<Real> *x, V *buffer) {
+  const MatrixIndexT kWidth = sizeof(V) / sizeof(Real);
+  MatrixIndexT N = t.N, num_rows = x->NumRows();
+  V *re = buffer, *im = buffer + N;
+  for (MatrixIndexT start = 0; start < num_rows; start += kWidth) {
+    MatrixIndexT width = std::min(kWidth, num_rows - start);
+    for (MatrixIndexT lane = 0; lane < kWidth; lane++) {
+      if (lane < width) {
+        const Real *row = x->RowData(start + lane);
+        for (MatrixIndexT k = 0; k < N; k++) {
+          re[k][lane] = row[2 * k];
+          im[k][lane] = row[2 * k + 1];
+        }
+      } else {
+        for (MatrixIndexT k = 0; k < N; k++)
+          re[k][lane] = im[k][lane] = 0.0;
+      }
+    }
+    if (real)
+      LanesRealFft(t, re, im, forward);
+    else
+      LanesComplexFft(t, re, im, forward);
+    for (MatrixIndexT lane = 0; lane < width; lane++) {
+      Real *row = x->RowData(start + lane);
+      for (MatrixIndexT k = 0; k < N; k++) {
+        row[2 * k] = re[k][lane];
+        row[2 * k + 1] = im[k][lane];
+      }
+    }
+  }
+}
+
+typedef float Avx2Float __attribute__((vector_size(32)));
+typedef double Avx2Double __attribute__((vector_size(32)));
+typedef float Avx512Float __attribute__((vector_size(64)));
+typedef double Avx512Double __attribute__((vector_size(64)));
+
+// Each entry point calls ClearAvxUpperState() before returning.
+__attribute__((target("avx2")))
+void Avx2ComputeRows(const SplitRadixTables<float> &t, bool real,
+                     bool forward, MatrixBase<float> *x, void *buffer) {
+  LanesComputeRows(t, real, forward, x, static_cast<Avx2Float*>(buffer));
+  ClearAvxUpperState();
+}
+
+__attribute__((target("avx2")))
+void Avx2ComputeRows(const SplitRadixTables<double> &t, bool real,
+                     bool forward, MatrixBase<double> *x, void *buffer) {
+  LanesComputeRows(t, real, forward, x, static_cast<Avx2Double*>(buffer));
+  ClearAvxUpperState();
+}
+
+__attribute__((target("avx512f")))
+void Avx512ComputeRows(const SplitRadixTables<float> &t, bool real,
+                       bool forward, MatrixBase<float> *x, void *buffer) {
+  LanesComputeRows(t, real, forward, x, static_cast<Avx512Float*>(buffer));
+  ClearAvxUpperState();
+}
+
+__attribute__((target("avx512f")))
+void Avx512ComputeRows(const SplitRadixTables<double> &t, bool real,
+                       bool forward, MatrixBase<double> *x, void *buffer) {
+  LanesComputeRows(t, real, forward, x, static_cast<Avx512Double*>(buffer));
+  ClearAvxUpperState();
+}
+
+#undef KALDI_SRFFT_INLINE
+
+SplitRadixFftImpl BestSplitRadixFftImpl() {
+  if (__builtin_cpu_supports("avx512f")) return kSplitRadixFftAvx512;
+  if (__builtin_cpu_supports("avx2")) return kSplitRadixFftAvx2;
+  return kSplitRadixFftScalar;
+}
+
+}  // namespace
+#endif  // KALDI_SRFFT_SIMD
+
+// Set by SetSplitRadixFftImpl().
+static SplitRadixFftImpl g_split_radix_fft_impl = kSplitRadixFftAuto;
+
+bool SplitRadixFftImplSupported(SplitRadixFftImpl impl) {
+  switch (impl) {
+    case kSplitRadixFftAuto: case kSplitRadixFftScalar:
+      return true;
+#ifdef KALDI_SRFFT_SIMD
+    case kSplitRadixFftAvx2:
+      return __builtin_cpu_supports("avx2");
+    case kSplitRadixFftAvx512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+void SetSplitRadixFftImpl(SplitRadixFftImpl impl) {
+  if (!SplitRadixFftImplSupported(impl))
+    KALDI_ERR << "Implementation " << impl << " of the split-radix FFT is "
+              << "not supported on this machine.";
+  g_split_radix_fft_impl = impl;
+}
+
+SplitRadixFftImpl GetSplitRadixFftImpl() {
+  if (g_split_radix_fft_impl != kSplitRadixFftAuto)
+    return g_split_radix_fft_impl;
+#ifdef KALDI_SRFFT_SIMD
+  static const SplitRadixFftImpl best = BestSplitRadixFftImpl();
+  return best;
+#else
+  return kSplitRadixFftScalar;
+#endif
+}
+
 
 template<typename Real>
 SplitRadixComplexFft<Real>::SplitRadixComplexFft(MatrixIndexT N) {
@@ -181,6 +506,36 @@ void SplitRadixComplexFft<Real>::Compute(Real *x, bool forward) {
   this->Compute(x, forward, &temp_buffer_);
 }
 
+template<typename Real>
+bool SplitRadixComplexFft<Real>::ComputeRowsSimd(MatrixBase<Real> *x,
+                                                 bool forward, bool real) {
+  KALDI_ASSERT(x->NumCols() == N_ * 2);
+  SplitRadixFftImpl impl = GetSplitRadixFftImpl();
+  if (impl == kSplitRadixFftScalar)
+    return false;
+#ifdef KALDI_SRFFT_SIMD
+  // Space for 2 * N_ vectors of up to 64 bytes, aligned to 64 bytes.
+  size_t buffer_size = 2 * static_cast<size_t>(N_) * 64 + 64;
+  if (lane_buffer_.size() < buffer_size)
+    lane_buffer_.resize(buffer_size);
+  char *buffer = &(lane_buffer_[0]);
+  buffer += (64 - reinterpret_cast<size_t>(buffer) % 64) % 64;
+  SplitRadixTables<Real> t = { N_, logn_, brseed_, tab_ };
+  if (impl == kSplitRadixFftAvx512)
+    Avx512ComputeRows(t, real, forward, x, buffer);
+  else
+    Avx2ComputeRows(t, real, forward, x, buffer);
+#endif
+  return true;
+}
+
+template<typename Real>
+void SplitRadixComplexFft<Real>::Compute(MatrixBase<Real> *x, bool forward) {
+  if (!ComputeRowsSimd(x, forward, false))
+    for (MatrixIndexT r = 0; r < x->NumRows(); r++)
+      Compute(x->RowData(r), forward, &temp_buffer_);
+}
+
 template<typename Real>
 void SplitRadixComplexFft<Real>::BitReversePermute(Real *x, MatrixIndexT logn) const {
   MatrixIndexT      i, j, lg2, n;
@@ -431,6 +786,45 @@ void SplitRadixRealFft<Real>::Compute(Real *data, bool forward,
   }
 }
 
+template<typename Real>
+void SplitRadixRealFft<Real>::Compute(MatrixBase<Real> *x, bool forward) {
+  if (!this->ComputeRowsSimd(x, forward, true))
+    for (MatrixIndexT r = 0; r < x->NumRows(); r++)
+      Compute(x->RowData(r), forward, &this->temp_buffer_);
+}
+
+namespace {
+// Owns the objects returned by ThreadLocalSplitRadixRealFft() for one thread.
+template<typename Real>
+class SplitRadixRealFftCache {
+ public:
+  SplitRadixRealFft<Real> &Get(MatrixIndexT N) {
+    SplitRadixRealFft<Real> *&fft = ffts_[N];
+    if (fft == NULL)
+      fft = new SplitRadixRealFft<Real>(N);
+    return *fft;
+  }
+  ~SplitRadixRealFftCache() {
+    for (typename std::map<MatrixIndexT, SplitRadixRealFft<Real>*>::iterator
+             iter = ffts_.begin(); iter != ffts_.end(); ++iter)
+      delete iter->second;
+  }
+ private:
+  std::map<MatrixIndexT, SplitRadixRealFft<Real>*> ffts_;
+};
+}  // namespace
+
+template<typename Real>
+SplitRadixRealFft<Real> &ThreadLocalSplitRadixRealFft(MatrixIndexT N) {
+  static thread_local SplitRadixRealFftCache<Real> cache;
+  return cache.Get(N);
+}
+
+template
+SplitRadixRealFft<float> &ThreadLocalSplitRadixRealFft(MatrixIndexT N);
+template
+SplitRadixRealFft<double> &ThreadLocalSplitRadixRealFft(MatrixIndexT N);
+
 template class SplitRadixComplexFft<float>;
 template class SplitRadixComplexFft<double>;
 template class SplitRadixRealFft<float>;
@@ -35,6 +35,29 @@ namespace kaldi {
 /// @addtogroup matrix_funcs_misc
 /// @{
 
+/// The implementations of the multi-row versions of Compute() in
+/// SplitRadixComplexFft and SplitRadixRealFft.  The SIMD ones do the FFTs of
+/// several rows at once, one row per lane of a vector register; the scalar one
+/// does one row at a time.  They all give the same output.  By default
+/// (kSplitRadixFftAuto) the fastest one this CPU supports is chosen at runtime.
+enum SplitRadixFftImpl {
+  kSplitRadixFftAuto,
+  kSplitRadixFftScalar,
+  kSplitRadixFftAvx2,
+  kSplitRadixFftAvx512
+};
+
+/// Returns true if "impl" can be used on this machine.
+bool SplitRadixFftImplSupported(SplitRadixFftImpl impl);
+
+/// Overrides the choice of implementation, e.g. to compare their speed; it is
+/// an error if "impl" is not supported.  This is not thread-safe with respect
+/// to FFTs that are being computed.
+void SetSplitRadixFftImpl(SplitRadixFftImpl impl);
+
+/// Returns the implementation that is in use (never kSplitRadixFftAuto).
+SplitRadixFftImpl GetSplitRadixFftImpl();
+
 
 // This class is based on code by Henrique (Rico) Malvar, from his book
 // "Signal Processing with Lapped Transforms" (1992).  Copied with
@@ -43,7 +66,8 @@ namespace kaldi {
 // This is a more efficient way of doing the complex FFT than ComplexFft
 // (declared in matrix-functios.h), but it only works for powers of 2.
 // Note: in multi-threaded code, you would need to have one of these objects per
-// thread, because multiple calls to Compute in parallel would not work.
+// thread, because multiple calls to Compute in parallel would not work (see
+// also ThreadLocalSplitRadixRealFft()).
 template<typename Real>
 class SplitRadixComplexFft {
  public:
@@ -77,12 +101,25 @@ class SplitRadixComplexFft {
   // needed.
   void Compute(Real *x, bool forward, std::vector<Real> *temp_buffer) const;
 
+  // This version of Compute does the FFT of each row of "x", which must have
+  // N*2 columns, each in the same format as the version above.  It is several
+  // times faster than doing the rows one by one, as it uses SIMD instructions
+  // to do several rows at once (see SplitRadixFftImpl).
+  void Compute(MatrixBase<Real> *x, bool forward);
+
   ~SplitRadixComplexFft();
 
  protected:
   // temp_buffer_ is allocated only if someone calls Compute with only one Real*
   // argument and we need a temporary buffer while creating interleaved data.
   std::vector<Real> temp_buffer_;
+
+  // Does the FFTs of the rows of "x" (which has N*2 columns) with SIMD
+  // instructions, followed by the extra step of the real FFT if "real" is
+  // true.  Returns false (and does nothing) if the implementation in use is
+  // kSplitRadixFftScalar.
+  bool ComputeRowsSimd(MatrixBase<Real> *x, bool forward, bool real);
+
  private:
   void ComputeTables();
   void ComputeRecursive(Real *xr, Real *xi, Integer logn) const;
@@ -97,6 +134,9 @@ class SplitRadixComplexFft {
   // IEEE Trans. ASSP, Aug. 1987, pp. 1120-1125).
   Real **tab_;       // Tables of butterfly coefficients.
 
+  // Workspace for ComputeRowsSimd(), allocated when first needed.
+  std::vector<char> lane_buffer_;
+
   // Disallow assignment.
   SplitRadixComplexFft &operator =(const SplitRadixComplexFft<Real> &other);
 };
@@ -125,6 +165,11 @@ class SplitRadixRealFft: private SplitRadixComplexFft<Real> {
   /// uses a user-supplied buffer.
   void Compute(Real *x, bool forward, std::vector<Real> *temp_buffer) const;
 
+  /// This version does the FFT of each row of "x", which must have N columns.
+  /// It is several times faster than doing the rows one by one, as it uses
+  /// SIMD instructions to do several rows at once (see SplitRadixFftImpl).
+  void Compute(MatrixBase<Real> *x, bool forward);
+
  private:
   // Disallow assignment.
   SplitRadixRealFft &operator =(const SplitRadixRealFft<Real> &other);
@@ -132,6 +177,14 @@ class SplitRadixRealFft: private SplitRadixComplexFft<Real> {
 };
 
 
+/// Returns a SplitRadixRealFft object of dimension N that belongs to the
+/// calling thread.  Each thread keeps these in a cache, so the tables of
+/// coefficients and the workspace are set up once per thread and dimension;
+/// this is useful where the dimension is not known in advance, so the object
+/// can't be a class member.  It must only be used by the calling thread.
+template<typename Real>
+SplitRadixRealFft<Real> &ThreadLocalSplitRadixRealFft(MatrixIndexT N);
+
 /// @} end of "addtogroup matrix_funcs_misc"
 
 } // end namespace kaldi
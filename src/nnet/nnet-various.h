@@ -103,6 +103,9 @@ class Splice: public Component {
     return str;
   }
 
+  /// Accessor to the frame offsets (e.g. to get the temporal context),
+  const CuArray<int32>& FrameOffsets() const { return frame_offsets_; }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in,
                     CuMatrixBase<BaseFloat> *out) {
     cu::Splice(in, frame_offsets_, out);
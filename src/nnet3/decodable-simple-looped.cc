@@ -61,7 +61,13 @@ void DecodableNnetSimpleLoopedInfo::Init(
   has_ivectors = (nnet->InputDim("ivector") > 0);
   int32 left_context, right_context;
   int32 extra_right_context = 0;
-  ComputeSimpleNnetContext(*nnet, &left_context, &right_context);
+  if (opts.computation_cache_dir.empty()) {
+    ComputeSimpleNnetContext(*nnet, &left_context, &right_context);
+  } else {
+    ComputationDiskCache disk_cache(opts.computation_cache_dir, *nnet,
+                                    opts.optimize_config);
+    disk_cache.GetSimpleNnetContext(&left_context, &right_context);
+  }
   frames_left_context = left_context + opts.extra_left_context_initial;
   frames_right_context = right_context + extra_right_context;
   frames_per_chunk = GetChunkSize(*nnet, opts.frame_subsampling_factor,
@@ -83,9 +89,30 @@ void DecodableNnetSimpleLoopedInfo::Init(
                                  num_sequences,
                                  &request1, &request2, &request3);
 
-  CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
-                &computation);
-  computation.ComputeCudaIndexes();
+  if (opts.computation_cache_dir.empty()) {
+    CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                  &computation);
+    computation.ComputeCudaIndexes();
+  } else {
+    // Note: this can't share the ComputationDiskCache object above, because
+    // ModifyNnetIvectorPeriod() may have changed the model.
+    ComputationDiskCache disk_cache(opts.computation_cache_dir, *nnet,
+                                    opts.optimize_config);
+    std::vector<const ComputationRequest*> requests;
+    requests.push_back(&request1);
+    requests.push_back(&request2);
+    requests.push_back(&request3);
+    NnetComputation *cached_computation = disk_cache.Read(requests);
+    if (cached_computation != NULL) {
+      computation = *cached_computation;
+      delete cached_computation;
+    } else {
+      CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                    &computation);
+      computation.ComputeCudaIndexes();
+      disk_cache.Write(requests, computation);
+    }
+  }
   if (GetVerboseLevel() >= 3) {
     KALDI_VLOG(3) << "Computation is:";
     computation.Print(std::cerr, *nnet);
@@ -49,6 +49,7 @@ struct NnetSimpleLoopedComputationOptions {
   int32 frames_per_chunk;
   BaseFloat acoustic_scale;
   bool debug_computation;
+  std::string computation_cache_dir;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   NnetSimpleLoopedComputationOptions():
@@ -83,6 +84,11 @@ struct NnetSimpleLoopedComputationOptions {
                    "if needed.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("computation-cache-dir", &computation_cache_dir,
+                   "If set, a directory in which the compiled computation is "
+                   "stored, so that later runs with the same model and "
+                   "options can read it instead of compiling it again.  It may "
+                   "be shared by processes running in parallel.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -94,6 +94,11 @@ struct NnetSimpleComputationOptions {
                    "input frames");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("computation-cache-dir", &compiler_config.cache_dir,
+                   "If set, a directory in which compiled computations are "
+                   "stored, so that later runs with the same model and "
+                   "options can read them instead of compiling them again.  "
+                   "It may be shared by processes running in parallel.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
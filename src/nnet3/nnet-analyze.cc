@@ -801,6 +801,16 @@ void ComputationChecker::CheckComputationIndexes() const {
 
   for (int32 command_index = 0; command_index < num_commands; command_index++) {
     const NnetComputation::Command &c = computation_.commands[command_index];
+    int32 num_fused = c.NumFusedCommands();
+    if (num_fused > 0) {
+      if (command_index + num_fused >= num_commands)
+        KALDI_ERR << "Fused commands go past the end of the computation";
+      for (int32 i = 1; i <= num_fused; i++) {
+        CommandType t = computation_.commands[command_index + i].command_type;
+        if (t != kPropagate && t != kMatrixCopy && t != kMatrixAdd)
+          KALDI_ERR << "Invalid command type in fused commands";
+      }
+    }
     switch (c.command_type) {
       case kAllocMatrix:
       case kDeallocMatrix:
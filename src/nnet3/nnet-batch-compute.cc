@@ -34,7 +34,7 @@ NnetBatchComputer::NnetBatchComputer(
     const VectorBase<BaseFloat> &priors):
     opts_(opts),
     nnet_(nnet),
-    compiler_(nnet_, opts.optimize_config),
+    compiler_(nnet_, opts.optimize_config, opts.compiler_config),
     log_priors_(priors),
     num_full_minibatches_(0) {
   log_priors_.ApplyLog();
@@ -977,14 +977,16 @@ NnetBatchDecoder::NnetBatchDecoder(
     const fst::SymbolTable *word_syms,
     bool allow_partial,
     int32 num_threads,
-    NnetBatchComputer *computer):
+    NnetBatchComputer *computer,
+    int32 decoder_batch_size):
   fst_(fst), decoder_opts_(decoder_opts),
   trans_model_(trans_model), word_syms_(word_syms),
   allow_partial_(allow_partial),  computer_(computer),
+  decoder_batch_size_(decoder_batch_size),
   is_finished_(false), tasks_finished_(false), priority_offset_(0.0),
   tot_like_(0.0), frame_count_(0), num_success_(0), num_fail_(0),
   num_partial_(0) {
-  KALDI_ASSERT(num_threads > 0);
+  KALDI_ASSERT(num_threads > 0 && decoder_batch_size > 0);
   for (int32 i = 0; i < num_threads; i++)
     decode_threads_.push_back(new std::thread(DecodeFunc, this));
   compute_thread_ = std::thread(ComputeFunc, this);
@@ -1119,6 +1121,62 @@ void NnetBatchDecoder::Compute() {
   }
 }
 
+void NnetBatchDecoder::StartUtterance(std::vector<NnetInferenceTask> *tasks,
+                                      UtteranceOutput **output) {
+  // we can be confident that the last element of 'pending_utts_' is the one
+  // for this utterance, as we know exactly at what point in the code the main
+  // thread will be in AcceptInput().
+  UtteranceOutput *output_utterance = pending_utts_.back();
+  {
+    UtteranceInput input_utterance(input_utterance_);
+    bool output_to_cpu = true;
+    computer_->SplitUtteranceIntoTasks(output_to_cpu,
+                                       *(input_utterance.input),
+                                       input_utterance.ivector,
+                                       input_utterance.online_ivectors,
+                                       input_utterance.online_ivector_period,
+                                       tasks);
+    KALDI_ASSERT(output_utterance->utterance_id ==
+                 input_utterance.utterance_id);
+    input_consumed_semaphore_.Signal();
+    // Now let input_utterance go out of scope; it's no longer valid as it may
+    // be overwritten by something else.
+  }
+
+  SetPriorities(tasks);
+  for (size_t i = 0; i < tasks->size(); i++)
+    computer_->AcceptTask(&((*tasks)[i]));
+  tasks_ready_semaphore_.Signal();
+  *output = output_utterance;
+}
+
+void NnetBatchDecoder::FinishUtterance(const LatticeFasterDecoder &decoder,
+                                       UtteranceOutput *output) {
+  const std::string &utterance_id = output->utterance_id;
+  bool use_final_probs = true;
+  if (!decoder.ReachedFinal()) {
+    if (allow_partial_) {
+      KALDI_WARN << "Outputting partial output for utterance "
+                 << utterance_id << " since no final-state reached\n";
+      use_final_probs = false;
+      std::unique_lock<std::mutex> lock(stats_mutex_);
+      num_partial_++;
+    } else {
+      KALDI_WARN << "Not producing output for utterance " << utterance_id
+                 << " since no final-state reached and "
+                 << "--allow-partial=false.\n";
+      std::unique_lock<std::mutex> lock(stats_mutex_);
+      num_fail_++;
+      // GetOutput() will skip this utterance, as its lattice is empty.
+      output->finished = true;
+      return;
+    }
+  }
+  // if we reached this point, we are getting a lattice.
+  decoder.GetRawLattice(&output->lat, use_final_probs);
+  ProcessOutputUtterance(output);
+}
+
 void NnetBatchDecoder::Decode() {
   while (true) {
     input_ready_semaphore_.Wait();
@@ -1126,76 +1184,128 @@ void NnetBatchDecoder::Decode() {
       return;
 
     std::vector<NnetInferenceTask> tasks;
-    std::string utterance_id;
-    // we can be confident that the last element of 'pending_utts_' is the one
-    // for this utterance, as we know exactly at what point in the code the main
-    // thread will be in AcceptInput().
-    UtteranceOutput *output_utterance = pending_utts_.back();
-    {
-      UtteranceInput input_utterance(input_utterance_);
-      utterance_id = input_utterance.utterance_id;
-      bool output_to_cpu = true;
-      computer_->SplitUtteranceIntoTasks(output_to_cpu,
-                                         *(input_utterance.input),
-                                         input_utterance.ivector,
-                                         input_utterance.online_ivectors,
-                                         input_utterance.online_ivector_period,
-                                         &tasks);
-      KALDI_ASSERT(output_utterance->utterance_id == utterance_id);
-      input_consumed_semaphore_.Signal();
-      // Now let input_utterance go out of scope; it's no longer valid as it may
-      // be overwritten by something else.
+    UtteranceOutput *output_utterance;
+    StartUtterance(&tasks, &output_utterance);
+
+    int32 frame_offset = 0;
+    LatticeFasterDecoder decoder(fst_, decoder_opts_);
+    decoder.InitDecoding();
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+      NnetInferenceTask &task = tasks[i];
+      task.semaphore.Wait();
+      UpdatePriorityOffset(task.priority);
+
+      SubMatrix<BaseFloat> post(task.output_cpu,
+                                task.num_initial_unused_output_frames,
+                                task.num_used_output_frames,
+                                0, task.output_cpu.NumCols());
+      DecodableMatrixMapped decodable(trans_model_, post, frame_offset);
+      frame_offset += post.NumRows();
+      decoder.AdvanceDecoding(&decodable);
+      task.output.Resize(0, 0);  // Free some memory.
     }
+    FinishUtterance(decoder, output_utterance);
+  }
+}
+
+void NnetBatchDecoder::DecodeBatched() {
+  int32 batch_size = decoder_batch_size_;
+  LatticeFasterBatchDecoder decoder(fst_, decoder_opts_, batch_size);
+
+  // The following are indexed by the stream (slot) of 'decoder'.  output[s] is
+  // NULL if stream s is not in use; otherwise tasks[s] are the tasks for its
+  // utterance, of which the first next_task[s] have been decoded, and
+  // frame_offset[s] is the number of frames decoded so far.
+  std::vector<UtteranceOutput*> output(batch_size, NULL);
+  std::vector<std::vector<NnetInferenceTask> > tasks(batch_size);
+  std::vector<size_t> next_task(batch_size, 0);
+  std::vector<int32> frame_offset(batch_size, 0);
+  std::vector<bool> ready(batch_size, false);
+  std::vector<DecodableInterface*> decodables(batch_size, NULL);
+  std::vector<SubMatrix<BaseFloat>*> posts(batch_size, NULL);
+  int32 num_active = 0;
+  bool input_finished = false;
 
-    SetPriorities(&tasks);
-    for (size_t i = 0; i < tasks.size(); i++)
-      computer_->AcceptTask(&(tasks[i]));
-    tasks_ready_semaphore_.Signal();
-
-    {
-      int32 frame_offset = 0;
-      LatticeFasterDecoder decoder(fst_, decoder_opts_);
-      decoder.InitDecoding();
-
-
-      for (size_t i = 0; i < tasks.size(); i++) {
-        NnetInferenceTask &task = tasks[i];
-        task.semaphore.Wait();
-        UpdatePriorityOffset(task.priority);
-
-        SubMatrix<BaseFloat> post(task.output_cpu,
-                                  task.num_initial_unused_output_frames,
-                                  task.num_used_output_frames,
-                                  0, task.output_cpu.NumCols());
-        DecodableMatrixMapped decodable(trans_model_, post, frame_offset);
-        frame_offset += post.NumRows();
-        decoder.AdvanceDecoding(&decodable);
-        task.output.Resize(0, 0);  // Free some memory.
+  while (true) {
+    // Start new utterances in any free streams.  We only block waiting for
+    // input if we have nothing else to do.
+    for (int32 s = 0; s < batch_size && !input_finished; s++) {
+      if (output[s] != NULL)
+        continue;
+      if (num_active == 0)
+        input_ready_semaphore_.Wait();
+      else if (!input_ready_semaphore_.TryWait())
+        break;
+      if (is_finished_) {
+        input_finished = true;
+        break;
       }
+      tasks[s].clear();
+      StartUtterance(&(tasks[s]), &(output[s]));
+      next_task[s] = 0;
+      frame_offset[s] = 0;
+      decoder.InitDecoding(s);
+      num_active++;
+    }
+    if (num_active == 0) {
+      KALDI_ASSERT(input_finished);
+      return;
+    }
 
-      bool use_final_probs = true;
-      if (!decoder.ReachedFinal()) {
-        if (allow_partial_) {
-          KALDI_WARN << "Outputting partial output for utterance "
-                     << utterance_id << " since no final-state reached\n";
-          use_final_probs = false;
-          std::unique_lock<std::mutex> lock(stats_mutex_);
-          num_partial_++;
-        } else {
-          KALDI_WARN << "Not producing output for utterance " << utterance_id
-                     << " since no final-state reached and "
-                     << "--allow-partial=false.\n";
-          std::unique_lock<std::mutex> lock(stats_mutex_);
-          num_fail_++;
-          continue;
+    // See which streams have their next chunk of posteriors ready; if none
+    // do, wait for the first one that has a chunk pending.
+    int32 num_ready = 0, first_pending = -1;
+    for (int32 s = 0; s < batch_size; s++) {
+      ready[s] = false;
+      if (output[s] != NULL && next_task[s] < tasks[s].size()) {
+        if (first_pending < 0)
+          first_pending = s;
+        if (tasks[s][next_task[s]].semaphore.TryWait()) {
+          ready[s] = true;
+          num_ready++;
         }
       }
-      // if we reached this point, we are getting a lattice.
-      decoder.GetRawLattice(&output_utterance->lat, use_final_probs);
-      // Let the decoder and the decodable object go out of scope, to save
-      // memory.
     }
-    ProcessOutputUtterance(output_utterance);
+    if (num_ready == 0 && first_pending >= 0) {
+      tasks[first_pending][next_task[first_pending]].semaphore.Wait();
+      ready[first_pending] = true;
+    }
+
+    for (int32 s = 0; s < batch_size; s++) {
+      if (!ready[s])
+        continue;
+      NnetInferenceTask &task = tasks[s][next_task[s]];
+      UpdatePriorityOffset(task.priority);
+      posts[s] = new SubMatrix<BaseFloat>(task.output_cpu,
+                                          task.num_initial_unused_output_frames,
+                                          task.num_used_output_frames,
+                                          0, task.output_cpu.NumCols());
+      decodables[s] = new DecodableMatrixMapped(trans_model_, *(posts[s]),
+                                                frame_offset[s]);
+      frame_offset[s] += posts[s]->NumRows();
+    }
+    decoder.AdvanceDecoding(decodables);
+    for (int32 s = 0; s < batch_size; s++) {
+      if (!ready[s])
+        continue;
+      delete decodables[s];
+      decodables[s] = NULL;
+      delete posts[s];
+      posts[s] = NULL;
+      tasks[s][next_task[s]].output.Resize(0, 0);  // Free some memory.
+      next_task[s]++;
+    }
+
+    // Finish the utterances that have been completely decoded.
+    for (int32 s = 0; s < batch_size; s++) {
+      if (output[s] != NULL && next_task[s] == tasks[s].size()) {
+        FinishUtterance(decoder.Decoder(s), output[s]);
+        output[s] = NULL;
+        tasks[s].clear();
+        num_active--;
+      }
+    }
   }
 }
 
@@ -1212,6 +1322,7 @@ void NnetBatchDecoder::ProcessOutputUtterance(UtteranceOutput *output) {
                << output->utterance_id;
     std::unique_lock<std::mutex> lock(stats_mutex_);
     num_fail_++;
+    output->finished = true;
     return;
   }
 
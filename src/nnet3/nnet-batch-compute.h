@@ -35,6 +35,7 @@
 #include "nnet3/am-nnet-simple.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "decoder/lattice-faster-decoder.h"
+#include "decoder/lattice-faster-batch-decoder.h"
 #include "util/stl-utils.h"
 
 
@@ -622,6 +623,12 @@ class NnetBatchDecoder {
                           and a thread for possibly-GPU-based inference.
         @param [in] computer The NnetBatchComputer object, through which the
                            neural net will be evaluated.
+        @param [in] decoder_batch_size  If >1, each decoder thread decodes up
+                          to this many utterances at a time in lockstep, using
+                          LatticeFasterBatchDecoder, which shares the FST
+                          accesses between the utterances.  If 1, each thread
+                          decodes one utterance at a time with
+                          LatticeFasterDecoder.
    */
   NnetBatchDecoder(const fst::Fst<fst::StdArc> &fst,
                    const LatticeFasterDecoderConfig &decoder_config,
@@ -629,7 +636,8 @@ class NnetBatchDecoder {
                    const fst::SymbolTable *word_syms,
                    bool allow_partial,
                    int32 num_threads,
-                   NnetBatchComputer *computer);
+                   NnetBatchComputer *computer,
+                   int32 decoder_batch_size = 1);
 
   /**
     The user should call this one by one for the utterances that
@@ -741,8 +749,28 @@ class NnetBatchDecoder {
   // background.  It will exit once the user calls Finished() and all
   // computation is completed.
   void Decode();
-  // static wrapper for Compute().
-  static void DecodeFunc(NnetBatchDecoder *object) { object->Decode(); }
+  // This is the version of Decode() that is used if decoder_batch_size_ > 1;
+  // it decodes up to decoder_batch_size_ utterances at a time.
+  void DecodeBatched();
+  // static wrapper for Decode() or DecodeBatched().
+  static void DecodeFunc(NnetBatchDecoder *object) {
+    if (object->decoder_batch_size_ > 1) object->DecodeBatched();
+    else object->Decode();
+  }
+
+  // Called from the decoder thread after input_ready_semaphore_ has been
+  // waited on (and is_finished_ is false): takes the utterance in
+  // input_utterance_, splits it into tasks which it gives to computer_, and
+  // returns the tasks and the utterance's output object.
+  void StartUtterance(std::vector<NnetInferenceTask> *tasks,
+                      UtteranceOutput **output);
+
+  // Called from the decoder thread when 'decoder' has decoded all the frames
+  // of the utterance for 'output'.  Gets the lattice (taking into account
+  // allow_partial_) and calls ProcessOutputUtterance(), or, on failure,
+  // updates the stats and marks 'output' as finished with an empty lattice.
+  void FinishUtterance(const LatticeFasterDecoder &decoder,
+                       UtteranceOutput *output);
 
   // This is the computation thread; it handles the neural net inference.
   void Compute();
@@ -769,6 +797,7 @@ class NnetBatchDecoder {
   const fst::SymbolTable *word_syms_;  // May be NULL.  Owned here.
   bool allow_partial_;
   NnetBatchComputer *computer_;
+  int32 decoder_batch_size_;
   std::vector<std::thread*> decode_threads_;
   std::thread compute_thread_;  // Thread that calls computer_->Compute().
 
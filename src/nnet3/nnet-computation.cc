@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <iterator>
 #include <sstream>
 #include "nnet3/nnet-computation.h"
@@ -97,6 +98,180 @@ void NnetComputation::ComputeCudaIndexes() {
     // the interface of CUDA being plain C.
     indexes_ranges_cuda[i].CopyFromVec(*input_cast);
   }
+  ComputeArenaOffsets();
+}
+
+int32 NnetComputation::ArenaStride(int32 m) const {
+  const MatrixInfo &info = matrices[m];
+  if (info.stride_type == kStrideEqualNumCols)
+    return info.num_cols;
+  // Round up to a multiple of 16 bytes, as in class Matrix.
+  int32 n = 16 / sizeof(BaseFloat);
+  return ((info.num_cols + n - 1) / n) * n;
+}
+
+// Used in ComputeArenaOffsets(); returns the root of i in the union-find
+// structure 'parent'.
+static int32 FindRoot(std::vector<int32> *parent, int32 i) {
+  while ((*parent)[i] != i) {
+    (*parent)[i] = (*parent)[(*parent)[i]];
+    i = (*parent)[i];
+  }
+  return i;
+}
+
+void NnetComputation::ComputeArenaOffsets() {
+  int32 num_matrices = matrices.size(),
+      num_commands = commands.size();
+  arena_offsets.clear();
+  arena_offsets.resize(num_matrices, -1);
+  arena_size = 0;
+
+  // Matrices that are swapped with each other (kSwapMatrix) exchange their
+  // memory, so they must have the same offset.  We group them into classes,
+  // represented by one of their members, and plan the classes.
+  std::vector<int32> parent(num_matrices);
+  for (int32 m = 0; m < num_matrices; m++)
+    parent[m] = m;
+  for (int32 c = 0; c < num_commands; c++) {
+    if (commands[c].command_type == kSwapMatrix) {
+      int32 m1 = submatrices[commands[c].arg1].matrix_index,
+          m2 = submatrices[commands[c].arg2].matrix_index;
+      parent[FindRoot(&parent, m1)] = FindRoot(&parent, m2);
+    }
+  }
+  std::vector<int32> matrix_class(num_matrices);
+  for (int32 m = 0; m < num_matrices; m++)
+    matrix_class[m] = FindRoot(&parent, m);
+
+  // excluded[k] is true if class k can't go in the arena: inputs and
+  // outputs; compressed matrices; and (to be safe) anything not allocated by
+  // kAllocMatrix.
+  std::vector<bool> excluded(num_matrices, false), allocated(num_matrices,
+                                                             false);
+  excluded[0] = true;  // matrix 0 is the empty matrix.
+  int32 label_command = -1, goto_command = -1;
+  for (int32 c = 0; c < num_commands; c++) {
+    const Command &command = commands[c];
+    switch (command.command_type) {
+      case kAcceptInput: case kProvideOutput:
+      case kCompressMatrix: case kDecompressMatrix:
+        excluded[matrix_class[submatrices[command.arg1].matrix_index]] = true;
+        break;
+      case kAllocMatrix:
+        allocated[matrix_class[submatrices[command.arg1].matrix_index]] = true;
+        break;
+      case kGotoLabel:
+        KALDI_ASSERT(goto_command == -1 && c == num_commands - 1);
+        goto_command = c;
+        label_command = command.arg1;
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Next we simulate the allocation of matrices to work out, for each class
+  // k, the interval of commands [start[k], end[k]] during which it may be
+  // allocated.  If two matrices of the same class are allocated at the same
+  // time (which can happen in looped computations, where a matrix may be
+  // allocated again while the matrix it was swapped into is still in use) the
+  // class can't be in the arena.  For looped computations we go through the
+  // commands from the label to the goto a second time, with the matrices that
+  // were allocated at the goto still allocated.
+  std::vector<bool> is_allocated(num_matrices, false);
+  std::vector<int32> num_allocated(num_matrices, 0),
+      start(num_matrices, num_commands), end(num_matrices, -1);
+  for (int32 pass = 0; pass < (goto_command >= 0 ? 2 : 1); pass++) {
+    int32 begin_command = 0, end_command = num_commands;
+    if (pass == 1) {
+      begin_command = label_command;
+      end_command = goto_command;
+      for (int32 k = 0; k < num_matrices; k++)
+        if (num_allocated[k] > 0)
+          start[k] = std::min(start[k], label_command);
+    }
+    for (int32 c = begin_command; c < end_command; c++) {
+      const Command &command = commands[c];
+      if (command.command_type == kAllocMatrix) {
+        int32 m = submatrices[command.arg1].matrix_index,
+            k = matrix_class[m];
+        if (num_allocated[k] > 0)
+          excluded[k] = true;
+        if (!is_allocated[m]) {
+          is_allocated[m] = true;
+          if (num_allocated[k]++ == 0)
+            start[k] = std::min(start[k], c);
+        }
+      } else if (command.command_type == kDeallocMatrix) {
+        int32 m = submatrices[command.arg1].matrix_index,
+            k = matrix_class[m];
+        if (is_allocated[m]) {
+          is_allocated[m] = false;
+          if (--num_allocated[k] == 0)
+            end[k] = std::max(end[k], c);
+        }
+      } else if (command.command_type == kSwapMatrix) {
+        int32 m1 = submatrices[command.arg1].matrix_index,
+            m2 = submatrices[command.arg2].matrix_index;
+        if (is_allocated[m1] && is_allocated[m2])
+          excluded[matrix_class[m1]] = true;
+        bool temp = is_allocated[m1];
+        is_allocated[m1] = is_allocated[m2];
+        is_allocated[m2] = temp;
+      }
+    }
+  }
+  for (int32 k = 0; k < num_matrices; k++)
+    if (num_allocated[k] > 0)
+      end[k] = num_commands;
+
+  // Work out the size of each class in bytes, rounded up to a multiple of 64
+  // so that each matrix starts on a cache line.
+  std::vector<int64> num_bytes(num_matrices, 0);
+  for (int32 m = 1; m < num_matrices; m++) {
+    int64 this_num_bytes = static_cast<int64>(matrices[m].num_rows) *
+        ArenaStride(m) * sizeof(BaseFloat);
+    this_num_bytes = ((this_num_bytes + 63) / 64) * 64;
+    int32 k = matrix_class[m];
+    num_bytes[k] = std::max(num_bytes[k], this_num_bytes);
+  }
+
+  // Now place the classes, largest first, each at the lowest offset where it
+  // doesn't overlap any previously placed class that is allocated at the same
+  // time.  This is the usual greedy approach for this (NP-hard) problem.
+  std::vector<std::pair<int64, int32> > classes;
+  for (int32 k = 1; k < num_matrices; k++)
+    if (matrix_class[k] == k && !excluded[k] && allocated[k] &&
+        start[k] <= end[k] && num_bytes[k] > 0)
+      classes.push_back(std::pair<int64, int32>(-num_bytes[k], k));
+  std::sort(classes.begin(), classes.end());
+  std::vector<int64> class_offsets(num_matrices, -1);
+  std::vector<int32> placed;
+  std::vector<std::pair<int64, int64> > used;  // (offset, end) of overlapping
+                                               // classes.
+  for (size_t i = 0; i < classes.size(); i++) {
+    int32 k = classes[i].second;
+    used.clear();
+    for (size_t j = 0; j < placed.size(); j++) {
+      int32 k2 = placed[j];
+      if (start[k2] <= end[k] && start[k] <= end[k2])
+        used.push_back(std::pair<int64, int64>(
+            class_offsets[k2], class_offsets[k2] + num_bytes[k2]));
+    }
+    std::sort(used.begin(), used.end());
+    int64 offset = 0;
+    for (size_t j = 0; j < used.size(); j++) {
+      if (used[j].first >= offset + num_bytes[k])
+        break;
+      offset = std::max(offset, used[j].second);
+    }
+    class_offsets[k] = offset;
+    placed.push_back(k);
+    arena_size = std::max(arena_size, offset + num_bytes[k]);
+  }
+  for (int32 m = 1; m < num_matrices; m++)
+    arena_offsets[m] = class_offsets[matrix_class[m]];
 }
 
 int32 NnetComputation::NewSubMatrix(int32 base_submatrix,
@@ -724,6 +899,10 @@ void NnetComputation::Print(std::ostream &os, const Nnet &nnet) const {
                            indexes_strings, indexes_multi_strings);
   os << "# begin forward commands\n";
   for (int32 c = 0; c < commands.size(); c++) {
+    int32 num_fused = commands[c].NumFusedCommands();
+    if (num_fused > 0)
+      os << "# c" << c << " to c" << (c + num_fused)
+         << " are fused (executed in blocks of rows)\n";
     PrintCommand(os, nnet, *this, c, submatrix_strings,
                  indexes_strings, indexes_multi_strings);
   }
@@ -1142,7 +1321,9 @@ NnetComputation::NnetComputation(const NnetComputation &other):
     commands(other.commands),
     need_model_derivative(other.need_model_derivative),
     indexes_cuda(other.indexes_cuda),
-    indexes_ranges_cuda(other.indexes_ranges_cuda) {
+    indexes_ranges_cuda(other.indexes_ranges_cuda),
+    arena_offsets(other.arena_offsets),
+    arena_size(other.arena_size) {
   for (size_t i = 1; i < component_precomputed_indexes.size(); i++)
     component_precomputed_indexes[i].data =
         component_precomputed_indexes[i].data->Copy();
@@ -1159,6 +1340,8 @@ NnetComputation& NnetComputation::operator = (const NnetComputation &other) {
   need_model_derivative = other.need_model_derivative;
   indexes_cuda = other.indexes_cuda;
   indexes_ranges_cuda = other.indexes_ranges_cuda;
+  arena_offsets = other.arena_offsets;
+  arena_size = other.arena_size;
 
   for (size_t i = 1; i < component_precomputed_indexes.size(); i++)
     delete component_precomputed_indexes[i].data;
@@ -205,6 +205,8 @@ struct ComputationRequestPtrEqual {
      - arg6 is 1 if we need to call StoreStats() after the Propagate, or 0
        if we don't.  We used to have a separate command for storing the
        stats, but that has been removed.
+     - arg7 is the number of following commands that are fused with this
+       one, or -1 or 0 if none (see below).
    - kBackprop: Do the back-propagation operation, see Component::Backprop()
      - arg1 is index of component in neural net
      - arg2 is index into ComponentPrecomputedIndexes (0 if NULL; always 0
@@ -224,6 +226,12 @@ struct ComputationRequestPtrEqual {
                   with arg1 == arg2 and it won't do any redundant copying.
    - kMatrixAdd: Add (alpha times contents of sub-matrix arg2)
                  to sub-matrix arg1
+   - For kPropagate, kMatrixCopy and kMatrixAdd, if arg7 > 0, this command
+     and the arg7 commands that follow it are "fused": they all operate row by
+     row on sub-matrices with the same number of rows, so they can be executed
+     together on one block of rows at a time, which keeps the data in the
+     cache (see FuseRowwiseCommands() in nnet-optimize-utils.h).  Executing
+     them one by one as usual gives the same result, so arg7 may be ignored.
    - kCopyRows: call \ref CuMatrix::CopyRows() "CopyRows()" on sub-matrix arg1
                 with sub-matrix arg2 and indexes[arg3] as arguments,
                 then if alpha != 1.0, scale sub-matrix arg1 by alpha.
@@ -362,6 +370,12 @@ struct NnetComputation {
         arg7(arg7) { }
     void Read(std::istream &istream, bool binary);
     void Write(std::ostream &ostream, bool binary) const;
+    // Returns the number of following commands that are fused with this one
+    // (see the documentation of arg7 above).
+    int32 NumFusedCommands() const {
+      return ((command_type == kPropagate || command_type == kMatrixCopy ||
+               command_type == kMatrixAdd) && arg7 > 0 ? arg7 : 0);
+    }
   };
   struct PrecomputedIndexesInfo {
     // For each step of the computation for which we might possibly need to store
@@ -447,6 +461,19 @@ struct NnetComputation {
   // computed from "indexes_ranges" by ComputeCudaIndexes().
   std::vector<CuArray<Int32Pair> > indexes_ranges_cuda;
 
+  // 'arena_offsets' and 'arena_size' are a memory plan that is used when the
+  // computation is run on CPU with NnetComputeOptions::use_arena == true: the
+  // matrices are placed in a single buffer (the "arena") of arena_size bytes,
+  // allocated once by each NnetComputer, instead of being allocated and freed
+  // one by one.
+  // arena_offsets[m] is the offset in bytes of matrix m in the arena, or -1 if
+  // matrix m is not in the arena (inputs and outputs, which are exchanged with
+  // the user, and matrices that are compressed, are allocated separately as
+  // usual).  Matrices that are not allocated at the same time may share
+  // memory.  Computed by ComputeArenaOffsets(); not written to disk.
+  std::vector<int64> arena_offsets;
+  int64 arena_size;
+
 
   /// Convenience function used when adding new matrices.  Writes to
   /// 'this->matrices' and 'this->submatrices'; and if 'this->matrix_debug_info'
@@ -470,9 +497,18 @@ struct NnetComputation {
 
   // This must be called after setting up the computation but prior to actually
   // using the Computation object in a computation, to compute CUDA versions of
-  // the indexes.
+  // the indexes.  It also calls ComputeArenaOffsets().
   void ComputeCudaIndexes();
 
+  // Computes 'arena_offsets' and 'arena_size' from the commands that allocate,
+  // deallocate and swap matrices.  Matrices that are swapped with each other
+  // get the same offset.  (Called from ComputeCudaIndexes()).
+  void ComputeArenaOffsets();
+
+  // Returns the row stride (in elements) that matrix m has when it is in the
+  // arena; this is the same as for a Matrix of the same size and stride type.
+  int32 ArenaStride(int32 m) const;
+
   // This function produces pretty-print ouput intended to allow a human to
   // interpret the computation.
   void Print(std::ostream &os, const Nnet &nnet) const;
@@ -511,7 +547,7 @@ struct NnetComputation {
   // Assignment operator.
   NnetComputation &operator = (const NnetComputation &other);
   // Default constructor
-  NnetComputation(): need_model_derivative(false) { }
+  NnetComputation(): need_model_derivative(false), arena_size(0) { }
 };
 
 
@@ -218,6 +218,8 @@ void UnitTestNnetCompute() {
     NnetComputeOptions compute_opts;
     if (RandInt(0, 1) == 0)
       compute_opts.debug = true;
+    if (RandInt(0, 1) == 0)
+      compute_opts.num_threads = RandInt(2, 4);
 
     computation.ComputeCudaIndexes();
     NnetComputer computer(compute_opts,
@@ -255,6 +257,31 @@ void UnitTestNnetCompute() {
       if (!ApproxEqual(output, output_collapsed)) {
         KALDI_ERR << "Regular and collapsed computations' outputs differ";
       }
+      // Test the memory arena and the multi-threaded execution (dropout is in
+      // test mode here, so the output is deterministic).
+      NnetComputeOptions compute_opts_alt(compute_opts);
+      compute_opts_alt.use_arena = !compute_opts.use_arena;
+      compute_opts_alt.num_threads =
+          (compute_opts.num_threads > 1 ? 1 : RandInt(2, 4));
+      NnetComputer computer_alt(compute_opts_alt, computation, nnet, &nnet);
+      for (size_t i = 0; i < request.inputs.size(); i++) {
+        CuMatrix<BaseFloat> temp(inputs[i]);
+        computer_alt.AcceptInput(request.inputs[i].name, &temp);
+      }
+      computer_alt.Run();
+      const CuMatrixBase<BaseFloat> &output_alt(
+          computer_alt.GetOutput("output"));
+      KALDI_LOG << "Output sum [use-arena="
+                << (compute_opts_alt.use_arena ? "true" : "false")
+                << ", num-threads=" << compute_opts_alt.num_threads
+                << "] is " << output_alt.Sum()
+                << ", arena size is " << computation.arena_size;
+      // Neither option changes the arithmetic, so the outputs should be
+      // exactly the same.
+      if (!Matrix<BaseFloat>(output).Equal(Matrix<BaseFloat>(output_alt))) {
+        KALDI_ERR << "Computations' outputs differ with different "
+                  << "use-arena or num-threads options";
+      }
     }
 
     CuMatrix<BaseFloat> output_deriv(output.NumRows(), output.NumCols());
@@ -17,13 +17,34 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <iterator>
+#include <mutex>
 #include <sstream>
+#include "base/kaldi-thread-pool.h"
 #include "nnet3/nnet-compute.h"
 
 namespace kaldi {
 namespace nnet3 {
 
+namespace {
+
+// The worker threads that NnetComputer uses to execute commands in parallel
+// (see NnetComputeOptions::num_threads).  It is never destroyed, as its
+// threads may still be waiting for work when the program exits.  Only one
+// computation can use it at a time; a computation that finds it busy (e.g.
+// because several threads are decoding in parallel) executes its commands in
+// the calling thread.
+ThreadPool *ComputeThreadPool() {
+  static ThreadPool *pool = new ThreadPool();
+  return pool;
+}
+
+}  // namespace
+
 
 NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            const NnetComputation &computation,
@@ -52,6 +73,25 @@ void NnetComputer::Init() {
                "executing the computation.");
   matrices_.resize(computation_.matrices.size());
   debug_ = (options_.debug || GetVerboseLevel() >= 5);
+  // In debug mode we look at the matrices directly, so we don't use the
+  // arena.  On GPU, the memory allocator already caches memory.
+  use_arena_ = (options_.use_arena && !debug_ && computation_.arena_size > 0);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    use_arena_ = false;
+#endif
+  if (use_arena_) {
+    KALDI_ASSERT(computation_.arena_offsets.size() ==
+                 computation_.matrices.size());
+    arena_.Resize(computation_.arena_size / sizeof(BaseFloat), kUndefined);
+  }
+  num_threads_ = (debug_ ? 1 : std::max<int32>(options_.num_threads, 1));
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    num_threads_ = 1;
+#endif
+  if (num_threads_ > 1)
+    InitParallel();
   if (debug_) {
     ComputationVariables variables;
     variables.Init(computation_);
@@ -199,21 +239,33 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
     matrices_(other.matrices_),
-    memos_(other.memos_) {
-  // Note: this is the same as the default copy constructor, except for the check below.
-  if (!memos_.empty()) {
+    memos_(other.memos_),
+    use_arena_(other.use_arena_),
+    arena_(other.arena_),
+    num_threads_(other.num_threads_),
+    unit_predecessors_(other.unit_predecessors_),
+    unit_successors_(other.unit_successors_),
+    num_pending_(other.num_pending_) {
+  // Note: this is the same as the default copy constructor, except for the
+  // check below.  (If num_threads_ > 1, memos_ is resized in advance, so we
+  // check for non-NULL memos.)
+  if (std::count(memos_.begin(), memos_.end(), static_cast<void*>(NULL)) !=
+      static_cast<std::ptrdiff_t>(memos_.size())) {
     KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
         "memos are used.";
   }
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command, int32 block_row_offset,
+                                  int32 block_num_rows) {
+  const NnetComputation::Command &c = computation_.commands[command];
   int32 m1, m2;
   try {
     switch (c.command_type) {
       case kAllocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
+        if (use_arena_ && computation_.arena_offsets[m1] >= 0)
+          break;  // It's in the arena.
         matrices_[m1].Resize(computation_.matrices[m1].num_rows,
                              computation_.matrices[m1].num_cols,
                              kUndefined,
@@ -221,11 +273,16 @@ void NnetComputer::ExecuteCommand() {
         break;
       case kDeallocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
+        if (use_arena_ && computation_.arena_offsets[m1] >= 0)
+          break;
         matrices_[m1].Resize(0, 0);
         break;
       case kSwapMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
         m2 = computation_.submatrices[c.arg2].matrix_index;
+        // Matrices that are swapped have the same offset in the arena.
+        if (use_arena_ && computation_.arena_offsets[m1] >= 0)
+          break;
         matrices_[m1].Swap(&(matrices_[m2]));
         break;
       case kSetConst: {
@@ -238,8 +295,10 @@ void NnetComputer::ExecuteCommand() {
         const Component *component = nnet_.GetComponent(c.arg1);
         ComponentPrecomputedIndexes *indexes =
             computation_.component_precomputed_indexes[c.arg2].data;
-        const CuSubMatrix<BaseFloat> input(GetSubMatrix(c.arg3));
-        CuSubMatrix<BaseFloat> output(GetSubMatrix(c.arg4));
+        const CuSubMatrix<BaseFloat> input(
+            GetSubMatrix(c.arg3, block_row_offset, block_num_rows));
+        CuSubMatrix<BaseFloat> output(
+            GetSubMatrix(c.arg4, block_row_offset, block_num_rows));
         void *memo = component->Propagate(indexes, input, &output);
         if (c.arg6) {  // need to store stats.
           KALDI_ASSERT(nnet_to_store_stats_ != NULL);
@@ -248,7 +307,8 @@ void NnetComputer::ExecuteCommand() {
           // if propagate was in-place, provide empty matrix and not 'input', as
           // input is no longer valid.
           const CuSubMatrix<BaseFloat> maybe_input(
-              GetSubMatrix(was_in_place ? 0 : c.arg3));
+              GetSubMatrix(was_in_place ? 0 : c.arg3, block_row_offset,
+                           block_num_rows));
           stats_component->StoreStats(maybe_input, output, memo);
         }
         SaveMemo(c.arg5, *component, memo);
@@ -292,8 +352,10 @@ void NnetComputer::ExecuteCommand() {
         break;
       }
       case kMatrixCopy: {
-        CuSubMatrix<BaseFloat> dest(GetSubMatrix(c.arg1));
-        const CuSubMatrix<BaseFloat> src(GetSubMatrix(c.arg2));
+        CuSubMatrix<BaseFloat> dest(
+            GetSubMatrix(c.arg1, block_row_offset, block_num_rows));
+        const CuSubMatrix<BaseFloat> src(
+            GetSubMatrix(c.arg2, block_row_offset, block_num_rows));
         dest.CopyFromMat(src);
         if (c.alpha != 1.0)
           dest.Scale(c.alpha);  // note: in principle in future we could write a
@@ -301,8 +363,10 @@ void NnetComputer::ExecuteCommand() {
         break;
       }
       case kMatrixAdd: {
-        CuSubMatrix<BaseFloat> dest(GetSubMatrix(c.arg1));
-        const CuSubMatrix<BaseFloat> src(GetSubMatrix(c.arg2));
+        CuSubMatrix<BaseFloat> dest(
+            GetSubMatrix(c.arg1, block_row_offset, block_num_rows));
+        const CuSubMatrix<BaseFloat> src(
+            GetSubMatrix(c.arg2, block_row_offset, block_num_rows));
         dest.AddMat(c.alpha, src);
         break;
       }
@@ -431,29 +495,305 @@ void NnetComputer::ExecuteCommand() {
     }
   } catch (...) {
     if (!debug_) {
+      // We don't set command_strings_ here, as other threads may be executing
+      // commands.
       std::string preamble;
-      computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
+      std::vector<std::string> command_strings;
+      computation_.GetCommandStrings(nnet_, &preamble, &command_strings);
       KALDI_WARN << "Printing some background info since error was detected";
       KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
-        KALDI_LOG << command_strings_[prev_c];
+      for (int32 prev_c = 0; prev_c < command; prev_c++)
+        KALDI_LOG << command_strings[prev_c];
+      KALDI_ERR << "Error running command " << command_strings[command];
     }
     // the following will re-throw the error, but now we've printed more info
     // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    KALDI_ERR << "Error running command " << command_strings_[command];
   }
 }
 
-CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index) {
+CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index,
+                                                  int32 block_row_offset,
+                                                  int32 block_num_rows) {
   KALDI_PARANOID_ASSERT(static_cast<size_t>(submatrix_index) <
                         computation_.submatrices.size());
   const NnetComputation::SubMatrixInfo &info =
       computation_.submatrices[submatrix_index];
+  if (use_arena_ && computation_.arena_offsets[info.matrix_index] >= 0) {
+    int32 stride = computation_.ArenaStride(info.matrix_index),
+        row_offset = info.row_offset, num_rows = info.num_rows;
+    if (block_num_rows >= 0) {
+      row_offset += block_row_offset;
+      num_rows = block_num_rows;
+    }
+    BaseFloat *data = arena_.Data() +
+        computation_.arena_offsets[info.matrix_index] / sizeof(BaseFloat) +
+        static_cast<int64>(row_offset) * stride + info.col_offset;
+    return CuSubMatrix<BaseFloat>(data, num_rows, info.num_cols, stride);
+  }
   const CuMatrix<BaseFloat> &mat = matrices_[info.matrix_index];
+  if (block_num_rows >= 0)
+    return CuSubMatrix<BaseFloat>(
+        mat, info.row_offset + block_row_offset, block_num_rows,
+        info.col_offset, info.num_cols);
   return CuSubMatrix<BaseFloat>(
       mat, info.row_offset, info.num_rows, info.col_offset, info.num_cols);
 }
 
+void NnetComputer::ExecuteFusedCommands(int32 command) {
+  // The number of bytes of data that we aim to process in each block of rows;
+  // this is a fraction of the size of a typical L2 cache.
+  const int32 kBlockBytes = 128 * 1024;
+  const std::vector<NnetComputation::Command> &commands =
+      computation_.commands;
+  const NnetComputation::Command &c = commands[command];
+  int32 first_command = command,
+      last_command = command + c.NumFusedCommands();
+  KALDI_ASSERT(static_cast<size_t>(last_command) < commands.size());
+  int32 num_rows = computation_.submatrices[
+      c.command_type == kPropagate ? c.arg4 : c.arg1].num_rows,
+      block_rows = num_rows;
+#if HAVE_CUDA == 1
+  if (!CuDevice::Instantiate().Enabled())
+#endif
+  {
+    // Work out the number of bytes per row of all the sub-matrices that are
+    // used.
+    std::vector<int32> submatrices;
+    for (int32 i = first_command; i <= last_command; i++) {
+      const NnetComputation::Command &d = commands[i];
+      if (d.command_type == kPropagate) {
+        submatrices.push_back(d.arg3);
+        submatrices.push_back(d.arg4);
+      } else {
+        submatrices.push_back(d.arg1);
+        submatrices.push_back(d.arg2);
+      }
+    }
+    SortAndUniq(&submatrices);
+    int32 row_bytes = 0;
+    for (size_t i = 0; i < submatrices.size(); i++)
+      row_bytes += computation_.submatrices[submatrices[i]].num_cols *
+          sizeof(BaseFloat);
+    block_rows = std::max<int32>(1, kBlockBytes / std::max<int32>(row_bytes,
+                                                                  1));
+  }
+  if (block_rows >= num_rows) {
+    // Everything fits in the cache, or we are using a GPU: just execute the
+    // commands one by one.
+    for (int32 i = first_command; i <= last_command; i++)
+      ExecuteCommand(i);
+  } else {
+    for (int32 row_offset = 0; row_offset < num_rows;
+         row_offset += block_rows) {
+      int32 this_block_rows = std::min(block_rows, num_rows - row_offset);
+      for (int32 i = first_command; i <= last_command; i++)
+        ExecuteCommand(i, row_offset, this_block_rows);
+    }
+  }
+}
+
+void NnetComputer::InitParallel() {
+  const std::vector<NnetComputation::Command> &commands =
+      computation_.commands;
+  int32 num_commands = commands.size();
+  ComputationVariables variables;
+  variables.Init(computation_);
+  std::vector<CommandAttributes> attributes;
+  ComputeCommandAttributes(nnet_, computation_, variables, &attributes);
+
+  // Besides the variables, we treat the stats and parameters of each
+  // component, and the random number generator, as variables that are written
+  // by commands that store stats or update the component, or use random
+  // numbers.  This keeps those commands in their original order, which makes
+  // the results reproducible.
+  int32 num_variables = variables.NumVariables(),
+      rng_variable = num_variables + nnet_.NumComponents(),
+      num_all_variables = rng_variable + 1;
+  // For each variable, the last unit that wrote it, and the units that read
+  // it since then.
+  std::vector<int32> last_writer(num_all_variables, -1);
+  std::vector<std::vector<int32> > readers(num_all_variables);
+  // The units that deallocated matrices in the arena, with those matrices.
+  std::vector<std::pair<int32, int32> > arena_deallocs;
+  int32 max_memo_index = 0;
+
+  unit_predecessors_.clear();
+  unit_predecessors_.resize(num_commands);
+  unit_successors_.clear();
+  unit_successors_.resize(num_commands);
+  num_pending_.resize(num_commands);
+  std::vector<int32> read, written;
+  for (int32 u = 0; u < num_commands;
+       u += 1 + commands[u].NumFusedCommands()) {
+    std::vector<int32> &predecessors = unit_predecessors_[u];
+    read.clear();
+    written.clear();
+    for (int32 i = u; i <= u + commands[u].NumFusedCommands(); i++) {
+      const NnetComputation::Command &c = commands[i];
+      const CommandAttributes &attr = attributes[i];
+      read.insert(read.end(), attr.variables_read.begin(),
+                  attr.variables_read.end());
+      written.insert(written.end(), attr.variables_written.begin(),
+                     attr.variables_written.end());
+      switch (c.command_type) {
+        case kAllocMatrix: case kDeallocMatrix:
+          variables.AppendVariablesForSubmatrix(c.arg1, &written);
+          break;
+        case kSwapMatrix:
+          variables.AppendVariablesForSubmatrix(c.arg1, &written);
+          variables.AppendVariablesForSubmatrix(c.arg2, &written);
+          break;
+        case kPropagate:
+          if (c.arg6)  // stores stats.
+            written.push_back(num_variables + c.arg1);
+          if (nnet_.GetComponent(c.arg1)->Properties() & kRandomComponent)
+            written.push_back(rng_variable);
+          max_memo_index = std::max(max_memo_index, c.arg5);
+          break;
+        case kBackprop:
+          // This may update the component or store stats, and the update may
+          // use random numbers.
+          written.push_back(num_variables + c.arg1);
+          written.push_back(rng_variable);
+          break;
+        case kBackpropNoModelUpdate:
+          if (nnet_.GetComponent(c.arg1)->Properties() & kRandomComponent)
+            written.push_back(rng_variable);
+          break;
+        default:
+          break;
+      }
+      if (use_arena_ && (c.command_type == kAllocMatrix ||
+                         c.command_type == kDeallocMatrix)) {
+        int32 m = computation_.submatrices[c.arg1].matrix_index;
+        int64 offset = computation_.arena_offsets[m];
+        if (offset >= 0) {
+          if (c.command_type == kDeallocMatrix) {
+            arena_deallocs.push_back(std::pair<int32, int32>(u, m));
+          } else {
+            // Wait for matrices that used the same memory to be deallocated.
+            int64 end = offset + static_cast<int64>(
+                computation_.matrices[m].num_rows) *
+                computation_.ArenaStride(m) * sizeof(BaseFloat);
+            for (size_t j = 0; j < arena_deallocs.size(); j++) {
+              int32 m2 = arena_deallocs[j].second;
+              int64 offset2 = computation_.arena_offsets[m2],
+                  end2 = offset2 + static_cast<int64>(
+                      computation_.matrices[m2].num_rows) *
+                      computation_.ArenaStride(m2) * sizeof(BaseFloat);
+              if (offset < end2 && offset2 < end)
+                predecessors.push_back(arena_deallocs[j].first);
+            }
+          }
+        }
+      }
+    }
+    SortAndUniq(&read);
+    SortAndUniq(&written);
+    for (size_t j = 0; j < read.size(); j++)
+      if (last_writer[read[j]] >= 0)
+        predecessors.push_back(last_writer[read[j]]);
+    for (size_t j = 0; j < written.size(); j++) {
+      int32 v = written[j];
+      if (last_writer[v] >= 0)
+        predecessors.push_back(last_writer[v]);
+      predecessors.insert(predecessors.end(), readers[v].begin(),
+                          readers[v].end());
+    }
+    for (size_t j = 0; j < read.size(); j++)
+      readers[read[j]].push_back(u);
+    for (size_t j = 0; j < written.size(); j++) {
+      readers[written[j]].clear();
+      last_writer[written[j]] = u;
+    }
+    SortAndUniq(&predecessors);
+    for (size_t j = 0; j < predecessors.size(); j++)
+      unit_successors_[predecessors[j]].push_back(u);
+  }
+  // Memos are saved by index, so make sure that saving them doesn't resize
+  // memos_ while other threads are using it.
+  if (memos_.size() <= static_cast<size_t>(max_memo_index))
+    memos_.resize(max_memo_index + 1, NULL);
+}
+
+void NnetComputer::ExecuteParallel(int32 begin_command, int32 end_command) {
+  const std::vector<NnetComputation::Command> &commands =
+      computation_.commands;
+  // 'ready' is a heap of the units that can be started, smallest first, to
+  // stay close to the original order.
+  std::vector<int32> ready;
+  int32 num_units = 0;
+  for (int32 u = begin_command; u < end_command;
+       u += 1 + commands[u].NumFusedCommands()) {
+    KALDI_ASSERT(u + commands[u].NumFusedCommands() < end_command);
+    const std::vector<int32> &predecessors = unit_predecessors_[u];
+    int32 num_pending = 0;
+    for (size_t j = 0; j < predecessors.size(); j++)
+      if (predecessors[j] >= begin_command)
+        num_pending++;
+    num_pending_[u] = num_pending;
+    if (num_pending == 0)
+      ready.push_back(u);
+    num_units++;
+  }
+  if (num_units == 0)
+    return;
+  std::make_heap(ready.begin(), ready.end(), std::greater<int32>());
+
+  std::mutex mutex;  // Protects the variables below, and num_pending_.
+  std::condition_variable cond;
+  int32 num_units_remaining = num_units;
+  std::exception_ptr error;
+
+  std::function<void(int32)> work = [&](int32 thread) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      cond.wait(lock, [&]() {
+          return !ready.empty() || num_units_remaining == 0 || error; });
+      if (num_units_remaining == 0 || error)
+        return;
+      std::pop_heap(ready.begin(), ready.end(), std::greater<int32>());
+      int32 u = ready.back();
+      ready.pop_back();
+      lock.unlock();
+      try {
+        if (commands[u].NumFusedCommands() > 0)
+          ExecuteFusedCommands(u);
+        else
+          ExecuteCommand(u);
+      } catch (...) {
+        lock.lock();
+        if (!error)
+          error = std::current_exception();
+        cond.notify_all();
+        return;
+      }
+      lock.lock();
+      const std::vector<int32> &successors = unit_successors_[u];
+      int32 num_new_ready = 0;
+      for (size_t j = 0; j < successors.size(); j++) {
+        int32 v = successors[j];
+        if (v < end_command && --num_pending_[v] == 0) {
+          ready.push_back(v);
+          std::push_heap(ready.begin(), ready.end(), std::greater<int32>());
+          num_new_ready++;
+        }
+      }
+      if (--num_units_remaining == 0) {
+        cond.notify_all();
+        return;
+      }
+      // This thread takes one of the new units itself.
+      for (int32 j = 1; j < num_new_ready; j++)
+        cond.notify_one();
+    }
+  };
+  ComputeThreadPool()->Run(std::min(num_threads_, num_units), work);
+  if (error)
+    std::rethrow_exception(error);
+}
+
 void NnetComputer::GetPointers(int32 indexes_multi_index,
                                int32 num_cols,
                                CuArray<BaseFloat*> *pointers) {
@@ -516,6 +856,26 @@ void NnetComputer::Run() {
   }
   CheckNoPendingIo();
 
+  if (num_threads_ > 1) {
+    // Execute the commands up to the next I/O command in parallel; goto
+    // commands are executed here.
+    while (true) {
+      int32 end_command = program_counter_;
+      while (end_command < num_commands &&
+             c[end_command].command_type != kAcceptInput &&
+             c[end_command].command_type != kProvideOutput &&
+             c[end_command].command_type != kGotoLabel)
+        end_command++;
+      ExecuteParallel(program_counter_, end_command);
+      program_counter_ = end_command;
+      if (end_command == num_commands ||
+          c[end_command].command_type != kGotoLabel)
+        return;
+      ExecuteCommand(end_command);  // Sets program_counter_ to the label.
+      program_counter_++;
+    }
+  }
+
   CommandDebugInfo info;
   Timer timer;
   double total_elapsed_previous = 0.0;
@@ -529,7 +889,15 @@ void NnetComputer::Run() {
     }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+    // In debug mode we execute fused commands one by one, so we can look at
+    // each of them.
+    if (!debug_ && c[program_counter_].NumFusedCommands() > 0) {
+      int32 num_fused_commands = c[program_counter_].NumFusedCommands();
+      ExecuteFusedCommands(program_counter_);
+      program_counter_ += num_fused_commands;
+    } else {
+      ExecuteCommand(program_counter_);
+    }
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
@@ -38,11 +38,26 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  bool use_arena;
+  int32 num_threads;
+  NnetComputeOptions(): debug(false), use_arena(false), num_threads(1) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("use-arena", &use_arena, "If true, when computing on CPU, "
+                   "put the matrices of the computation in a single buffer, "
+                   "at offsets planned when the computation is compiled, "
+                   "instead of allocating and freeing them one by one.  The "
+                   "buffer is allocated again for every NnetComputer, i.e. "
+                   "for every chunk that is computed, so this only saves the "
+                   "allocations within a chunk.  Inputs and outputs are still "
+                   "allocated separately.  Has no effect in debug mode.");
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "execute commands of the computation that do not depend "
+                   "on each other (e.g. different branches of the network) "
+                   "in parallel, when computing on CPU.  The results do not "
+                   "depend on this.  Has no effect in debug mode.");
   }
 
 };
@@ -172,9 +187,53 @@ class NnetComputer {
   // happens.
   std::vector<CuCompressedMatrixBase*> compressed_matrices_;
 
-
-  // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  // True if we are using the memory arena (see NnetComputeOptions::use_arena
+  // and NnetComputation::arena_offsets).  In that case the matrices m with
+  // computation_.arena_offsets[m] >= 0 live in 'arena_' and the corresponding
+  // elements of 'matrices_' are not used, and allocating, deallocating and
+  // swapping them does nothing.
+  bool use_arena_;
+  Vector<BaseFloat> arena_;
+
+  // The number of threads we execute commands in; it is 1 unless
+  // options_.num_threads > 1 and we are computing on CPU and not in debug mode.
+  int32 num_threads_;
+  // The following are only set up if num_threads_ > 1, by InitParallel().  We
+  // then execute the commands in "units", each consisting of a command and the
+  // commands fused with it (see NumFusedCommands() in nnet-computation.h), and
+  // identified by the index of its first command.  For such a command u,
+  // unit_predecessors_[u] contains the earlier units that must finish before
+  // unit u starts, because they access the same variables (see class
+  // ComputationVariables), at least one of them writing, or the same memory in
+  // the arena, or have side effects on the same component; and
+  // unit_successors_[u] contains the later units for which unit u is a
+  // predecessor.  num_pending_[u] is used in ExecuteParallel().
+  std::vector<std::vector<int32> > unit_predecessors_;
+  std::vector<std::vector<int32> > unit_successors_;
+  std::vector<int32> num_pending_;
+
+  // Executes the command computation_.commands[command].  If block_num_rows
+  // is not -1 (which is only possible for commands that may be fused), it
+  // only processes rows block_row_offset through block_row_offset +
+  // block_num_rows - 1 of each sub-matrix.  A command of type kGotoLabel
+  // sets program_counter_ to the label.
+  void ExecuteCommand(int32 command, int32 block_row_offset = 0,
+                      int32 block_num_rows = -1);
+
+  // Executes the command computation_.commands[command] and the commands that
+  // are fused with it (see NumFusedCommands() in nnet-computation.h).  On
+  // CPU, the commands are executed one block of rows at a time.
+  void ExecuteFusedCommands(int32 command);
+
+  // Sets up unit_predecessors_ and unit_successors_; called from Init() if
+  // num_threads_ > 1.
+  void InitParallel();
+
+  // Executes the commands from begin_command to end_command - 1, which must
+  // not include I/O or goto commands, using num_threads_ threads.  Each unit
+  // (see unit_predecessors_) starts once its predecessors have finished, so
+  // the results are the same as when executing the commands in order.
+  void ExecuteParallel(int32 begin_command, int32 end_command);
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
@@ -193,7 +252,12 @@ class NnetComputer {
   // skips over any pending output.
   void CheckNoPendingIo();
 
-  CuSubMatrix<BaseFloat> GetSubMatrix(int32 submatrix_index);
+  // Returns the sub-matrix with index 'submatrix_index', or if block_num_rows
+  // is not -1, rows block_row_offset through block_row_offset +
+  // block_num_rows - 1 of it.
+  CuSubMatrix<BaseFloat> GetSubMatrix(int32 submatrix_index,
+                                      int32 block_row_offset = 0,
+                                      int32 block_num_rows = -1);
 
   void GetPointers(int32 indexes_multi_index,
                    int32 num_cols,
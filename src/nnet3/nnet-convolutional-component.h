@@ -559,8 +559,20 @@ class TdnnComponent: public UpdatableComponent {
 
   BaseFloat OrthonormalConstraint() const { return orthonormal_constraint_; }
 
+  const std::vector<int32> &TimeOffsets() const { return time_offsets_; }
+
   void ConsolidateMemory();
  private:
+  // QuantizedTdnnComponent (see nnet-quantized-component.h) uses the same
+  // indexes as this component, and the static functions below.
+  friend class QuantizedTdnnComponent;
+
+  // This does the work of PrecomputeIndexes(), for time offsets
+  // 'time_offsets'.
+  static PrecomputedIndexes *PrecomputeIndexesForOffsets(
+      const std::vector<int32> &time_offsets,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes);
 
   // This static function is a utility function that extracts a CuSubMatrix
   // representing a subset of rows of 'input_matrix'.
@@ -87,6 +87,55 @@ void SetDerivTimesOptions(const ComputationRequest &request,
             << opt_config->max_deriv_time << ')';
 }
 
+// Runs the forward and backward computation once, with the random generators
+// reset first, and outputs the output and adds the model-derivative to
+// "nnet_deriv".
+static void RunForwardBackward(const NnetComputeOptions &compute_opts,
+                               const NnetComputation &computation,
+                               const Nnet &nnet,
+                               const ComputationRequest &request,
+                               const std::vector<Matrix<BaseFloat> > &inputs,
+                               const CuMatrix<BaseFloat> &output_deriv,
+                               CuMatrix<BaseFloat> *output,
+                               Nnet *nnet_deriv) {
+  Nnet nnet_copy(nnet);
+  ResetGenerators(&nnet_copy);
+  NnetComputer computer(compute_opts, computation, nnet_copy, nnet_deriv);
+  for (size_t i = 0; i < request.inputs.size(); i++) {
+    CuMatrix<BaseFloat> temp(inputs[i]);
+    computer.AcceptInput(request.inputs[i].name, &temp);
+  }
+  computer.Run();
+  *output = computer.GetOutput("output");
+  CuMatrix<BaseFloat> temp(output_deriv);
+  computer.AcceptInput("output", &temp);
+  computer.Run();
+}
+
+// Checks that the computation with compute_opts.num_threads > 1 gives exactly
+// the same output and model-derivative as with one thread.
+static void CheckThreadedComputation(
+    const NnetComputeOptions &compute_opts,
+    const NnetComputation &computation, const Nnet &nnet,
+    const Nnet &nnet_deriv_in, const ComputationRequest &request,
+    const std::vector<Matrix<BaseFloat> > &inputs,
+    const CuMatrix<BaseFloat> &output_deriv) {
+  NnetComputeOptions serial_opts(compute_opts);
+  serial_opts.num_threads = 1;
+  CuMatrix<BaseFloat> output, serial_output;
+  Nnet nnet_deriv(nnet_deriv_in), serial_nnet_deriv(nnet_deriv_in);
+  RunForwardBackward(compute_opts, computation, nnet, request, inputs,
+                     output_deriv, &output, &nnet_deriv);
+  RunForwardBackward(serial_opts, computation, nnet, request, inputs,
+                     output_deriv, &serial_output, &serial_nnet_deriv);
+  if (!Matrix<BaseFloat>(output).Equal(Matrix<BaseFloat>(serial_output)))
+    KALDI_ERR << "Output differs with num-threads="
+              << compute_opts.num_threads << " and 1";
+  if (!NnetParametersAreIdentical(nnet_deriv, serial_nnet_deriv, 0.0))
+    KALDI_ERR << "Model-derivative differs with num-threads="
+              << compute_opts.num_threads << " and 1";
+}
+
 // This test makes sure that the model-derivatives are correct.
 void UnitTestNnetModelDerivatives() {
   int32 N = 20;
@@ -162,6 +211,11 @@ void UnitTestNnetModelDerivatives() {
     NnetComputeOptions compute_opts;
     if (RandInt(0, 1) == 0)
       compute_opts.debug = true;
+    else if (RandInt(0, 1) == 0)
+      compute_opts.num_threads = RandInt(2, 4);
+    if (compute_opts.num_threads > 1)
+      CheckThreadedComputation(compute_opts, computation, nnet, nnet_deriv,
+                               request, inputs, output_deriv);
 
     // pass 0 is the forward pass with the un-perturbed model.
     // Other passes are with various differently-perturbed versions of
@@ -302,6 +356,8 @@ void UnitTestNnetInputDerivatives() {
     NnetComputeOptions compute_opts;
     if (RandInt(0, 1) == 0)
       compute_opts.debug = true;
+    else if (RandInt(0, 1) == 0)
+      compute_opts.num_threads = RandInt(2, 4);
     computation.ComputeCudaIndexes();
 
 
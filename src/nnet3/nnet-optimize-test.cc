@@ -17,12 +17,17 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-utils.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -265,6 +270,11 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
                                                               compiler);
   optimize = optimize_all;
 
+  optimize.fuse_rowwise_commands = false;
+  bool succ_no_fuse_rowwise_commands = UnitTestNnetOptimizeWithOptions(
+      srand_seed, optimize, compiler);
+  optimize = optimize_all;
+
 
   optimize.min_deriv_time = std::numeric_limits<int32>::min();
   optimize.max_deriv_time = std::numeric_limits<int32>::max();
@@ -288,10 +298,235 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
     << "\n  allocate_from_other  ... " << KALDI_SUCCFAIL(succ_no_allocate_from_other)
     << "\n  move_sizing_commands ... " << KALDI_SUCCFAIL(succ_no_move_sizing_commands)
     << "\n  snip_row_ops         ... " << KALDI_SUCCFAIL(succ_no_snip_row_ops)
+    << "\n  fuse_rowwise_commands ... " << KALDI_SUCCFAIL(succ_no_fuse_rowwise_commands)
     << "\n  no_deriv_time        ... " << KALDI_SUCCFAIL(succ_no_deriv_time);
 #undef KALDI_SUCCFAIL
 }
 
+// Computes the output of 'nnet' for a request for 'num_frames' frames of the
+// output, using 'opt_config'.  Outputs the number of fused commands (see
+// FuseRowwiseCommands()) in the computation to 'num_fused'.
+static void ComputeOutputWithOptions(const Nnet &nnet,
+                                     const NnetOptimizeOptions &opt_config,
+                                     const Matrix<BaseFloat> &input,
+                                     int32 num_frames,
+                                     Matrix<BaseFloat> *output,
+                                     int32 *num_fused) {
+  ComputationRequest request;
+  request.inputs.resize(1);
+  request.outputs.resize(1);
+  request.inputs[0].name = "input";
+  request.outputs[0].name = "output";
+  int32 left_context = (input.NumRows() - num_frames) / 2;
+  for (int32 t = 0; t < input.NumRows(); t++)
+    request.inputs[0].indexes.push_back(Index(0, t - left_context));
+  for (int32 t = 0; t < num_frames; t++)
+    request.outputs[0].indexes.push_back(Index(0, t));
+
+  CachingOptimizingCompilerOptions compiler_config;
+  CachingOptimizingCompiler compiler(nnet, opt_config, compiler_config);
+  const NnetComputation &computation = *compiler.Compile(request);
+  *num_fused = 0;
+  for (size_t c = 0; c < computation.commands.size(); c++)
+    *num_fused += computation.commands[c].NumFusedCommands();
+
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, computation, nnet, NULL);
+  CuMatrix<BaseFloat> cu_input(input);
+  computer.AcceptInput("input", &cu_input);
+  computer.Run();
+  *output = Matrix<BaseFloat>(computer.GetOutput("output"));
+}
+
+// Checks that the fusion of row-wise commands doesn't change the output of an
+// inference computation that is large enough for the fused commands to be
+// executed in several blocks of rows.
+static void UnitTestNnetOptimizeFusion() {
+  int32 dim = RandInt(300, 700), num_frames = RandInt(200, 500);
+  std::ostringstream config;
+  config << "input-node name=input dim=40\n"
+         << "component name=affine1 type=AffineComponent input-dim=120 "
+         << "output-dim=" << dim << "\n"
+         << "component-node name=affine1 component=affine1 "
+         << "input=Append(Offset(input,-1),input,Offset(input,1))\n"
+         << "component name=relu1 type=RectifiedLinearComponent dim="
+         << dim << "\n"
+         << "component-node name=relu1 component=relu1 input=affine1\n"
+         << "component name=batchnorm1 type=BatchNormComponent dim="
+         << dim << "\n"
+         << "component-node name=batchnorm1 component=batchnorm1 "
+         << "input=relu1\n"
+         << "component name=affine2 type=AffineComponent input-dim=" << dim
+         << " output-dim=" << dim << "\n"
+         << "component-node name=affine2 component=affine2 input=batchnorm1\n"
+         << "component name=relu2 type=RectifiedLinearComponent dim="
+         << dim << "\n"
+         << "component-node name=relu2 component=relu2 input=affine2\n"
+         << "component name=scale2 type=ScaleAndOffsetComponent dim="
+         << dim << "\n"
+         << "component-node name=scale2 component=scale2 "
+         << "input=Sum(Scale(0.66, batchnorm1), relu2)\n"
+         << "component name=output.affine type=AffineComponent input-dim="
+         << dim << " output-dim=10\n"
+         << "component-node name=output.affine component=output.affine "
+         << "input=scale2\n"
+         << "output-node name=output input=output.affine\n";
+  Nnet nnet;
+  {
+    std::istringstream is(config.str());
+    nnet.ReadConfig(is);
+  }
+  SetBatchnormTestMode(true, &nnet);
+  Matrix<BaseFloat> input(num_frames + 2, 40);
+  input.SetRandn();
+
+  NnetOptimizeOptions opt_config, opt_config_no_fusion;
+  opt_config_no_fusion.fuse_rowwise_commands = false;
+  Matrix<BaseFloat> output, output_no_fusion;
+  int32 num_fused, num_fused_no_fusion;
+  ComputeOutputWithOptions(nnet, opt_config, input, num_frames,
+                           &output, &num_fused);
+  ComputeOutputWithOptions(nnet, opt_config_no_fusion, input, num_frames,
+                           &output_no_fusion, &num_fused_no_fusion);
+  KALDI_LOG << "Number of fused commands is " << num_fused;
+  KALDI_ASSERT(num_fused > 0 && num_fused_no_fusion == 0);
+  KALDI_ASSERT(output.ApproxEqual(output_no_fusion, 1.0e-06));
+}
+
+// Removes the directory 'dir' and the files in it, and returns the number of
+// files that were removed.
+static int32 RemoveDirectory(const std::string &dir) {
+  int32 num_files = 0;
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL)
+    return 0;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    std::string name(entry->d_name);
+    if (name != "." && name != "..") {
+      unlink((dir + "/" + name).c_str());
+      num_files++;
+    }
+  }
+  closedir(d);
+  rmdir(dir.c_str());
+  return num_files;
+}
+
+// Changes the version in the header of the computations in directory 'dir'
+// (see ComputationDiskCache::kVersion) to 'version'.
+static void SetComputationVersion(const std::string &dir, int32 version) {
+  DIR *d = opendir(dir.c_str());
+  KALDI_ASSERT(d != NULL);
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    std::string name(entry->d_name), suffix(".computation");
+    if (name.size() <= suffix.size() ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+      continue;
+    std::string filename = dir + "/" + name;
+    std::string contents;
+    {
+      std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+      std::ostringstream os;
+      os << is.rdbuf();
+      contents = os.str();
+    }
+    // In binary mode the token is followed by a space, and the integer by its
+    // size (one byte) and value.
+    std::string token = "<Version> ";
+    size_t pos = contents.find(token);
+    KALDI_ASSERT(pos != std::string::npos);
+    pos += token.size() + 1;
+    KALDI_ASSERT(pos + sizeof(int32) <= contents.size());
+    contents.replace(pos, sizeof(int32),
+                     reinterpret_cast<const char*>(&version), sizeof(int32));
+    std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+    os << contents;
+  }
+  closedir(d);
+}
+
+// Checks that computations written to a ComputationDiskCache directory by one
+// CachingOptimizingCompiler are read back by another one, and are the same.
+static void UnitTestComputationDiskCache() {
+  struct NnetGenerationOptions gen_config;
+  std::vector<std::string> configs;
+  GenerateConfigSequence(gen_config, &configs);
+  Nnet nnet;
+  for (size_t j = 0; j < configs.size(); j++) {
+    std::istringstream is(configs[j]);
+    nnet.ReadConfig(is);
+  }
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+  std::string dir = "tmp-computation-cache";
+  RemoveDirectory(dir);  // In case an earlier run crashed.
+  KALDI_ASSERT(mkdir(dir.c_str(), 0777) == 0);
+
+  NnetOptimizeOptions opt_config;
+  CachingOptimizingCompilerOptions compiler_config;
+  compiler_config.cache_dir = dir;
+  std::ostringstream os1, os2;
+  {
+    CachingOptimizingCompiler compiler(nnet, opt_config, compiler_config);
+    compiler.Compile(request)->Print(os1, nnet);
+  }
+  {
+    CachingOptimizingCompiler compiler(nnet, opt_config, compiler_config);
+    compiler.Compile(request)->Print(os2, nnet);
+  }
+  KALDI_ASSERT(os1.str() == os2.str());
+
+  std::vector<const ComputationRequest*> requests(1, &request);
+  ComputationDiskCache disk_cache(dir, nnet, opt_config);
+  NnetComputation *computation = disk_cache.Read(requests);
+  KALDI_ASSERT(computation != NULL);
+  std::ostringstream os3;
+  computation->Print(os3, nnet);
+  KALDI_ASSERT(os3.str() == os1.str());
+  delete computation;
+
+  // Files with a different version should not be used.
+  SetComputationVersion(dir, ComputationDiskCache::kVersion + 1);
+  KALDI_ASSERT(disk_cache.Read(requests) == NULL);
+  SetComputationVersion(dir, ComputationDiskCache::kVersion);
+  computation = disk_cache.Read(requests);
+  KALDI_ASSERT(computation != NULL);
+  delete computation;
+
+  // With different options, or a different model, nothing should be found.
+  NnetOptimizeOptions opt_config2(opt_config);
+  opt_config2.optimize_row_ops = false;
+  ComputationDiskCache disk_cache2(dir, nnet, opt_config2);
+  KALDI_ASSERT(disk_cache2.Read(requests) == NULL);
+  Nnet nnet2(nnet);
+  PerturbParams(0.1, &nnet2);
+  ComputationDiskCache disk_cache3(dir, nnet2, opt_config);
+  KALDI_ASSERT(disk_cache3.Read(requests) == NULL ||
+               NumParameters(nnet) == 0);
+
+  if (IsSimpleNnet(nnet)) {
+    int32 left_context, right_context, left_context2, right_context2,
+        left_context3, right_context3;
+    ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+    disk_cache.GetSimpleNnetContext(&left_context2, &right_context2);
+    disk_cache.GetSimpleNnetContext(&left_context3, &right_context3);
+    KALDI_ASSERT(left_context2 == left_context &&
+                 right_context2 == right_context &&
+                 left_context3 == left_context &&
+                 right_context3 == right_context);
+  }
+
+  // There may be more than one file, if the shortcut compilation was used
+  // or the context was written.
+  int32 num_files = RemoveDirectory(dir);
+  KALDI_LOG << "Computation cache had " << num_files << " files.";
+  KALDI_ASSERT(num_files >= 1);
+}
+
 static void UnitTestNnetOptimize() {
   for (int32 srand_seed = 0; srand_seed < 40; srand_seed++) {
     KALDI_LOG << "About to run UnitTestNnetOptimizeInternal with srand_seed = "
@@ -317,6 +552,10 @@ int main() {
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  for (int32 i = 0; i < 5; i++)
+    UnitTestNnetOptimizeFusion();
+  for (int32 i = 0; i < 5; i++)
+    UnitTestComputationDiskCache();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -4579,6 +4579,115 @@ void FixGotoLabel(NnetComputation *computation) {
   }
 }
 
+// Returns true if command 'c' may be part of a sequence of fused commands
+// (see FuseRowwiseCommands()).  If so, it outputs to 'output_submatrix' the
+// sub-matrix that it writes to, and to 'submatrix_list' all the sub-matrices
+// it uses (including 'output_submatrix').
+static bool IsRowwiseCommand(const Nnet &nnet,
+                             const NnetComputation::Command &c,
+                             int32 *output_submatrix,
+                             std::vector<int32> *submatrix_list) {
+  switch (c.command_type) {
+    case kPropagate: {
+      int32 properties = nnet.GetComponent(c.arg1)->Properties();
+      if (!(properties & kSimpleComponent) ||
+          !(properties & kPropagateInPlace) ||
+          (properties & (kUsesMemo|kRandomComponent)) ||
+          c.arg2 != 0 || c.arg5 > 0 || c.arg6 != 0)
+        return false;
+      *output_submatrix = c.arg4;
+      submatrix_list->resize(2);
+      (*submatrix_list)[0] = c.arg3;
+      (*submatrix_list)[1] = c.arg4;
+      return true;
+    }
+    case kMatrixCopy: case kMatrixAdd:
+      *output_submatrix = c.arg1;
+      submatrix_list->resize(2);
+      (*submatrix_list)[0] = c.arg1;
+      (*submatrix_list)[1] = c.arg2;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// This is used in FuseRowwiseCommands().  It returns true if all the
+// sub-matrices in 'submatrix_list' have 'num_rows' rows and, for each matrix,
+// the same row offset as each other and as the one recorded in 'row_offsets'
+// (a map from matrix index to row offset).  If so, it adds their row offsets
+// to 'row_offsets'.
+static bool RowOffsetsAreConsistent(
+    const NnetComputation &computation,
+    const std::vector<int32> &submatrix_list,
+    int32 num_rows,
+    unordered_map<int32, int32> *row_offsets) {
+  unordered_map<int32, int32> new_row_offsets(*row_offsets);
+  for (size_t i = 0; i < submatrix_list.size(); i++) {
+    const NnetComputation::SubMatrixInfo &info =
+        computation.submatrices[submatrix_list[i]];
+    if (info.num_rows != num_rows)
+      return false;
+    unordered_map<int32, int32>::iterator iter =
+        new_row_offsets.find(info.matrix_index);
+    if (iter == new_row_offsets.end())
+      new_row_offsets[info.matrix_index] = info.row_offset;
+    else if (iter->second != info.row_offset)
+      return false;
+  }
+  row_offsets->swap(new_row_offsets);
+  return true;
+}
+
+void FuseRowwiseCommands(const Nnet &nnet,
+                         NnetComputation *computation) {
+  std::vector<NnetComputation::Command> &commands = computation->commands;
+  int32 num_commands = commands.size();
+  for (int32 c = 0; c < num_commands; c++)
+    if (commands[c].NumFusedCommands() > 0)
+      commands[c].arg7 = -1;
+
+  std::vector<int32> submatrix_list;
+  // Maps from each matrix used in the current sequence of commands to the row
+  // offset of the sub-matrices of it that are used.
+  unordered_map<int32, int32> row_offsets;
+  int32 c = 0;
+  while (c < num_commands) {
+    int32 prev_output;
+    row_offsets.clear();
+    if (!IsRowwiseCommand(nnet, commands[c], &prev_output, &submatrix_list) ||
+        !RowOffsetsAreConsistent(*computation, submatrix_list,
+                                 computation->submatrices[prev_output].num_rows,
+                                 &row_offsets)) {
+      c++;
+      continue;
+    }
+    int32 num_rows = computation->submatrices[prev_output].num_rows,
+        end = c + 1;  // will be one past the last command of the sequence.
+    for (; end < num_commands; end++) {
+      int32 this_output;
+      if (!IsRowwiseCommand(nnet, commands[end], &this_output,
+                            &submatrix_list))
+        break;
+      // The command must use the output of the previous command.
+      int32 prev_matrix = computation->submatrices[prev_output].matrix_index;
+      bool uses_prev_output = false;
+      for (size_t i = 0; i < submatrix_list.size(); i++)
+        if (computation->submatrices[submatrix_list[i]].matrix_index ==
+            prev_matrix)
+          uses_prev_output = true;
+      if (!uses_prev_output ||
+          !RowOffsetsAreConsistent(*computation, submatrix_list, num_rows,
+                                   &row_offsets))
+        break;
+      prev_output = this_output;
+    }
+    if (end - c > 1)
+      commands[c].arg7 = end - c - 1;
+    c = end;
+  }
+}
+
 bool MatrixIsUnused(const Analyzer &analyzer,
                     const NnetComputation &computation,
                     int32 m) {
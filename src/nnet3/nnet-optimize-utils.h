@@ -616,6 +616,25 @@ void OptimizeLoopedComputation(const Nnet &nnet,
 void FixGotoLabel(NnetComputation *computation);
 
 
+/// This function marks sequences of consecutive commands that operate row by
+/// row on sub-matrices with the same number of rows, such as a ReLU followed by
+/// batch-norm and scaling, as "fused" (see the documentation of arg7 of
+/// kPropagate in nnet-computation.h).  On CPU, class NnetComputer executes a
+/// fused sequence one block of rows at a time, so each block stays in the cache
+/// while all the commands are applied to it, instead of each command reading
+/// and writing the whole matrix.  The commands that may be fused are kMatrixCopy,
+/// kMatrixAdd, and kPropagate for simple components that can be propagated
+/// in place and do not use a memo or store stats; components that multiply by
+/// a parameter matrix (such as AffineComponent) cannot be propagated in place,
+/// so they are never fused.  Each command of a sequence has to use a matrix
+/// written by the previous one, and all the sub-matrices of any one matrix used
+/// in the sequence must have the same row offset.
+/// This does not change the results.  Since the fused commands must stay
+/// together, it must be done after all other optimizations.
+void FuseRowwiseCommands(const Nnet &nnet,
+                         NnetComputation *computation);
+
+
 /// Class ComputationCache is used inside class CachingOptimizingCompiler to
 /// cache previously computed computations.  The code was moved from class
 /// CachingOptimizingCompiler to this separate class for clarity when adding
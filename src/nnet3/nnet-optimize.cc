@@ -18,7 +18,17 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
+#include <thread>
+#ifdef _MSC_VER
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-utils.h"
@@ -79,6 +89,10 @@ void NnetOptimizeOptions::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<MemoryCompressionLevel>");
     ReadBasicType(is, binary, &memory_compression_level);
   }
+  if (PeekToken(is, binary) == 'F') {
+    ExpectToken(is, binary, "<FuseRowwiseCommands>");
+    ReadBasicType(is, binary, &fuse_rowwise_commands);
+  }
   ExpectToken(is, binary, "</NnetOptimizeOptions>");
 }
 
@@ -122,6 +136,8 @@ void NnetOptimizeOptions::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, snip_row_ops);
   WriteToken(os, binary, "<MemoryCompressionLevel>");
   WriteBasicType(os, binary, memory_compression_level);
+  WriteToken(os, binary, "<FuseRowwiseCommands>");
+  WriteBasicType(os, binary, fuse_rowwise_commands);
   WriteToken(os, binary, "</NnetOptimizeOptions>");
 }
 
@@ -143,7 +159,8 @@ bool NnetOptimizeOptions::operator == (const NnetOptimizeOptions &other) const {
           other.max_deriv_time == max_deriv_time &&
           other.max_deriv_time_relative == max_deriv_time_relative &&
           other.snip_row_ops == snip_row_ops &&
-          other.memory_compression_level == memory_compression_level);
+          other.memory_compression_level == memory_compression_level &&
+          other.fuse_rowwise_commands == fuse_rowwise_commands);
 }
 
 // move commands that resize and zero matrices to as late/early as possible.
@@ -624,6 +641,13 @@ void Optimize(const NnetOptimizeOptions &config,
       CheckComputation(nnet, *computation, false);
   }
 
+  // This should come last, because the fused commands have to stay together.
+  if (config.optimize && config.fuse_rowwise_commands) {
+    FuseRowwiseCommands(nnet, computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
   if (GetVerboseLevel() >= 3) {
     CheckComputation(nnet, *computation, false);
     KALDI_LOG << "After optimization, max memory use (bytes) = "
@@ -632,6 +656,253 @@ void Optimize(const NnetOptimizeOptions &config,
 }
 
 
+static const uint64 kFnvOffset = 14695981039346656037ULL,
+    kFnvPrime = 1099511628211ULL;
+
+// Returns the 64-bit FNV-1a hash of 'str'.
+static uint64 HashString(const std::string &str) {
+  uint64 hash = kFnvOffset;
+  for (size_t i = 0; i < str.size(); i++) {
+    hash ^= static_cast<unsigned char>(str[i]);
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+// This stream buffer computes a hash of whatever is written to it, without
+// storing it; it's used to hash models, which may be large.  For speed it
+// hashes 8 bytes at a time (the result is not the standard FNV-1a hash).
+class HashingStreambuf: public std::streambuf {
+ public:
+  HashingStreambuf(): hash_(kFnvOffset), buffer_(4096) {
+    setp(&(buffer_[0]), &(buffer_[0]) + buffer_.size());
+  }
+  // Returns the hash of everything written so far; call it only once, at the
+  // end.
+  uint64 Hash() {
+    size_t num_bytes = pptr() - pbase(), num_words = num_bytes / 8;
+    HashWords(num_words);
+    for (size_t i = num_words * 8; i < num_bytes; i++) {
+      hash_ ^= static_cast<unsigned char>(buffer_[i]);
+      hash_ *= kFnvPrime;
+    }
+    setp(&(buffer_[0]), &(buffer_[0]) + buffer_.size());
+    return hash_;
+  }
+ protected:
+  virtual int_type overflow(int_type c) {
+    // The buffer is full; its size is a multiple of 8.
+    HashWords(buffer_.size() / 8);
+    setp(&(buffer_[0]), &(buffer_[0]) + buffer_.size());
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+ private:
+  void HashWords(size_t num_words) {
+    for (size_t i = 0; i < num_words; i++) {
+      uint64 word;
+      memcpy(&word, &(buffer_[i * 8]), 8);
+      hash_ ^= word;
+      hash_ *= kFnvPrime;
+    }
+  }
+  uint64 hash_;
+  std::vector<char> buffer_;
+};
+
+const int32 ComputationDiskCache::kVersion;
+
+ComputationDiskCache::ComputationDiskCache(
+    const std::string &dir,
+    const Nnet &nnet,
+    const NnetOptimizeOptions &opt_config):
+    dir_(dir), nnet_(nnet), opt_config_(opt_config),
+    have_model_key_(false), model_key_(0), warned_(false) {
+  KALDI_ASSERT(!dir.empty());
+}
+
+uint64 ComputationDiskCache::ModelKey() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!have_model_key_) {
+    HashingStreambuf buf;
+    std::ostream os(&buf);
+    nnet_.Write(os, true);
+    model_key_ = buf.Hash();
+    have_model_key_ = true;
+  }
+  return model_key_;
+}
+
+std::string ComputationDiskCache::Filename(
+    const std::vector<const ComputationRequest*> &requests) {
+  std::ostringstream os;
+  WriteBasicType(os, true, kVersion);
+  WriteBasicType(os, true, ModelKey());
+  opt_config_.Write(os, true);
+  for (size_t i = 0; i < requests.size(); i++)
+    requests[i]->Write(os, true);
+  std::ostringstream filename;
+  filename << dir_ << '/' << std::hex << std::setfill('0') << std::setw(16)
+           << HashString(os.str()) << ".computation";
+  return filename.str();
+}
+
+NnetComputation *ComputationDiskCache::Read(
+    const std::vector<const ComputationRequest*> &requests) {
+  std::string filename = Filename(requests);
+  std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!is.is_open())
+    return NULL;
+  NnetComputation *computation = new NnetComputation();
+  try {
+    bool binary;
+    if (!InitKaldiInputStream(is, &binary))
+      KALDI_ERR << "Could not read header";
+    ExpectToken(is, binary, "<ComputationDiskCache>");
+    ExpectToken(is, binary, "<Version>");
+    int32 version;
+    ReadBasicType(is, binary, &version);
+    if (version != kVersion) {
+      // This could only happen if there was a hash collision, since the
+      // version is part of the filename.
+      KALDI_WARN << "Computation in " << filename << " has version "
+                 << version << ", expected " << kVersion
+                 << "; will compile it again.";
+      delete computation;
+      return NULL;
+    }
+    ExpectToken(is, binary, "<ModelKey>");
+    uint64 model_key;
+    ReadBasicType(is, binary, &model_key);
+    ExpectToken(is, binary, "<NumRequests>");
+    int32 num_requests;
+    ReadBasicType(is, binary, &num_requests);
+    bool match = (model_key == ModelKey() &&
+                  num_requests == static_cast<int32>(requests.size()));
+    for (int32 i = 0; match && i < num_requests; i++) {
+      ComputationRequest request;
+      request.Read(is, binary);
+      match = (request == *(requests[i]));
+    }
+    if (match) {
+      NnetOptimizeOptions opt_config;
+      opt_config.Read(is, binary);
+      match = (opt_config == opt_config_);
+    }
+    if (!match) {
+      // This could only happen if there was a hash collision.
+      KALDI_WARN << "Computation in " << filename << " does not match the "
+                 << "computation request; will compile it again.";
+      delete computation;
+      return NULL;
+    }
+    computation->Read(is, binary);  // Also calls ComputeCudaIndexes().
+    ExpectToken(is, binary, "</ComputationDiskCache>");
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Could not read computation from " << filename
+               << " (it may have been written by a different version of the "
+               << "code); will compile it again.";
+    delete computation;
+    return NULL;
+  }
+  return computation;
+}
+
+void ComputationDiskCache::Write(
+    const std::vector<const ComputationRequest*> &requests,
+    const NnetComputation &computation) {
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<ComputationDiskCache>");
+  WriteToken(os, binary, "<Version>");
+  WriteBasicType(os, binary, kVersion);
+  WriteToken(os, binary, "<ModelKey>");
+  WriteBasicType(os, binary, ModelKey());
+  WriteToken(os, binary, "<NumRequests>");
+  WriteBasicType(os, binary, static_cast<int32>(requests.size()));
+  for (size_t i = 0; i < requests.size(); i++)
+    requests[i]->Write(os, binary);
+  opt_config_.Write(os, binary);
+  computation.Write(os, binary);
+  WriteToken(os, binary, "</ComputationDiskCache>");
+  WriteFile(Filename(requests), os.str());
+}
+
+void ComputationDiskCache::GetSimpleNnetContext(int32 *nnet_left_context,
+                                                int32 *nnet_right_context) {
+  std::ostringstream filename;
+  filename << dir_ << '/' << std::hex << std::setfill('0') << std::setw(16)
+           << ModelKey() << ".context";
+  std::ifstream is(filename.str().c_str(), std::ios::in | std::ios::binary);
+  if (is.is_open()) {
+    try {
+      bool binary;
+      if (!InitKaldiInputStream(is, &binary))
+        KALDI_ERR << "Could not read header";
+      ExpectToken(is, binary, "<SimpleNnetContext>");
+      ExpectToken(is, binary, "<ModelKey>");
+      uint64 model_key;
+      ReadBasicType(is, binary, &model_key);
+      ExpectToken(is, binary, "<LeftContext>");
+      ReadBasicType(is, binary, nnet_left_context);
+      ExpectToken(is, binary, "<RightContext>");
+      ReadBasicType(is, binary, nnet_right_context);
+      ExpectToken(is, binary, "</SimpleNnetContext>");
+      if (model_key == ModelKey())
+        return;
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Could not read context from " << filename.str()
+                 << "; will compute it again.";
+    }
+  }
+  ComputeSimpleNnetContext(nnet_, nnet_left_context, nnet_right_context);
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<SimpleNnetContext>");
+  WriteToken(os, binary, "<ModelKey>");
+  WriteBasicType(os, binary, ModelKey());
+  WriteToken(os, binary, "<LeftContext>");
+  WriteBasicType(os, binary, *nnet_left_context);
+  WriteToken(os, binary, "<RightContext>");
+  WriteBasicType(os, binary, *nnet_right_context);
+  WriteToken(os, binary, "</SimpleNnetContext>");
+  WriteFile(filename.str(), os.str());
+}
+
+void ComputationDiskCache::WriteFile(const std::string &filename,
+                                     const std::string &contents) {
+  // The temporary name has to be unique to this process and thread.
+  std::ostringstream tmp_filename;
+  tmp_filename << filename << ".tmp." << getpid() << '.'
+               << std::hash<std::thread::id>()(std::this_thread::get_id());
+  bool ok = false;
+  {
+    std::ofstream os(tmp_filename.str().c_str(),
+                     std::ios::out | std::ios::binary);
+    if (os.is_open()) {
+      InitKaldiOutputStream(os, true);
+      os.write(contents.data(), contents.size());
+      os.close();
+      ok = !os.fail();
+    }
+  }
+  // rename() replaces any existing file atomically (on POSIX systems), so
+  // readers never see a partly written file.
+  if (ok && std::rename(tmp_filename.str().c_str(), filename.c_str()) == 0)
+    return;
+  std::remove(tmp_filename.str().c_str());
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!warned_) {
+    KALDI_WARN << "Could not write " << filename << " (does the directory "
+               << dir_ << " exist?)";
+    warned_ = true;
+  }
+}
+
+
 CachingOptimizingCompiler::CachingOptimizingCompiler(
     const Nnet &nnet,
     const CachingOptimizingCompilerOptions config):
@@ -640,6 +911,8 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
     seconds_taken_io_(0.0), cache_(config.cache_capacity),
+    disk_cache_(config.cache_dir.empty() ? NULL :
+                new ComputationDiskCache(config.cache_dir, nnet, opt_config_)),
     nnet_left_context_(-1), nnet_right_context_(-1) { }
 
 CachingOptimizingCompiler::CachingOptimizingCompiler(
@@ -651,13 +924,19 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
     seconds_taken_io_(0.0), cache_(config.cache_capacity),
+    disk_cache_(config.cache_dir.empty() ? NULL :
+                new ComputationDiskCache(config.cache_dir, nnet, opt_config_)),
     nnet_left_context_(-1), nnet_right_context_(-1) { }
 
 void CachingOptimizingCompiler::GetSimpleNnetContext(
     int32 *nnet_left_context, int32 *nnet_right_context) {
   if (nnet_left_context_ == -1) {
-    ComputeSimpleNnetContext(nnet_, &nnet_left_context_,
-                             &nnet_right_context_);
+    if (disk_cache_ != NULL)
+      disk_cache_->GetSimpleNnetContext(&nnet_left_context_,
+                                        &nnet_right_context_);
+    else
+      ComputeSimpleNnetContext(nnet_, &nnet_left_context_,
+                               &nnet_right_context_);
   }
   *nnet_left_context = nnet_left_context_;
   *nnet_right_context = nnet_right_context_;
@@ -693,6 +972,7 @@ void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
 }
 
 CachingOptimizingCompiler::~CachingOptimizingCompiler() {
+  delete disk_cache_;
   if (seconds_taken_total_ > 0.0 || seconds_taken_io_ > 0.0) {
     std::ostringstream os;
     double seconds_taken_misc = seconds_taken_total_ - seconds_taken_compile_
@@ -716,8 +996,11 @@ CachingOptimizingCompiler::~CachingOptimizingCompiler() {
 std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::Compile(
     const ComputationRequest  &in_request) {
   Timer timer;
+  double seconds_taken_io_before = seconds_taken_io_;
   std::shared_ptr<const NnetComputation>  ans = CompileInternal(in_request);
-  seconds_taken_total_ += timer.Elapsed();
+  // Time spent reading or writing the disk cache (if any) is counted as I/O.
+  seconds_taken_total_ += timer.Elapsed() -
+      (seconds_taken_io_ - seconds_taken_io_before);
   return ans;
 }
 
@@ -728,11 +1011,29 @@ std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::CompileInterna
     return ans;
   } else {
     const NnetComputation *computation = NULL;
-    if (config_.use_shortcut)
-      computation = CompileViaShortcut(request);
-    if (computation == NULL)
-      computation = CompileNoShortcut(request);
-    KALDI_ASSERT(computation != NULL);
+    std::vector<const ComputationRequest*> requests(1, &request);
+    if (disk_cache_ != NULL) {
+      Timer timer;
+      computation = disk_cache_->Read(requests);
+      seconds_taken_io_ += timer.Elapsed();
+      if (computation != NULL && GetVerboseLevel() >= 2) {
+        Timer timer;
+        CheckComputation(nnet_, *computation, false);
+        seconds_taken_check_ += timer.Elapsed();
+      }
+    }
+    if (computation == NULL) {
+      if (config_.use_shortcut)
+        computation = CompileViaShortcut(request);
+      if (computation == NULL)
+        computation = CompileNoShortcut(request);
+      KALDI_ASSERT(computation != NULL);
+      if (disk_cache_ != NULL) {
+        Timer timer;
+        disk_cache_->Write(requests, *computation);
+        seconds_taken_io_ += timer.Elapsed();
+      }
+    }
     return cache_.Insert(request, computation);
   }
 }
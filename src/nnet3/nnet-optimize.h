@@ -54,6 +54,7 @@ struct NnetOptimizeOptions {
   int32 max_deriv_time_relative;
   bool snip_row_ops;
   int32 memory_compression_level;
+  bool fuse_rowwise_commands;
   // optimize_looped_computation is a 'hidden config' not available from
   // the command line; it's set to true to enable the optimization for
   // looped computation that turns a linear computation into a loop.
@@ -79,6 +80,7 @@ struct NnetOptimizeOptions {
       max_deriv_time_relative(std::numeric_limits<int32>::max()),
       snip_row_ops(true),
       memory_compression_level(1),
+      fuse_rowwise_commands(true),
       optimize_looped_computation(false) { }
 
   void Register(OptionsItf *opts) {
@@ -145,6 +147,12 @@ struct NnetOptimizeOptions {
                    "potentially at the expense of speed and the accuracy "
                    "of derivatives.  0 means no compression at all; 1 means "
                    "compression that shouldn't affect results at all.");
+    opts->Register("fuse-rowwise-commands", &fuse_rowwise_commands, "Set to "
+                   "false to disable the optimization that fuses sequences of "
+                   "row-wise operations, such as ReLU then batch-norm then "
+                   "scaling, so that on CPU they are done together on blocks "
+                   "of rows that stay in the cache.  This does not affect the "
+                   "results.");
 
   }
   void Read(std::istream &is, bool binary);
@@ -189,9 +197,94 @@ void Optimize(const NnetOptimizeOptions &config,
 
 
 
+/**
+   Class ComputationDiskCache stores compiled computations as files in a
+   directory, so that other processes (e.g. later runs of a decoding program
+   with the same model) can read them instead of compiling them again, which
+   for large models can take several seconds.  Each file contains one
+   computation and its name is a hash of the model, the computation requests
+   and the optimization options; the requests, the options and the hash of the
+   model are stored in the file and checked when it is read, so a collision of
+   file names cannot cause the wrong computation to be used.  The left and right context of the model are
+   stored too, since they also take a while to compute.
+
+   The model is identified by a hash of everything in it, including the
+   parameters (it would not be possible to hash just the structure, because
+   the configuration values of components that affect the computation, such
+   as time offsets, are not accessible in a generic way).  So a retrained
+   model gets new files even if its structure is the same.  Computing the hash
+   takes roughly as long as writing the model to memory.  Files are never
+   deleted, so you may want to clean the directory up from time to time; in
+   particular after updating the code, although files that can no longer be
+   read are simply compiled again.
+
+   A file is written under a temporary name and then renamed, so any number of
+   processes may share a directory.  It's OK to call the member functions from
+   multiple threads without additional synchronization.
+ */
+class ComputationDiskCache {
+ public:
+  /// Note: 'nnet' is retained as a const reference and opt_config is copied.
+  /// The model key is computed when it is first needed, so it's OK if 'nnet'
+  /// is modified after the constructor but before any other member function
+  /// is called.
+  ComputationDiskCache(const std::string &dir,
+                       const Nnet &nnet,
+                       const NnetOptimizeOptions &opt_config);
+
+  /// Returns a newly allocated computation read from the directory, or NULL
+  /// if there is no (readable) file for these computation requests.
+  /// 'requests' would normally have one element; looped computations (see
+  /// CompileLooped()) are compiled from three.
+  NnetComputation *Read(const std::vector<const ComputationRequest*> &requests);
+
+  /// Writes 'computation', which should be the result of compiling and
+  /// optimizing 'requests' with the options given to the constructor, to the
+  /// directory.  A failure to write (e.g. because the directory does not
+  /// exist) is not an error; it is warned about the first time.
+  void Write(const std::vector<const ComputationRequest*> &requests,
+             const NnetComputation &computation);
+
+  /// Outputs the left and right context of the model, as computed by
+  /// ComputeSimpleNnetContext() (see nnet-utils.h), which can take a while
+  /// for large models.  They are read from the directory if they are there,
+  /// and otherwise computed and written to it.
+  void GetSimpleNnetContext(int32 *nnet_left_context,
+                            int32 *nnet_right_context);
+
+  /// The version of the files in the directory.  It is part of the hash in the
+  /// filenames, and is checked when they are read.  It must be increased
+  /// whenever a change to the compiler or optimizer changes the computations
+  /// they produce, or the format of NnetComputation, ComputationRequest or
+  /// NnetOptimizeOptions on disk changes.
+  static const int32 kVersion = 1;
+
+ private:
+  // Returns a hash of the model, computing it the first time it is called.
+  uint64 ModelKey();
+
+  // Returns the name of the file for these requests.
+  std::string Filename(const std::vector<const ComputationRequest*> &requests);
+
+  // Writes 'contents', after a binary-mode header, to 'filename' (via a
+  // temporary file which is renamed).
+  void WriteFile(const std::string &filename, const std::string &contents);
+
+  std::string dir_;
+  const Nnet &nnet_;
+  NnetOptimizeOptions opt_config_;
+
+  std::mutex mutex_;  // Guards the following three variables.
+  bool have_model_key_;
+  uint64 model_key_;
+  bool warned_;
+};
+
+
 struct CachingOptimizingCompilerOptions {
   bool use_shortcut;
   int32 cache_capacity;
+  std::string cache_dir;
 
   CachingOptimizingCompilerOptions():
       use_shortcut(true),
@@ -208,6 +301,12 @@ struct CachingOptimizingCompilerOptions {
     opts->Register("cache-capacity", &cache_capacity,
                    "Determines how many computations the computation-cache will "
                    "store (most-recently-used).");
+    opts->Register("cache-dir", &cache_dir,
+                   "If set, a directory in which compiled computations are "
+                   "stored, so that other processes using the same model can "
+                   "read them instead of compiling them again.  It may be "
+                   "shared by processes running in parallel.  See class "
+                   "ComputationDiskCache.");
   }
 };
 
@@ -301,6 +400,9 @@ class CachingOptimizingCompiler {
 
   ComputationCache cache_;
 
+  // Non-NULL if config_.cache_dir is set.
+  ComputationDiskCache *disk_cache_;
+
   // These following two variables are only used by the function GetSimpleNnetContext().
   int32 nnet_left_context_;
   int32 nnet_right_context_;
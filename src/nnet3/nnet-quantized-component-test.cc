@@ -0,0 +1,258 @@
+// nnet3/nnet-quantized-component-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/decodable-simple-looped.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns the norm of (a - b) relative to the norm of a.
+static BaseFloat RelativeDifference(const MatrixBase<BaseFloat> &a,
+                                    const MatrixBase<BaseFloat> &b) {
+  Matrix<BaseFloat> diff(a);
+  diff.AddMat(-1.0, b);
+  return diff.FrobeniusNorm() / a.FrobeniusNorm();
+}
+
+static Component *ComponentFromConfig(const std::string &config) {
+  ConfigLine cfl;
+  KALDI_ASSERT(cfl.ParseLine(config));
+  Component *c = Component::NewComponentOfType(cfl.FirstToken());
+  KALDI_ASSERT(c != NULL);
+  c->InitFromConfig(&cfl);
+  return c;
+}
+
+// Writes and reads 'c', and checks that the copy computes the same output (up
+// to the precision of the text format).
+static void TestQuantizedComponentIo(const Component &c,
+                                     const CuMatrixBase<BaseFloat> &in) {
+  bool binary = (Rand() % 2 == 0);
+  std::ostringstream os;
+  c.Write(os, binary);
+  std::istringstream is(os.str());
+  Component *c2 = Component::ReadNew(is, binary);
+  Component *c3 = c2->Copy();
+  KALDI_ASSERT(c2->Info() == c.Info() && c3->Info() == c.Info());
+  CuMatrix<BaseFloat> out(in.NumRows(), c.OutputDim()),
+      out2(in.NumRows(), c.OutputDim());
+  c.Propagate(NULL, in, &out);
+  c3->Propagate(NULL, in, &out2);
+  KALDI_ASSERT(Matrix<BaseFloat>(out).ApproxEqual(Matrix<BaseFloat>(out2),
+                                                   1.0e-05));
+  delete c2;
+  delete c3;
+}
+
+// Checks that the quantized versions of affine, linear and fixed-affine
+// components compute nearly the same as the originals.
+void UnitTestQuantizedAffineComponent() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 input_dim = RandInt(1, 300), output_dim = RandInt(1, 200),
+        num_rows = RandInt(1, 100);
+    std::ostringstream config;
+    std::string type = (n % 3 == 0 ? "LinearComponent" :
+                        (n % 3 == 1 ? "AffineComponent" :
+                         "NaturalGradientAffineComponent"));
+    config << type << " input-dim=" << input_dim << " output-dim="
+           << output_dim;
+    Component *c = ComponentFromConfig(config.str()), *quantized;
+    if (type == "LinearComponent") {
+      quantized = new QuantizedAffineComponent(
+          dynamic_cast<const LinearComponent&>(*c));
+    } else if (n % 2 == 0) {
+      FixedAffineComponent fixed(dynamic_cast<const AffineComponent&>(*c));
+      quantized = new QuantizedAffineComponent(fixed);
+    } else {
+      quantized = new QuantizedAffineComponent(
+          dynamic_cast<const AffineComponent&>(*c));
+    }
+    KALDI_LOG << quantized->Info();
+    KALDI_ASSERT(quantized->InputDim() == input_dim &&
+                 quantized->OutputDim() == output_dim);
+
+    CuMatrix<BaseFloat> in(num_rows, input_dim),
+        out(num_rows, output_dim), quantized_out(num_rows, output_dim);
+    in.SetRandn();
+    if (c->Properties() & kPropagateAdds)
+      out.SetZero();
+    c->Propagate(NULL, in, &out);
+    quantized_out.Set(std::numeric_limits<BaseFloat>::quiet_NaN());
+    quantized->Propagate(NULL, in, &quantized_out);
+    BaseFloat diff = RelativeDifference(Matrix<BaseFloat>(out),
+                                        Matrix<BaseFloat>(quantized_out));
+    KALDI_LOG << "Relative difference for " << type << " is " << diff;
+    KALDI_ASSERT(diff < 0.02);
+    TestQuantizedComponentIo(*quantized, in);
+    delete c;
+    delete quantized;
+  }
+}
+
+// Computes the output of 'nnet' for 'input' with two kinds of decodable
+// object.  (The looped one may modify the nnet.)
+static void ComputeNnetOutput(Nnet *nnet,
+                              const Matrix<BaseFloat> &input,
+                              Matrix<BaseFloat> *output,
+                              Matrix<BaseFloat> *looped_output) {
+  int32 num_frames = input.NumRows(), output_dim = nnet->OutputDim("output");
+  Vector<BaseFloat> priors;
+  output->Resize(num_frames, output_dim);
+  looped_output->Resize(num_frames, output_dim);
+  {
+    NnetSimpleComputationOptions opts;
+    opts.frames_per_chunk = RandInt(5, 25);
+    CachingOptimizingCompiler compiler(*nnet);
+    DecodableNnetSimple decodable(opts, *nnet, priors, input, &compiler);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(*output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+  }
+  {
+    NnetSimpleLoopedComputationOptions opts;
+    DecodableNnetSimpleLoopedInfo info(opts, nnet);
+    DecodableNnetSimpleLooped decodable(info, input, NULL);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(*looped_output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+  }
+}
+
+// Checks which components QuantizeNnet() quantizes, that a quantized TDNN
+// computes nearly the same as the original, with the simple and the looped
+// decodable objects, and that it can be written and read.
+void UnitTestQuantizeNnet() {
+  std::string config =
+      "input-node name=input dim=40\n"
+      "component name=lda type=FixedAffineComponent input-dim=40 "
+      "output-dim=40\n"
+      "component-node name=lda component=lda input=input\n"
+      "component name=tdnn1 type=TdnnComponent input-dim=40 output-dim=200 "
+      "time-offsets=-1,0,1\n"
+      "component-node name=tdnn1 component=tdnn1 input=lda\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=200\n"
+      "component-node name=relu1 component=relu1 input=tdnn1\n"
+      "component name=linear2 type=LinearComponent input-dim=200 "
+      "output-dim=64\n"
+      "component-node name=linear2 component=linear2 input=relu1\n"
+      "component name=tdnn3 type=TdnnComponent input-dim=64 output-dim=200 "
+      "time-offsets=-3,0,3 use-bias=false\n"
+      "component-node name=tdnn3 component=tdnn3 input=linear2\n"
+      "component name=relu3 type=RectifiedLinearComponent dim=200\n"
+      "component-node name=relu3 component=relu3 input=tdnn3\n"
+      "component name=affine4 type=NaturalGradientAffineComponent "
+      "input-dim=200 output-dim=100\n"
+      "component-node name=affine4 component=affine4 input=relu3\n"
+      "component name=output.affine type=AffineComponent input-dim=100 "
+      "output-dim=30\n"
+      "component-node name=output.affine component=output.affine "
+      "input=affine4\n";
+  // We compare the outputs of the networks without the log-softmax, since
+  // relative differences of log-probabilities are not very meaningful.
+  std::string output_config = "output-node name=output input=output.affine\n",
+      log_softmax_output_config =
+      "component name=output.log-softmax type=LogSoftmaxComponent dim=30\n"
+      "component-node name=output.log-softmax component=output.log-softmax "
+      "input=output.affine\n"
+      "output-node name=output input=output.log-softmax\n";
+  Nnet nnet, log_softmax_nnet;
+  {
+    std::istringstream is(config + output_config);
+    nnet.ReadConfig(is);
+    std::istringstream is2(config + log_softmax_output_config);
+    log_softmax_nnet.ReadConfig(is2);
+  }
+
+  // By default, lda and output.affine are not quantized.
+  QuantizeNnetConfig default_config, all_config, tdnn_config;
+  all_config.quantize_fixed_affine = true;
+  all_config.quantize_output_layer = true;
+  tdnn_config.components = "tdnn*";
+  Nnet quantized_nnet(nnet), fully_quantized_nnet(nnet);
+  KALDI_ASSERT(QuantizeNnet(default_config, &quantized_nnet) == 4);
+  KALDI_ASSERT(QuantizeNnet(all_config, &fully_quantized_nnet) == 6);
+  Nnet nnet_copy(log_softmax_nnet);
+  KALDI_ASSERT(QuantizeNnet(default_config, &nnet_copy) == 4);
+  KALDI_ASSERT(QuantizeNnet(tdnn_config, &log_softmax_nnet) == 2);
+
+  Matrix<BaseFloat> input(RandInt(10, 100), 40);
+  input.SetRandn();
+  Matrix<BaseFloat> output, looped_output, quantized_output,
+      quantized_looped_output, fully_quantized_output,
+      fully_quantized_looped_output;
+  ComputeNnetOutput(&nnet, input, &output, &looped_output);
+  ComputeNnetOutput(&quantized_nnet, input, &quantized_output,
+                    &quantized_looped_output);
+  ComputeNnetOutput(&fully_quantized_nnet, input, &fully_quantized_output,
+                    &fully_quantized_looped_output);
+  BaseFloat diff = RelativeDifference(output, quantized_output),
+      looped_diff = RelativeDifference(looped_output,
+                                       quantized_looped_output),
+      full_diff = RelativeDifference(output, fully_quantized_output),
+      full_looped_diff = RelativeDifference(looped_output,
+                                            fully_quantized_looped_output);
+  KALDI_LOG << "Relative difference of outputs is " << diff
+            << " (simple), " << looped_diff << " (looped); with all "
+            << "components quantized it is " << full_diff << " (simple), "
+            << full_looped_diff << " (looped)";
+  KALDI_ASSERT(diff < 0.05 && looped_diff < 0.05 &&
+               full_diff < 0.05 && full_looped_diff < 0.05);
+
+  bool binary = (Rand() % 2 == 0);
+  std::ostringstream os;
+  quantized_nnet.Write(os, binary);
+  std::istringstream is(os.str());
+  Nnet nnet2;
+  nnet2.Read(is, binary);
+  KALDI_ASSERT(nnet2.Info() == quantized_nnet.Info());
+  Matrix<BaseFloat> output2, looped_output2;
+  ComputeNnetOutput(&nnet2, input, &output2, &looped_output2);
+  // In text mode the scales are not written exactly, which may change the
+  // rounding of some of the requantized activations.
+  KALDI_ASSERT(output2.ApproxEqual(quantized_output, binary ? 0.0 : 0.01));
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+#if HAVE_CUDA == 1
+  kaldi::int32 loop = 0;
+  for (loop = 0; loop < 2; loop++) {
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestQuantizedAffineComponent();
+    for (int32 i = 0; i < 3; i++)
+      UnitTestQuantizeNnet();
+#if HAVE_CUDA == 1
+  } // No for loop if 'HAVE_CUDA != 1',
+#endif
+  KALDI_LOG << "Quantized component tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,367 @@
+// nnet3/nnet-quantized-component.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iterator>
+#include <sstream>
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-computation-graph.h"
+#include "nnet3/nnet-parse.h"
+#include "matrix/kaldi-gemm.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+QuantizedLinearParams::QuantizedLinearParams(
+    const CuMatrixBase<BaseFloat> &params):
+    num_rows_(params.NumRows()), num_cols_(params.NumCols()),
+    data_(static_cast<size_t>(num_rows_) * num_cols_),
+    scales_(num_rows_) {
+  Matrix<BaseFloat> cpu_params(params);
+  QuantizeRowsInt8(num_rows_, num_cols_, cpu_params.Data(),
+                   cpu_params.Stride(), (data_.empty() ? NULL : &(data_[0])),
+                   num_cols_, scales_.Data());
+}
+
+void QuantizedLinearParams::GetParams(CuMatrixBase<BaseFloat> *params) const {
+  KALDI_ASSERT(params->NumRows() == num_rows_ &&
+               params->NumCols() == num_cols_);
+  Matrix<BaseFloat> cpu_params(num_rows_, num_cols_, kUndefined);
+  for (int32 i = 0; i < num_rows_; i++) {
+    const int8 *row_data = Data() + static_cast<size_t>(i) * num_cols_;
+    BaseFloat scale = scales_(i);
+    BaseFloat *row = cpu_params.RowData(i);
+    for (int32 j = 0; j < num_cols_; j++)
+      row[j] = scale * row_data[j];
+  }
+  params->CopyFromMat(cpu_params);
+}
+
+void QuantizedLinearParams::AddMatParamsTrans(
+    const CuMatrixBase<BaseFloat> &in, int32 col_offset,
+    CuMatrixBase<BaseFloat> *out) const {
+  KALDI_ASSERT(col_offset >= 0 && col_offset + in.NumCols() <= num_cols_ &&
+               in.NumRows() == out->NumRows() && out->NumCols() == num_rows_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuMatrix<BaseFloat> params(num_rows_, num_cols_, kUndefined);
+    GetParams(&params);
+    out->AddMatMat(1.0, in, kNoTrans,
+                   params.ColRange(col_offset, in.NumCols()), kTrans, 1.0);
+    return;
+  }
+#endif
+  int32 num_rows = in.NumRows(), dim = in.NumCols();
+  if (num_rows == 0)
+    return;
+  const MatrixBase<BaseFloat> &in_mat = in.Mat();
+  MatrixBase<BaseFloat> &out_mat = out->Mat();
+  std::vector<int8> in_data(static_cast<size_t>(num_rows) * dim + 1);
+  std::vector<float> in_scales(num_rows);
+  QuantizeRowsInt8(num_rows, dim, in_mat.Data(), in_mat.Stride(),
+                   &(in_data[0]), dim, &(in_scales[0]));
+  Int8Gemm(num_rows, num_rows_, dim, &(in_data[0]), dim, &(in_scales[0]),
+           Data() + col_offset, num_cols_, Scales(), out_mat.Data(),
+           out_mat.Stride());
+}
+
+void QuantizedLinearParams::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<NumRows>");
+  WriteBasicType(os, binary, num_rows_);
+  WriteToken(os, binary, "<NumCols>");
+  WriteBasicType(os, binary, num_cols_);
+  WriteToken(os, binary, "<Scales>");
+  scales_.Write(os, binary);
+  WriteToken(os, binary, "<Values>");
+  WriteIntegerVector(os, binary, data_);
+}
+
+void QuantizedLinearParams::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<NumRows>");
+  ReadBasicType(is, binary, &num_rows_);
+  ExpectToken(is, binary, "<NumCols>");
+  ReadBasicType(is, binary, &num_cols_);
+  ExpectToken(is, binary, "<Scales>");
+  scales_.Read(is, binary);
+  ExpectToken(is, binary, "<Values>");
+  ReadIntegerVector(is, binary, &data_);
+  if (num_rows_ < 0 || num_cols_ < 0 || scales_.Dim() != num_rows_ ||
+      data_.size() != static_cast<size_t>(num_rows_) * num_cols_)
+    KALDI_ERR << "Bad quantized parameters: dimensions do not match.";
+}
+
+
+QuantizedAffineComponent::QuantizedAffineComponent(const AffineComponent &c):
+    linear_params_(c.LinearParams()),
+    bias_params_(c.BiasParams()) { }
+
+QuantizedAffineComponent::QuantizedAffineComponent(const LinearComponent &c):
+    linear_params_(c.Params()) { }
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const FixedAffineComponent &c):
+    linear_params_(c.LinearParams()),
+    bias_params_(c.BiasParams()) { }
+
+std::string QuantizedAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  CuMatrix<BaseFloat> linear_params(OutputDim(), InputDim(), kUndefined);
+  linear_params_.GetParams(&linear_params);
+  PrintParameterStats(stream, "linear-params", linear_params);
+  if (bias_params_.Dim() == 0)
+    stream << ", has-bias=false";
+  else
+    PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  KALDI_ERR << "QuantizedAffineComponent cannot be initialized from a "
+            << "config line; it is created from a trained model by "
+            << "nnet3-quantize.";
+}
+
+void* QuantizedAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  if (bias_params_.Dim() != 0)
+    out->CopyRowsFromVec(bias_params_);
+  else
+    out->SetZero();
+  linear_params_.AddMatParamsTrans(in, 0, out);
+  return NULL;
+}
+
+void QuantizedAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &,  // in_value
+    const CuMatrixBase<BaseFloat> &,  // out_value
+    const CuMatrixBase<BaseFloat> &,  // out_deriv
+    void *memo,
+    Component *,  // to_update
+    CuMatrixBase<BaseFloat> *) const {  // in_deriv
+  KALDI_ERR << "Backprop is not supported for QuantizedAffineComponent "
+            << debug_info << "; quantized models are only for inference.";
+}
+
+Component* QuantizedAffineComponent::Copy() const {
+  QuantizedAffineComponent *ans = new QuantizedAffineComponent();
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedAffineComponent>");
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedAffineComponent>");
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedAffineComponent>",
+                       "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedAffineComponent>");
+  KALDI_ASSERT(bias_params_.Dim() == 0 ||
+               bias_params_.Dim() == linear_params_.NumRows());
+}
+
+
+QuantizedTdnnComponent::QuantizedTdnnComponent(const TdnnComponent &c):
+    time_offsets_(c.time_offsets_),
+    linear_params_(c.linear_params_),
+    bias_params_(c.bias_params_) {
+  Check();
+}
+
+void QuantizedTdnnComponent::Check() const {
+  KALDI_ASSERT(linear_params_.NumRows() > 0 &&
+               !time_offsets_.empty() &&
+               std::set<int32>(time_offsets_.begin(),
+                               time_offsets_.end()).size() ==
+               time_offsets_.size() &&
+               linear_params_.NumCols() % time_offsets_.size() == 0 &&
+               (bias_params_.Dim() == 0 ||
+                bias_params_.Dim() == linear_params_.NumRows()));
+}
+
+std::string QuantizedTdnnComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  stream << ", time-offsets=";
+  for (size_t i = 0; i < time_offsets_.size(); i++) {
+    if (i != 0) stream << ',';
+    stream << time_offsets_[i];
+  }
+  CuMatrix<BaseFloat> linear_params(linear_params_.NumRows(),
+                                    linear_params_.NumCols(), kUndefined);
+  linear_params_.GetParams(&linear_params);
+  PrintParameterStats(stream, "linear-params", linear_params);
+  if (bias_params_.Dim() == 0)
+    stream << ", has-bias=false";
+  else
+    PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void QuantizedTdnnComponent::InitFromConfig(ConfigLine *cfl) {
+  KALDI_ERR << "QuantizedTdnnComponent cannot be initialized from a "
+            << "config line; it is created from a trained model by "
+            << "nnet3-quantize.";
+}
+
+void* QuantizedTdnnComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  const TdnnComponent::PrecomputedIndexes *indexes =
+      dynamic_cast<const TdnnComponent::PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL &&
+               indexes->row_offsets.size() == time_offsets_.size());
+
+  if (bias_params_.Dim() != 0)
+    out->CopyRowsFromVec(bias_params_);
+  else
+    out->SetZero();
+
+  int32 num_offsets = time_offsets_.size(),
+      input_dim = InputDim();
+  for (int32 i = 0; i < num_offsets; i++) {
+    CuSubMatrix<BaseFloat> in_part =
+        TdnnComponent::GetInputPart(in, out->NumRows(), indexes->row_stride,
+                                    indexes->row_offsets[i]);
+    linear_params_.AddMatParamsTrans(in_part, i * input_dim, out);
+  }
+  return NULL;
+}
+
+void QuantizedTdnnComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &,  // in_value
+    const CuMatrixBase<BaseFloat> &,  // out_value
+    const CuMatrixBase<BaseFloat> &,  // out_deriv
+    void *memo,
+    Component *,  // to_update
+    CuMatrixBase<BaseFloat> *) const {  // in_deriv
+  KALDI_ERR << "Backprop is not supported for QuantizedTdnnComponent "
+            << debug_info << "; quantized models are only for inference.";
+}
+
+Component* QuantizedTdnnComponent::Copy() const {
+  QuantizedTdnnComponent *ans = new QuantizedTdnnComponent();
+  ans->time_offsets_ = time_offsets_;
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedTdnnComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedTdnnComponent>");
+  WriteToken(os, binary, "<TimeOffsets>");
+  WriteIntegerVector(os, binary, time_offsets_);
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedTdnnComponent>");
+}
+
+void QuantizedTdnnComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedTdnnComponent>",
+                       "<TimeOffsets>");
+  ReadIntegerVector(is, binary, &time_offsets_);
+  ExpectToken(is, binary, "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedTdnnComponent>");
+  Check();
+}
+
+void QuantizedTdnnComponent::ReorderIndexes(
+    std::vector<Index> *input_indexes,
+    std::vector<Index> *output_indexes) const {
+  using namespace time_height_convolution;
+  ConvolutionComputationIo io;
+  GetComputationIo(*input_indexes, *output_indexes, &io);
+  TdnnComponent::ModifyComputationIo(&io);
+  std::vector<Index> modified_input_indexes,
+      modified_output_indexes;
+  GetIndexesForComputation(io, *input_indexes, *output_indexes,
+                           &modified_input_indexes,
+                           &modified_output_indexes);
+  input_indexes->swap(modified_input_indexes);
+  output_indexes->swap(modified_output_indexes);
+}
+
+void QuantizedTdnnComponent::GetInputIndexes(
+    const MiscComputationInfo &misc_info,
+    const Index &output_index,
+    std::vector<Index> *desired_indexes) const {
+  KALDI_ASSERT(output_index.t != kNoTime);
+  size_t size = time_offsets_.size();
+  desired_indexes->resize(size);
+  for (size_t i = 0; i < size; i++) {
+    (*desired_indexes)[i].n = output_index.n;
+    (*desired_indexes)[i].t = output_index.t + time_offsets_[i];
+    (*desired_indexes)[i].x = output_index.x;
+  }
+}
+
+bool QuantizedTdnnComponent::IsComputable(
+    const MiscComputationInfo &misc_info,
+    const Index &output_index,
+    const IndexSet &input_index_set,
+    std::vector<Index> *used_inputs) const {
+  KALDI_ASSERT(output_index.t != kNoTime);
+  size_t size = time_offsets_.size();
+  Index index(output_index);
+  if (used_inputs != NULL) {
+    used_inputs->clear();
+    used_inputs->reserve(size);
+  }
+  for (size_t i = 0; i < size; i++) {
+    index.t = output_index.t + time_offsets_[i];
+    if (!input_index_set(index))
+      return false;
+    if (used_inputs != NULL)
+      used_inputs->push_back(index);
+  }
+  return true;
+}
+
+ComponentPrecomputedIndexes* QuantizedTdnnComponent::PrecomputeIndexes(
+    const MiscComputationInfo &misc_info,
+    const std::vector<Index> &input_indexes,
+    const std::vector<Index> &output_indexes,
+    bool need_backprop) const {
+  return TdnnComponent::PrecomputeIndexesForOffsets(
+      time_offsets_, input_indexes, output_indexes);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
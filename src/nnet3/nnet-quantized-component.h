@@ -0,0 +1,210 @@
+// nnet3/nnet-quantized-component.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+#define KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-component-itf.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-convolutional-component.h"
+#include <iostream>
+
+namespace kaldi {
+namespace nnet3 {
+
+/// @file  nnet-quantized-component.h
+///
+/// This file contains components for 8-bit integer inference: versions of the
+/// affine, linear and TDNN components whose weights are stored as int8.  They
+/// are created from a trained model by QuantizeNnet() (see nnet-utils.h, and
+/// the program nnet3-quantize), and cannot be trained.
+///
+/// The quantization is symmetric, with one scale per row of the weight matrix
+/// (i.e. per output dimension), chosen after training ("post-training
+/// quantization").  When a quantized component is propagated, each row of its
+/// input (each frame) is quantized in the same way, with its own scale, and
+/// the product is computed by Int8Gemm() (see matrix/kaldi-gemm.h), which sums
+/// the int8 products exactly in int32 and only then scales the sums back to
+/// floating point and adds the bias.  Since the nonlinearities in nnet3 are
+/// separate components, the output of each nonlinearity is requantized in
+/// this way at the input of the next quantized component.
+///
+/// The int8 code is used for CPU computation; on a GPU the weights are
+/// converted back to floating point on every call, which is slow, so on a GPU
+/// the original model should be used.  Backprop() is an error.
+
+
+/// QuantizedLinearParams stores the quantized weight matrix of a quantized
+/// component: int8 values with one scale per row, as produced by
+/// QuantizeRowsInt8().
+class QuantizedLinearParams {
+ public:
+  QuantizedLinearParams(): num_rows_(0), num_cols_(0) { }
+
+  /// Quantizes "params".
+  explicit QuantizedLinearParams(const CuMatrixBase<BaseFloat> &params);
+
+  int32 NumRows() const { return num_rows_; }
+  int32 NumCols() const { return num_cols_; }
+
+  /// Returns the int8 values, which are stored row by row, without padding.
+  const int8 *Data() const { return data_.empty() ? NULL : &(data_[0]); }
+
+  /// Returns the scales of the rows.
+  const float *Scales() const { return scales_.Data(); }
+
+  /// Sets "params" to the weights converted back to floating point; it must
+  /// be NumRows() by NumCols().
+  void GetParams(CuMatrixBase<BaseFloat> *params) const;
+
+  /// Computes out += in params[:, col_offset:col_offset+in.NumCols()]^T,
+  /// quantizing "in" first.  This is what the quantized components use, e.g.
+  /// for AffineComponent col_offset is 0 and in.NumCols() is NumCols().
+  void AddMatParamsTrans(const CuMatrixBase<BaseFloat> &in, int32 col_offset,
+                         CuMatrixBase<BaseFloat> *out) const;
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+ private:
+  int32 num_rows_;
+  int32 num_cols_;
+  std::vector<int8> data_;
+  Vector<float> scales_;
+};
+
+
+/**
+   QuantizedAffineComponent is the quantized version of AffineComponent,
+   NaturalGradientAffineComponent, LinearComponent and FixedAffineComponent:
+   it computes out = in W^T + b, where W is quantized (see
+   QuantizedLinearParams) and the bias b, which is kept in floating point, may
+   be empty.  It is not initialized from a config line; it is created with one
+   of the constructors below, usually by QuantizeNnet().
+ */
+class QuantizedAffineComponent: public Component {
+ public:
+  QuantizedAffineComponent() { }
+  explicit QuantizedAffineComponent(const AffineComponent &c);
+  explicit QuantizedAffineComponent(const LinearComponent &c);
+  explicit QuantizedAffineComponent(const FixedAffineComponent &c);
+
+  virtual std::string Type() const { return "QuantizedAffineComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+  virtual int32 Properties() const { return kSimpleComponent; }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &out_value,
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  const QuantizedLinearParams &LinearParams() const { return linear_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+
+ private:
+  QuantizedLinearParams linear_params_;
+  CuVector<BaseFloat> bias_params_;  // Empty if there is no bias.
+};
+
+
+/**
+   QuantizedTdnnComponent is the quantized version of TdnnComponent.  It has
+   the same time offsets, and the same indexes and precomputed indexes (of
+   type TdnnComponent::PrecomputedIndexes), as the TdnnComponent it was
+   created from; it is not initialized from a config line.
+ */
+class QuantizedTdnnComponent: public Component {
+ public:
+  QuantizedTdnnComponent() { }
+  explicit QuantizedTdnnComponent(const TdnnComponent &c);
+
+  virtual std::string Type() const { return "QuantizedTdnnComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+  virtual int32 Properties() const { return kReordersIndexes; }
+  virtual int32 InputDim() const {
+    return linear_params_.NumCols() / static_cast<int32>(time_offsets_.size());
+  }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &out_value,
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  // The following functions are as for TdnnComponent.
+  virtual void ReorderIndexes(std::vector<Index> *input_indexes,
+                              std::vector<Index> *output_indexes) const;
+  virtual void GetInputIndexes(const MiscComputationInfo &misc_info,
+                               const Index &output_index,
+                               std::vector<Index> *desired_indexes) const;
+  virtual bool IsComputable(const MiscComputationInfo &misc_info,
+                            const Index &output_index,
+                            const IndexSet &input_index_set,
+                            std::vector<Index> *used_inputs) const;
+  virtual ComponentPrecomputedIndexes* PrecomputeIndexes(
+      const MiscComputationInfo &misc_info,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes,
+      bool need_backprop) const;
+
+  const std::vector<int32> &TimeOffsets() const { return time_offsets_; }
+  const QuantizedLinearParams &LinearParams() const { return linear_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+
+ private:
+  void Check() const;
+
+  std::vector<int32> time_offsets_;
+  // The linear parameters; as in TdnnComponent, its NumCols() is the input
+  // dim times time_offsets_.size().
+  QuantizedLinearParams linear_params_;
+  CuVector<BaseFloat> bias_params_;  // Empty if there is no bias.
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif
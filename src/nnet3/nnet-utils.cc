@@ -25,6 +25,7 @@
 #include "nnet3/nnet-normalize-component.h"
 #include "nnet3/nnet-general-component.h"
 #include "nnet3/nnet-convolutional-component.h"
+#include "nnet3/nnet-quantized-component.h"
 #include "nnet3/nnet-parse.h"
 #include "nnet3/nnet-computation-graph.h"
 #include "nnet3/nnet-diagnostics.h"
@@ -480,6 +481,89 @@ void ConvertRepeatedToBlockAffine(Nnet *nnet) {
   }
 }
 
+// Returns true if QuantizeNnet() can quantize components of type 'type'.
+static bool IsQuantizableType(const std::string &type) {
+  return type == "AffineComponent" ||
+      type == "NaturalGradientAffineComponent" ||
+      type == "LinearComponent" ||
+      type == "FixedAffineComponent" ||
+      type == "TdnnComponent";
+}
+
+// Sets (*in_output_layer)[c] to true for the components c of the output layer,
+// i.e. the quantizable components that an output node depends on without
+// going through another quantizable component (e.g. output.affine, which is
+// followed by a log-softmax component), and to false for the others.
+static void FindOutputLayerComponents(const Nnet &nnet,
+                                      std::vector<bool> *in_output_layer) {
+  in_output_layer->clear();
+  in_output_layer->resize(nnet.NumComponents(), false);
+  std::vector<bool> visited(nnet.NumNodes(), false);
+  std::vector<int32> queue;
+  for (int32 n = 0; n < nnet.NumNodes(); n++)
+    if (nnet.IsOutputNode(n))
+      queue.push_back(n);
+  while (!queue.empty()) {
+    int32 n = queue.back();
+    queue.pop_back();
+    if (visited[n])
+      continue;
+    visited[n] = true;
+    const NetworkNode &node = nnet.GetNode(n);
+    if (node.node_type == kDescriptor) {
+      std::vector<int32> dependencies;
+      node.descriptor.GetNodeDependencies(&dependencies);
+      queue.insert(queue.end(), dependencies.begin(), dependencies.end());
+    } else if (node.node_type == kDimRange) {
+      queue.push_back(node.u.node_index);
+    } else if (node.node_type == kComponent) {
+      int32 c = node.u.component_index;
+      if (IsQuantizableType(nnet.GetComponent(c)->Type()))
+        (*in_output_layer)[c] = true;
+      else
+        queue.push_back(n - 1);  // the component-input node.
+    }
+  }
+}
+
+int32 QuantizeNnet(const QuantizeNnetConfig &config, Nnet *nnet) {
+  std::vector<bool> in_output_layer;
+  FindOutputLayerComponents(*nnet, &in_output_layer);
+  int32 num_quantized = 0;
+  for (int32 c = 0; c < nnet->NumComponents(); c++) {
+    if (!NameMatchesPattern(nnet->GetComponentName(c).c_str(),
+                            config.components.c_str()) ||
+        (in_output_layer[c] && !config.quantize_output_layer))
+      continue;
+    const Component *comp = nnet->GetComponent(c);
+    std::string type = comp->Type();
+    Component *quantized = NULL;
+    if (type == "AffineComponent" ||
+        type == "NaturalGradientAffineComponent") {
+      // N.B.: NaturalGradientAffineComponent is a subclass of
+      // AffineComponent.
+      quantized = new QuantizedAffineComponent(
+          dynamic_cast<const AffineComponent&>(*comp));
+    } else if (type == "LinearComponent") {
+      quantized = new QuantizedAffineComponent(
+          dynamic_cast<const LinearComponent&>(*comp));
+    } else if (type == "FixedAffineComponent" &&
+               config.quantize_fixed_affine) {
+      quantized = new QuantizedAffineComponent(
+          dynamic_cast<const FixedAffineComponent&>(*comp));
+    } else if (type == "TdnnComponent") {
+      quantized = new QuantizedTdnnComponent(
+          dynamic_cast<const TdnnComponent&>(*comp));
+    }
+    if (quantized != NULL) {
+      // the following call deletes the original component.
+      nnet->SetComponent(c, quantized);
+      num_quantized++;
+    }
+  }
+  return num_quantized;
+}
+
 std::string NnetInfo(const Nnet &nnet) {
   std::ostringstream ostr;
   if (IsSimpleNnet(nnet)) {
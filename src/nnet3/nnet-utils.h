@@ -156,6 +156,44 @@ void FreezeNaturalGradient(bool freeze, Nnet *nnet);
 /// NaturalGradientRepeatedAffineComponent to BlockAffineComponent in nnet.
 void ConvertRepeatedToBlockAffine(Nnet *nnet);
 
+/// Configuration for QuantizeNnet().
+struct QuantizeNnetConfig {
+  std::string components;
+  bool quantize_fixed_affine;
+  bool quantize_output_layer;
+  QuantizeNnetConfig(): components("*"),
+                        quantize_fixed_affine(false),
+                        quantize_output_layer(false) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("components", &components,
+                   "Pattern (with wildcard '*') of the names of the components "
+                   "to quantize, e.g. 'tdnn*'.  Only components of type "
+                   "AffineComponent, NaturalGradientAffineComponent, "
+                   "LinearComponent, TdnnComponent and (see "
+                   "--quantize-fixed-affine) FixedAffineComponent are "
+                   "quantized, and (see --quantize-output-layer) not those of "
+                   "the output layer.");
+    opts->Register("quantize-fixed-affine", &quantize_fixed_affine,
+                   "If true, also quantize components of type "
+                   "FixedAffineComponent, such as the LDA-like transform at "
+                   "the input, which sees the raw features.");
+    opts->Register("quantize-output-layer", &quantize_output_layer,
+                   "If true, also quantize the components of the output layer "
+                   "(e.g. output.affine), whose errors go straight into the "
+                   "log-likelihoods.  These are the affine, linear and TDNN "
+                   "components that an output node depends on without going "
+                   "through another such component.");
+  }
+};
+
+/// Replaces the components of the nnet selected by 'config' (see
+/// QuantizeNnetConfig) with their int8 versions for inference (see
+/// nnet-quantized-component.h).  Returns the number of components replaced.
+/// Call SetBatchnormTestMode(), SetDropoutTestMode() and CollapseModel()
+/// first, since CollapseModel() cannot merge batch-norm components into
+/// quantized components.
+int32 QuantizeNnet(const QuantizeNnetConfig &config, Nnet *nnet);
+
 /// This function returns various info about the neural net.
 /// If the nnet satisfied IsSimpleNnet(nnet), the info includes "left-context=5\nright-context=3\n...".  The info includes
 /// the output of nnet.Info().
@@ -29,13 +29,35 @@
 namespace kaldi {
 namespace nnet3 {
 
+// Compresses the examples as they are written; with the wspecifier option
+// "bg" this is done in the writer's background threads.  This is equivalent
+// to copying the example and calling Compress(), but it compresses the full
+// matrices directly from "in".
+class ExampleCompressor: public TableWriterPreprocessor<NnetExample> {
+ public:
+  virtual void Preprocess(const NnetExample &in, NnetExample *out) const {
+    out->io.resize(in.io.size());
+    for (size_t i = 0; i < in.io.size(); i++) {
+      const NnetIo &in_io = in.io[i];
+      NnetIo &out_io = out->io[i];
+      out_io.name = in_io.name;
+      out_io.indexes = in_io.indexes;
+      if (in_io.features.Type() == kFullMatrix) {
+        CompressedMatrix cmat(in_io.features.GetFullMatrix());
+        out_io.features.Clear();
+        out_io.features.SwapCompressedMatrix(&cmat);
+      } else {
+        out_io.features = in_io.features;
+      }
+    }
+  }
+};
 
 static bool ProcessFile(const GeneralMatrix &feats,
                         const MatrixBase<BaseFloat> *ivector_feats,
                         int32 ivector_period,
                         const Posterior &pdf_post,
                         const std::string &utt_id,
-                        bool compress,
                         int32 num_pdfs,
                         int32 length_tolerance,
                         UtteranceSplitter *utt_splitter,
@@ -121,9 +143,6 @@ static bool ProcessFile(const GeneralMatrix &feats,
 
     eg.io.push_back(NnetIo("output", num_pdfs, 0, labels, frame_subsampling_factor));
 
-    if (compress)
-      eg.Compress();
-
     std::ostringstream os;
     os << utt_id << "-" << chunk.first_frame;
 
@@ -221,7 +240,10 @@ int main(int argc, char *argv[]) {
     // the feature matrices without uncompressing and re-compressing.
     SequentialGeneralMatrixReader feat_reader(feature_rspecifier);
     RandomAccessPosteriorReader pdf_post_reader(pdf_post_rspecifier);
+    ExampleCompressor compressor;  // must outlive example_writer.
     NnetExampleWriter example_writer(examples_wspecifier);
+    if (compress)
+      example_writer.SetPreprocessor(&compressor);
     RandomAccessBaseFloatMatrixReader online_ivector_reader(
         online_ivector_rspecifier);
 
@@ -260,7 +282,7 @@ int main(int argc, char *argv[]) {
         }
 
         if (!ProcessFile(feats, online_ivector_feats, online_ivector_period,
-                         pdf_post, key, compress, num_pdfs, 
+                         pdf_post, key, num_pdfs, 
                          targets_length_tolerance,
                          &utt_splitter, &example_writer))
           num_err++;
@@ -20,6 +20,51 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-analyze.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Compiles the computation that evaluates the output of a simple nnet for a
+// chunk of 'frames_per_chunk' frames, and prints how much memory it needs.
+void PrintComputationMemoryInfo(const Nnet &nnet, int32 frames_per_chunk,
+                                const CachingOptimizingCompilerOptions &opts) {
+  int32 left_context, right_context;
+  ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+  ComputationRequest request;
+  request.inputs.resize(1);
+  request.inputs[0].name = "input";
+  for (int32 t = -left_context; t < frames_per_chunk + right_context; t++)
+    request.inputs[0].indexes.push_back(Index(0, t, 0));
+  if (nnet.InputDim("ivector") > 0) {
+    request.inputs.resize(2);
+    request.inputs[1].name = "ivector";
+    request.inputs[1].indexes.push_back(Index(0, 0, 0));
+  }
+  request.outputs.resize(1);
+  request.outputs[0].name = "output";
+  for (int32 t = 0; t < frames_per_chunk; t++)
+    request.outputs[0].indexes.push_back(Index(0, t, 0));
+
+  CachingOptimizingCompiler compiler(nnet, opts);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler.Compile(request);
+  int32 num_matrices = computation->matrices.size(), num_in_arena = 0;
+  for (size_t m = 0; m < computation->arena_offsets.size(); m++)
+    if (computation->arena_offsets[m] >= 0)
+      num_in_arena++;
+  std::cout << "memory-frames-per-chunk: " << frames_per_chunk << "\n"
+            << "max-memory-use: " << GetMaxMemoryUse(*computation)
+            << " bytes\n"
+            << "arena-size: " << computation->arena_size << " bytes, for "
+            << num_in_arena << " of " << (num_matrices - 1)
+            << " matrices\n";
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -34,9 +79,19 @@ int main(int argc, char *argv[]) {
         "Usage:  nnet3-info [options] <raw-nnet>\n"
         "e.g.:\n"
         " nnet3-info 0.raw\n"
+        " nnet3-info --memory-frames-per-chunk=150 final.raw\n"
         "See also: nnet3-am-info\n";
 
+    int32 memory_frames_per_chunk = 0;
+    CachingOptimizingCompilerOptions compiler_config;
+
     ParseOptions po(usage);
+    po.Register("memory-frames-per-chunk", &memory_frames_per_chunk,
+                "If >0, compile the computation that evaluates the output "
+                "of a simple nnet for chunks of this many frames, and print "
+                "its peak memory use and the size of the memory arena that "
+                "holds its matrices when computing on CPU.");
+    compiler_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -52,6 +107,15 @@ int main(int argc, char *argv[]) {
 
     std::cout << nnet.Info();
 
+    if (memory_frames_per_chunk > 0) {
+      if (IsSimpleNnet(nnet))
+        PrintComputationMemoryInfo(nnet, memory_frames_per_chunk,
+                                   compiler_config);
+      else
+        KALDI_WARN << "Not printing memory information since the nnet is "
+                   << "not a simple nnet.";
+    }
+
     return 0;
   } catch(const std::exception &e) {
     std::cerr << e.what() << '\n';
@@ -77,7 +77,7 @@ int main(int argc, char *argv[]) {
         " <lattice-wspecifier>\n";
     ParseOptions po(usage);
 
-    bool allow_partial = false;
+    bool allow_partial = false, mmap_fst = false;
     LatticeFasterDecoderConfig decoder_opts;
     NnetBatchComputerOptions compute_opts;
     std::string use_gpu = "yes";
@@ -86,13 +86,18 @@ int main(int argc, char *argv[]) {
     std::string ivector_rspecifier,
         online_ivector_rspecifier,
         utt2spk_rspecifier;
-    int32 online_ivector_period = 0, num_threads = 1;
+    int32 online_ivector_period = 0, num_threads = 1, decoder_batch_size = 1;
     decoder_opts.Register(&po);
     compute_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("mmap-fst", &mmap_fst, "If true and the decoding graph is "
+                "a ConstFst in an ordinary file, memory-map it rather than "
+                "reading it, so that its memory is shared between processes.  "
+                "The graph must have been written with aligned data, e.g. by "
+                "fstconvert --fst_type=const --fst_align=true.");
     po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
                 "iVectors as vectors (i.e. not estimated online); per utterance "
                 "by default, or per speaker if you provide the --utt2spk option.");
@@ -105,6 +110,10 @@ int main(int argc, char *argv[]) {
     po.Register("num-threads", &num_threads, "Number of decoder (i.e. "
                 "graph-search) threads.  The number of model-evaluation threads "
                 "is always 1; this is optimized for use with the GPU.");
+    po.Register("decoder-batch-size", &decoder_batch_size, "If >1, each "
+                "decoder thread decodes this many utterances at a time in "
+                "lockstep, sharing the accesses to the decoding graph between "
+                "them (this uses --flat-hash=true internally).");
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
@@ -159,7 +168,8 @@ int main(int argc, char *argv[]) {
 
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
-    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_rxfilename);
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_rxfilename, true,
+                                                       mmap_fst);
 
     int32 num_success;
     {
@@ -167,7 +177,7 @@ int main(int argc, char *argv[]) {
                                  am_nnet.Priors());
       NnetBatchDecoder decoder(*decode_fst, decoder_opts,
                                trans_model, word_syms, allow_partial,
-                               num_threads, &computer);
+                               num_threads, &computer, decoder_batch_size);
 
       for (; !feature_reader.Done(); feature_reader.Next()) {
         std::string utt = feature_reader.Key();
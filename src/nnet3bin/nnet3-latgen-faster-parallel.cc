@@ -53,7 +53,7 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
 
     Timer timer;
-    bool allow_partial = false;
+    bool allow_partial = false, mmap_fst = false;
     TaskSequencerConfig sequencer_config; // has --num-threads option
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
@@ -70,6 +70,11 @@ int main(int argc, char *argv[]) {
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("mmap-fst", &mmap_fst, "If true and the decoding graph is "
+                "a ConstFst in an ordinary file, memory-map it rather than "
+                "reading it, so that its memory is shared between processes.  "
+                "The graph must have been written with aligned data, e.g. by "
+                "fstconvert --fst_type=const --fst_align=true.");
     po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
                 "iVectors as vectors (i.e. not estimated online); per utterance "
                 "by default, or per speaker if you provide the --utt2spk option.");
@@ -137,7 +142,8 @@ int main(int argc, char *argv[]) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
       // Input FST is just one FST, not a table of FSTs.
-      Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+      Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str, true,
+                                                         mmap_fst);
       timer.Reset();
 
       {
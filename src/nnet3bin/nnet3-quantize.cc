@@ -0,0 +1,107 @@
+// nnet3bin/nnet3-quantize.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Quantize the affine, linear and TDNN components of an nnet3\n"
+        "acoustic model to 8-bit integers, for faster decoding on CPU (see\n"
+        "nnet3/nnet-quantized-component.h).  By default the fixed-affine\n"
+        "components (e.g. LDA) and the output layer are not quantized; see\n"
+        "--quantize-fixed-affine and --quantize-output-layer.  The quantized\n"
+        "model can be used by nnet3-latgen-faster and similar programs, but\n"
+        "cannot be trained.\n"
+        "\n"
+        "Usage:  nnet3-quantize [options] <nnet-in> <nnet-out>\n"
+        "e.g.:\n"
+        " nnet3-quantize final.mdl final_int8.mdl\n"
+        " nnet3-quantize --components='tdnn*' final.mdl final_int8.mdl\n";
+
+    bool binary_write = true,
+        raw = false,
+        prepare_for_test = true;
+    QuantizeNnetConfig quantize_config;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, write only 'raw' neural net "
+                "without transition model and priors.");
+    po.Register("prepare-for-test", &prepare_for_test,
+                "If true, prepares the model for test time before quantizing "
+                "it (sets test mode in dropout and batch-norm components, and "
+                "calls CollapseModel(), which may merge batch-norm into the "
+                "affine components).  Should normally be true.");
+    quantize_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        nnet_wxfilename = po.GetArg(2);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+
+    if (prepare_for_test) {
+      SetBatchnormTestMode(true, &am_nnet.GetNnet());
+      SetDropoutTestMode(true, &am_nnet.GetNnet());
+      CollapseModel(CollapseModelConfig(), &am_nnet.GetNnet());
+    }
+
+    int32 num_quantized = QuantizeNnet(quantize_config, &am_nnet.GetNnet());
+    if (num_quantized == 0)
+      KALDI_WARN << "No components were quantized (no affine, linear or TDNN "
+                 << "components match the pattern '"
+                 << quantize_config.components << "')";
+    else
+      KALDI_LOG << "Quantized " << num_quantized << " components.";
+
+    if (raw) {
+      WriteKaldiObject(am_nnet.GetNnet(), nnet_wxfilename, binary_write);
+    } else {
+      Output ko(nnet_wxfilename, binary_write);
+      trans_model.Write(ko.Stream(), binary_write);
+      am_nnet.Write(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Wrote quantized neural net from " << nnet_rxfilename
+              << " to " << nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -107,12 +107,18 @@ int main(int argc, char *argv[]) {
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
     bool online = true;
+    bool mmap_fst = false;
 
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.  Set to <= 0 "
                 "to use all input in one chunk.");
     po.Register("word-symbol-table", &word_syms_rxfilename,
                 "Symbol table for words [for debug output]");
+    po.Register("mmap-fst", &mmap_fst, "If true and the decoding graph is "
+                "a ConstFst in an ordinary file, memory-map it rather than "
+                "reading it, so that its memory is shared between processes.  "
+                "The graph must have been written with aligned data, e.g. by "
+                "fstconvert --fst_type=const --fst_align=true.");
     po.Register("do-endpointing", &do_endpointing,
                 "If true, apply endpoint detection");
     po.Register("online", &online,
@@ -173,7 +179,8 @@ int main(int argc, char *argv[]) {
                                                         &am_nnet);
 
 
-    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename,
+                                                            true, mmap_fst);
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_rxfilename != "")
@@ -0,0 +1,113 @@
+// util/flat-hash-list-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/flat-hash-list.h"
+#include <map>  // for baseline.
+#include <cstdlib>
+#include <iostream>
+
+namespace kaldi {
+
+template<class Int, class T> void TestFlatHashList() {
+  FlatHashList<Int, T> hash;
+  hash.SetSize(200);
+  std::map<Int, T> m1;
+  for (size_t j = 0; j < 50; j++) {
+    Int key = Rand() % 200;
+    T val = Rand() % 50;
+    m1[key] = val;
+    T *v = hash.Find(key);
+    if (v) *v = val;
+    else  hash.Insert(key, val);
+  }
+
+  std::vector<Int> keys;
+  std::vector<T> vals;
+  std::map<Int, T> m2;
+
+  for (int i = 0; i < 100; i++) {
+    m2.clear();
+    for (typename std::map<Int, T>::const_iterator iter = m1.begin();
+        iter != m1.end();
+        iter++) {
+      m2[iter->first + 1] = iter->second;
+    }
+    std::swap(m1, m2);
+
+    hash.Clear(&keys, &vals);
+    KALDI_ASSERT(keys.size() == vals.size() && hash.NumElements() == 0);
+
+    if (i % 2 == 0)
+      hash.SetSize(100 + Rand() % 100);
+    // else keep the current size; Insert() grows the hash if needed.
+
+    for (size_t j = 0; j < keys.size(); j++)
+      hash.Insert(static_cast<Int>(keys[j] + 1), vals[j]);
+    KALDI_ASSERT(2 * hash.NumElements() <= hash.Size());
+
+    // Now make sure the hash and m1 are the same, and that the order of
+    // insertion was preserved.
+    KALDI_ASSERT(hash.NumElements() == m1.size());
+    for (size_t j = 0; j < hash.NumElements(); j++) {
+      KALDI_ASSERT(hash.Keys()[j] == static_cast<Int>(keys[j] + 1));
+      KALDI_ASSERT(m1[hash.Keys()[j]] == hash.Vals()[j]);
+    }
+
+    for (size_t j = 0; j < 10; j++) {
+      Int key = Rand() % 200;
+      bool found_m1 = (m1.find(key) != m1.end());
+      T *v = hash.Find(key);
+      KALDI_ASSERT((v != NULL) == found_m1);
+      if (found_m1)
+        KALDI_ASSERT(m1[key] == *v);
+    }
+  }
+  hash.Clear();
+  KALDI_ASSERT(hash.NumElements() == 0 && hash.Find(m1.begin()->first) == NULL);
+}
+
+// Checks that Clear() really empties the hash when the epoch counter is used
+// many times, i.e. that stale slots are never found.
+void TestFlatHashListClear() {
+  FlatHashList<int32, int32> hash;
+  hash.SetSize(64);
+  for (int32 i = 0; i < 10000; i++) {
+    int32 key = Rand() % 32;
+    KALDI_ASSERT(hash.Find(key) == NULL);
+    hash.Insert(key, i);
+    KALDI_ASSERT(*hash.Find(key) == i);
+    hash.Clear();
+  }
+}
+
+}  // end namespace kaldi
+
+
+
+int main() {
+  using namespace kaldi;
+  for (size_t i = 0;i < 3;i++) {
+    TestFlatHashList<int, unsigned int>();
+    TestFlatHashList<unsigned int, int>();
+    TestFlatHashList<int16, int32>();
+    TestFlatHashList<char, unsigned char>();
+    TestFlatHashList<unsigned char, int>();
+  }
+  TestFlatHashListClear();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,230 @@
+// util/flat-hash-list.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_FLAT_HASH_LIST_H_
+#define KALDI_UTIL_FLAT_HASH_LIST_H_
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "base/kaldi-common.h"
+
+
+/* This header provides an alternative to HashList (see hash-list.h) for use in
+   decoders.  It serves the same purpose: it stores the elements active on the
+   current frame in a sequence that can be iterated over, together with a hash
+   that indexes them by key, and it allows you to take away the whole sequence
+   and clear the hash in one operation when you move on to the next frame.
+
+   The difference is in how things are stored.  Instead of a linked list of
+   individually allocated elements, the keys and values are kept in two
+   separate arrays in insertion order ("structure of arrays"), so iterating
+   over the elements of a frame touches contiguous memory.  The hash is an
+   open-addressing table with linear probing, whose slots store the key and the
+   position of the element in those arrays; there are no per-element
+   allocations and no pointer chasing.  Clearing the hash is O(1): each slot is
+   stamped with the "epoch" in which it was written, and Clear() just starts a
+   new epoch.
+
+   There is no locking of any kind; like HashList, an object of this type is
+   meant to be used from a single thread.
+
+   See flat-hash-list-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+template<class I, class T> class FlatHashList {
+ public:
+  /// Constructor takes no arguments.  Call SetSize to inform it of the likely
+  /// size.
+  FlatHashList();
+
+  /// Clears the hash and gives the keys and values of the current elements, in
+  /// the order they were inserted, to the user by swapping them into "keys"
+  /// and "vals".  The previous contents of those vectors are discarded, but
+  /// their memory is reused, so if you keep passing in the same vectors there
+  /// are no allocations in the steady state.
+  void Clear(std::vector<I> *keys, std::vector<T> *vals);
+
+  /// Clears the hash and discards the current elements.
+  void Clear();
+
+  /// Returns the number of elements currently stored.
+  inline size_t NumElements() const { return keys_.size(); }
+
+  /// Gives the keys of the current elements, in the order they were inserted.
+  /// The reference is invalidated by Insert() and Clear().
+  inline const std::vector<I> &Keys() const { return keys_; }
+
+  /// Gives the values of the current elements, in the same order as Keys().
+  inline const std::vector<T> &Vals() const { return vals_; }
+
+  /// Find tries to find this key using the hash.  It returns a pointer to the
+  /// corresponding value, which the user is free to modify, or NULL if not
+  /// present.  The pointer is invalidated by Insert() and Clear().
+  inline T *Find(I key);
+
+  /// Insert inserts a new element.  By calling this, the user asserts that it
+  /// is not already present (e.g. Find was called and returned NULL).  The hash
+  /// grows automatically if it becomes more than half full.
+  inline void Insert(I key, T val);
+
+  /// SetSize tells the object how many hash slots to allocate; it is rounded up
+  /// to a power of two.  It should be at least twice the number of elements we
+  /// expect to go in the structure.  Unlike HashList::SetSize(), this may be
+  /// called while the hash is non-empty; it never shrinks the hash.
+  void SetSize(size_t sz);
+
+  /// Returns current number of hash slots.
+  inline size_t Size() const { return hash_size_; }
+
+ private:
+  struct Slot {
+    I key;
+    int32 index;  // index into keys_ and vals_.
+    uint32 epoch;  // the slot is empty unless this equals epoch_.
+  };
+
+  inline size_t Hash(I key) const {
+    // Fibonacci hashing: the high bits of the product are well mixed even if
+    // the keys are consecutive integers, as they tend to be for FST states.
+    return static_cast<size_t>(
+        (static_cast<uint64>(key) * 11400714819323198485ULL) >> shift_);
+  }
+
+  // Reallocates the slots with "sz" (a power of two) slots, and reinserts the
+  // current elements.
+  void Rehash(size_t sz);
+
+  // Makes all the slots empty.
+  void NewEpoch();
+
+  std::vector<I> keys_;  // keys of the current elements, in insertion order.
+  std::vector<T> vals_;  // values of the current elements, in insertion order.
+
+  std::vector<Slot> slots_;
+  size_t hash_size_;  // number of slots; a power of two.
+  size_t mask_;  // hash_size_ - 1.
+  int32 shift_;  // 64 - log2(hash_size_).
+  uint32 epoch_;
+};
+
+
+template<class I, class T>
+FlatHashList<I, T>::FlatHashList(): hash_size_(0), mask_(0), shift_(64),
+                                    epoch_(1) {
+  Rehash(16);
+}
+
+template<class I, class T>
+void FlatHashList<I, T>::Clear(std::vector<I> *keys, std::vector<T> *vals) {
+  keys->swap(keys_);
+  vals->swap(vals_);
+  keys_.clear();
+  vals_.clear();
+  NewEpoch();
+}
+
+template<class I, class T>
+void FlatHashList<I, T>::Clear() {
+  keys_.clear();
+  vals_.clear();
+  NewEpoch();
+}
+
+template<class I, class T>
+void FlatHashList<I, T>::NewEpoch() {
+  epoch_++;
+  if (epoch_ == 0) {
+    // The counter wrapped around; old stamps could now look valid, so really
+    // clear the slots.
+    Slot empty;
+    empty.key = I();
+    empty.index = -1;
+    empty.epoch = 0;
+    std::fill(slots_.begin(), slots_.end(), empty);
+    epoch_ = 1;
+  }
+}
+
+template<class I, class T>
+inline T *FlatHashList<I, T>::Find(I key) {
+  for (size_t h = Hash(key); ; h = (h + 1) & mask_) {
+    const Slot &slot = slots_[h];
+    if (slot.epoch != epoch_)
+      return NULL;
+    if (slot.key == key)
+      return &(vals_[slot.index]);
+  }
+}
+
+template<class I, class T>
+inline void FlatHashList<I, T>::Insert(I key, T val) {
+  if (2 * (keys_.size() + 1) > hash_size_)
+    Rehash(2 * hash_size_);
+  size_t h = Hash(key);
+  while (slots_[h].epoch == epoch_)
+    h = (h + 1) & mask_;
+  Slot &slot = slots_[h];
+  slot.key = key;
+  slot.index = static_cast<int32>(keys_.size());
+  slot.epoch = epoch_;
+  keys_.push_back(key);
+  vals_.push_back(val);
+}
+
+template<class I, class T>
+void FlatHashList<I, T>::SetSize(size_t sz) {
+  size_t new_size = 16;
+  while (new_size < sz)
+    new_size *= 2;
+  if (new_size > hash_size_)
+    Rehash(new_size);
+}
+
+template<class I, class T>
+void FlatHashList<I, T>::Rehash(size_t sz) {
+  KALDI_ASSERT(sz > 0 && (sz & (sz - 1)) == 0 &&
+               sz <= static_cast<size_t>(std::numeric_limits<int32>::max()));
+  hash_size_ = sz;
+  mask_ = sz - 1;
+  shift_ = 64;
+  while (sz > 1) {
+    sz >>= 1;
+    shift_--;
+  }
+  Slot empty;
+  empty.key = I();
+  empty.index = -1;
+  empty.epoch = 0;
+  slots_.assign(hash_size_, empty);
+  epoch_ = 1;
+  for (size_t i = 0; i < keys_.size(); i++) {
+    size_t h = Hash(keys_[i]);
+    while (slots_[h].epoch == epoch_)
+      h = (h + 1) & mask_;
+    slots_[h].key = keys_[i];
+    slots_[h].index = static_cast<int32>(i);
+    slots_[h].epoch = epoch_;
+  }
+}
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_FLAT_HASH_LIST_H_
@@ -0,0 +1,62 @@
+// util/kaldi-mmap-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include "util/kaldi-mmap.h"
+
+namespace kaldi {
+
+void UnitTestMappedFileRegion() {
+  if (!MappedFileRegion::Supported())
+    return;
+  std::string filename = "tmpf.mmap";
+  int32 file_size = RandInt(1, 30000);
+  std::vector<char> contents(file_size);
+  for (int32 i = 0; i < file_size; i++)
+    contents[i] = static_cast<char>(RandInt(0, 255));
+  {
+    std::ofstream os(filename.c_str(), std::ios::binary);
+    os.write(&(contents[0]), file_size);
+    KALDI_ASSERT(os.good());
+  }
+  MappedFileRegion region;
+  for (int32 i = 0; i < 10; i++) {
+    // Use arbitrary (unaligned) offsets.
+    int64 offset = RandInt(0, file_size - 1),
+        size = RandInt(0, file_size - offset);
+    KALDI_ASSERT(region.Open(filename, offset, size));
+    KALDI_ASSERT(region.IsOpen() && region.Size() == size);
+    if (size > 0)
+      KALDI_ASSERT(memcmp(region.Data(), &(contents[offset]), size) == 0);
+  }
+  // Regions that go past the end of the file must fail.
+  KALDI_ASSERT(!region.Open(filename, file_size - 1, 2));
+  KALDI_ASSERT(!region.IsOpen());
+  KALDI_ASSERT(!region.Open("tmpf.does-not-exist", 0, 1));
+  unlink(filename.c_str());
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    UnitTestMappedFileRegion();
+  std::cout << "Test OK.\n";
+}
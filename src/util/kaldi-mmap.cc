@@ -0,0 +1,103 @@
+// util/kaldi-mmap.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/kaldi-mmap.h"
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstring>
+
+namespace kaldi {
+
+#ifndef _MSC_VER
+
+bool MappedFileRegion::Supported() { return true; }
+
+bool MappedFileRegion::Open(const std::string &filename, int64 offset,
+                            int64 size) {
+  Close();
+  KALDI_ASSERT(offset >= 0 && size >= 0);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    KALDI_WARN << "Could not open " << filename << " for mapping: "
+               << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      offset + size > static_cast<int64>(st.st_size)) {
+    KALDI_WARN << "Cannot map bytes " << offset << " to " << (offset + size)
+               << " of " << filename << ": not an ordinary file, or too short.";
+    close(fd);
+    return false;
+  }
+  // mmap() needs the offset to be a multiple of the page size, so we map from
+  // the start of the page that contains "offset".
+  int64 page_size = sysconf(_SC_PAGESIZE),
+      map_offset = offset - offset % page_size;
+  size_t map_size = static_cast<size_t>(offset - map_offset + size);
+  if (map_size == 0) map_size = 1;  // mmap() does not accept zero sizes.
+  void *addr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd,
+                    static_cast<off_t>(map_offset));
+  int mmap_errno = errno;
+  close(fd);  // The mapping stays valid after closing the file.
+  if (addr == MAP_FAILED) {
+    KALDI_WARN << "Could not map " << filename << ": "
+               << strerror(mmap_errno);
+    return false;
+  }
+  map_addr_ = addr;
+  map_size_ = map_size;
+  data_ = static_cast<const char*>(addr) + (offset - map_offset);
+  size_ = static_cast<size_t>(size);
+  return true;
+}
+
+void MappedFileRegion::Close() {
+  if (map_addr_ != NULL) {
+    if (munmap(map_addr_, map_size_) != 0)
+      KALDI_WARN << "munmap() failed: " << strerror(errno);
+  }
+  data_ = NULL;
+  size_ = 0;
+  map_addr_ = NULL;
+  map_size_ = 0;
+}
+
+#else  // _MSC_VER
+
+bool MappedFileRegion::Supported() { return false; }
+
+bool MappedFileRegion::Open(const std::string &filename, int64 offset,
+                            int64 size) {
+  KALDI_WARN << "Memory-mapping files is not supported on this platform.";
+  return false;
+}
+
+void MappedFileRegion::Close() {
+  data_ = NULL;
+  size_ = 0;
+}
+
+#endif  // _MSC_VER
+
+}  // namespace kaldi
@@ -0,0 +1,73 @@
+// util/kaldi-mmap.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_MMAP_H_
+#define KALDI_UTIL_KALDI_MMAP_H_
+
+#include <string>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   MappedFileRegion maps a read-only region of an ordinary file into memory.
+   The pages are shared, via the page cache, with any other process that maps
+   or reads the same file, and they are only read from disk when they are
+   first touched.  This is useful for large, read-only model files (decoding
+   graphs, language models, indexes) that many processes use at the same
+   time.
+
+   The offset of the region does not need to be page-aligned; Data() points to
+   the byte at that offset, so its alignment is that of the offset itself.
+
+   On platforms without mmap() (Windows), Open() always returns false, and the
+   caller is expected to fall back to reading the data.
+*/
+class MappedFileRegion {
+ public:
+  MappedFileRegion(): data_(NULL), size_(0), map_addr_(NULL), map_size_(0) { }
+
+  /// Maps "size" bytes starting at byte "offset" of file "filename" (which
+  /// must be an ordinary file name, not an rxfilename with pipes etc.).
+  /// Returns true on success; on failure prints a warning and returns false.
+  /// Any region that was previously mapped is unmapped first.
+  bool Open(const std::string &filename, int64 offset, int64 size);
+
+  /// Unmaps the region (if any).
+  void Close();
+
+  const char *Data() const { return data_; }
+  size_t Size() const { return size_; }
+  bool IsOpen() const { return data_ != NULL; }
+
+  /// Returns true if this platform supports memory-mapping files.
+  static bool Supported();
+
+  ~MappedFileRegion() { Close(); }
+
+ private:
+  const char *data_;  // The start of the region the user asked for.
+  size_t size_;
+  void *map_addr_;  // The start of the mapping, which is page-aligned.
+  size_t map_size_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedFileRegion);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_MMAP_H_
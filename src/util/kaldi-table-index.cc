@@ -0,0 +1,227 @@
+// util/kaldi-table-index.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <fstream>
+
+#include "util/kaldi-io.h"
+#include "util/kaldi-table-index.h"
+
+namespace kaldi {
+
+namespace {
+
+struct ArchiveIndexHeader {
+  char magic[8];     // "KaldiIdx"
+  int32 version;     // kArchiveIndexVersion
+  int32 byte_order;  // kArchiveIndexByteOrder, in native byte order.
+  int64 archive_size;
+  int64 num_keys;
+  int64 num_buckets;
+  int64 keys_size;
+};
+
+const char kArchiveIndexMagic[8] = { 'K', 'a', 'l', 'd', 'i', 'I', 'd', 'x' };
+const int32 kArchiveIndexVersion = 1;
+const int32 kArchiveIndexByteOrder = 0x01020304;
+
+// The FNV-1a hash; we need a hash function that does not depend on the
+// platform or compiler, as the index is stored on disk.
+inline uint64 HashArchiveKey(const char *key, size_t length) {
+  uint64 hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Returns the size of the file "filename", or -1 if it cannot be opened.
+int64 GetFileSize(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!is.is_open())
+    return -1;
+  is.seekg(0, std::ios::end);
+  std::streamoff size = is.tellg();
+  return is.fail() ? -1 : static_cast<int64>(size);
+}
+
+}  // namespace
+
+std::string ArchiveIndexFilename(const std::string &archive_filename) {
+  return archive_filename + ".idx";
+}
+
+bool ArchiveIndexWriter::Write(const std::string &archive_filename,
+                               int64 archive_size) const {
+  int64 num_buckets = 2;
+  while (num_buckets < 2 * static_cast<int64>(keys_.size()))
+    num_buckets *= 2;
+  std::vector<int64> buckets(num_buckets, 0), entries;
+  entries.reserve(3 * keys_.size());
+  std::string keys;
+  int64 num_keys = 0;
+  for (size_t i = 0; i < keys_.size(); i++) {
+    const std::string &key = keys_[i].first;
+    int64 b = HashArchiveKey(key.data(), key.size()) & (num_buckets - 1);
+    bool duplicate = false;
+    for (; buckets[b] != 0; b = (b + 1) & (num_buckets - 1)) {
+      const int64 *entry = &(entries[3 * (buckets[b] - 1)]);
+      if (entry[2] == static_cast<int64>(key.size()) &&
+          keys.compare(entry[1], entry[2], key) == 0) {
+        duplicate = true;
+        break;
+      }
+    }
+    if (duplicate) {
+      KALDI_WARN << "Key " << key << " appears more than once in archive "
+                 << archive_filename << "; only the first one is indexed.";
+      continue;
+    }
+    entries.push_back(keys_[i].second);
+    entries.push_back(keys.size());
+    entries.push_back(key.size());
+    keys += key;
+    buckets[b] = ++num_keys;
+  }
+
+  ArchiveIndexHeader header;
+  memcpy(header.magic, kArchiveIndexMagic, sizeof(header.magic));
+  header.version = kArchiveIndexVersion;
+  header.byte_order = kArchiveIndexByteOrder;
+  header.archive_size = archive_size;
+  header.num_keys = num_keys;
+  header.num_buckets = num_buckets;
+  header.keys_size = keys.size();
+
+  std::string index_filename = ArchiveIndexFilename(archive_filename);
+  Output ko;
+  if (!ko.Open(index_filename, true, false)) {  // false means no binary header.
+    KALDI_WARN << "Could not open archive index " << index_filename
+               << " for writing.";
+    return false;
+  }
+  std::ostream &os = ko.Stream();
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  os.write(reinterpret_cast<const char*>(&(buckets[0])),
+           sizeof(int64) * num_buckets);
+  if (num_keys > 0)
+    os.write(reinterpret_cast<const char*>(&(entries[0])),
+             sizeof(int64) * entries.size());
+  os.write(keys.data(), keys.size());
+  if (!os.good() || !ko.Close()) {
+    KALDI_WARN << "Error writing archive index " << index_filename;
+    return false;
+  }
+  return true;
+}
+
+bool ArchiveIndex::Open(const std::string &archive_filename) {
+  Close();
+  std::string index_filename = ArchiveIndexFilename(archive_filename);
+  int64 index_size = GetFileSize(index_filename),
+      archive_size = GetFileSize(archive_filename);
+  if (index_size < 0) {
+    KALDI_WARN << "Could not open archive index " << index_filename
+               << " (write the archive with the wspecifier option \"idx\" "
+               << "to create it)";
+    return false;
+  }
+  if (index_size < static_cast<int64>(sizeof(ArchiveIndexHeader))) {
+    KALDI_WARN << "Archive index " << index_filename << " is truncated.";
+    return false;
+  }
+  if (MappedFileRegion::Supported() &&
+      region_.Open(index_filename, 0, index_size)) {
+    data_ = region_.Data();
+  } else {
+    std::ifstream is(index_filename.c_str(),
+                     std::ios::in | std::ios::binary);
+    buffer_.resize(index_size);
+    is.read(&(buffer_[0]), index_size);
+    if (!is.good()) {
+      KALDI_WARN << "Error reading archive index " << index_filename;
+      Close();
+      return false;
+    }
+    data_ = &(buffer_[0]);
+  }
+
+  ArchiveIndexHeader header;
+  memcpy(&header, data_, sizeof(header));
+  if (memcmp(header.magic, kArchiveIndexMagic, sizeof(header.magic)) != 0 ||
+      header.version != kArchiveIndexVersion) {
+    KALDI_WARN << index_filename << " is not an archive index (or it was "
+               << "written by a different version of the code).";
+    Close();
+    return false;
+  }
+  if (header.byte_order != kArchiveIndexByteOrder) {
+    KALDI_WARN << "Archive index " << index_filename << " was written on a "
+               << "machine with a different byte order.";
+    Close();
+    return false;
+  }
+  if (index_size != static_cast<int64>(sizeof(header)) +
+      static_cast<int64>(sizeof(int64)) * (header.num_buckets +
+                                           3 * header.num_keys) +
+      header.keys_size || header.num_buckets <= 0 ||
+      (header.num_buckets & (header.num_buckets - 1)) != 0) {
+    KALDI_WARN << "Archive index " << index_filename << " is corrupted.";
+    Close();
+    return false;
+  }
+  if (header.archive_size != archive_size) {
+    KALDI_WARN << "Archive index " << index_filename << " is out of date: "
+               << "it is for an archive of " << header.archive_size
+               << " bytes, but " << archive_filename << " has "
+               << archive_size << " bytes.";
+    Close();
+    return false;
+  }
+  num_keys_ = header.num_keys;
+  num_buckets_ = header.num_buckets;
+  buckets_ = reinterpret_cast<const int64*>(data_ + sizeof(header));
+  entries_ = buckets_ + num_buckets_;
+  keys_ = reinterpret_cast<const char*>(entries_ + 3 * num_keys_);
+  return true;
+}
+
+void ArchiveIndex::Close() {
+  region_.Close();
+  std::vector<char>().swap(buffer_);
+  data_ = NULL;
+  num_keys_ = 0;
+  num_buckets_ = 0;
+}
+
+bool ArchiveIndex::Lookup(const std::string &key, int64 *offset) const {
+  KALDI_ASSERT(IsOpen());
+  int64 mask = num_buckets_ - 1;
+  for (int64 b = HashArchiveKey(key.data(), key.size()) & mask;
+       buckets_[b] != 0; b = (b + 1) & mask) {
+    const int64 *entry = entries_ + 3 * (buckets_[b] - 1);
+    if (entry[2] == static_cast<int64>(key.size()) &&
+        memcmp(keys_ + entry[1], key.data(), key.size()) == 0) {
+      *offset = entry[0];
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // end namespace kaldi
@@ -0,0 +1,120 @@
+// util/kaldi-table-index.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_TABLE_INDEX_H_
+#define KALDI_UTIL_KALDI_TABLE_INDEX_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "util/kaldi-mmap.h"
+
+namespace kaldi {
+
+/// \addtogroup table_group
+/// @{
+
+/*
+  An archive index is a sidecar file, written next to an archive by TableWriter
+  when the wspecifier has the "idx" option (e.g. "ark,idx:foo.ark" writes
+  foo.ark and foo.ark.idx).  It is a hash table from each key to the byte
+  offset of that key in the archive, so that RandomAccessTableReader (with the
+  rspecifier "ark,idx:foo.ark") can go straight to any object, without reading
+  the archive sequentially or needing it to be sorted.
+
+  The file is native-endian binary, designed to be memory-mapped:
+     header  (see ArchiveIndexHeader in kaldi-table-index.cc)
+     int64 buckets[num_buckets]    (entry index plus one, or 0 if empty)
+     int64 entries[num_keys][3]    (archive offset, key offset, key length)
+     char keys[keys_size]          (the keys, concatenated)
+  The number of buckets is a power of two, at least twice the number of keys,
+  and collisions are resolved by linear probing.  The header records the size
+  of the archive, so we can detect (most) indexes that are out of date.
+*/
+
+/// Returns the name of the index file for archive "archive_filename",
+/// which is archive_filename + ".idx".
+std::string ArchiveIndexFilename(const std::string &archive_filename);
+
+/// Collects the keys and offsets of an archive as it is written, and writes
+/// them out as an index.
+class ArchiveIndexWriter {
+ public:
+  ArchiveIndexWriter() { }
+
+  /// Records that the object with key "key" starts at byte "offset" of the
+  /// archive (this is the offset of the key itself).
+  void Add(const std::string &key, int64 offset) {
+    keys_.push_back(std::make_pair(key, offset));
+  }
+
+  /// Writes the index of archive "archive_filename", whose size is
+  /// "archive_size", to ArchiveIndexFilename(archive_filename).  If a key
+  /// was added more than once, the first occurrence is indexed.  Returns true
+  /// on success; on failure prints a warning and returns false.
+  bool Write(const std::string &archive_filename, int64 archive_size) const;
+
+  void Clear() { keys_.clear(); }
+
+ private:
+  std::vector<std::pair<std::string, int64> > keys_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ArchiveIndexWriter);
+};
+
+/// Looks up keys in the index of an archive.  The index is memory-mapped where
+/// possible (otherwise it is read into memory), so opening it takes constant
+/// time and lookups only touch the pages they need.
+class ArchiveIndex {
+ public:
+  ArchiveIndex(): data_(NULL), num_keys_(0), num_buckets_(0) { }
+
+  /// Opens the index of archive "archive_filename" (an ordinary file name).
+  /// Returns true on success; on failure (including if the index does not
+  /// exist or does not match the size of the archive) prints a warning and
+  /// returns false.
+  bool Open(const std::string &archive_filename);
+
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL; }
+
+  /// If "key" is in the archive, sets "offset" to the byte offset of the key
+  /// in the archive and returns true; otherwise returns false.
+  bool Lookup(const std::string &key, int64 *offset) const;
+
+  int64 NumKeys() const { return num_keys_; }
+
+  ~ArchiveIndex() { Close(); }
+
+ private:
+  MappedFileRegion region_;
+  std::vector<char> buffer_;  // Used if we could not map the index.
+  const char *data_;          // The index file: region_.Data() or &buffer_[0].
+  int64 num_keys_;
+  int64 num_buckets_;
+  const int64 *buckets_;
+  const int64 *entries_;
+  const char *keys_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ArchiveIndex);
+};
+
+/// @} end "addtogroup table_group"
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_TABLE_INDEX_H_
@@ -24,8 +24,13 @@
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
 #include <algorithm>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #include <errno.h>
@@ -33,6 +38,7 @@
 #include "util/kaldi-holder.h"
 #include "util/text-utils.h"
 #include "util/stl-utils.h"  // for StringHasher.
+#include "util/kaldi-table-index.h"
 #include "util/kaldi-semaphore.h"
 
 
@@ -193,6 +199,15 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
     // suppressing compiler warnings by casting to void.  It will cause the
     // program to die with KALDI_ERR if we couldn't get a value.
     (void) Value();
+    TrySwapHolder(other_holder);
+  }
+
+  // This is as SwapHolder(), but if the object could not be loaded it returns
+  // false (after printing a warning) instead of dying.  It is used by
+  // SequentialTableReaderBackgroundImpl when it has several threads.
+  bool TrySwapHolder(Holder *other_holder) {
+    if (!EnsureObjectLoaded())
+      return false;
     // At this point we know that we successfully loaded an object,
     // and if there was a range specified, it's in range_holder_.
     if (state_ == kHaveObject) {
@@ -208,6 +223,7 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
     // Note: after this call there may be some junk left in range_holder_ or
     // holder_, but it won't matter.  We avoid calling Clear() on them, as this
     // function needs to be lightweight for the 'bg' feature to work well.
+    return true;
   }
 
   // Next goes to the next object.
@@ -696,8 +712,14 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
   } state_;
 };
 
-// this is for when someone adds the 'th' modifier; it wraps around the basic
-// implementation and allows it to do the reading in a background thread.
+// This is for when someone adds the 'bg' modifier (or 'bg=N', 'bgthreads=M');
+// it wraps around the basic implementation and does the reading in background
+// threads, which fill a queue of up to N objects: entry i of the input goes in
+// slot i % N.  With one thread, the thread uses the basic implementation we
+// were constructed with.  With M > 1 threads (scp input only), each thread
+// opens the scp file itself and loads the entries i with i % M equal to its
+// thread index; skipping the other threads' scp lines is cheap, as the objects
+// are only loaded when asked for.
 template<class Holder>
 class SequentialTableReaderBackgroundImpl:
       public SequentialTableReaderImplBase<Holder> {
@@ -706,67 +728,134 @@ class SequentialTableReaderBackgroundImpl:
 
   SequentialTableReaderBackgroundImpl(
       SequentialTableReaderImplBase<Holder> *base_reader):
-      base_reader_(base_reader) {}
+      base_reader_(base_reader), permissive_(false), num_consumed_(0),
+      end_index_(std::numeric_limits<int64>::max()), thread_error_(false),
+      closing_(false) { }
 
-  // This function ignores the rxfilename argument.
-  // We use the same function signature as the regular Open(),
-  // for convenience.
-  virtual bool Open(const std::string &rxfilename) {
+  // "rspecifier" is the rspecifier the base reader was opened with; we need it
+  // to get the options, and the scp filename if there are several threads.
+  virtual bool Open(const std::string &rspecifier) {
     KALDI_ASSERT(base_reader_ != NULL &&
                  base_reader_->IsOpen());  // or code error.
-    {
-      thread_ = std::thread(SequentialTableReaderBackgroundImpl<Holder>::run,
-                            this);
+    RspecifierOptions opts;
+    std::string script_rxfilename;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &script_rxfilename,
+                                           &opts);
+    permissive_ = opts.permissive;
+    int32 num_threads = 1;
+    if (opts.read_threads > 1 && rs == kScriptRspecifier) {
+      if (ClassifyRxfilename(script_rxfilename) == kFileInput)
+        num_threads = opts.read_threads;
+      else
+        KALDI_WARN << "Using one background thread, as the scp file "
+                   << PrintableRxfilename(script_rxfilename)
+                   << " is not an ordinary file (relates to 'bgthreads' "
+                   << "option)";
+    }
+    if (num_threads == 1) {
+      readers_.push_back(base_reader_);
+    } else {
+      // We don't need base_reader_.  The threads open the scp file without the
+      // 'p' option, because in permissive mode Next() loads every object; we
+      // deal with objects that can't be loaded ourselves.
+      base_reader_->Close();
+      delete base_reader_;
+      for (int32 t = 0; t < num_threads; t++) {
+        readers_.push_back(new SequentialTableReaderScriptImpl<Holder>());
+        if (!readers_.back()->Open("scp:" + script_rxfilename)) {
+          for (int32 u = 0; u < t; u++)
+            readers_[u]->Close();
+          DeletePointers(&readers_);
+          readers_.clear();
+          base_reader_ = NULL;
+          return false;
+        }
+      }
     }
+    base_reader_ = NULL;
 
-    if (!base_reader_->Done())
-      Next();
+    int32 num_slots = std::max(opts.read_ahead, num_threads);
+    for (int32 i = 0; i < num_slots; i++)
+      slots_.push_back(new Slot());
+    for (int32 t = 0; t < num_threads; t++)
+      threads_.push_back(
+          std::thread(SequentialTableReaderBackgroundImpl<Holder>::run,
+                      this, t));
+    Next();
     return true;
   }
 
   virtual bool IsOpen() const {
-    // Close() sets base_reader_ to NULL, and we never initialize this object
-    // with a non-open base_reader_, so no need to check if it's open.
-    return base_reader_ != NULL;
-  }
-
-  void RunInBackground() {
+    // Close() clears readers_, and we never initialize this object with a
+    // non-open base_reader_, so no need to check if it's open.
+    return !readers_.empty();
+  }
+
+  // This function is called in background thread "t".  The whole point of the
+  // background threads is that we don't want to do the actual reading (inside
+  // Next() and SwapHolder()) in the foreground.
+  void RunInBackground(int32 t) {
+    SequentialTableReaderImplBase<Holder> *reader = readers_[t];
+    int32 num_threads = readers_.size(), num_slots = slots_.size();
+    int64 i = t;  // the index of the entry this thread is working on.
     try {
-      // This function is called in the background thread.  The whole point of
-      // the background thread is that we don't want to do the actual reading
-      // (inside Next()) in the foreground.
-      while (base_reader_ != NULL && !base_reader_->Done()) {
-        consumer_sem_.Signal();
-        // Here is where the consumer process (parent thread) gets to do its
-        // stuff.  Principally it calls SwapHolder()-- a shallow swap that is
-        // cheap.
-        producer_sem_.Wait();
-        // we check that base_reader_ is not NULL in case Close() was
-        // called in the main thread.
-        if (base_reader_ != NULL)
-          base_reader_->Next();   //  here is where the work happens.
+      for (int64 pos = 0; ; i += num_threads) {
+        // pos is the index of the entry that "reader" is at.
+        for (; pos < i && !reader->Done(); pos++)
+          reader->Next();
+        if (reader->Done())
+          break;
+        {
+          // wait till the consumer has taken entry i - num_slots.
+          std::unique_lock<std::mutex> lock(mutex_);
+          while (i >= num_consumed_ + num_slots && !closing_)
+            producer_cond_.wait(lock);
+          if (closing_)
+            return;
+        }
+        // We now own the slot, so don't need the lock to fill it.
+        Slot *slot = slots_[i % num_slots];
+        slot->key = reader->Key();
+        bool ok;
+        try {
+          if (num_threads == 1) {
+            reader->SwapHolder(&(slot->holder));
+            ok = true;
+          } else {
+            ok = static_cast<SequentialTableReaderScriptImpl<Holder>*>(
+                reader)->TrySwapHolder(&(slot->holder));
+          }
+        } catch (...) {
+          // SwapHolder() dies if the object on an scp line could not be read.
+          ok = false;
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          slot->state = (ok ? kFull : (permissive_ ? kSkipped : kFailed));
+        }
+        consumer_cond_.notify_one();
+        // Note: we can't call Done() on an archive reader after SwapHolder()
+        // till we call Next().
+        reader->Next();
+        pos++;
       }
-      // this signal will be waited on in the Next() function of the foreground
-      // thread if it is still running, or Close() otherwise.
-      consumer_sem_.Signal();
-      // this signal may be waited on in Close().
-      consumer_sem_.Signal();
     } catch (...) {
       // There is nothing we called above that could potentially throw due to
-      // user data.  So we treat reaching this point as a code-error condition.
-      // Closing base_reader_ will trigger an exception in Next() in the main
-      // thread when it checks that base_reader_->IsOpen().
-      if (base_reader_->IsOpen()) {
-        base_reader_->Close();
-        delete base_reader_;
-        base_reader_ = NULL;
-      }
-      consumer_sem_.Signal();
-      return;
+      // user data.  So we treat reaching this point as a code-error condition,
+      // which Next() in the main thread will report.
+      std::lock_guard<std::mutex> lock(mutex_);
+      thread_error_ = true;
+    }
+    {
+      // Entry i is past the end of the input.
+      std::lock_guard<std::mutex> lock(mutex_);
+      end_index_ = std::min(end_index_, i);
     }
+    consumer_cond_.notify_one();
   }
-  static void run(SequentialTableReaderBackgroundImpl<Holder> *object) {
-    object->RunInBackground();
+  static void run(SequentialTableReaderBackgroundImpl<Holder> *object,
+                  int32 t) {
+    object->RunInBackground(t);
   }
   virtual bool Done() const {
     return key_.empty();
@@ -795,45 +884,76 @@ class SequentialTableReaderBackgroundImpl:
     holder_.Clear();
   }
   virtual void Next() {
-    consumer_sem_.Wait();
-    if (base_reader_ == NULL || !base_reader_->IsOpen())
-      KALDI_ERR << "Error detected (likely code error) in background "
-                << "reader (',bg' option)";
-    if (base_reader_->Done()) {
-      // there is nothing else to read.
-      key_ = "";
-    } else {
-      key_ = base_reader_->Key();
-      base_reader_->SwapHolder(&holder_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      Slot *slot = slots_[num_consumed_ % slots_.size()];
+      while (slot->state == kEmpty && num_consumed_ < end_index_)
+        consumer_cond_.wait(lock);
+      if (slot->state == kEmpty) {
+        // there is nothing else to read.
+        if (thread_error_)
+          KALDI_ERR << "Error detected (likely code error) in background "
+                    << "reader (',bg' option)";
+        key_ = "";
+        return;
+      }
+      SlotState state = slot->state;
+      slot->state = kEmpty;
+      num_consumed_++;
+      if (state == kFull) {
+        key_.swap(slot->key);
+        holder_.Swap(&(slot->holder));
+      }
+      // this tells the producer threads that the slot is free.
+      producer_cond_.notify_all();
+      if (state == kFull)
+        return;
+      if (state == kFailed)
+        KALDI_ERR << "Failed to load object for key " << slot->key
+                  << " (to suppress this error, add the permissive "
+                  << "(p, ) option to the rspecifier.";
+      // else the object could not be loaded, but we are in permissive mode,
+      // so we go on to the next one.
     }
-    // this Signal() tells the producer thread, in the background,
-    // that it's now safe to read the next value.
-    producer_sem_.Signal();
   }
 
   // note: we can be sure that Close() won't be called twice, as the TableReader
   // object will delete this object after calling Close.
   virtual bool Close() {
-    KALDI_ASSERT(base_reader_ != NULL && thread_.joinable());
-    // wait until the producer thread is idle.
-    consumer_sem_.Wait();
+    KALDI_ASSERT(IsOpen());
+    {
+      // this will cause the producer threads to exit once they have finished
+      // what they are reading.
+      std::lock_guard<std::mutex> lock(mutex_);
+      closing_ = true;
+    }
+    producer_cond_.notify_all();
+    for (size_t t = 0; t < threads_.size(); t++)
+      threads_[t].join();
     bool ans = true;
-    try {
-      ans = base_reader_->Close();
-    } catch (...) {
-      ans = false;
+    for (size_t t = 0; t < readers_.size(); t++) {
+      try {
+        if (!readers_[t]->Close())
+          ans = false;
+      } catch (...) {
+        ans = false;
+      }
     }
-    delete base_reader_;
-    // setting base_reader_ to NULL will cause the loop in the producer thread
-    // to exit.
-    base_reader_ = NULL;
-    producer_sem_.Signal();
-
-    thread_.join();
+    if (!ans && permissive_ && readers_.size() > 1) {
+      // we opened these readers without the 'p' option.
+      KALDI_WARN << "Close() called on scp file with read error, ignoring the"
+          " error because permissive mode specified.";
+      ans = true;
+    }
+    threads_.clear();
+    DeletePointers(&readers_);
+    readers_.clear();
+    DeletePointers(&slots_);
+    slots_.clear();
     return ans;
   }
   ~SequentialTableReaderBackgroundImpl() {
-    if (base_reader_) {
+    if (IsOpen()) {
       if (!Close()) {
         KALDI_ERR << "Error detected closing background reader "
                   << "(relates to ',bg' modifier)";
@@ -841,16 +961,39 @@ class SequentialTableReaderBackgroundImpl:
     }
   }
  private:
+  enum SlotState {
+    kEmpty,    // Free, or being filled by a producer thread.
+    kFull,     // Holds the next object for the consumer.
+    kSkipped,  // The object could not be loaded, and we are in permissive mode.
+    kFailed    // The object could not be loaded.
+  };
+  struct Slot {
+    SlotState state;
+    std::string key;
+    Holder holder;
+    Slot(): state(kEmpty) { }
+  };
+
   std::string key_;
   Holder holder_;
-  // I couldn't figure out what to call these semaphores.  consumer_sem_ is the
-  // one that the consumer (main thread) waits on; producer_sem_ is the one
-  // that the producer (background thread) waits on.
-  Semaphore consumer_sem_;
-  Semaphore producer_sem_;
-  std::thread thread_;
+  // base_reader_ is only used until Open() is called.
   SequentialTableReaderImplBase<Holder> *base_reader_;
-
+  bool permissive_;
+  // one reader per thread.
+  std::vector<SequentialTableReaderImplBase<Holder>*> readers_;
+  std::vector<std::thread> threads_;
+  std::vector<Slot*> slots_;
+
+  // mutex_ protects the variables below, and the states of the slots.
+  // consumer_cond_ is what the consumer (main thread) waits on;
+  // producer_cond_ is what the producers (background threads) wait on.
+  std::mutex mutex_;
+  std::condition_variable consumer_cond_;
+  std::condition_variable producer_cond_;
+  int64 num_consumed_;  // the index of the next entry the consumer will take.
+  int64 end_index_;  // the number of entries, once a producer has seen the end.
+  bool thread_error_;
+  bool closing_;
 };
 
 template<class Holder>
@@ -888,9 +1031,9 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
   if (opts.background) {
     impl_ = new SequentialTableReaderBackgroundImpl<Holder>(
         impl_);
-    if (!impl_->Open("")) {
-      // the rxfilename is ignored in that Open() call.
-      // It should only return false on code error.
+    if (!impl_->Open(rspecifier)) {
+      delete impl_;
+      impl_ = NULL;
       return false;
     }
   }
@@ -981,6 +1124,11 @@ template<class Holder> class TableWriterImplBase {
 
   virtual bool IsOpen() const = 0;
 
+  // Only TableWriterBackgroundImpl does anything with the preprocessor;
+  // otherwise, TableWriter applies it itself.
+  virtual void SetPreprocessor(const TableWriterPreprocessor<T> *preprocessor) {
+  }
+
   // May throw on write error if Close was not called.
   virtual ~TableWriterImplBase() { }
 
@@ -1014,6 +1162,13 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
                                            NULL,
                                            &opts_);
     KALDI_ASSERT(ws == kArchiveWspecifier);  // or wrongly called.
+    if (opts_.index && ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "The \"idx\" option requires the archive to be an actual "
+                 << "file: wspecifier is " << wspecifier;
+      state_ = kUninitialized;
+      return false;
+    }
+    index_writer_.Clear();
 
     if (output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false
                                                       // means no binary header.
@@ -1052,6 +1207,8 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     // state is now kOpen or kWriteError.
     if (!IsToken(key))  // e.g. empty string or has spaces...
       KALDI_ERR << "Using invalid key " << key;
+    if (opts_.index)
+      index_writer_.Add(key, output_.Stream().tellp());
     output_.Stream() << key << ' ';
     if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
       KALDI_WARN << "Write failure to "
@@ -1084,6 +1241,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!this->IsOpen() || !output_.IsOpen())
       KALDI_ERR << "Close called on a stream that was not open."
                 << this->IsOpen() << ", " << output_.IsOpen();
+    int64 archive_size = output_.Stream().tellp();
     bool close_success = output_.Close();
     if (!close_success) {
       KALDI_WARN << "Error closing stream: wspecifier is " << wspecifier_;
@@ -1097,6 +1255,11 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
       return false;
     }
     state_ = kUninitialized;
+    if (opts_.index) {
+      bool ans = index_writer_.Write(archive_wxfilename_, archive_size);
+      index_writer_.Clear();
+      return ans;
+    }
     return true;
   }
 
@@ -1115,6 +1278,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
   WspecifierOptions opts_;
   std::string wspecifier_;
   std::string archive_wxfilename_;
+  ArchiveIndexWriter index_writer_;  // Used if opts_.index.
   enum {               // is stream open?
     kUninitialized,    // no
     kOpen,             // yes
@@ -1307,10 +1471,18 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
                                            &script_wxfilename_,
                                            &opts_);
     KALDI_ASSERT(ws == kBothWspecifier);  // or wrongly called.
-    if (ClassifyWxfilename(archive_wxfilename_) != kFileOutput)
+    if (ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      if (opts_.index) {
+        KALDI_WARN << "The \"idx\" option requires the archive to be an "
+                   << "actual file: wspecifier is " << wspecifier;
+        state_ = kUninitialized;
+        return false;
+      }
       KALDI_WARN << "When writing to both archive and script, the script file "
           "will generally not be interpreted correctly unless the archive is "
           "an actual file: wspecifier = " << wspecifier;
+    }
+    index_writer_.Clear();
 
     if (!archive_output_.Open(archive_wxfilename_, opts_.binary, false)) {
       // false means no binary header.
@@ -1367,6 +1539,8 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     if (!IsToken(key))  // e.g. empty string or has spaces...
       KALDI_ERR << "Using invalid key " << key;
     std::ostream &archive_os = archive_output_.Stream();
+    if (opts_.index)
+      index_writer_.Add(key, archive_os.tellp());
     archive_os << key << ' ';
     typename std::ostream::pos_type archive_os_pos = archive_os.tellp();
     // position at start of Write() to archive.  We will record this in the
@@ -1428,12 +1602,18 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     if (!this->IsOpen())
       KALDI_ERR << "Close called on a stream that was not open.";
     bool close_success = true;
-    if (archive_output_.IsOpen())
+    int64 archive_size = -1;
+    if (archive_output_.IsOpen()) {
+      archive_size = archive_output_.Stream().tellp();
       if (!archive_output_.Close()) close_success = false;
+    }
     if (script_output_.IsOpen())
       if (!script_output_.Close()) close_success = false;
     bool ans = close_success && (state_ != kWriteError);
     state_ = kUninitialized;
+    if (ans && opts_.index)
+      ans = index_writer_.Write(archive_wxfilename_, archive_size);
+    index_writer_.Clear();
     return ans;
   }
 
@@ -1455,6 +1635,7 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
   std::string archive_wxfilename_;
   std::string script_wxfilename_;
   std::string wspecifier_;
+  ArchiveIndexWriter index_writer_;  // Used if opts_.index.
   enum {               // is stream open?
     kUninitialized,    // no
     kOpen,             // yes
@@ -1463,8 +1644,238 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
 };
 
 
+// This is for when someone adds the 'bg' option (or 'bg=N', 'bgthreads=M') to
+// a wspecifier; it wraps around the basic implementation.  Write() copies the
+// object into slot i % N of a queue, where i is its index, and the background
+// threads apply any preprocessor to it and then write it with the basic
+// implementation, taking turns so that the objects are written in order.
+// Not all types that are written to tables can be copied (e.g. AmDiagGmm);
+// for those, Write() applies the preprocessor itself to fill the slot, and
+// if there is no preprocessor it waits for the queue to empty and writes the
+// object directly.
 template<class Holder>
-TableWriter<Holder>::TableWriter(const std::string &wspecifier): impl_(NULL) {
+class TableWriterBackgroundImpl: public TableWriterImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  explicit TableWriterBackgroundImpl(TableWriterImplBase<Holder> *base_writer):
+      base_writer_(base_writer), preprocessor_(NULL), num_queued_(0),
+      num_taken_(0), num_written_(0), write_error_(false), closing_(false) { }
+
+  // Starts the background threads.  "wspecifier" is the wspecifier that the
+  // base writer was opened with; we need it to get the options.
+  virtual bool Open(const std::string &wspecifier) {
+    KALDI_ASSERT(base_writer_ != NULL &&
+                 base_writer_->IsOpen());  // or code error.
+    WspecifierOptions opts;
+    ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
+    int32 num_slots = std::max(opts.write_ahead, opts.write_threads);
+    for (int32 i = 0; i < num_slots; i++)
+      slots_.push_back(new Slot());
+    for (int32 t = 0; t < opts.write_threads; t++)
+      threads_.push_back(
+          std::thread(TableWriterBackgroundImpl<Holder>::run, this));
+    return true;
+  }
+
+  virtual bool IsOpen() const { return base_writer_ != NULL; }
+
+  virtual void SetPreprocessor(const TableWriterPreprocessor<T> *preprocessor) {
+    // The objects already queued will still be preprocessed with the old
+    // preprocessor.
+    std::lock_guard<std::mutex> lock(mutex_);
+    preprocessor_ = preprocessor;
+  }
+
+  virtual bool Write(const std::string &key, const T &value) {
+    size_t num_slots = slots_.size();
+    const TableWriterPreprocessor<T> *preprocessor;
+    {
+      // wait till object num_queued_ - num_slots has been written.
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (num_queued_ >= num_written_ + static_cast<int64>(num_slots) &&
+             !write_error_)
+        caller_cond_.wait(lock);
+      if (write_error_)
+        return false;  // The base writer will have printed a warning.
+      preprocessor = preprocessor_;
+    }
+    // Only this thread changes num_queued_, and the background threads don't
+    // look at this slot till we increment it, so we don't need the lock here.
+    Slot *slot = slots_[num_queued_ % num_slots];
+    if (!FillSlot(value, preprocessor, slot,
+                  typename std::is_copy_assignable<T>::type()))
+      return WriteDirectly(key, value);
+    slot->key = key;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_queued_++;
+    }
+    thread_cond_.notify_all();
+    return true;
+  }
+
+  // This function is called in the background threads.
+  void RunInBackground() {
+    size_t num_slots = slots_.size();
+    while (true) {
+      int64 i;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (num_taken_ == num_queued_ && !closing_)
+          thread_cond_.wait(lock);
+        if (num_taken_ == num_queued_)
+          return;  // We are closing and there is nothing left to write.
+        i = num_taken_++;
+      }
+      Slot *slot = slots_[i % num_slots];
+      bool ok = true;
+      if (slot->preprocessor != NULL) {
+        try {
+          slot->preprocessor->Preprocess(slot->value, &(slot->preprocessed));
+        } catch (...) {
+          ok = false;
+          KALDI_WARN << "Error preprocessing object with key " << slot->key;
+        }
+      }
+      {
+        // wait for our turn to write.
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (num_written_ != i)
+          thread_cond_.wait(lock);
+      }
+      try {
+        ok = ok && base_writer_->Write(slot->key, slot->use_preprocessed ?
+                                       slot->preprocessed : slot->value);
+      } catch (...) {
+        ok = false;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_written_++;
+        if (!ok)
+          write_error_ = true;
+      }
+      thread_cond_.notify_all();
+      caller_cond_.notify_one();
+    }
+  }
+  static void run(TableWriterBackgroundImpl<Holder> *object) {
+    object->RunInBackground();
+  }
+
+  // This waits till everything that was queued has been written, so it has
+  // the same meaning as without the 'bg' option.
+  virtual void Flush() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (num_written_ != num_queued_)
+        caller_cond_.wait(lock);
+    }
+    base_writer_->Flush();
+  }
+
+  virtual bool Close() {
+    if (!IsOpen())
+      KALDI_ERR << "Close called on a stream that was not open.";
+    {
+      // this will cause the background threads to exit once they have written
+      // everything.
+      std::lock_guard<std::mutex> lock(mutex_);
+      closing_ = true;
+    }
+    thread_cond_.notify_all();
+    for (size_t t = 0; t < threads_.size(); t++)
+      threads_[t].join();
+    threads_.clear();
+    bool ans = base_writer_->Close() && !write_error_;
+    delete base_writer_;
+    base_writer_ = NULL;
+    DeletePointers(&slots_);
+    slots_.clear();
+    return ans;
+  }
+
+  virtual ~TableWriterBackgroundImpl() {
+    if (IsOpen() && !Close())
+      KALDI_ERR << "Error closing background writer (relates to ',bg' "
+                << "option)";
+  }
+ private:
+  struct Slot {
+    std::string key;
+    T value;  // A copy of the object, if T is copyable.
+    T preprocessed;  // The object after preprocessing.
+    // The preprocessor that the background thread should apply to "value" to
+    // get "preprocessed", or NULL.
+    const TableWriterPreprocessor<T> *preprocessor;
+    bool use_preprocessed;  // If true, we write "preprocessed", else "value".
+    Slot(): preprocessor(NULL), use_preprocessed(false) { }
+  };
+
+  // Puts the object in "slot" for the background threads, for copyable T.
+  // Returns true.
+  bool FillSlot(const T &value,
+                const TableWriterPreprocessor<T> *preprocessor,
+                Slot *slot, std::true_type) {
+    slot->value = value;
+    slot->preprocessor = preprocessor;
+    slot->use_preprocessed = (preprocessor != NULL);
+    return true;
+  }
+
+  // Puts the object in "slot" for the background threads, for T that cannot
+  // be copied.  If there is a preprocessor we apply it here, as it is the
+  // only way to get the object into the slot; otherwise we return false, and
+  // the caller has to write the object itself.
+  bool FillSlot(const T &value,
+                const TableWriterPreprocessor<T> *preprocessor,
+                Slot *slot, std::false_type) {
+    if (preprocessor == NULL)
+      return false;
+    preprocessor->Preprocess(value, &(slot->preprocessed));
+    slot->preprocessor = NULL;
+    slot->use_preprocessed = true;
+    return true;
+  }
+
+  // Waits until everything that was queued has been written, and then writes
+  // "value" with the base writer; this is for objects that we could not put
+  // in the queue (see FillSlot()).
+  bool WriteDirectly(const std::string &key, const T &value) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (num_written_ != num_queued_ && !write_error_)
+        caller_cond_.wait(lock);
+      if (write_error_)
+        return false;
+    }
+    // The background threads are all idle until we queue something else.
+    return base_writer_->Write(key, value);
+  }
+
+  TableWriterImplBase<Holder> *base_writer_;
+  std::vector<std::thread> threads_;
+  std::vector<Slot*> slots_;
+
+  // mutex_ protects the variables below.  caller_cond_ is what the main thread
+  // waits on; thread_cond_ is what the background threads wait on.
+  std::mutex mutex_;
+  std::condition_variable caller_cond_;
+  std::condition_variable thread_cond_;
+  const TableWriterPreprocessor<T> *preprocessor_;
+  int64 num_queued_;   // the number of objects Write() has put in the queue.
+  int64 num_taken_;    // the number of objects the background threads have
+                       // started on.
+  int64 num_written_;  // the number of objects written by base_writer_.
+  bool write_error_;
+  bool closing_;
+};
+
+
+template<class Holder>
+TableWriter<Holder>::TableWriter(const std::string &wspecifier):
+    impl_(NULL), preprocessor_(NULL), background_(false) {
   if (wspecifier != "" && !Open(wspecifier))
     KALDI_ERR << "Failed to open table for writing with wspecifier: " << wspecifier
               << ": errno (in case it's relevant) is: " << strerror(errno);
@@ -1483,7 +1894,8 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDI_ERR << "Failed to close previously open writer.";
   }
   KALDI_ASSERT(impl_ == NULL);
-  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, NULL);
+  WspecifierOptions opts;
+  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
   switch (wtype) {
     case kBothWspecifier:
       impl_ = new TableWriterBothImpl<Holder>();
@@ -1499,6 +1911,16 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       return false;
   }
   if (impl_->Open(wspecifier)) {
+    background_ = opts.background;
+    if (background_) {
+      impl_ = new TableWriterBackgroundImpl<Holder>(impl_);
+      if (!impl_->Open(wspecifier)) {  // Should only fail on code error.
+        delete impl_;
+        impl_ = NULL;
+        return false;
+      }
+      impl_->SetPreprocessor(preprocessor_);
+    }
     return true;
   } else {  // The class will have printed a more specific warning.
     delete impl_;
@@ -1511,12 +1933,28 @@ template<class Holder>
 void TableWriter<Holder>::Write(const std::string &key,
                                 const T &value) const {
   CheckImpl();
-  if (!impl_->Write(key, value))
+  bool ans;
+  if (preprocessor_ != NULL && !background_) {
+    T preprocessed;
+    preprocessor_->Preprocess(value, &preprocessed);
+    ans = impl_->Write(key, preprocessed);
+  } else {
+    ans = impl_->Write(key, value);
+  }
+  if (!ans)
     KALDI_ERR << "Error in TableWriter::Write";
   // More specific warning will have
   // been printed in the Write function.
 }
 
+template<class Holder>
+void TableWriter<Holder>::SetPreprocessor(
+    const TableWriterPreprocessor<T> *preprocessor) {
+  preprocessor_ = preprocessor;
+  if (impl_ != NULL)
+    impl_->SetPreprocessor(preprocessor);
+}
+
 template<class Holder>
 void TableWriter<Holder>::Flush() {
   CheckImpl();
@@ -2501,6 +2939,152 @@ class RandomAccessTableReaderUnsortedArchiveImpl:
 };
 
 
+// RandomAccessTableReaderIndexedArchiveImpl is the implementation for
+// random-access reading of archives that have an index (see
+// kaldi-table-index.h); this is when the "idx" option is given.  It looks up
+// the offset of each key in the index and seeks to it, so it works for any
+// order of the archive and of the calls, and only keeps the most recently read
+// object in memory.
+template<class Holder>
+class RandomAccessTableReaderIndexedArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderIndexedArchiveImpl(): holder_(NULL),
+                                               state_(kUninitialized) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (state_ != kUninitialized) {
+      if (!this->Close())  // call Close() yourself to suppress this exception.
+        KALDI_ERR << "Error closing previous input.";
+    }
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier && opts_.index);
+    if (ClassifyRxfilename(archive_rxfilename_) != kFileInput) {
+      KALDI_WARN << "The \"idx\" option requires the archive to be an actual "
+                 << "file: rspecifier is " << rspecifier;
+      return false;
+    }
+    if (!index_.Open(archive_rxfilename_))
+      return false;  // It will have printed a warning.
+    // NULL means don't expect binary-mode header
+    bool ans;
+    if (Holder::IsReadInBinary())
+      ans = input_.Open(archive_rxfilename_, NULL);
+    else
+      ans = input_.OpenTextMode(archive_rxfilename_);
+    if (!ans) {
+      KALDI_WARN << "Failed to open stream "
+                 << PrintableRxfilename(archive_rxfilename_);
+      index_.Close();
+      return false;
+    }
+    state_ = kOpen;
+    return true;
+  }
+
+  virtual bool Close() {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "Close() called on TableReader twice or otherwise wrongly.";
+    input_.Close();
+    index_.Close();
+    delete holder_;
+    holder_ = NULL;
+    bool ans = (state_ != kError);
+    state_ = kUninitialized;
+    if (!ans && opts_.permissive) {
+      KALDI_WARN << "Error state detected closing reader.  "
+                 << "Ignoring it because you specified permissive mode.";
+      return true;
+    }
+    return ans;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    if (opts_.permissive) {
+      // In permissive mode, keys whose objects cannot be read are treated as
+      // if they were not there, so we have to read the object.
+      return ReadObject(key);
+    }
+    int64 offset;
+    return index_.Lookup(key, &offset);
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (!ReadObject(key))
+      KALDI_ERR << "Value() called but no such key " << key
+                << " in archive " << PrintableRxfilename(archive_rxfilename_)
+                << " (or it could not be read)";
+    return holder_->Value();
+  }
+
+  ~RandomAccessTableReaderIndexedArchiveImpl() {
+    if (state_ != kUninitialized && !this->Close())
+      KALDI_ERR << "Error detected closing TableReader for archive "
+                << PrintableRxfilename(archive_rxfilename_)
+                << " but ignoring it.";
+  }
+
+ private:
+  // Makes holder_ hold the object for "key"; returns false if the key is not
+  // in the index or the object could not be read.
+  bool ReadObject(const std::string &key) {
+    if (holder_ != NULL && cur_key_ == key)
+      return true;
+    int64 offset;
+    if (!index_.Lookup(key, &offset))
+      return false;
+    delete holder_;
+    holder_ = NULL;
+    std::istream &is = input_.Stream();
+    is.clear();
+    is.seekg(offset, std::ios_base::beg);
+    std::string key_read;
+    is >> key_read;
+    int c;
+    if (is.fail() || key_read != key ||
+        ((c = is.peek()) != ' ' && c != '\t' && c != '\n')) {
+      KALDI_WARN << "Expected key " << key << " at offset " << offset
+                 << " of archive " << PrintableRxfilename(archive_rxfilename_)
+                 << ", but found " << key_read
+                 << "; the index may be out of date.";
+      state_ = kError;
+      return false;
+    }
+    if (c != '\n') is.get();  // Consume the space or tab.
+    Holder *holder = new Holder;
+    if (!holder->Read(is)) {
+      KALDI_WARN << "Object read failed, reading archive "
+                 << PrintableRxfilename(archive_rxfilename_);
+      delete holder;
+      state_ = kError;
+      return false;
+    }
+    holder_ = holder;
+    cur_key_ = key;
+    return true;
+  }
+
+  Input input_;          // Input object for the archive.
+  ArchiveIndex index_;   // The index of the archive.
+  std::string cur_key_;  // Key of the object in holder_ (if non-NULL).
+  Holder *holder_;       // The object we most recently read, or NULL.
+
+  std::string rspecifier_;
+  std::string archive_rxfilename_;
+  RspecifierOptions opts_;
+
+  enum {
+    kUninitialized,  // Uninitialized or closed.
+    kOpen,           // Open, and no errors so far.
+    kError           // Open, but we failed to read an object.
+  } state_;
+};
+
+
 
 
 
@@ -2524,7 +3108,9 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
-      if (opts.sorted) {
+      if (opts.index) {
+        impl_ = new RandomAccessTableReaderIndexedArchiveImpl<Holder>();
+      } else if (opts.sorted) {
         if (opts.called_sorted)  // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
         else
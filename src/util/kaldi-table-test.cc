@@ -89,6 +89,25 @@ void UnitTestReadScriptFile() {
 
 
 void UnitTestClassifyWspecifier() {
+  {
+    std::string a = "ark,scp,idx:foo.ark,foo.scp";
+    std::string ark = "x", scp = "y";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kBothWspecifier && ark == "foo.ark" &&
+                 scp == "foo.scp" && opts.index && !opts.permissive);
+  }
+
+  {
+    std::string a = "ark,scp,bg=8,bgthreads=2:foo.ark,foo.scp";
+    std::string ark = "x", scp = "y";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kBothWspecifier && ark == "foo.ark" &&
+                 scp == "foo.scp" && opts.background &&
+                 opts.write_ahead == 8 && opts.write_threads == 2);
+  }
+
   {
     std::string a = "b,ark:foo|";
     std::string ark = "x", scp = "y";
@@ -181,6 +200,15 @@ void UnitTestClassifyWspecifier() {
 
 
 void UnitTestClassifyRspecifier() {
+  {
+    std::string a = "idx,ark:foo.ark";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo.ark" &&
+                 opts.index);
+  }
+
   {
     std::string a = "ark:foo|";
     std::string fname = "x";
@@ -259,6 +287,22 @@ void UnitTestClassifyRspecifier() {
   }
 
 
+  {
+    std::string a = "bg=8,bgthreads=3,scp:foo|";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kScriptRspecifier && fname == "foo|");
+    KALDI_ASSERT(opts.background && opts.read_ahead == 8 &&
+                 opts.read_threads == 3);
+  }
+
+  {
+    std::string a = "bg=0,scp:foo|";
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+
   {
     std::string a = "scp:foo|";
     std::string fname = "x";
@@ -654,6 +698,176 @@ void UnitTestTableSequentialInt32Script(bool binary) {
   KALDI_ASSERT(v2 == v);
 }
 
+class NegateInt32: public TableWriterPreprocessor<int32> {
+ public:
+  virtual void Preprocess(const int32 &in, int32 *out) const { *out = -in; }
+};
+
+// Tests writing with the 'bg', 'bg=N' and 'bgthreads=M' options, and with a
+// preprocessor.
+void UnitTestTableWriterBackground(bool binary, bool write_both) {
+  int32 sz = RandInt(0, 40);
+  std::vector<std::string> k;
+  std::vector<int32> v;
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    k.push_back(os.str());
+    v.push_back(Rand());
+  }
+  bool preprocess = (RandInt(0, 1) == 0);
+  NegateInt32 negate;
+  std::ostringstream wspecifier;
+  wspecifier << (binary ? "b," : "t,");
+  switch (RandInt(0, 3)) {
+    case 0: break;
+    case 1: wspecifier << "bg,"; break;
+    default: wspecifier << "bg=" << RandInt(1, 5) << ",bgthreads="
+                        << RandInt(1, 4) << ",";
+  }
+  wspecifier << (write_both ? "ark,scp:tmpf,tmpf.scp" : "ark:tmpf");
+  {
+    Int32Writer writer;
+    if (preprocess && RandInt(0, 1) == 0)
+      writer.SetPreprocessor(&negate);
+    KALDI_ASSERT(writer.Open(wspecifier.str()));
+    if (preprocess)
+      writer.SetPreprocessor(&negate);
+    for (int32 i = 0; i < sz; i++) {
+      writer.Write(k[i], v[i]);
+      if (RandInt(0, 10) == 0)
+        writer.Flush();
+    }
+    KALDI_ASSERT(writer.Close());
+  }
+  SequentialInt32Reader reader(write_both ? "scp:tmpf.scp" : "ark:tmpf");
+  std::vector<std::string> k2;
+  std::vector<int32> v2;
+  for (; !reader.Done(); reader.Next()) {
+    k2.push_back(reader.Key());
+    v2.push_back(preprocess ? -reader.Value() : reader.Value());
+  }
+  KALDI_ASSERT(reader.Close());
+  unlink("tmpf");
+  unlink("tmpf.scp");
+  KALDI_ASSERT(k2 == k);
+  KALDI_ASSERT(v2 == v);
+}
+
+// A type that cannot be copied (like AmDiagGmm), to check that TableWriter
+// does not need to copy the objects, with or without 'bg' or a preprocessor.
+class UncopyableInt32 {
+ public:
+  UncopyableInt32(): value(0) { }
+  void Write(std::ostream &os, bool binary) const {
+    WriteBasicType(os, binary, value);
+  }
+  void Read(std::istream &is, bool binary) { ReadBasicType(is, binary, &value); }
+  int32 value;
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(UncopyableInt32);
+};
+
+class NegateUncopyableInt32: public TableWriterPreprocessor<UncopyableInt32> {
+ public:
+  virtual void Preprocess(const UncopyableInt32 &in,
+                          UncopyableInt32 *out) const {
+    out->value = -in.value;
+  }
+};
+
+void UnitTestTableWriterUncopyable(bool binary) {
+  int32 sz = RandInt(0, 10);
+  bool preprocess = (RandInt(0, 1) == 0);
+  NegateUncopyableInt32 negate;
+  std::string wspecifier = std::string(binary ? "b," : "t,") +
+      (RandInt(0, 1) == 0 ? "bg=2,bgthreads=2," : "") + "ark:tmpf";
+  {
+    TableWriter<KaldiObjectHolder<UncopyableInt32> > writer(wspecifier);
+    if (preprocess)
+      writer.SetPreprocessor(&negate);
+    UncopyableInt32 obj;
+    for (int32 i = 0; i < sz; i++) {
+      obj.value = i;
+      writer.Write("key", obj);
+    }
+    KALDI_ASSERT(writer.Close());
+  }
+  SequentialTableReader<KaldiObjectHolder<UncopyableInt32> > reader("ark:tmpf");
+  int32 i = 0;
+  for (; !reader.Done(); reader.Next(), i++)
+    KALDI_ASSERT(reader.Value().value == (preprocess ? -i : i));
+  KALDI_ASSERT(i == sz && reader.Close());
+  unlink("tmpf");
+}
+
+// Tests reading with the 'bg=N' and 'bgthreads=M' options, including stopping
+// early and (in permissive mode) objects that cannot be read.
+void UnitTestTableSequentialReadAhead(bool binary, bool read_scp,
+                                      bool permissive) {
+  int32 sz = RandInt(0, 40);
+  std::vector<std::pair<std::string, std::string> > script;
+  std::vector<std::string> k;
+  std::vector<int32> v;
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    k.push_back(os.str());
+    script.push_back(std::make_pair(os.str(), os.str() + ".tmp"));
+    v.push_back(Rand());
+  }
+  WriteScriptFile("tmp.scp", script);
+  {
+    Int32Writer bw(binary ? "b,ark,scp:tmpf,tmpf.scp" :
+                   "t,ark,scp:tmpf,tmpf.scp");
+    for (int32 i = 0; i < sz; i++)
+      bw.Write(k[i], v[i]);
+    KALDI_ASSERT(bw.Close());
+  }
+  if (read_scp) {
+    // write one file per object.
+    Int32Writer bw(binary ? "b,scp:tmp.scp" : "t,scp:tmp.scp");
+    for (int32 i = 0; i < sz; i++)
+      bw.Write(k[i], v[i]);
+    KALDI_ASSERT(bw.Close());
+  }
+  std::vector<std::string> k_expected;
+  std::vector<int32> v_expected;
+  for (int32 i = 0; i < sz; i++) {
+    if (read_scp && permissive && RandInt(0, 3) == 0) {
+      unlink(script[i].second.c_str());
+    } else {
+      k_expected.push_back(k[i]);
+      v_expected.push_back(v[i]);
+    }
+  }
+
+  std::ostringstream rspecifier;
+  rspecifier << (permissive ? "p," : "") << "bg=" << RandInt(1, 5)
+             << ",bgthreads=" << RandInt(1, 4)
+             << (read_scp ? ",scp:tmp.scp" : ",ark:tmpf");
+  SequentialInt32Reader sbr(rspecifier.str());
+  int32 num_to_read = (RandInt(0, 1) == 0 ? RandInt(0, sz) : sz);
+  std::vector<std::string> k2;
+  std::vector<int32> v2;
+  for (; !sbr.Done() && static_cast<int32>(k2.size()) < num_to_read;
+       sbr.Next()) {
+    k2.push_back(sbr.Key());
+    v2.push_back(sbr.Value());
+  }
+  KALDI_ASSERT(sbr.Close());
+
+  unlink("tmpf");
+  unlink("tmpf.scp");
+  unlink("tmp.scp");
+  for (size_t i = 0; i < script.size(); i++)
+    unlink(script[i].second.c_str());
+  k_expected.resize(std::min<size_t>(k_expected.size(), num_to_read));
+  v_expected.resize(k_expected.size());
+  KALDI_ASSERT(k2 == k_expected);
+  KALDI_ASSERT(v2 == v_expected);
+}
+
 // Writing as both and reading as archive.
 void UnitTestTableSequentialDoubleMatrixBoth(bool binary, bool read_scp) {
   int32 sz = Rand() % 10;
@@ -845,6 +1059,76 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
 
 
 
+// Writes archives with an index, and reads them in random order with the
+// "idx" option, for holders that read in binary and in text mode.
+void UnitTestTableRandomIndexed(bool binary, bool write_scp) {
+  int32 sz = Rand() % 20;
+  std::vector<std::string> k;
+  std::vector<std::vector<int32> > v;
+  std::vector<Matrix<double> > m;
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "key" << Rand() % 1000 << "_" << i;
+    k.push_back(os.str());
+    v.push_back(std::vector<int32>(Rand() % 5));
+    for (size_t j = 0; j < v.back().size(); j++)
+      v.back()[j] = Rand() % 100;
+    m.push_back(Matrix<double>(Rand() % 4 + 1, Rand() % 4 + 1));
+    m.back().SetRandn();
+  }
+  std::string opts = std::string(binary ? "b," : "t,") +
+      (write_scp ? "ark,scp,idx:" : "ark,idx:");
+  std::string scp1 = (write_scp ? ",tmpf1.scp" : ""),
+      scp2 = (write_scp ? ",tmpf2.scp" : "");
+  {
+    Int32VectorWriter vw(opts + "tmpf1" + scp1);
+    TokenVectorWriter tw(opts + "tmpf2" + scp2);
+    DoubleMatrixWriter mw(opts + "tmpf3" + scp1);
+    for (int32 i = 0; i < sz; i++) {
+      vw.Write(k[i], v[i]);
+      std::vector<std::string> tokens;
+      for (size_t j = 0; j < v[i].size(); j++)
+        tokens.push_back(k[j % k.size()]);
+      tw.Write(k[i], tokens);
+      mw.Write(k[i], m[i]);
+    }
+    KALDI_ASSERT(vw.Close() && tw.Close() && mw.Close());
+  }
+
+  RandomAccessInt32VectorReader vr("idx,ark:tmpf1");
+  RandomAccessTokenVectorReader tr("idx,ark:tmpf2");
+  RandomAccessDoubleMatrixReader mr("idx,ark:tmpf3");
+  KALDI_ASSERT(!vr.HasKey("nosuchkey") && !tr.HasKey("nosuchkey"));
+  for (int32 n = 0; n < 2 * sz; n++) {
+    int32 i = Rand() % sz;
+    KALDI_ASSERT(vr.HasKey(k[i]) && tr.HasKey(k[i]) && mr.HasKey(k[i]));
+    KALDI_ASSERT(vr.Value(k[i]) == v[i]);
+    const std::vector<std::string> &tokens = tr.Value(k[i]);
+    KALDI_ASSERT(tokens.size() == v[i].size());
+    for (size_t j = 0; j < tokens.size(); j++)
+      KALDI_ASSERT(tokens[j] == k[j % k.size()]);
+    KALDI_ASSERT(mr.Value(k[i]).ApproxEqual(m[i], 1.0e-04));
+  }
+  KALDI_ASSERT(vr.Close() && tr.Close() && mr.Close());
+
+  // If the archive changes after the index is written, we should refuse to
+  // use the index.
+  {
+    std::ofstream os("tmpf1", std::ios::app);
+    os << "extra ";
+  }
+  RandomAccessInt32VectorReader vr2;
+  KALDI_ASSERT(!vr2.Open("idx,ark:tmpf1"));
+
+  for (int32 i = 1; i <= 3; i++) {
+    std::string name = "tmpf" + std::to_string(i);
+    unlink(name.c_str());
+    unlink((name + ".idx").c_str());
+    unlink((name + ".scp").c_str());
+  }
+}
+
+
 void UnitTestRangesMatrix(bool binary) {
   int32 archive_size = RandInt(1, 10);
   std::vector<std::pair<std::string, Matrix<BaseFloat> > > archive_contents(
@@ -1074,6 +1358,11 @@ int main() {
       UnitTestTableSequentialInt32PairVectorBoth(b, c);
       UnitTestTableSequentialInt32VectorVectorBoth(b, c);
       UnitTestTableSequentialBaseFloatVectorBoth(b, c);
+      UnitTestTableRandomIndexed(b, c);
+      UnitTestTableSequentialReadAhead(b, c, false);
+      UnitTestTableWriterBackground(b, c);
+      UnitTestTableWriterUncopyable(b);
+      UnitTestTableSequentialReadAhead(b, c, true);
       for (int k = 0; k < 2; k++) {
         bool d = (k == 0);
         for (int l = 0; l < 2; l++) {
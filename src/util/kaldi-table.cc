@@ -132,6 +132,22 @@ bool WriteScriptFile(const std::string &wxfilename,
 
 
 
+// Interprets the rspecifier and wspecifier options "bg=N" and "bgthreads=M".
+// Returns false if "str" is neither of them, or N or M is not a positive
+// integer; otherwise sets "queue_size" or "num_threads".
+static bool ParseBackgroundOption(const std::string &str, int32 *queue_size,
+                                  int32 *num_threads) {
+  const char *c = str.c_str();
+  bool is_threads = !strncmp(c, "bgthreads=", 10);
+  if (!is_threads && strncmp(c, "bg=", 3))
+    return false;
+  int32 n;
+  if (!ConvertStringToInteger(str.substr(is_threads ? 10 : 3), &n) || n <= 0)
+    return false;
+  *(is_threads ? num_threads : queue_size) = n;
+  return true;
+}
+
 WspecifierType ClassifyWspecifier(const std::string &wspecifier,
                                   std::string *archive_wxfilename,
                                   std::string *script_wxfilename,
@@ -168,6 +184,7 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
   if (opts != NULL)
     *opts = WspecifierOptions();  // Make sure all the defaults are as in the
                                   // default constructor of the options class.
+  int32 write_ahead = 1, write_threads = 1;
 
   for (size_t i = 0; i < split_first_part.size(); i++) {
     const std::string &str = split_first_part[i];  // e.g. "b", "t", "f", "ark",
@@ -183,6 +200,16 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->index = true;
+    } else if (!strcmp(c, "bg")) {
+      if (opts) opts->background = true;
+    } else if (ParseBackgroundOption(str, &write_ahead, &write_threads)) {
+      if (opts) {
+        opts->background = true;
+        opts->write_ahead = write_ahead;
+        opts->write_threads = write_threads;
+      }
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else
@@ -267,6 +294,7 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
   // don't omit empty strings between commas.
 
   RspecifierType rs = kNoRspecifier;
+  int32 read_ahead = 1, read_threads = 1;
 
   for (size_t i = 0; i < split_first_part.size(); i++) {
     const std::string &str = split_first_part[i];  // e.g. "b", "t", "f", "ark",
@@ -293,6 +321,14 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       if (opts) opts->called_sorted = false;
     } else if (!strcmp(c, "bg")) {
       if (opts) opts->background = true;
+    } else if (ParseBackgroundOption(str, &read_ahead, &read_threads)) {
+      if (opts) {
+        opts->background = true;
+        opts->read_ahead = read_ahead;
+        opts->read_threads = read_threads;
+      }
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->index = true;
     } else if (!strcmp(c, "ark")) {
       if (rs == kNoRspecifier) rs = kArchiveRspecifier;
       else
@@ -71,9 +71,23 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  idx means also write an index of the archive, to the archive filename plus
+//     ".idx", which allows random access to it with the rspecifier option
+//     "idx" (see kaldi-table-index.h).  The archive must be an actual file.
+//  bg means "background": Write() just copies the object into a queue, and a
+//     background thread writes it, so the program does not wait for the
+//     output.  Any preprocessing (see TableWriter::SetPreprocessor(), e.g. for
+//     compression) also happens in the background.
+//  bg=N  is as bg, with a queue of up to N objects (the default is 1).
+//  bgthreads=M  (implies bg) means M background threads preprocess the objects
+//     in parallel; they are still written in order, so the archive and scp
+//     output are the same as without "bg".  The queue holds at least M
+//     objects.
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
+//  ark,idx:foo.ark
+//  ark,bg=8,bgthreads=4:foo.ark
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
@@ -114,7 +128,13 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive;  // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool index;  // will write an index of the archive.
+  bool background;  // will write in a background thread.
+  int32 write_ahead;  // the size of the queue, with "bg".
+  int32 write_threads;  // the number of background threads, with "bg".
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       index(false), background(false), write_ahead(1),
+                       write_threads(1) { }
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
@@ -189,6 +209,21 @@ bool WriteScriptFile(std::ostream &os,
 //       value, in a background thread.  Recommended when reading larger objects
 //       such as neural-net training examples, especially when you want to
 //       maximize GPU usage.
+//   bg=N  is as bg but reads up to N objects ahead, in a queue, which evens
+//       out variations in the time taken to read them.
+//   bgthreads=M  (implies bg) means that for scp input, M background threads
+//       read the objects in parallel; this helps when the scp points to many
+//       different files or the objects are slow to parse (e.g. compressed
+//       matrices).  It requires the scp file itself to be an ordinary file, as
+//       each thread reads it; otherwise, and for archives, we use one thread.
+//       The queue holds at least M objects.  The objects are still returned
+//       in the order of the input.
+//
+//   idx means the archive has an index (written with the wspecifier option
+//       "idx"), which RandomAccessTableReader uses to seek directly to the
+//       object for any key, without reading the archive sequentially or
+//       holding objects in memory.  The archive must be an actual file.  It has
+//       no effect for sequential readers.
 //
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
@@ -197,6 +232,8 @@ bool WriteScriptFile(std::ostream &os,
 //  So for instance the following would be a valid rspecifier:
 //
 //   "o, s, p, ark:gunzip -c foo.gz|"
+//   "idx, ark:foo.ark"
+//   "bg=16, bgthreads=4, scp:feats.scp"
 
 struct  RspecifierOptions {
   // These options only make a difference for the RandomAccessTableReader class.
@@ -211,9 +248,15 @@ struct  RspecifierOptions {
   bool background;  // For sequential readers, if the background option ("bg")
                     // is provided, it will read ahead to the next object in a
                     // background thread.
+  int32 read_ahead;  // With "bg=N", the number of objects to read ahead.
+  int32 read_threads;  // With "bgthreads=M", the number of background threads
+                       // (only for scp input).
+  bool index;  // For random-access readers of archives, if the "idx" option
+               // is provided, it will look up keys in the archive's index.
   RspecifierOptions(): once(false), sorted(false),
                        called_sorted(false), permissive(false),
-                       background(false) { }
+                       background(false), read_ahead(1), read_threads(1),
+                       index(false) { }
 };
 
 enum RspecifierType  {
@@ -362,6 +405,19 @@ class SequentialTableReader {
 };
 
 
+/// An interface for converting objects just before TableWriter writes them;
+/// see TableWriter::SetPreprocessor().  This is intended for expensive
+/// conversions such as compression, which with the "bg" wspecifier option
+/// happen in the background threads, so Preprocess() must be thread-safe.
+template<class T>
+class TableWriterPreprocessor {
+ public:
+  /// Sets "out" to the converted form of "in".  "out" is never the same
+  /// object as "in", and may contain a previously converted object.
+  virtual void Preprocess(const T &in, T *out) const = 0;
+  virtual ~TableWriterPreprocessor() { }
+};
+
 /// A templated class for writing objects to an
 /// archive or script file; see \ref io_sec_tables.
 template<class Holder>
@@ -369,7 +425,7 @@ class TableWriter {
  public:
   typedef typename Holder::T T;
 
-  TableWriter(): impl_(NULL) { }
+  TableWriter(): impl_(NULL), preprocessor_(NULL), background_(false) { }
 
   // This constructor equivalent to default constructor
   // + "open", but throws on error.  See docs for
@@ -384,9 +440,19 @@ class TableWriter {
   bool IsOpen() const;
 
   // Write the object.  Throws  std::runtime_error on error (via the
-  // KALDI_ERR macro)
+  // KALDI_ERR macro).  With the "bg" wspecifier option, some errors may not
+  // be detected until the next Write, Flush or Close.
   inline void Write(const std::string &key, const T &value) const;
 
+  // Sets an object that will convert each object before it is written, e.g.
+  // to compress it; or NULL (the default) for none.  With the "bg" wspecifier
+  // option, this happens in the background threads, which work on a copy of
+  // the object (if T cannot be copied, it happens in Write()).
+  // It does not take ownership of "preprocessor", which must outlive this
+  // object (or at least the next Close()); it may be called before or after
+  // Open().
+  void SetPreprocessor(const TableWriterPreprocessor<T> *preprocessor);
+
 
   // Flush will flush any archive; it does not return error status
   // or throw, any errors will be reported on the next Write or Close.
@@ -404,7 +470,8 @@ class TableWriter {
 
   // Allow copy-constructor only for non-opened writers (needed for inclusion in
   // stl vector)
-  TableWriter(const TableWriter &other): impl_(NULL) {
+  TableWriter(const TableWriter &other): impl_(NULL), preprocessor_(NULL),
+                                          background_(false) {
     KALDI_ASSERT(other.impl_ == NULL);
   }
  private:
@@ -413,6 +480,9 @@ class TableWriter {
   void CheckImpl() const;  // Checks that impl_ is non-NULL; prints an error
                            // message and dies (with KALDI_ERR) if NULL.
   TableWriterImplBase<Holder> *impl_;
+  const TableWriterPreprocessor<T> *preprocessor_;
+  bool background_;  // true if impl_ is a TableWriterBackgroundImpl, which
+                     // applies preprocessor_ itself.
 };
 
 
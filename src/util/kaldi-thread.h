@@ -23,6 +23,7 @@
 #define KALDI_THREAD_KALDI_THREAD_H_ 1
 
 #include <thread>
+#include "base/kaldi-thread-pool.h"
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
 
@@ -52,6 +53,10 @@
 // destructor to have side effects such as outputting data.
 // Note: the destructor of TaskSequencer will wait for any remaining jobs that
 // are still running and will call the destructors.
+//
+// For fine-grained parallelism, where starting threads for each job would cost
+// too much, see the class ThreadPool in base/kaldi-thread-pool.h (it is in
+// base so that the matrix library can use it too); this header includes it.
 
 
 namespace kaldi {
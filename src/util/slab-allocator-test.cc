@@ -0,0 +1,107 @@
+// util/slab-allocator-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/slab-allocator.h"
+#include <set>
+#include <iostream>
+
+namespace kaldi {
+
+struct TestObject {
+  double d;
+  int32 i;
+  TestObject *next;
+  TestObject(double d, int32 i, TestObject *next): d(d), i(i), next(next) { }
+};
+
+void TestSlabAllocator() {
+  size_t slab_size = RandInt(1, 20);
+  SlabAllocator<TestObject> allocator(slab_size);
+  std::vector<TestObject*> objects;
+  std::set<TestObject*> addresses;
+  size_t peak = 0;
+
+  for (int32 iter = 0; iter < 5; iter++) {
+    for (int32 i = 0; i < 1000; i++) {
+      if (objects.empty() || RandInt(0, 2) != 0) {
+        TestObject *t = new (allocator.Allocate()) TestObject(
+            RandGauss(), objects.size(), NULL);
+        // Must not overlap with anything that is still in use.
+        KALDI_ASSERT(addresses.insert(t).second);
+        KALDI_ASSERT(reinterpret_cast<size_t>(t) % alignof(TestObject) == 0);
+        objects.push_back(t);
+      } else {
+        size_t j = RandInt(0, objects.size() - 1);
+        addresses.erase(objects[j]);
+        allocator.Deallocate(objects[j]);
+        objects[j] = objects.back();
+        objects.pop_back();
+        if (j < objects.size())
+          objects[j]->i = j;
+      }
+      peak = std::max(peak, objects.size());
+      KALDI_ASSERT(allocator.NumInUse() == objects.size());
+    }
+    // Make sure nothing was overwritten.
+    for (size_t j = 0; j < objects.size(); j++)
+      KALDI_ASSERT(objects[j]->i == static_cast<int32>(j));
+
+    SlabAllocatorStats stats;
+    allocator.GetStats(&stats);
+    KALDI_ASSERT(stats.bytes_in_use >= objects.size() * sizeof(TestObject) &&
+                 stats.peak_bytes_in_use >= peak * sizeof(TestObject) &&
+                 stats.bytes_allocated >= stats.peak_bytes_in_use &&
+                 stats.num_slabs == (peak + slab_size - 1) / slab_size);
+
+    if (iter % 2 == 0) {
+      allocator.DeallocateAll();
+    } else {
+      for (size_t j = 0; j < objects.size(); j++)
+        allocator.Deallocate(objects[j]);
+    }
+    objects.clear();
+    addresses.clear();
+    KALDI_ASSERT(allocator.NumInUse() == 0);
+
+    // The slabs are reused, so none are added until we need more than the
+    // peak.
+    allocator.GetStats(&stats);
+    size_t num_slabs = stats.num_slabs;
+    for (size_t j = 0; j < peak; j++)
+      objects.push_back(new (allocator.Allocate()) TestObject(0.0, j, NULL));
+    allocator.GetStats(&stats);
+    KALDI_ASSERT(stats.num_slabs == num_slabs);
+    for (size_t j = 0; j < objects.size(); j++)
+      allocator.Deallocate(objects[j]);
+    objects.clear();
+  }
+  allocator.ReleaseMemory();
+  SlabAllocatorStats stats;
+  allocator.GetStats(&stats);
+  KALDI_ASSERT(stats.num_slabs == 0 && stats.bytes_allocated == 0);
+}
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestSlabAllocator();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,173 @@
+// util/slab-allocator.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_SLAB_ALLOCATOR_H_
+#define KALDI_UTIL_SLAB_ALLOCATOR_H_
+#include <new>
+#include <vector>
+#include <type_traits>
+#include "base/kaldi-common.h"
+
+
+/* This header provides an allocator for large numbers of small objects of a
+   single type, such as the tokens and forward links of a decoder, that are
+   created and destroyed on every frame.  Memory is obtained from the system in
+   "slabs" of many objects at a time, and objects that are freed go on a free
+   list from which later allocations are served, so in the steady state there
+   are no calls to malloc or free at all.
+
+   All the objects can also be freed at once with DeallocateAll(), e.g. at the
+   end of an utterance; this is O(1), it just rewinds the allocator to the start
+   of its first slab, keeping the slabs for reuse.  Because the objects are not
+   visited, this is only allowed for types that are trivially destructible.
+
+   Objects of this type are not thread safe.
+
+   See slab-allocator-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+/// Statistics about the memory held by a SlabAllocator.
+struct SlabAllocatorStats {
+  size_t num_slabs;  // Number of slabs currently allocated.
+  size_t bytes_allocated;  // Total size of those slabs, in bytes.
+  size_t bytes_in_use;  // Bytes in objects that are currently allocated.
+  size_t peak_bytes_in_use;  // The maximum of bytes_in_use since the allocator
+                             // was created.
+  SlabAllocatorStats(): num_slabs(0), bytes_allocated(0), bytes_in_use(0),
+                        peak_bytes_in_use(0) { }
+};
+
+
+template<class T> class SlabAllocator {
+ public:
+  /// "slab_size" is the number of objects in each slab.
+  explicit SlabAllocator(size_t slab_size = 1024);
+
+  /// Returns uninitialized memory for one object of type T; use placement new
+  /// to construct it.
+  inline T *Allocate();
+
+  /// Returns the memory for an object to the allocator.  The destructor of the
+  /// object is not called.
+  inline void Deallocate(T *t);
+
+  /// Deallocates all objects at once, keeping the slabs for reuse.  The
+  /// destructors of the objects are not called.
+  void DeallocateAll();
+
+  /// Deallocates all objects and frees the slabs.
+  void ReleaseMemory();
+
+  /// Returns the number of objects currently allocated.
+  size_t NumInUse() const { return num_in_use_; }
+
+  void GetStats(SlabAllocatorStats *stats) const;
+
+  ~SlabAllocator() { ReleaseMemory(); }
+
+ private:
+  union Elem {
+    Elem *next;  // next element in the free list, when on the free list.
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  size_t slab_size_;  // Number of Elems in each slab.
+  std::vector<Elem*> slabs_;
+  // Allocations that cannot be served from the free list take the next unused
+  // Elem, which is slabs_[cur_slab_][cur_pos_] (a new slab is allocated if
+  // cur_slab_ == slabs_.size()).  We always have cur_pos_ < slab_size_.
+  size_t cur_slab_;
+  size_t cur_pos_;
+  Elem *free_head_;  // head of list of freed elements.
+  size_t num_in_use_;
+  size_t peak_in_use_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SlabAllocator);
+};
+
+
+template<class T>
+SlabAllocator<T>::SlabAllocator(size_t slab_size):
+    slab_size_(slab_size), cur_slab_(0), cur_pos_(0), free_head_(NULL),
+    num_in_use_(0), peak_in_use_(0) {
+  KALDI_ASSERT(slab_size > 0);
+}
+
+template<class T>
+inline T *SlabAllocator<T>::Allocate() {
+  Elem *e;
+  if (free_head_ != NULL) {
+    e = free_head_;
+    free_head_ = e->next;
+  } else {
+    if (cur_slab_ == slabs_.size())
+      slabs_.push_back(new Elem[slab_size_]);
+    e = slabs_[cur_slab_] + cur_pos_;
+    if (++cur_pos_ == slab_size_) {
+      cur_slab_++;
+      cur_pos_ = 0;
+    }
+  }
+  if (++num_in_use_ > peak_in_use_)
+    peak_in_use_ = num_in_use_;
+  return reinterpret_cast<T*>(e);
+}
+
+template<class T>
+inline void SlabAllocator<T>::Deallocate(T *t) {
+  Elem *e = reinterpret_cast<Elem*>(t);
+  e->next = free_head_;
+  free_head_ = e;
+  num_in_use_--;
+}
+
+template<class T>
+void SlabAllocator<T>::DeallocateAll() {
+  static_assert(std::is_trivially_destructible<T>::value,
+                "DeallocateAll() requires a trivially destructible type.");
+  cur_slab_ = 0;
+  cur_pos_ = 0;
+  free_head_ = NULL;
+  num_in_use_ = 0;
+}
+
+template<class T>
+void SlabAllocator<T>::ReleaseMemory() {
+  for (size_t i = 0; i < slabs_.size(); i++)
+    delete [] slabs_[i];
+  slabs_.clear();
+  cur_slab_ = 0;
+  cur_pos_ = 0;
+  free_head_ = NULL;
+  num_in_use_ = 0;
+}
+
+template<class T>
+void SlabAllocator<T>::GetStats(SlabAllocatorStats *stats) const {
+  stats->num_slabs = slabs_.size();
+  stats->bytes_allocated = slabs_.size() * slab_size_ * sizeof(Elem);
+  stats->bytes_in_use = num_in_use_ * sizeof(Elem);
+  stats->peak_bytes_in_use = peak_in_use_ * sizeof(Elem);
+}
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_SLAB_ALLOCATOR_H_